@@ -3,6 +3,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <set>
+#include <algorithm>
 #include <fstream>
 
 #include "llvm/Support/Debug.h"
@@ -31,6 +32,15 @@ using std::string;
 using clang::QualType;
 using clang::ASTContext;
 
+// Apply a custom category to all command-line options so that they are the
+// only ones displayed.
+static llvm::cl::OptionCategory MyToolCategory("my-tool options");
+
+static llvm::cl::opt<bool> CanonicalTypes("canonical-types",
+    llvm::cl::desc("Look through type sugar other than typedefs and export each "
+                   "structurally distinct type only once"),
+    llvm::cl::cat(MyToolCategory));
+
 // Encode a string object assuming that it is valid UTF-8 encoded text
 static void cbor_encode_string(CborEncoder *encoder, const std::string &str) {
     auto ptr = str.data();
@@ -52,6 +62,18 @@ class TypeEncoder final : public TypeVisitor<TypeEncoder>
    
     std::unordered_set<const clang::Type*> exports;
     
+    // When exporting canonical types, every exported type maps to the
+    // first structurally identical type we emitted. Structural identity is
+    // decided by the tag and the encoded extras of a type.
+    bool canonical;
+    std::unordered_map<string, uintptr_t> structural;
+    std::unordered_map<const clang::Type*, uintptr_t> aliases;
+    
+    // Types whose structural key is being computed, and those of them that
+    // were referenced (through a record or typedef declaration) meanwhile.
+    std::unordered_set<const clang::Type*> typesUnderVisit;
+    std::unordered_set<const clang::Type*> referencedUnderVisit;
+    
     bool markExported(const clang::Type *ptr) {
         return exports.emplace(ptr).second;
     }
@@ -60,10 +82,74 @@ class TypeEncoder final : public TypeVisitor<TypeEncoder>
         return exports.find(ptr) != exports.end();
     }
     
+    // Look through the sugar that the importer doesn't distinguish from the
+    // underlying type. Typedefs are kept since their names are translated.
+    QualType stripSugar(QualType t) {
+        for (;;) {
+            auto s = t.split();
+            QualType inner;
+            
+            if (auto T = dyn_cast<ElaboratedType>(s.Ty)) {
+                inner = T->desugar();
+            } else if (auto T = dyn_cast<ParenType>(s.Ty)) {
+                inner = T->getInnerType();
+            } else if (auto T = dyn_cast<AttributedType>(s.Ty)) {
+                inner = T->getModifiedType();
+            } else if (auto T = dyn_cast<DecayedType>(s.Ty)) {
+                inner = T->getDecayedType();
+            } else if (auto T = dyn_cast<TypeOfType>(s.Ty)) {
+                inner = T->desugar();
+            } else if (auto T = dyn_cast<TypeOfExprType>(s.Ty)) {
+                inner = T->desugar();
+            } else {
+                return t;
+            }
+            
+            t = Context->getQualifiedType(inner, s.Quals);
+        }
+    }
+    
+    // Encode the tag and extras of a type on their own, to be used as the key
+    // identifying structurally equal types.
+    string structuralKey(TypeTag tag, const std::function<void(CborEncoder*)> &extra) {
+        std::vector<uint8_t> buf(64);
+        for (;;) {
+            CborEncoder scratch, local;
+            cbor_encoder_init(&scratch, buf.data(), buf.size(), 0);
+            cbor_encoder_create_array(&scratch, &local, CborIndefiniteLength);
+            cbor_encode_uint(&local, tag);
+            extra(&local);
+            cbor_encoder_close_container(&scratch, &local);
+            
+            auto needed = cbor_encoder_get_extra_bytes_needed(&scratch);
+            if (needed == 0) {
+                auto len = cbor_encoder_get_buffer_size(&scratch, buf.data());
+                return string(reinterpret_cast<char*>(buf.data()), len);
+            }
+            buf.resize(buf.size() + needed);
+        }
+    }
+    
     void encodeType(const clang::Type *T, TypeTag tag,
                     std::function<void(CborEncoder*)> extra = [](CborEncoder*){}) {
         if (!markExported(T)) return;
         
+        if (canonical) {
+            // Computing the key visits the types this one refers to, so
+            // their ids are final by the time we encode this entry.
+            typesUnderVisit.insert(T);
+            auto key = structuralKey(tag, extra);
+            typesUnderVisit.erase(T);
+            
+            auto found = structural.emplace(key, uintptr_t(T));
+            bool referenced = referencedUnderVisit.erase(T) > 0;
+            if (!found.second && !referenced) {
+                // Already emitted under another id
+                aliases.emplace(T, found.first->second);
+                return;
+            }
+        }
+        
         CborEncoder local;
         cbor_encoder_create_array(encoder, &local, CborIndefiniteLength);
         
@@ -81,6 +167,12 @@ class TypeEncoder final : public TypeVisitor<TypeEncoder>
 
 public:
     uintptr_t encodeQualType(QualType t) {
+        if (canonical && !t.isNull()) {
+            // The id of a canonical type is only known once it is visited
+            t = stripSugar(t);
+            VisitQualType(t);
+        }
+        
         auto s = t.split();
 
         auto desugared = sugared->find((void*) s.Ty);
@@ -88,6 +180,15 @@ public:
           return encodeQualType(desugared->second);
 
         auto i = uintptr_t(s.Ty);
+        
+        if (canonical) {
+            auto alias = aliases.find(s.Ty);
+            if (alias != aliases.end()) {
+                i = alias->second;
+            } else if (typesUnderVisit.count(s.Ty)) {
+                referencedUnderVisit.insert(s.Ty);
+            }
+        }
 
         if (t.isConstQualified()) {
           i |= 1;
@@ -107,11 +208,16 @@ public:
        CborEncoder *encoder,
        std::unordered_map<void*, QualType> *sugared,
        TranslateASTVisitor *ast)
-      : Context(Context), encoder(encoder), sugared(sugared), astEncoder(ast) {}
+      : Context(Context), encoder(encoder), sugared(sugared), astEncoder(ast),
+        canonical(CanonicalTypes) {}
+    
+    bool isCanonical() const {
+        return canonical;
+    }
     
     void VisitQualType(const QualType &QT) {
         if (!QT.isNull()) {
-            auto s = QT.split();
+            auto s = (canonical ? stripSugar(QT) : QT).split();
             
             auto desugared = sugared->find((void*) s.Ty);
             if (desugared != sugared->end())
@@ -204,10 +310,11 @@ public:
     void VisitRecordType(const RecordType *T);
 
     void VisitVectorType(const clang::VectorType *T) {
-        auto t = T->desugar();
+        auto t = T->getElementType();
         auto qt = encodeQualType(t);
-        encodeType(T, TagVectorType, [qt](CborEncoder *local){
+        encodeType(T, TagVectorType, [T,qt](CborEncoder *local){
             cbor_encode_uint(local, qt);
+            cbor_encode_uint(local, T->getNumElements());
         });
         VisitQualType(t);
     }
@@ -298,12 +405,12 @@ public:
 
     // See `VisitFunctionProtoType`.
     void VisitFunctionNoProtoType(const FunctionNoProtoType *T) {
-        encodeType(T, TagFunctionType, [T](CborEncoder *local) {
+        encodeType(T, TagFunctionType, [T, this](CborEncoder *local) {
             CborEncoder arrayEncoder;
 
             cbor_encoder_create_array(local, &arrayEncoder, 1);
 
-            cbor_encode_uint(&arrayEncoder, uintptr_t(T->getReturnType().getTypePtrOrNull()));
+            cbor_encode_uint(&arrayEncoder, encodeQualType(T->getReturnType()));
 
             cbor_encoder_close_container(local, &arrayEncoder);
 
@@ -375,6 +482,29 @@ class TranslateASTVisitor final
       std::unordered_map<string, uint64_t> filenames;
       std::set<std::pair<void*, ASTEntryTag>> exportedTags;
       
+      // Comments clang attaches to an exported declaration (or one of its
+      // redeclarations), keyed by the comment
+      std::unordered_map<const RawComment*, void*> commentOwners;
+      
+      // Statements appearing directly in a compound statement, along with
+      // their starting location and that compound statement. Comments that
+      // don't document a declaration are attached to the first of these
+      // that follows them in the innermost block around the comment.
+      struct BlockStmt {
+          SourceLocation loc;
+          Stmt *stmt;
+          CompoundStmt *block;
+      };
+      std::vector<BlockStmt> blockStmts;
+      
+      // Source ranges of all the compound statements, by their opening brace
+      struct BlockRange {
+          SourceLocation begin;
+          SourceLocation end;
+          CompoundStmt *block;
+      };
+      std::vector<BlockRange> blockRanges;
+      
       // Returns true when a new entry is added to exportedTags
       bool markForExport(void* ptr, ASTEntryTag tag) {
           return exportedTags.emplace(ptr,tag).second;
@@ -392,6 +522,11 @@ class TranslateASTVisitor final
       {
           if (!markForExport(ast, tag)) return;
           
+          // Canonical type ids are only known after visiting the type, which
+          // can't happen once this entry has been started
+          if (typeEncoder.isCanonical())
+              typeEncoder.VisitQualType(ty);
+          
           CborEncoder local, childEnc;
           cbor_encoder_create_array(encoder, &local, CborIndefiniteLength);
           
@@ -463,6 +598,12 @@ class TranslateASTVisitor final
        std::function<void(CborEncoder*)> extra = [](CborEncoder*){}
        ) {
           encode_entry_raw(ast, tag, ast->getLocStart(), T, childIds, extra);
+          
+          for (auto rd : ast->redecls()) {
+              if (auto comment = Context->getRawCommentForDeclNoCache(rd)) {
+                  commentOwners.emplace(comment, ast);
+              }
+          }
       }
       
       
@@ -480,10 +621,100 @@ class TranslateASTVisitor final
           return filenames;
       }
       
-      void encodeSourcePos(CborEncoder *enc, SourceLocation loc) {
+      // Where a comment goes in the translation. `owner` is the declaration
+      // the comment documents, the statement it comes before, or the
+      // compound statement it ends when no statement of that block follows
+      // it (`endsBlock`). Top-level comments have no owner, and are placed
+      // by their position.
+      struct CommentPlacement {
+          RawComment *comment;
+          void *owner;
+          bool endsBlock;
+          uint64_t fileid;
+          unsigned line;
+          unsigned column;
+      };
+      
+      // Find the placement of each comment. Comments documenting a
+      // declaration belong to it, and comments inside a block belong to the
+      // next statement in that block, or end the block. Comments outside of
+      // any block get no owner, and are kept as top-level comments.
+      std::vector<CommentPlacement>
+      getCommentPlacements(ArrayRef<RawComment*> comments) {
+          auto& manager = Context->getSourceManager();
+          BeforeThanCompare<SourceLocation> before(manager);
+          
+          std::sort(blockStmts.begin(), blockStmts.end(),
+                    [&before](const BlockStmt &a, const BlockStmt &b) {
+                        return before(a.loc, b.loc);
+                    });
+          std::sort(blockRanges.begin(), blockRanges.end(),
+                    [&before](const BlockRange &a, const BlockRange &b) {
+                        return before(a.begin, b.begin);
+                    });
+          
+          std::vector<CommentPlacement> placements;
+          for (auto comment : comments) {
+              auto begin = comment->getLocStart();
+              CommentPlacement placement = {
+                  comment, nullptr, false, getFileId(begin),
+                  manager.getPresumedLineNumber(begin),
+                  manager.getPresumedColumnNumber(begin),
+              };
+              
+              auto it = commentOwners.find(comment);
+              if (it != commentOwners.end()) {
+                  placement.owner = it->second;
+                  placements.push_back(placement);
+                  continue;
+              }
+              
+              // Blocks nest, so the innermost block around the comment is
+              // the last one opened before it that is still open after it
+              auto loc = comment->getLocEnd();
+              auto fileid = manager.getFileID(loc);
+              auto after = std::upper_bound(blockRanges.begin(), blockRanges.end(), loc,
+                  [&before](SourceLocation l, const BlockRange &range) {
+                      return before(l, range.begin);
+                  });
+              const BlockRange *range = nullptr;
+              while (after != blockRanges.begin()) {
+                  --after;
+                  if (manager.getFileID(after->begin) == fileid &&
+                      before(loc, after->end)) {
+                      range = &*after;
+                      break;
+                  }
+              }
+              if (range == nullptr) {
+                  placements.push_back(placement);
+                  continue;
+              }
+              
+              // The statements of nested blocks and of statements like
+              // `for` come before the next statement of this block
+              auto next = std::lower_bound(blockStmts.begin(), blockStmts.end(), loc,
+                  [&before](const BlockStmt &entry, SourceLocation l) {
+                      return before(entry.loc, l);
+                  });
+              while (next != blockStmts.end() && next->block != range->block &&
+                     before(next->loc, range->end)) {
+                  ++next;
+              }
+              if (next != blockStmts.end() && next->block == range->block) {
+                  placement.owner = next->stmt;
+              } else {
+                  placement.owner = range->block;
+                  placement.endsBlock = true;
+              }
+              placements.push_back(placement);
+          }
+          return placements;
+      }
+      
+      // Number the files in the order their first location is encoded
+      uint64_t getFileId(SourceLocation loc) {
           auto& manager = Context->getSourceManager();
-          auto line = manager.getPresumedLineNumber(loc);
-          auto col  = manager.getPresumedColumnNumber(loc);
           auto fileid = manager.getFileID(loc);
           auto entry = manager.getFileEntryForID(fileid);
           
@@ -493,8 +724,15 @@ class TranslateASTVisitor final
           }
           
           auto pair = filenames.insert(std::make_pair(filename, filenames.size()));
+          return pair.first->second;
+      }
+      
+      void encodeSourcePos(CborEncoder *enc, SourceLocation loc) {
+          auto& manager = Context->getSourceManager();
+          auto line = manager.getPresumedLineNumber(loc);
+          auto col  = manager.getPresumedColumnNumber(loc);
           
-          cbor_encode_uint(enc, pair.first->second);
+          cbor_encode_uint(enc, getFileId(loc));
           cbor_encode_uint(enc, line);
           cbor_encode_uint(enc, col);
       }
@@ -504,9 +742,19 @@ class TranslateASTVisitor final
       //
       
       bool VisitCompoundStmt(CompoundStmt *CS) {
+          auto& manager = Context->getSourceManager();
+          auto begin = manager.getExpansionLoc(CS->getLBracLoc());
+          auto end = manager.getExpansionLoc(CS->getRBracLoc());
+          if (begin.isValid() && end.isValid())
+              blockRanges.push_back({ begin, end, CS });
+          
           std::vector<void*> childIds;
           for (auto x : CS->children()) {
               childIds.push_back(x);
+              
+              auto loc = manager.getExpansionLoc(x->getLocStart());
+              if (loc.isValid())
+                  blockStmts.push_back({ loc, x, CS });
           }
 
           encode_entry(CS, TagCompoundStmt, childIds);
@@ -916,6 +1164,34 @@ class TranslateASTVisitor final
       }
       
       bool VisitCallExpr(CallExpr *CE) {
+          // Branch prediction and prefetch hints are exported separately so
+          // that they aren't translated as calls to unsupported builtins
+          switch (CE->getBuiltinCallee()) {
+              case Builtin::BI__builtin_expect: {
+                  std::vector<void*> childIds = { CE->getArg(0), CE->getArg(1) };
+                  encode_entry(CE, TagBuiltinExpectExpr, childIds);
+                  return true;
+              }
+              case Builtin::BI__builtin_prefetch: {
+                  std::vector<void*> childIds = { CE->getArg(0) };
+                  encode_entry(CE, TagBuiltinPrefetchExpr, childIds, [this, CE](CborEncoder *extras) {
+                      // The optional read/write and locality arguments are integer constants
+                      uint64_t rw = 0, locality = 3;
+                      APSInt value;
+                      if (CE->getNumArgs() > 1 && CE->getArg(1)->isIntegerConstantExpr(value, *Context))
+                          rw = value.getZExtValue();
+                      if (CE->getNumArgs() > 2 && CE->getArg(2)->isIntegerConstantExpr(value, *Context))
+                          locality = value.getZExtValue();
+                      
+                      cbor_encode_boolean(extras, rw != 0);
+                      cbor_encode_uint(extras, locality);
+                  });
+                  return true;
+              }
+              default:
+                  break;
+          }
+          
           std::vector<void*> childIds = { CE->getCallee() };
           for (auto x : CE->arguments()) {
               childIds.push_back(x);
@@ -931,13 +1207,22 @@ class TranslateASTVisitor final
       }
  
       bool VisitShuffleVectorExpr(ShuffleVectorExpr *E) {
-          std::vector<void*> childIds;
-          encode_entry(E, TagShuffleVectorExpr, childIds);
+          std::vector<void*> childIds = { E->getExpr(0), E->getExpr(1) };
+          encode_entry(E, TagShuffleVectorExpr, childIds, [this, E](CborEncoder *extras) {
+              // The remaining arguments are constant lane indices, -1 meaning undefined
+              auto n = E->getNumSubExprs() - 2;
+              CborEncoder indexEncoder;
+              cbor_encoder_create_array(extras, &indexEncoder, n);
+              for (unsigned i = 0; i < n; i++) {
+                  cbor_encode_int(&indexEncoder, E->getShuffleMaskIdx(*Context, i).getSExtValue());
+              }
+              cbor_encoder_close_container(extras, &indexEncoder);
+          });
           return true;
       }
       
       bool VisitConvertVectorExpr(ConvertVectorExpr *E) {
-          std::vector<void*> childIds;
+          std::vector<void*> childIds = { E->getSrcExpr() };
           encode_entry(E, TagConvertVectorExpr, childIds);
           return true;
       }
@@ -986,6 +1271,42 @@ class TranslateASTVisitor final
                                  
                                  auto bid = FD->getBuiltinID();
                                  cbor_encode_boolean(array,                                                    bid && !Context->BuiltinInfo.getHeaderName(bid));
+
+                                 // Attributes affecting code generation. The most recent
+                                 // declaration has inherited all earlier attributes.
+                                 auto recent = FD->getMostRecentDecl();
+                                 std::vector<const char*> attrs;
+                                 if (recent->hasAttr<AlwaysInlineAttr>()) attrs.push_back("always_inline");
+                                 if (recent->hasAttr<NoInlineAttr>())     attrs.push_back("noinline");
+                                 if (recent->hasAttr<HotAttr>())          attrs.push_back("hot");
+                                 if (recent->hasAttr<ColdAttr>())         attrs.push_back("cold");
+                                 if (recent->hasAttr<PureAttr>())         attrs.push_back("pure");
+                                 if (recent->hasAttr<ConstAttr>())        attrs.push_back("const");
+                                 if (recent->hasAttr<FlattenAttr>())      attrs.push_back("flatten");
+
+                                 CborEncoder attrEncoder;
+                                 cbor_encoder_create_array(array, &attrEncoder, attrs.size());
+                                 for (auto attr : attrs) {
+                                     cbor_encode_text_stringz(&attrEncoder, attr);
+                                 }
+                                 cbor_encoder_close_container(array, &attrEncoder);
+
+                                 // Features enabled by `__attribute__((target(...)))`, like
+                                 // the `sse2` of the intrinsics in <emmintrin.h>
+                                 std::vector<string> features;
+                                 if (auto target = recent->getAttr<TargetAttr>()) {
+                                     for (auto &feature : target->parse().Features) {
+                                         if (!feature.empty() && feature[0] == '+')
+                                             features.push_back(feature.substr(1));
+                                     }
+                                 }
+
+                                 CborEncoder featureEncoder;
+                                 cbor_encoder_create_array(array, &featureEncoder, features.size());
+                                 for (auto &feature : features) {
+                                     cbor_encode_string(&featureEncoder, feature);
+                                 }
+                                 cbor_encoder_close_container(array, &featureEncoder);
                              });
           typeEncoder.VisitQualType(functionType);
 
@@ -1357,26 +1678,44 @@ public:
             }
             cbor_encoder_close_container(&encoder, &array);
             
-            // Encode all of the visited file names
+            // Placing the comments numbers the files they are in, so this
+            // has to happen before the file names are encoded.
+            //
+            // Getting all comments will require processing the file with -fparse-all-comments !
+            auto comments = Context.getRawCommentList().getComments();
+            auto placements = visitor.getCommentPlacements(comments);
+            
+            // Encode all of the visited file names, in the order of the file ids
+            // the source positions refer to
             auto filenames = visitor.getFilenames();
-            cbor_encoder_create_array(&encoder, &array, filenames.size());
+            std::vector<string> ordered_filenames(filenames.size());
             for (auto &kv : filenames) {
-                auto str = kv.first;
+                ordered_filenames[kv.second] = kv.first;
+            }
+            cbor_encoder_create_array(&encoder, &array, ordered_filenames.size());
+            for (auto &str : ordered_filenames) {
                 cbor_encode_string(&array, str);
             }
             cbor_encoder_close_container(&encoder, &array);
             
             // Emit comments as array of arrays. Each comment is represented as an array
-            // of source position followed by comment string.
-            //
-            // Getting all comments will require processing the file with -fparse-all-comments !
-            auto comments = Context.getRawCommentList().getComments();
-            cbor_encoder_create_array(&encoder, &array, comments.size());
-            for (auto comment : comments) {
+            // of the ID of the declaration or statement it belongs to (or null, for
+            // top-level comments), whether it ends that compound statement, its
+            // source position and the comment string.
+            cbor_encoder_create_array(&encoder, &array, placements.size());
+            for (auto &placement : placements) {
                 CborEncoder entry;
-                cbor_encoder_create_array(&array, &entry, 4);
-                visitor.encodeSourcePos(&entry, comment->getLocStart()); // emits 3 values
-                cbor_encode_string(&entry, comment->getRawText(Context.getSourceManager()).str());
+                cbor_encoder_create_array(&array, &entry, 6);
+                if (placement.owner) {
+                    cbor_encode_uint(&entry, uintptr_t(placement.owner));
+                } else {
+                    cbor_encode_null(&entry);
+                }
+                cbor_encode_boolean(&entry, placement.endsBlock);
+                cbor_encode_uint(&entry, placement.fileid);
+                cbor_encode_uint(&entry, placement.line);
+                cbor_encode_uint(&entry, placement.column);
+                cbor_encode_string(&entry, placement.comment->getRawText(Context.getSourceManager()).str());
                 cbor_encoder_close_container(&array, &entry);
             }
             cbor_encoder_close_container(&encoder, &array);
@@ -1405,10 +1744,6 @@ public:
   }
 };
 
-// Apply a custom category to all command-line options so that they are the
-// only ones displayed.
-static llvm::cl::OptionCategory MyToolCategory("my-tool options");
-
 int main(int argc, const char **argv) {
   CommonOptionsParser OptionsParser(argc, argv, MyToolCategory);
   ClangTool Tool(OptionsParser.getCompilations(),
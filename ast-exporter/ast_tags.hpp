@@ -69,6 +69,9 @@ enum ASTEntryTag {
     TagShuffleVectorExpr,
     TagConvertVectorExpr,
     
+    TagBuiltinExpectExpr,
+    TagBuiltinPrefetchExpr,
+    
     TagIntegerLiteral = 300,
     TagStringLiteral,
     TagCharacterLiteral,
@@ -2,6 +2,7 @@ extern crate bindgen;
 
 use std::env;
 use std::path::PathBuf;
+use std::time::{SystemTime, UNIX_EPOCH};
 
 fn main() {
     // Tell cargo to tell rustc to link the system bzip2
@@ -31,4 +32,12 @@ fn main() {
     bindings
         .write_to_file(out_path.join("bindings.rs"))
         .expect("Couldn't write bindings!");
+
+    // Identify this build of the translator, for the translation cache. Without any
+    // `rerun-if-changed` lines, cargo reruns this script whenever a file in the package
+    // changes, so the ID changes along with the translator.
+    let build_time = SystemTime::now().duration_since(UNIX_EPOCH)
+        .expect("System time is before the epoch");
+    println!("cargo:rustc-env=C2RUST_BUILD_ID={}.{:09}",
+             build_time.as_secs(), build_time.subsec_nanos());
 }
@@ -0,0 +1,283 @@
+use std::mem;
+use std::ops::Index;
+use std::slice;
+
+/// IDs usable as keys of a `NodeArena`. The `IdMapper` hands out new IDs sequentially, so they can
+/// be used directly as vector indices.
+pub trait ArenaId: Copy {
+    fn as_index(self) -> usize;
+}
+
+const VACANT: u32 = !0;
+
+/// Map from node IDs to nodes backed by vectors rather than hashing.
+///
+/// Since all node kinds share one ID space, each arena only holds a fraction of the IDs. To avoid
+/// reserving room for a whole node per ID, `slots` maps every ID to the position of its node in
+/// `entries`, which holds the nodes contiguously. Iteration follows `entries`, so it is
+/// deterministic.
+#[derive(Debug, Clone)]
+pub struct NodeArena<I, T> {
+    slots: Vec<u32>,
+    entries: Vec<(I, T)>,
+}
+
+impl<I: ArenaId, T> NodeArena<I, T> {
+    pub fn new() -> NodeArena<I, T> {
+        NodeArena {
+            slots: Vec::new(),
+            entries: Vec::new(),
+        }
+    }
+
+    fn position(&self, id: I) -> Option<usize> {
+        match self.slots.get(id.as_index()) {
+            Some(&pos) if pos != VACANT => Some(pos as usize),
+            _ => None,
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.entries.is_empty()
+    }
+
+    pub fn contains_key(&self, id: &I) -> bool {
+        self.position(*id).is_some()
+    }
+
+    pub fn get(&self, id: &I) -> Option<&T> {
+        self.position(*id).map(|pos| &self.entries[pos].1)
+    }
+
+    pub fn get_mut(&mut self, id: &I) -> Option<&mut T> {
+        match self.position(*id) {
+            Some(pos) => Some(&mut self.entries[pos].1),
+            None => None,
+        }
+    }
+
+    /// Insert a node, returning the node previously stored under that ID, if any
+    pub fn insert(&mut self, id: I, node: T) -> Option<T> {
+        if let Some(pos) = self.position(id) {
+            return Some(mem::replace(&mut self.entries[pos].1, node))
+        }
+
+        let index = id.as_index();
+        if index >= self.slots.len() {
+            self.slots.resize(index + 1, VACANT);
+        }
+        self.slots[index] = self.entries.len() as u32;
+        self.entries.push((id, node));
+        None
+    }
+
+    pub fn remove(&mut self, id: &I) -> Option<T> {
+        let pos = self.position(*id)?;
+        self.slots[id.as_index()] = VACANT;
+        let (_, node) = self.entries.swap_remove(pos);
+
+        // The last entry took the place of the removed one
+        if let Some(&(moved_id, _)) = self.entries.get(pos) {
+            self.slots[moved_id.as_index()] = pos as u32;
+        }
+        Some(node)
+    }
+
+    /// Keep only the nodes for which `keep` returns true, preserving their order
+    pub fn retain<F: FnMut(&I, &mut T) -> bool>(&mut self, mut keep: F) {
+        let mut kept = 0;
+        for pos in 0..self.entries.len() {
+            let keep_entry = {
+                let (ref id, ref mut node) = self.entries[pos];
+                keep(id, node)
+            };
+            if keep_entry {
+                self.entries.swap(kept, pos);
+                kept += 1;
+            } else {
+                self.slots[self.entries[pos].0.as_index()] = VACANT;
+            }
+        }
+        self.entries.truncate(kept);
+
+        for (pos, &(id, _)) in self.entries.iter().enumerate() {
+            self.slots[id.as_index()] = pos as u32;
+        }
+    }
+
+    pub fn iter(&self) -> Iter<I, T> {
+        Iter(self.entries.iter())
+    }
+
+    pub fn iter_mut(&mut self) -> IterMut<I, T> {
+        IterMut(self.entries.iter_mut())
+    }
+
+    pub fn values(&self) -> Values<I, T> {
+        Values(self.entries.iter())
+    }
+}
+
+impl<'a, I: ArenaId, T> Index<&'a I> for NodeArena<I, T> {
+    type Output = T;
+
+    fn index(&self, id: &I) -> &T {
+        match self.position(*id) {
+            None => panic!("Node not found in arena"),
+            Some(pos) => &self.entries[pos].1,
+        }
+    }
+}
+
+pub struct Iter<'a, I: 'a, T: 'a>(slice::Iter<'a, (I, T)>);
+
+impl<'a, I, T> Iterator for Iter<'a, I, T> {
+    type Item = (&'a I, &'a T);
+
+    fn next(&mut self) -> Option<(&'a I, &'a T)> {
+        self.0.next().map(|&(ref id, ref node)| (id, node))
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.0.size_hint()
+    }
+}
+
+pub struct IterMut<'a, I: 'a, T: 'a>(slice::IterMut<'a, (I, T)>);
+
+impl<'a, I, T> Iterator for IterMut<'a, I, T> {
+    type Item = (&'a I, &'a mut T);
+
+    fn next(&mut self) -> Option<(&'a I, &'a mut T)> {
+        self.0.next().map(|&mut (ref id, ref mut node)| (id, node))
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.0.size_hint()
+    }
+}
+
+pub struct Values<'a, I: 'a, T: 'a>(slice::Iter<'a, (I, T)>);
+
+impl<'a, I, T> Iterator for Values<'a, I, T> {
+    type Item = &'a T;
+
+    fn next(&mut self) -> Option<&'a T> {
+        self.0.next().map(|&(_, ref node)| node)
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.0.size_hint()
+    }
+}
+
+impl<'a, I: ArenaId, T> IntoIterator for &'a NodeArena<I, T> {
+    type Item = (&'a I, &'a T);
+    type IntoIter = Iter<'a, I, T>;
+
+    fn into_iter(self) -> Iter<'a, I, T> {
+        self.iter()
+    }
+}
+
+impl<'a, I: ArenaId, T> IntoIterator for &'a mut NodeArena<I, T> {
+    type Item = (&'a I, &'a mut T);
+    type IntoIter = IterMut<'a, I, T>;
+
+    fn into_iter(self) -> IterMut<'a, I, T> {
+        self.iter_mut()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[derive(Copy, Clone, Debug, PartialEq)]
+    struct Id(usize);
+
+    impl ArenaId for Id {
+        fn as_index(self) -> usize {
+            self.0
+        }
+    }
+
+    fn ids<T>(arena: &NodeArena<Id, T>) -> Vec<usize> {
+        arena.iter().map(|(id, _)| id.0).collect()
+    }
+
+    #[test]
+    fn insert_and_lookup() {
+        let mut arena = NodeArena::new();
+        assert!(arena.is_empty());
+        assert_eq!(arena.insert(Id(7), "seven"), None);
+        assert_eq!(arena.insert(Id(2), "two"), None);
+        assert_eq!(arena.insert(Id(7), "SEVEN"), Some("seven"));
+
+        assert_eq!(arena.len(), 2);
+        assert_eq!(arena.get(&Id(2)), Some(&"two"));
+        assert_eq!(arena[&Id(7)], "SEVEN");
+        assert!(arena.contains_key(&Id(7)));
+
+        // IDs below, between and past the inserted ones
+        assert_eq!(arena.get(&Id(0)), None);
+        assert_eq!(arena.get(&Id(5)), None);
+        assert_eq!(arena.get(&Id(100)), None);
+
+        *arena.get_mut(&Id(2)).unwrap() = "TWO";
+        assert_eq!(arena.values().cloned().collect::<Vec<_>>(), vec!["SEVEN", "TWO"]);
+    }
+
+    #[test]
+    #[should_panic]
+    fn index_missing() {
+        let mut arena = NodeArena::new();
+        arena.insert(Id(1), ());
+        let _ = arena[&Id(0)];
+    }
+
+    #[test]
+    fn remove() {
+        let mut arena = NodeArena::new();
+        for i in 0..4 {
+            arena.insert(Id(i), i * 10);
+        }
+        assert_eq!(arena.remove(&Id(1)), Some(10));
+        assert_eq!(arena.remove(&Id(1)), None);
+
+        // The last node moved into the hole and can still be found
+        assert_eq!(ids(&arena), vec![0, 3, 2]);
+        assert_eq!(arena[&Id(3)], 30);
+        assert_eq!(arena.remove(&Id(3)), Some(30));
+        assert_eq!(arena.remove(&Id(2)), Some(20));
+        assert_eq!(ids(&arena), vec![0]);
+
+        arena.insert(Id(1), 11);
+        assert_eq!(arena[&Id(1)], 11);
+    }
+
+    #[test]
+    fn retain() {
+        let mut arena = NodeArena::new();
+        for &i in &[5, 1, 4, 2, 3] {
+            arena.insert(Id(i), i);
+        }
+        arena.retain(|id, node| {
+            *node *= 2;
+            id.0 % 2 == 1
+        });
+
+        assert_eq!(ids(&arena), vec![5, 1, 3]);
+        assert_eq!(arena[&Id(3)], 6);
+        assert!(!arena.contains_key(&Id(4)) && !arena.contains_key(&Id(2)));
+
+        for (_, node) in &mut arena {
+            *node += 1;
+        }
+        assert_eq!(arena.values().cloned().collect::<Vec<_>>(), vec![11, 3, 7]);
+    }
+}
@@ -37,11 +37,13 @@ type NewId = u64;
 /// We need to re-ID nodes since the mapping from Clang's AST to ours is not one-to-one. Sometimes
 /// we need to add nodes (such as 'Semi' nodes to make the lifting of expressions into statements
 /// explicit), sometimes we need to collapse (such as inlining 'FieldDecl' into the 'StructDecl').
+///
+/// NEW_IDs are handed out sequentially, so the typed context can store nodes in vectors indexed
+/// by them. CLANG_IDs are node addresses in the exporter, so mapping those still needs a hash map.
 #[derive(Debug)]
 pub struct IdMapper {
     new_id_source: NewId,
     old_to_new: HashMap<ClangId, NewId>,
-    new_to_old: HashMap<NewId, ClangId>,
 }
 
 impl IdMapper {
@@ -49,7 +51,6 @@ impl IdMapper {
         IdMapper {
             new_id_source: 0,
             old_to_new: HashMap::new(),
-            new_to_old: HashMap::new(),
         }
     }
 
@@ -77,11 +78,6 @@ impl IdMapper {
         }
     }
 
-    /// Lookup the CLANG_ID corresponding to a NEW_ID
-    pub fn get_old(&mut self, new_id: NewId) -> Option<ClangId> {
-        self.new_to_old.get(&new_id).map(|n| *n)
-    }
-
     /// If the `old_id` is present in the mapper, make `other_old_id` map to the same value. Note
     /// that `other_old_id` should not already be in the mapper.
     pub fn merge_old(&mut self, old_id: ClangId, other_old_id: ClangId) -> Option<NewId> {
@@ -94,6 +90,31 @@ impl IdMapper {
     }
 }
 
+/// Node types of the new nodes processed so far, indexed by NEW_ID. Node types are never 0, so
+/// a 0 entry marks a node that hasn't been processed.
+struct ProcessedNodes(Vec<NodeType>);
+
+impl ProcessedNodes {
+    fn new() -> ProcessedNodes {
+        ProcessedNodes(vec![])
+    }
+
+    fn insert(&mut self, new_id: NewId, node_ty: NodeType) {
+        let index = new_id as usize;
+        if index >= self.0.len() {
+            self.0.resize(index + 1, 0);
+        }
+        self.0[index] = node_ty;
+    }
+
+    fn get(&self, new_id: &NewId) -> Option<&NodeType> {
+        match self.0.get(*new_id as usize) {
+            Some(node_ty) if *node_ty != 0 => Some(node_ty),
+            _ => None,
+        }
+    }
+}
+
 /// Transfer location information off of an `AstNode` and onto something that is `Located`
 fn located<T>(node: &AstNode, t: T) -> Located<T> {
     Located {
@@ -152,7 +173,7 @@ pub struct ConversionContext {
     pub id_mapper: IdMapper,
 
     /// Keep track of new nodes already processed and their types
-    processed_nodes: HashMap<NewId, NodeType>,
+    processed_nodes: ProcessedNodes,
 
     /// Stack of nodes to visit, and the types we expect to see out of them
     visit_as: Vec<(ClangId, NodeType)>,
@@ -175,7 +196,7 @@ impl ConversionContext {
 
         ConversionContext {
             id_mapper: IdMapper::new(),
-            processed_nodes: HashMap::new(),
+            processed_nodes: ProcessedNodes::new(),
             visit_as,
             typed_context: TypedAstContext::new(),
         }
@@ -287,16 +308,8 @@ impl ConversionContext {
     /// This populates the `typed_context` of the `ConversionContext` it is called on.
     pub fn convert(&mut self, untyped_context: &AstContext) -> () {
 
-        for raw_comment in &untyped_context.comments {
-            let comment = Located {
-                loc: Some(SrcLoc {
-                    line: raw_comment.line,
-                    column: raw_comment.column,
-                    fileid: raw_comment.fileid
-                }),
-                kind: raw_comment.string.clone(),
-            };
-            self.typed_context.comments.push(comment);
+        for (fileid, file) in untyped_context.files.iter().enumerate() {
+            self.typed_context.c_files.insert(fileid as u64, file.to_string());
         }
 
         // Continue popping Clang nodes off of the stack of nodes we have promised to visit
@@ -321,6 +334,37 @@ impl ConversionContext {
 
             self.visit_node(untyped_context, node_id, new_id, expected_ty)
         }
+
+        // Attach comments to the declarations and statements the exporter found for them,
+        // and keep the ones it found no owner for as top-level comments
+        for raw_comment in &untyped_context.comments {
+            let comment = raw_comment.string.to_owned();
+            let node_id = match raw_comment.owner {
+                Some(node_id) => node_id,
+                None => {
+                    let loc = SrcLoc {
+                        fileid: raw_comment.fileid,
+                        line: raw_comment.line,
+                        column: raw_comment.column,
+                    };
+                    self.typed_context.comments.add_top_level_comment(loc, comment);
+                    continue
+                }
+            };
+
+            // Comments on nodes that weren't converted are dropped along with them
+            let owner = self.id_mapper.get_new(node_id)
+                .and_then(|new_id| self.processed_nodes.get(&new_id).map(|&ty| (new_id, ty)));
+            match owner {
+                Some((new_id, ty)) if ty & node_types::DECL != 0 =>
+                    self.typed_context.comments.add_decl_comment(CDeclId(new_id), comment),
+                Some((new_id, ty)) if ty & node_types::STMT != 0 && raw_comment.ends_block =>
+                    self.typed_context.comments.add_block_end_comment(CStmtId(new_id), comment),
+                Some((new_id, ty)) if ty & node_types::STMT != 0 =>
+                    self.typed_context.comments.add_stmt_comment(CStmtId(new_id), comment),
+                _ => {}
+            }
+        }
     }
 
 
@@ -624,7 +668,10 @@ impl ConversionContext {
                         .expect("Vector child not found");
                     let elt_new = self.visit_qualified_type(elt);
 
-                    let vector_ty = CTypeKind::Vector(elt_new);
+                    let count = expect_u64(&ty_node.extras[1])
+                        .expect("Vector element count not found");
+
+                    let vector_ty = CTypeKind::Vector(elt_new, count as usize);
                     self.add_type(new_id, not_located(vector_ty));
                     self.processed_nodes.insert(new_id, OTHER_TYPE);
                 }
@@ -888,7 +935,7 @@ impl ConversionContext {
                     let ty_old = node.type_id.expect("Expected expression to have type");
                     let ty = self.visit_qualified_type(ty_old);
                     let width = expect_u64(&node.extras[1]).expect("string literal char width") as u8;
-                    let bytes = expect_vec8(&node.extras[2]).expect("string literal bytes");
+                    let bytes = expect_bytes(&node.extras[2]).expect("string literal bytes");
                     let string_literal = CExprKind::Literal(ty, CLiteral::String(bytes.to_owned(), width));
                     self.expr_possibly_as_stmt(expected_ty, new_id, node, string_literal);
                 }
@@ -1229,22 +1276,65 @@ impl ConversionContext {
                     self.expr_possibly_as_stmt(expected_ty, new_id, node, vaarg_expr)
                 }
 
+                ASTEntryTag::TagBuiltinExpectExpr if expected_ty & (EXPR | STMT) != 0 => {
+                    let value_old = node.children[0].expect("Expected value for __builtin_expect");
+                    let value = self.visit_expr(value_old);
+
+                    let expected_old = node.children[1].expect("Expected expected value for __builtin_expect");
+                    let expected = self.visit_expr(expected_old);
+
+                    let ty_old = node.type_id.expect("Expected expression to have type");
+                    let ty = self.visit_qualified_type(ty_old);
+
+                    let e = CExprKind::Expect(ty, value, expected);
+
+                    self.expr_possibly_as_stmt(expected_ty, new_id, node, e)
+                }
+
+                ASTEntryTag::TagBuiltinPrefetchExpr if expected_ty & (EXPR | STMT) != 0 => {
+                    let addr_old = node.children[0].expect("Expected address for __builtin_prefetch");
+                    let addr = self.visit_expr(addr_old);
+
+                    let is_write = expect_bool(&node.extras[0]).expect("Expected prefetch read/write flag");
+                    let locality = expect_u64(&node.extras[1]).expect("Expected prefetch locality");
+
+                    let ty_old = node.type_id.expect("Expected expression to have type");
+                    let ty = self.visit_qualified_type(ty_old);
+
+                    let e = CExprKind::Prefetch(ty, addr, is_write, locality);
+
+                    self.expr_possibly_as_stmt(expected_ty, new_id, node, e)
+                }
+
                 ASTEntryTag::TagShuffleVectorExpr => {
+                    let lhs_old = node.children[0].expect("Expected first vector to shuffle");
+                    let lhs = self.visit_expr(lhs_old);
+
+                    let rhs_old = node.children[1].expect("Expected second vector to shuffle");
+                    let rhs = self.visit_expr(rhs_old);
+
+                    let indices = expect_array(&node.extras[0])
+                        .expect("Expected shuffle indices")
+                        .iter()
+                        .map(|x| expect_i64(x).expect("Expected shuffle index"))
+                        .collect();
 
                     let ty_old = node.type_id.expect("Expected expression to have type");
                     let ty = self.visit_qualified_type(ty_old);
 
-                    let e = CExprKind::ShuffleVector(ty);
+                    let e = CExprKind::ShuffleVector(ty, lhs, rhs, indices);
 
                     self.expr_possibly_as_stmt(expected_ty, new_id, node, e)
                 }
 
                 ASTEntryTag::TagConvertVectorExpr => {
+                    let src_old = node.children[0].expect("Expected vector to convert");
+                    let src = self.visit_expr(src_old);
 
                     let ty_old = node.type_id.expect("Expected expression to have type");
                     let ty = self.visit_qualified_type(ty_old);
 
-                    let e = CExprKind::ConvertVector(ty);
+                    let e = CExprKind::ConvertVector(ty, src);
 
                     self.expr_possibly_as_stmt(expected_ty, new_id, node, e)
                 }
@@ -1265,6 +1355,27 @@ impl ConversionContext {
 
                     let is_implicit = expect_bool(&node.extras[4]).expect("Expected to find implicit");
 
+                    let attrs = expect_array(&node.extras[5])
+                        .expect("Expected to find function attributes")
+                        .iter()
+                        .map(|attr| match expect_str(attr).expect("Function attribute not a string") {
+                            "always_inline" => FunctionAttribute::AlwaysInline,
+                            "noinline" => FunctionAttribute::NoInline,
+                            "hot" => FunctionAttribute::Hot,
+                            "cold" => FunctionAttribute::Cold,
+                            "pure" => FunctionAttribute::Pure,
+                            "const" => FunctionAttribute::Const,
+                            "flatten" => FunctionAttribute::Flatten,
+                            other => panic!("Unknown function attribute: {}", other),
+                        })
+                        .collect();
+
+                    let target_features = expect_array(&node.extras[6])
+                        .expect("Expected to find target features")
+                        .iter()
+                        .map(|feature| expect_str(feature).expect("Target feature not a string").to_string())
+                        .collect();
+
                     let typ_old = node.type_id.expect("Expected to find a type on a function decl");
                     let typ = CTypeId(self.visit_node_type(typ_old, TYPE));
 
@@ -1282,7 +1393,8 @@ impl ConversionContext {
                         .collect();
 
                     let function_decl =
-                        CDeclKind::Function { is_extern, is_inline, is_implicit, typ, name, parameters, body };
+                        CDeclKind::Function { is_extern, is_inline, is_implicit, attrs, target_features, typ, name,
+                                             parameters, body };
 
                     self.add_decl(new_id, located(node, function_decl));
                     self.processed_nodes.insert(new_id, OTHER_DECL);
@@ -47,7 +47,6 @@ fn immediate_expr_children(kind: &CExprKind) -> Vec<SomeId> {
     use c_ast::CExprKind::*;
     match *kind {
         BadExpr => vec![],
-        ShuffleVector(..) | ConvertVector(..) => vec![],
         OffsetOf(..) | Literal(..) | ImplicitValueInit(..) => vec![],
         DeclRef(_, _) => vec![], // don't follow references back!
         Unary(_ty, _op, subexpr) => intos![subexpr],
@@ -65,6 +64,10 @@ fn immediate_expr_children(kind: &CExprKind) -> Vec<SomeId> {
         ImplicitCast(_, e, _, _) | ExplicitCast(_, e, _, _) |
         Member(_, e, _, _) | CompoundLiteral(_, e) | Predefined(_, e) | VAArg(_,e) => intos![e],
         Statements(_, s) => vec![s.into()],
+        Expect(_, value, expected) => intos![value, expected],
+        Prefetch(_, addr, _, _) => intos![addr],
+        ShuffleVector(_, lhs, rhs, _) => intos![lhs, rhs],
+        ConvertVector(_, e) => intos![e],
     }
 }
 
@@ -169,7 +172,7 @@ fn immediate_type_children(kind: &CTypeKind) -> Vec<SomeId> {
         Void | Bool | Short | Int | Long | LongLong | UShort | UInt | ULong | ULongLong | SChar |
         UChar | Char | Double | LongDouble | Float | Int128 | UInt128 | BuiltinFn | Half => vec![],
 
-        Pointer(qtype) | Attributed(qtype, _) | BlockPointer(qtype) | Vector(qtype) =>
+        Pointer(qtype) | Attributed(qtype, _) | BlockPointer(qtype) | Vector(qtype, _) =>
             intos![qtype.ctype],
 
         Decayed(ctype) | Paren(ctype) | TypeOf(ctype) | Complex(ctype) |
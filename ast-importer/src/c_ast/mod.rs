@@ -1,5 +1,6 @@
 use std::collections::{HashMap,HashSet};
 use std::ops::Index;
+use std::mem;
 
 #[derive(Eq, PartialEq, Ord, PartialOrd, Hash, Debug, Copy, Clone)]
 pub struct CTypeId(pub u64);
@@ -25,25 +26,44 @@ pub type CEnumConstantId = CDeclId;  // Enum's need to point to child 'DeclKind:
 
 pub use self::conversion::*;
 pub use self::print::Printer;
+pub use self::arena::{ArenaId, NodeArena};
 
 mod conversion;
 mod print;
+pub mod arena;
 pub mod iterators;
+pub mod structural_hash;
+
+impl ArenaId for CTypeId {
+    fn as_index(self) -> usize { self.0 as usize }
+}
+
+impl ArenaId for CExprId {
+    fn as_index(self) -> usize { self.0 as usize }
+}
+
+impl ArenaId for CDeclId {
+    fn as_index(self) -> usize { self.0 as usize }
+}
+
+impl ArenaId for CStmtId {
+    fn as_index(self) -> usize { self.0 as usize }
+}
 
 /// AST context containing all of the nodes in the Clang AST
 #[derive(Debug, Clone)]
 pub struct TypedAstContext {
-    pub c_types: HashMap<CTypeId, CType>,
-    pub c_exprs: HashMap<CExprId, CExpr>,
-    pub c_decls: HashMap<CDeclId, CDecl>,
-    pub c_stmts: HashMap<CStmtId, CStmt>,
+    pub c_types: NodeArena<CTypeId, CType>,
+    pub c_exprs: NodeArena<CExprId, CExpr>,
+    pub c_decls: NodeArena<CDeclId, CDecl>,
+    pub c_stmts: NodeArena<CStmtId, CStmt>,
 
     pub c_decls_top: Vec<CDeclId>,
     pub c_main: Option<CDeclId>,
     pub c_files: HashMap<u64, String>,
     pub parents: HashMap<CDeclId, CDeclId>, // record fields and enum constants
 
-    pub comments: Vec<Located<String>>,
+    pub comments: CommentContext,
 }
 
 /// Comments associated with a typed AST context
@@ -51,22 +71,24 @@ pub struct TypedAstContext {
 pub struct CommentContext {
     decl_comments: HashMap<CDeclId, Vec<String>>,
     stmt_comments: HashMap<CStmtId, Vec<String>>,
+    block_end_comments: HashMap<CStmtId, Vec<String>>,
+    top_level_comments: Vec<(SrcLoc, String)>,
 }
 
 impl TypedAstContext {
     pub fn new() -> TypedAstContext {
         TypedAstContext {
-            c_types: HashMap::new(),
-            c_exprs: HashMap::new(),
-            c_decls: HashMap::new(),
-            c_stmts: HashMap::new(),
+            c_types: NodeArena::new(),
+            c_exprs: NodeArena::new(),
+            c_decls: NodeArena::new(),
+            c_stmts: NodeArena::new(),
 
             c_decls_top: Vec::new(),
             c_main: None,
             c_files: HashMap::new(),
             parents: HashMap::new(),
 
-            comments: vec![],
+            comments: CommentContext::empty(),
         }
     }
 
@@ -124,8 +146,6 @@ impl TypedAstContext {
     pub fn is_expr_pure(&self, expr: CExprId) -> bool {
         match self.index(expr).kind {
             CExprKind::BadExpr |
-            CExprKind::ShuffleVector(..) |
-            CExprKind::ConvertVector(..) |
             CExprKind::Call(_, _, _) |
             CExprKind::Unary(_, UnOp::PreIncrement, _) |
             CExprKind::Unary(_, UnOp::PostIncrement, _) |
@@ -135,6 +155,7 @@ impl TypedAstContext {
             CExprKind::InitList { .. } |
             CExprKind::ImplicitValueInit { .. } |
             CExprKind::Predefined(_, _) |
+            CExprKind::Prefetch(..) |
             CExprKind::Statements(..) => false, // TODO: more precision
 
             CExprKind::Literal(_, _) |
@@ -155,6 +176,9 @@ impl TypedAstContext {
             CExprKind::ArraySubscript(_, lhs, rhs) => self.is_expr_pure(lhs) && self.is_expr_pure(rhs),
             CExprKind::Conditional(_, c, lhs, rhs) => self.is_expr_pure(c) && self.is_expr_pure(lhs) && self.is_expr_pure(rhs),
             CExprKind::BinaryConditional(_, lhs, rhs) => self.is_expr_pure(lhs) && self.is_expr_pure(rhs),
+            CExprKind::Expect(_, value, expected) => self.is_expr_pure(value) && self.is_expr_pure(expected),
+            CExprKind::ShuffleVector(_, lhs, rhs, _) => self.is_expr_pure(lhs) && self.is_expr_pure(rhs),
+            CExprKind::ConvertVector(_, e) => self.is_expr_pure(e),
         }
     }
 
@@ -309,7 +333,7 @@ impl TypedAstContext {
 
                 // Types with CQualtypeId fields
                 CTypeKind::Pointer(qtype_id) | CTypeKind::Attributed(qtype_id, _) |
-                CTypeKind::BlockPointer(qtype_id) | CTypeKind::Vector(qtype_id) =>
+                CTypeKind::BlockPointer(qtype_id) | CTypeKind::Vector(qtype_id, _) =>
                     type_queue.push(qtype_id.ctype),
 
                 CTypeKind::Function(qtype_id, ref qtype_ids, _, _) => {
@@ -376,78 +400,72 @@ impl CommentContext {
         CommentContext {
             decl_comments: HashMap::new(),
             stmt_comments: HashMap::new(),
+            block_end_comments: HashMap::new(),
+            top_level_comments: vec![],
         }
     }
 
 
-    // Try to match up every comment with a declaration or a statement
+    // Take the comments the exporter attached to declarations and statements
     pub fn new(
         ast_context: &mut TypedAstContext
     ) -> CommentContext {
+        mem::replace(&mut ast_context.comments, CommentContext::empty())
+    }
 
-        // Group and sort declarations by file and by position
-        let mut decls: HashMap<u64, Vec<(SrcLoc, CDeclId)>> = HashMap::new();
-        for (decl_id, ref loc_decl) in &ast_context.c_decls {
-            if let Some(loc) = loc_decl.loc {
-                decls.entry(loc.fileid).or_insert(vec![]).push((loc, *decl_id));
-            }
-        }
-        decls.iter_mut().for_each(|(_, v)| v.sort());
-
-        // Group and sort statements by file and by position
-        let mut stmts: HashMap<u64, Vec<(SrcLoc, CStmtId)>> = HashMap::new();
-        for (stmt_id, ref loc_stmt) in &ast_context.c_stmts {
-            if let Some(loc) = loc_stmt.loc {
-                stmts.entry(loc.fileid).or_insert(vec![]).push((loc, *stmt_id));
-            }
-        }
-        stmts.iter_mut().for_each(|(_, v)| v.sort());
-
-
-        let mut decl_comments: HashMap<CDeclId, Vec<String>> = HashMap::new();
-        let mut stmt_comments: HashMap<CStmtId, Vec<String>> = HashMap::new();
-
-        let empty_vec1 = &vec![];
-        let empty_vec2 = &vec![];
+    // Attach a comment to a given declaration
+    pub fn add_decl_comment(&mut self, decl_id: CDeclId, comment: String) {
+        self.decl_comments.entry(decl_id).or_insert(vec![]).push(comment)
+    }
 
+    // Attach a comment to a given statement
+    pub fn add_stmt_comment(&mut self, stmt_id: CStmtId, comment: String) {
+        self.stmt_comments.entry(stmt_id).or_insert(vec![]).push(comment)
+    }
 
-        // Match comments to declarations and statements
-        while let Some(Located { loc, kind: comment_str }) = ast_context.comments.pop() {
-            if let Some(loc) = loc {
-                let this_file_decls = decls.get(&loc.fileid).unwrap_or(empty_vec1);
-                let this_file_stmts = stmts.get(&loc.fileid).unwrap_or(empty_vec2);
+    // Attach a comment to the end of a given compound statement
+    pub fn add_block_end_comment(&mut self, stmt_id: CStmtId, comment: String) {
+        self.block_end_comments.entry(stmt_id).or_insert(vec![]).push(comment)
+    }
 
-                // Find the closest declaration and statement
-                let decl_ix = this_file_decls
-                    .binary_search_by_key(&loc, |&(l,_)| l)
-                    .unwrap_or_else(|x| x);
-                let stmt_ix = this_file_stmts
-                    .binary_search_by_key(&loc, |&(l,_)| l)
-                    .unwrap_or_else(|x| x);
+    // Add a comment that is outside of any function, and doesn't document a declaration
+    pub fn add_top_level_comment(&mut self, loc: SrcLoc, comment: String) {
+        self.top_level_comments.push((loc, comment))
+    }
 
-                // Prefer the one that is higher up (biasing towards declarations if there is a tie)
-                match (this_file_decls.get(decl_ix), this_file_stmts.get(stmt_ix)) {
-                    (Some(&(l1, d)), Some(&(l2, s))) => {
-                        if l1 > l2 {
-                            stmt_comments.entry(s).or_insert(vec![]).push(comment_str);
-                        } else {
-                            decl_comments.entry(d).or_insert(vec![]).push(comment_str);
-                        }
-                    }
-                    (Some(&(_, d)), None) => {
-                        decl_comments.entry(d).or_insert(vec![]).push(comment_str);
-                    }
-                    (None, Some(&(_, s))) => {
-                        stmt_comments.entry(s).or_insert(vec![]).push(comment_str);
-                    }
-                    (None, None) => {
-                        eprintln!("Didn't find a target node for the comment '{}'", comment_str);
-                    },
-                };
+    // Move each top-level comment in front of the comments of the nearest of the given top-level
+    // declarations that follows it in the same file
+    pub fn attach_top_level_comments(&mut self, decls: &[(CDeclId, SrcLoc)]) {
+        let mut sorted_decls: Vec<(SrcLoc, CDeclId)> = decls.iter().map(|&(id, loc)| (loc, id)).collect();
+        sorted_decls.sort();
+
+        let mut attached: HashMap<CDeclId, Vec<String>> = HashMap::new();
+        let mut unattached = vec![];
+        for (loc, comment) in mem::replace(&mut self.top_level_comments, vec![]) {
+            let next = match sorted_decls.binary_search_by(|&(decl_loc, _)| decl_loc.cmp(&loc)) {
+                Ok(index) | Err(index) => sorted_decls.get(index),
+            };
+            match next {
+                Some(&(decl_loc, decl_id)) if decl_loc.fileid == loc.fileid =>
+                    attached.entry(decl_id).or_insert(vec![]).push(comment),
+                _ => unattached.push((loc, comment)),
             }
         }
+        self.top_level_comments = unattached;
+
+        for (decl_id, mut comments) in attached {
+            let documentation = self.decl_comments.remove(&decl_id).unwrap_or(vec![]);
+            comments.extend(documentation);
+            self.decl_comments.insert(decl_id, comments);
+        }
+    }
 
-        CommentContext { decl_comments, stmt_comments }
+    // Extract the top-level comments that no declaration follows, in source order
+    pub fn remove_top_level_comments(&mut self) -> Vec<String> {
+        mem::replace(&mut self.top_level_comments, vec![])
+            .into_iter()
+            .map(|(_, comment)| comment)
+            .collect()
     }
 
     // Extract the comment for a given declaration
@@ -459,6 +477,26 @@ impl CommentContext {
     pub fn remove_stmt_comment(&mut self, stmt_id: CStmtId) -> Vec<String> {
         self.stmt_comments.remove(&stmt_id).unwrap_or(vec![])
     }
+
+    // Extract the comments at the end of a given compound statement
+    pub fn remove_block_end_comment(&mut self, stmt_id: CStmtId) -> Vec<String> {
+        self.block_end_comments.remove(&stmt_id).unwrap_or(vec![])
+    }
+
+    // Look up the comment for a given declaration without extracting it
+    pub fn decl_comment(&self, decl_id: CDeclId) -> &[String] {
+        self.decl_comments.get(&decl_id).map(|c| c.as_slice()).unwrap_or(&[])
+    }
+
+    // Look up the comment for a given statement without extracting it
+    pub fn stmt_comment(&self, stmt_id: CStmtId) -> &[String] {
+        self.stmt_comments.get(&stmt_id).map(|c| c.as_slice()).unwrap_or(&[])
+    }
+
+    // Look up the comments at the end of a given compound statement without extracting them
+    pub fn block_end_comment(&self, stmt_id: CStmtId) -> &[String] {
+        self.block_end_comments.get(&stmt_id).map(|c| c.as_slice()).unwrap_or(&[])
+    }
 }
 
 impl Index<CTypeId> for TypedAstContext {
@@ -534,6 +572,8 @@ pub enum CDeclKind {
         is_extern: bool,
         is_inline: bool,
         is_implicit: bool,
+        attrs: HashSet<FunctionAttribute>,
+        target_features: Vec<String>,
         typ: CFuncTypeId,
         name: String,
         parameters: Vec<CParamId>,
@@ -673,14 +713,24 @@ pub enum CExprKind {
     // Variable argument list
     VAArg(CQualTypeId, CExprId),
 
-    // Unsupported vector operations,
-    ShuffleVector(CQualTypeId),
-    ConvertVector(CQualTypeId),
+    // Branch prediction hint (`__builtin_expect`) with the value and its expected value
+    Expect(CQualTypeId, CExprId, CExprId),
+
+    // Prefetch hint (`__builtin_prefetch`) with the address, whether the access is a write, and
+    // the temporal locality (0 to 3)
+    Prefetch(CQualTypeId, CExprId, bool, u64),
+
+    // Vector shuffle (`__builtin_shufflevector`) of two vectors, with the lane index (or -1, for
+    // an undefined lane) selected for each lane of the result
+    ShuffleVector(CQualTypeId, CExprId, CExprId, Vec<i64>),
+
+    // Lane-wise vector conversion (`__builtin_convertvector`)
+    ConvertVector(CQualTypeId, CExprId),
 
     BadExpr,
 }
 
-#[derive(Copy, Debug, Clone)]
+#[derive(Copy, Debug, Clone, Hash)]
 pub enum MemberKind {
     Arrow,
     Dot,
@@ -709,8 +759,10 @@ impl CExprKind {
             CExprKind::Predefined(ty, _) |
             CExprKind::Statements(ty, _) |
             CExprKind::VAArg(ty, _) |
-            CExprKind::ShuffleVector(ty) |
-            CExprKind::ConvertVector(ty) => Some(ty),
+            CExprKind::Expect(ty, _, _) |
+            CExprKind::Prefetch(ty, _, _, _) |
+            CExprKind::ShuffleVector(ty, _, _, _) |
+            CExprKind::ConvertVector(ty, _) => Some(ty),
         }
     }
 
@@ -728,7 +780,7 @@ impl CExprKind {
     }
 }
 
-#[derive(Debug, Clone, Copy)]
+#[derive(Debug, Clone, Copy, Hash)]
 pub enum CastKind {
     BitCast,
     LValueToRValue,
@@ -762,7 +814,7 @@ pub enum CastKind {
 }
 
 /// Represents a unary operator in C (6.5.3 Unary operators) and GNU C extensions
-#[derive(Debug, Clone, Copy)]
+#[derive(Debug, Clone, Copy, Hash)]
 pub enum UnOp {
     AddressOf,      // &x
     Deref,          // *x
@@ -781,7 +833,7 @@ pub enum UnOp {
 }
 
 /// Represents a unary type operator in C
-#[derive(Debug, Clone, Copy)]
+#[derive(Debug, Clone, Copy, Hash)]
 pub enum UnTypeOp {
     SizeOf,
     AlignOf,
@@ -800,7 +852,7 @@ impl UnOp {
 }
 
 /// Represents a binary operator in C (6.5.5 Multiplicative operators - 6.5.14 Logical OR operator)
-#[derive(Debug, Clone, Copy)]
+#[derive(Debug, Clone, Copy, Hash)]
 pub enum BinOp {
     Multiply,         // *
     Divide,           // /
@@ -881,7 +933,7 @@ impl CLiteral {
 }
 
 /// Represents a constant integer expression as used in a case expression
-#[derive(Debug, Clone, Copy, Eq, PartialEq)]
+#[derive(Debug, Clone, Copy, Eq, PartialEq, Hash)]
 pub enum ConstIntExpr {
     U(u64),
     I(i64),
@@ -959,7 +1011,7 @@ pub struct AsmOperand {
 }
 
 /// Type qualifiers (6.7.3)
-#[derive(Debug, Copy, Clone, Default)]
+#[derive(Debug, Copy, Clone, Default, Hash)]
 pub struct Qualifiers {
 
     /// The `const` qualifier, which marks lvalues as non-assignable.
@@ -1004,8 +1056,10 @@ impl PartialEq for Qualifiers {
     }
 }
 
+impl Eq for Qualifiers {}
+
 /// Qualified type
-#[derive(Debug, Copy, Clone)]
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Hash)]
 pub struct CQualTypeId {
     pub qualifiers: Qualifiers,
     pub ctype: CTypeId,
@@ -1101,18 +1155,31 @@ pub enum CTypeKind {
 
     BlockPointer(CQualTypeId),
 
-    Vector(CQualTypeId),
+    // GCC vector type with its element type and number of elements
+    Vector(CQualTypeId, usize),
 
     Half,
 }
 
-#[derive(Copy, Clone, Debug)]
+#[derive(Copy, Clone, Debug, Hash)]
 pub enum Attribute {
     NoReturn,
     NotNull,
     Nullable,
 }
 
+/// GCC attributes on a function declaration that affect code generation
+#[derive(Copy, Clone, Debug, PartialEq, Eq, Hash)]
+pub enum FunctionAttribute {
+    AlwaysInline,
+    NoInline,
+    Hot,
+    Cold,
+    Pure,
+    Const,
+    Flatten,
+}
+
 impl CTypeKind {
 
     pub fn is_pointer(&self) -> bool {
@@ -1184,3 +1251,34 @@ impl CTypeKind {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn loc(fileid: u64, line: u64) -> SrcLoc {
+        SrcLoc { fileid, line, column: 1 }
+    }
+
+    #[test]
+    fn attach_top_level_comments() {
+        let mut comments = CommentContext::empty();
+        comments.add_top_level_comment(loc(0, 1), "// header".to_owned());
+        comments.add_top_level_comment(loc(1, 3), "// in an include".to_owned());
+        comments.add_top_level_comment(loc(0, 8), "// before f".to_owned());
+        comments.add_top_level_comment(loc(0, 20), "// after everything".to_owned());
+        comments.add_decl_comment(CDeclId(2), "/// documents f".to_owned());
+
+        // The declarations of the main file don't come first
+        comments.attach_top_level_comments(&[
+            (CDeclId(3), loc(1, 1)),
+            (CDeclId(1), loc(0, 4)),
+            (CDeclId(2), loc(0, 10)),
+        ]);
+
+        assert_eq!(comments.decl_comment(CDeclId(1)), ["// header"]);
+        assert_eq!(comments.decl_comment(CDeclId(2)), ["// before f", "/// documents f"]);
+        assert!(comments.decl_comment(CDeclId(3)).is_empty());
+        assert_eq!(comments.remove_top_level_comments(), vec!["// in an include", "// after everything"]);
+    }
+}
@@ -72,10 +72,23 @@ impl<W: Write> Printer<W> {
         match context.c_exprs.get(&expr_id).map(|l| &l.kind) {
             Some(&CExprKind::BadExpr) =>
                 self.writer.write_all(b"BAD"),
-            Some(&CExprKind::ShuffleVector(..)) =>
-                self.writer.write_all(b"SHUFFLE"),
-            Some(&CExprKind::ConvertVector(..)) =>
-                self.writer.write_all(b"CONVERT"),
+            Some(&CExprKind::ShuffleVector(_, lhs, rhs, ref indices)) => {
+                self.writer.write_all(b"__builtin_shufflevector(")?;
+                self.print_expr(lhs, context)?;
+                self.writer.write_all(b", ")?;
+                self.print_expr(rhs, context)?;
+                for index in indices {
+                    self.writer.write_fmt(format_args!(", {}", index))?;
+                }
+                self.writer.write_all(b")")
+            }
+            Some(&CExprKind::ConvertVector(ty, e)) => {
+                self.writer.write_all(b"__builtin_convertvector(")?;
+                self.print_expr(e, context)?;
+                self.writer.write_all(b", ")?;
+                self.print_qtype(ty, None, context)?;
+                self.writer.write_all(b")")
+            }
 
             Some(&CExprKind::Statements(_, compound_stmt_id)) => {
                 self.writer.write_all(b"(")?;
@@ -195,6 +208,19 @@ impl<W: Write> Printer<W> {
             Some(&CExprKind::VAArg(_,val)) =>
                 self.print_expr(val, context),
 
+            Some(&CExprKind::Expect(_, value, expected)) => {
+                self.writer.write_all(b"__builtin_expect(")?;
+                self.print_expr(value, context)?;
+                self.writer.write_all(b", ")?;
+                self.print_expr(expected, context)?;
+                self.writer.write_all(b")")
+            }
+            Some(&CExprKind::Prefetch(_, addr, is_write, locality)) => {
+                self.writer.write_all(b"__builtin_prefetch(")?;
+                self.print_expr(addr, context)?;
+                self.writer.write_fmt(format_args!(", {}, {})", is_write as u8, locality))
+            }
+
             None => panic!("Could not find expression with ID {:?}", expr_id),
            // _ => unimplemented!("Printer::print_expr"),
         }
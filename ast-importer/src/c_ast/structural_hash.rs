@@ -0,0 +1,421 @@
+//! Hashing of the AST nodes reachable from a declaration, by structure rather than by node ID.
+//!
+//! Node IDs are hashed as the order in which the nodes are first reached, so two declarations get
+//! the same hash when they are the same code, even if unrelated nodes were added to the AST
+//! before them.
+
+use std::collections::{HashMap, VecDeque};
+use std::hash::{Hash, Hasher};
+use std::mem;
+use c_ast::*;
+
+/// Reference to a node of any kind
+#[derive(Debug, Copy, Clone, PartialEq, Eq, Hash)]
+pub enum NodeRef {
+    Decl(CDeclId),
+    Type(CTypeId),
+    Expr(CExprId),
+    Stmt(CStmtId),
+}
+
+/// Hasher that renumbers node IDs, and queues the nodes it reaches for the first time
+pub struct StructuralHasher<H> {
+    hasher: H,
+    reached: HashMap<NodeRef, usize>,
+    queue: VecDeque<NodeRef>,
+}
+
+impl<H: Hasher> StructuralHasher<H> {
+    pub fn new(hasher: H) -> StructuralHasher<H> {
+        StructuralHasher {
+            hasher,
+            reached: HashMap::new(),
+            queue: VecDeque::new(),
+        }
+    }
+
+    /// Hash a value that contains no node IDs
+    pub fn write<T: Hash + ?Sized>(&mut self, value: &T) {
+        value.hash(&mut self.hasher)
+    }
+
+    /// Hash a reference to a node as the order in which the node was first reached
+    pub fn node(&mut self, node: NodeRef) {
+        let next_ordinal = self.reached.len();
+        let queue = &mut self.queue;
+        let ordinal = *self.reached.entry(node).or_insert_with(|| {
+            queue.push_back(node);
+            next_ordinal
+        });
+        ordinal.hash(&mut self.hasher)
+    }
+
+    /// Next node reached but not hashed yet
+    pub fn next_node(&mut self) -> Option<NodeRef> {
+        self.queue.pop_front()
+    }
+
+    pub fn finish(&self) -> u64 {
+        self.hasher.finish()
+    }
+}
+
+/// Values that can be hashed by a `StructuralHasher`
+pub trait StructuralHash {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>);
+}
+
+/// Hash every node reachable from `root`, calling `node_state` after each node to hash whatever
+/// else the caller keeps about it. Function definitions other than `root` are reached through
+/// calls, but their bodies are left out.
+pub fn hash_reachable<H, F>(
+    ast_context: &TypedAstContext,
+    root: CDeclId,
+    h: &mut StructuralHasher<H>,
+    mut node_state: F,
+) where H: Hasher, F: FnMut(NodeRef, &mut StructuralHasher<H>) {
+    h.node(NodeRef::Decl(root));
+
+    while let Some(node) = h.next_node() {
+        match node {
+            NodeRef::Decl(decl_id) => match ast_context.c_decls.get(&decl_id) {
+                None => h.write(&false),
+                Some(decl) => {
+                    h.write(&true);
+                    match decl.kind {
+                        CDeclKind::Function { body: Some(_), .. } if decl_id != root => {
+                            let mut signature = decl.kind.clone();
+                            if let CDeclKind::Function { ref mut body, .. } = signature {
+                                *body = None;
+                            }
+                            signature.structural_hash(h);
+                        }
+                        ref kind => kind.structural_hash(h),
+                    }
+                    ast_context.parents.get(&decl_id).cloned().structural_hash(h);
+                }
+            },
+            NodeRef::Type(type_id) => {
+                ast_context.c_types.get(&type_id).map(|ty| &ty.kind).structural_hash(h)
+            }
+            NodeRef::Expr(expr_id) => {
+                ast_context.c_exprs.get(&expr_id).map(|expr| &expr.kind).structural_hash(h)
+            }
+            NodeRef::Stmt(stmt_id) => {
+                ast_context.c_stmts.get(&stmt_id).map(|stmt| &stmt.kind).structural_hash(h)
+            }
+        }
+        node_state(node, h);
+    }
+}
+
+// Values without node IDs in them are hashed as they are
+macro_rules! impl_leaf_hash {
+    ($($ty:ty),*) => { $(
+        impl StructuralHash for $ty {
+            fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+                h.write(self)
+            }
+        }
+    )* }
+}
+
+impl_leaf_hash!(bool, u8, u64, i64, usize, String, Qualifiers, ConstIntExpr, CastKind, UnOp,
+                UnTypeOp, BinOp, MemberKind, Attribute, FunctionAttribute);
+
+impl StructuralHash for CDeclId {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        h.node(NodeRef::Decl(*self))
+    }
+}
+
+impl StructuralHash for CTypeId {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        h.node(NodeRef::Type(*self))
+    }
+}
+
+impl StructuralHash for CExprId {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        h.node(NodeRef::Expr(*self))
+    }
+}
+
+impl StructuralHash for CStmtId {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        h.node(NodeRef::Stmt(*self))
+    }
+}
+
+impl<'a, T: StructuralHash + ?Sized> StructuralHash for &'a T {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        (**self).structural_hash(h)
+    }
+}
+
+impl<T: StructuralHash> StructuralHash for Option<T> {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        h.write(&self.is_some());
+        if let Some(ref value) = *self {
+            value.structural_hash(h);
+        }
+    }
+}
+
+impl<T: StructuralHash> StructuralHash for [T] {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        h.write(&self.len());
+        for value in self {
+            value.structural_hash(h);
+        }
+    }
+}
+
+impl<T: StructuralHash> StructuralHash for Vec<T> {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        self[..].structural_hash(h)
+    }
+}
+
+impl StructuralHash for CQualTypeId {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        self.qualifiers.structural_hash(h);
+        self.ctype.structural_hash(h);
+    }
+}
+
+impl StructuralHash for CLiteral {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        h.write(&mem::discriminant(self));
+        match *self {
+            CLiteral::Integer(x) | CLiteral::Character(x) => h.write(&x),
+            CLiteral::Floating(x) => h.write(&x.to_bits()),
+            CLiteral::String(ref bytes, width) => {
+                h.write(bytes);
+                h.write(&width);
+            }
+        }
+    }
+}
+
+impl StructuralHash for AsmOperand {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        self.constraints.structural_hash(h);
+        self.expression.structural_hash(h);
+    }
+}
+
+// Hash the variant of an enum, then each of the given fields
+macro_rules! hash_variant {
+    ($h:expr, $value:expr $(, $field:expr)*) => {{
+        $h.write(&mem::discriminant($value));
+        $( StructuralHash::structural_hash($field, $h); )*
+    }}
+}
+
+impl StructuralHash for CDeclKind {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        match *self {
+            CDeclKind::Function { ref is_extern, ref is_inline, ref is_implicit, ref attrs,
+                                  ref target_features, ref typ, ref name, ref parameters,
+                                  ref body } => {
+                // Attributes are a hash set, so they are hashed in a fixed order
+                let mut attrs: Vec<FunctionAttribute> = attrs.iter().cloned().collect();
+                attrs.sort_by_key(|&attr| attr as u8);
+                hash_variant!(h, self, is_extern, is_inline, is_implicit, &attrs, target_features,
+                              typ, name, parameters, body)
+            }
+            CDeclKind::Variable { ref is_static, ref is_extern, ref is_defn, ref ident,
+                                  ref initializer, ref typ } =>
+                hash_variant!(h, self, is_static, is_extern, is_defn, ident, initializer, typ),
+            CDeclKind::Enum { ref name, ref variants, ref integral_type } =>
+                hash_variant!(h, self, name, variants, integral_type),
+            CDeclKind::EnumConstant { ref name, ref value } =>
+                hash_variant!(h, self, name, value),
+            CDeclKind::Typedef { ref name, ref typ, ref is_implicit } =>
+                hash_variant!(h, self, name, typ, is_implicit),
+            CDeclKind::Struct { ref name, ref fields, ref is_packed, ref is_aligned } =>
+                hash_variant!(h, self, name, fields, is_packed, is_aligned),
+            CDeclKind::Union { ref name, ref fields } =>
+                hash_variant!(h, self, name, fields),
+            CDeclKind::Field { ref name, ref typ } =>
+                hash_variant!(h, self, name, typ),
+        }
+    }
+}
+
+impl StructuralHash for CExprKind {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        match *self {
+            CExprKind::Literal(ref ty, ref lit) => hash_variant!(h, self, ty, lit),
+            CExprKind::Unary(ref ty, ref op, ref e) => hash_variant!(h, self, ty, op, e),
+            CExprKind::UnaryType(ref ty, ref op, ref e, ref arg_ty) =>
+                hash_variant!(h, self, ty, op, e, arg_ty),
+            CExprKind::OffsetOf(ref ty, ref offset) => hash_variant!(h, self, ty, offset),
+            CExprKind::Binary(ref ty, ref op, ref lhs, ref rhs, ref lhs_ty, ref res_ty) =>
+                hash_variant!(h, self, ty, op, lhs, rhs, lhs_ty, res_ty),
+            CExprKind::ImplicitCast(ref ty, ref e, ref kind, ref field) |
+            CExprKind::ExplicitCast(ref ty, ref e, ref kind, ref field) =>
+                hash_variant!(h, self, ty, e, kind, field),
+            CExprKind::DeclRef(ref ty, ref decl) => hash_variant!(h, self, ty, decl),
+            CExprKind::Call(ref ty, ref func, ref args) => hash_variant!(h, self, ty, func, args),
+            CExprKind::Member(ref ty, ref e, ref field, ref kind) =>
+                hash_variant!(h, self, ty, e, field, kind),
+            CExprKind::ArraySubscript(ref ty, ref lhs, ref rhs) =>
+                hash_variant!(h, self, ty, lhs, rhs),
+            CExprKind::Conditional(ref ty, ref cond, ref lhs, ref rhs) =>
+                hash_variant!(h, self, ty, cond, lhs, rhs),
+            CExprKind::BinaryConditional(ref ty, ref lhs, ref rhs) =>
+                hash_variant!(h, self, ty, lhs, rhs),
+            CExprKind::InitList(ref ty, ref inits, ref field) =>
+                hash_variant!(h, self, ty, inits, field),
+            CExprKind::ImplicitValueInit(ref ty) => hash_variant!(h, self, ty),
+            CExprKind::CompoundLiteral(ref ty, ref e) |
+            CExprKind::Predefined(ref ty, ref e) |
+            CExprKind::VAArg(ref ty, ref e) |
+            CExprKind::ConvertVector(ref ty, ref e) => hash_variant!(h, self, ty, e),
+            CExprKind::Statements(ref ty, ref stmt) => hash_variant!(h, self, ty, stmt),
+            CExprKind::Expect(ref ty, ref e, ref expected) =>
+                hash_variant!(h, self, ty, e, expected),
+            CExprKind::Prefetch(ref ty, ref addr, ref is_write, ref locality) =>
+                hash_variant!(h, self, ty, addr, is_write, locality),
+            CExprKind::ShuffleVector(ref ty, ref lhs, ref rhs, ref lanes) =>
+                hash_variant!(h, self, ty, lhs, rhs, lanes),
+            CExprKind::BadExpr => hash_variant!(h, self),
+        }
+    }
+}
+
+impl StructuralHash for CStmtKind {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        match *self {
+            CStmtKind::Label(ref stmt) |
+            CStmtKind::Default(ref stmt) |
+            CStmtKind::Goto(ref stmt) => hash_variant!(h, self, stmt),
+            CStmtKind::Case(ref e, ref stmt, ref value) => hash_variant!(h, self, e, stmt, value),
+            CStmtKind::Compound(ref stmts) => hash_variant!(h, self, stmts),
+            CStmtKind::Expr(ref e) => hash_variant!(h, self, e),
+            CStmtKind::Empty |
+            CStmtKind::Break |
+            CStmtKind::Continue => hash_variant!(h, self),
+            CStmtKind::If { ref scrutinee, ref true_variant, ref false_variant } =>
+                hash_variant!(h, self, scrutinee, true_variant, false_variant),
+            CStmtKind::Switch { ref scrutinee, ref body } =>
+                hash_variant!(h, self, scrutinee, body),
+            CStmtKind::While { ref condition, ref body } =>
+                hash_variant!(h, self, condition, body),
+            CStmtKind::DoWhile { ref body, ref condition } =>
+                hash_variant!(h, self, body, condition),
+            CStmtKind::ForLoop { ref init, ref condition, ref increment, ref body } =>
+                hash_variant!(h, self, init, condition, increment, body),
+            CStmtKind::Return(ref e) => hash_variant!(h, self, e),
+            CStmtKind::Decls(ref decls) => hash_variant!(h, self, decls),
+            CStmtKind::Asm { ref asm, ref inputs, ref outputs, ref clobbers, ref is_volatile } =>
+                hash_variant!(h, self, asm, inputs, outputs, clobbers, is_volatile),
+        }
+    }
+}
+
+impl StructuralHash for CTypeKind {
+    fn structural_hash<H: Hasher>(&self, h: &mut StructuralHasher<H>) {
+        match *self {
+            CTypeKind::Complex(ref ty) |
+            CTypeKind::IncompleteArray(ref ty) |
+            CTypeKind::TypeOf(ref ty) |
+            CTypeKind::Decayed(ref ty) |
+            CTypeKind::Elaborated(ref ty) |
+            CTypeKind::Paren(ref ty) => hash_variant!(h, self, ty),
+            CTypeKind::Pointer(ref ty) |
+            CTypeKind::BlockPointer(ref ty) => hash_variant!(h, self, ty),
+            CTypeKind::ConstantArray(ref ty, ref len) => hash_variant!(h, self, ty, len),
+            CTypeKind::VariableArray(ref ty, ref len) => hash_variant!(h, self, ty, len),
+            CTypeKind::TypeOfExpr(ref e) => hash_variant!(h, self, e),
+            CTypeKind::Function(ref ret, ref params, ref is_variadic, ref is_noreturn) =>
+                hash_variant!(h, self, ret, params, is_variadic, is_noreturn),
+            CTypeKind::Typedef(ref decl) |
+            CTypeKind::Struct(ref decl) |
+            CTypeKind::Union(ref decl) |
+            CTypeKind::Enum(ref decl) => hash_variant!(h, self, decl),
+            CTypeKind::Attributed(ref ty, ref attr) => hash_variant!(h, self, ty, attr),
+            CTypeKind::Vector(ref ty, ref len) => hash_variant!(h, self, ty, len),
+            _ => hash_variant!(h, self),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::collections::HashSet;
+    use std::collections::hash_map::DefaultHasher;
+
+    fn located<T>(kind: T) -> Located<T> {
+        Located { loc: None, kind }
+    }
+
+    fn qual(ctype: CTypeId) -> CQualTypeId {
+        CQualTypeId { qualifiers: Qualifiers::default(), ctype }
+    }
+
+    /// Builds `int callee(void) { return <value>; } <ret> caller(void) { return callee(); }`,
+    /// starting from node ID `first_id`, and returns the ID of `caller`
+    fn build(ast: &mut TypedAstContext, first_id: u64, value: u64, callee_ret: CTypeKind) -> CDeclId {
+        let id = |n: u64| first_id + n;
+        ast.c_types.insert(CTypeId(id(0)), located(CTypeKind::Int));
+        ast.c_types.insert(CTypeId(id(1)), located(callee_ret));
+        ast.c_types.insert(CTypeId(id(2)), located(CTypeKind::Function(qual(CTypeId(id(1))), vec![], false, false)));
+        ast.c_types.insert(CTypeId(id(3)), located(CTypeKind::Function(qual(CTypeId(id(0))), vec![], false, false)));
+
+        ast.c_exprs.insert(CExprId(id(10)), located(CExprKind::Literal(qual(CTypeId(id(0))), CLiteral::Integer(value))));
+        ast.c_stmts.insert(CStmtId(id(20)), located(CStmtKind::Return(Some(CExprId(id(10))))));
+        ast.c_stmts.insert(CStmtId(id(21)), located(CStmtKind::Compound(vec![CStmtId(id(20))])));
+        ast.c_decls.insert(CDeclId(id(30)), located(CDeclKind::Function {
+            is_extern: true, is_inline: false, is_implicit: false, attrs: HashSet::new(),
+            target_features: vec![], typ: CTypeId(id(2)), name: "callee".to_owned(), parameters: vec![], body: Some(CStmtId(id(21))),
+        }));
+
+        ast.c_exprs.insert(CExprId(id(11)), located(CExprKind::DeclRef(qual(CTypeId(id(2))), CDeclId(id(30)))));
+        ast.c_exprs.insert(CExprId(id(12)), located(CExprKind::Call(qual(CTypeId(id(1))), CExprId(id(11)), vec![])));
+        ast.c_stmts.insert(CStmtId(id(22)), located(CStmtKind::Return(Some(CExprId(id(12))))));
+        ast.c_stmts.insert(CStmtId(id(23)), located(CStmtKind::Compound(vec![CStmtId(id(22))])));
+        ast.c_decls.insert(CDeclId(id(31)), located(CDeclKind::Function {
+            is_extern: true, is_inline: false, is_implicit: false, attrs: HashSet::new(),
+            target_features: vec![], typ: CTypeId(id(3)), name: "caller".to_owned(), parameters: vec![], body: Some(CStmtId(id(23))),
+        }));
+        CDeclId(id(31))
+    }
+
+    fn hash(ast: &TypedAstContext, root: CDeclId) -> u64 {
+        let mut h = StructuralHasher::new(DefaultHasher::new());
+        hash_reachable(ast, root, &mut h, |_, _| ());
+        h.finish()
+    }
+
+    #[test]
+    fn test_node_ids_ignored() {
+        let mut ast1 = TypedAstContext::new();
+        let caller1 = build(&mut ast1, 0, 1, CTypeKind::Int);
+        let mut ast2 = TypedAstContext::new();
+        let caller2 = build(&mut ast2, 100, 1, CTypeKind::Int);
+        assert_eq!(hash(&ast1, caller1), hash(&ast2, caller2));
+    }
+
+    #[test]
+    fn test_callee_body_ignored() {
+        let mut ast1 = TypedAstContext::new();
+        let caller1 = build(&mut ast1, 0, 1, CTypeKind::Int);
+        let mut ast2 = TypedAstContext::new();
+        let caller2 = build(&mut ast2, 0, 2, CTypeKind::Int);
+        assert_eq!(hash(&ast1, caller1), hash(&ast2, caller2));
+        assert_ne!(hash(&ast1, CDeclId(30)), hash(&ast2, CDeclId(30)));
+    }
+
+    #[test]
+    fn test_callee_signature_hashed() {
+        let mut ast1 = TypedAstContext::new();
+        let caller1 = build(&mut ast1, 0, 1, CTypeKind::Int);
+        let mut ast2 = TypedAstContext::new();
+        let caller2 = build(&mut ast2, 0, 1, CTypeKind::Long);
+        assert_ne!(hash(&ast1, caller1), hash(&ast2, caller2));
+    }
+}
@@ -0,0 +1,321 @@
+//! Dense bitsets and a worklist solver for dataflow problems over control-flow graphs.
+//!
+//! Sets of labels or declarations are kept as bitsets over indices handed out by a `DenseIndex`,
+//! which keeps unions and intersections linear in the number of machine words rather than in the
+//! number of elements, and avoids hashing altogether.
+
+use std::collections::{HashMap, VecDeque};
+use std::hash::Hash;
+use std::iter::FromIterator;
+
+const WORD_BITS: usize = 64;
+
+/// Growable set of small integers
+#[derive(Clone, Debug, Default)]
+pub struct BitSet {
+    words: Vec<u64>,
+}
+
+impl BitSet {
+    pub fn new() -> BitSet {
+        BitSet { words: vec![] }
+    }
+
+    /// Empty set with room for the elements below `bits`
+    pub fn with_capacity(bits: usize) -> BitSet {
+        BitSet { words: vec![0; (bits + WORD_BITS - 1) / WORD_BITS] }
+    }
+
+    /// Add an element, returning whether it was absent
+    pub fn insert(&mut self, elem: usize) -> bool {
+        let (word, bit) = (elem / WORD_BITS, 1 << (elem % WORD_BITS));
+        if word >= self.words.len() {
+            self.words.resize(word + 1, 0);
+        }
+        let absent = self.words[word] & bit == 0;
+        self.words[word] |= bit;
+        absent
+    }
+
+    /// Remove an element, returning whether it was present
+    pub fn remove(&mut self, elem: usize) -> bool {
+        let present = self.contains(elem);
+        if present {
+            self.words[elem / WORD_BITS] &= !(1 << (elem % WORD_BITS));
+        }
+        present
+    }
+
+    pub fn contains(&self, elem: usize) -> bool {
+        self.words.get(elem / WORD_BITS).map_or(false, |word| word & (1 << (elem % WORD_BITS)) != 0)
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.words.iter().all(|&word| word == 0)
+    }
+
+    pub fn len(&self) -> usize {
+        self.words.iter().map(|word| word.count_ones() as usize).sum()
+    }
+
+    /// Add all the elements of `other`, returning whether this set changed
+    pub fn union_with(&mut self, other: &BitSet) -> bool {
+        if other.words.len() > self.words.len() {
+            self.words.resize(other.words.len(), 0);
+        }
+        let mut changed = false;
+        for (word, &other_word) in self.words.iter_mut().zip(&other.words) {
+            let new_word = *word | other_word;
+            changed |= new_word != *word;
+            *word = new_word;
+        }
+        changed
+    }
+
+    /// Remove all the elements of `other`
+    pub fn subtract(&mut self, other: &BitSet) {
+        for (word, &other_word) in self.words.iter_mut().zip(&other.words) {
+            *word &= !other_word;
+        }
+    }
+
+    /// Keep only the elements also in `other`
+    pub fn intersect_with(&mut self, other: &BitSet) {
+        for (i, word) in self.words.iter_mut().enumerate() {
+            *word &= other.words.get(i).cloned().unwrap_or(0);
+        }
+    }
+
+    pub fn intersects(&self, other: &BitSet) -> bool {
+        self.words.iter().zip(&other.words).any(|(&a, &b)| a & b != 0)
+    }
+
+    /// Elements in increasing order
+    pub fn iter(&self) -> BitIter {
+        BitIter { words: &self.words, word_index: 0, word: self.words.first().cloned().unwrap_or(0) }
+    }
+}
+
+impl PartialEq for BitSet {
+    fn eq(&self, other: &BitSet) -> bool {
+        let (shorter, longer) = if self.words.len() <= other.words.len() {
+            (&self.words, &other.words)
+        } else {
+            (&other.words, &self.words)
+        };
+        shorter[..] == longer[..shorter.len()] && longer[shorter.len()..].iter().all(|&word| word == 0)
+    }
+}
+
+impl Eq for BitSet {}
+
+impl FromIterator<usize> for BitSet {
+    fn from_iter<I: IntoIterator<Item = usize>>(iter: I) -> BitSet {
+        let mut set = BitSet::new();
+        for elem in iter {
+            set.insert(elem);
+        }
+        set
+    }
+}
+
+pub struct BitIter<'a> {
+    words: &'a [u64],
+    word_index: usize,
+    word: u64,
+}
+
+impl<'a> Iterator for BitIter<'a> {
+    type Item = usize;
+
+    fn next(&mut self) -> Option<usize> {
+        while self.word == 0 {
+            self.word_index += 1;
+            self.word = *self.words.get(self.word_index)?;
+        }
+        let bit = self.word.trailing_zeros() as usize;
+        self.word &= self.word - 1;
+        Some(self.word_index * WORD_BITS + bit)
+    }
+}
+
+/// Assigns consecutive indices to values, so that sets of them can be `BitSet`s
+#[derive(Clone, Debug)]
+pub struct DenseIndex<T> {
+    indices: HashMap<T, usize>,
+    values: Vec<T>,
+}
+
+impl<T: Copy + Hash + Eq> DenseIndex<T> {
+    pub fn new() -> DenseIndex<T> {
+        DenseIndex { indices: HashMap::new(), values: vec![] }
+    }
+
+    /// Index of a value, assigning the next one if the value hasn't been seen yet
+    pub fn index_of(&mut self, value: T) -> usize {
+        let values = &mut self.values;
+        *self.indices.entry(value).or_insert_with(|| {
+            values.push(value);
+            values.len() - 1
+        })
+    }
+
+    /// Index of a value, if it has one
+    pub fn get(&self, value: &T) -> Option<usize> {
+        self.indices.get(value).cloned()
+    }
+
+    pub fn value(&self, index: usize) -> T {
+        self.values[index]
+    }
+
+    pub fn len(&self) -> usize {
+        self.values.len()
+    }
+
+    /// Bitset of the indices of `values`, assigning indices as needed
+    pub fn set_of<I: IntoIterator<Item = T>>(&mut self, values: I) -> BitSet {
+        values.into_iter().map(|value| self.index_of(value)).collect()
+    }
+
+    /// Values whose indices are in `set`
+    pub fn values_of<'a>(&'a self, set: &'a BitSet) -> impl Iterator<Item = T> + 'a {
+        set.iter().map(move |index| self.values[index])
+    }
+}
+
+/// Which way facts propagate along the edges of the graph
+#[derive(Copy, Clone, Debug, PartialEq, Eq)]
+pub enum Direction {
+    /// Facts at the start of a node come from its predecessors (e.g. reaching definitions)
+    Forward,
+    /// Facts at the end of a node come from its successors (e.g. liveness)
+    Backward,
+}
+
+/// Facts holding at the start and at the end of each node
+#[derive(Clone, Debug)]
+pub struct Solution {
+    pub entry: Vec<BitSet>,
+    pub exit: Vec<BitSet>,
+}
+
+/// Solve a gen/kill dataflow problem whose meet is set union. Nodes are the indices of
+/// `successors`. Going in `direction`, the facts flowing into a node are the union of the facts
+/// flowing out of its neighbours, and the facts flowing out are `gen ∪ (in − kill)`.
+///
+/// The worklist only revisits the nodes whose inputs changed, so acyclic regions are processed
+/// once and each loop only as many times as its facts keep growing.
+pub fn solve(successors: &[Vec<usize>], direction: Direction, gen: &[BitSet], kill: &[BitSet]) -> Solution {
+    let n = successors.len();
+
+    let mut predecessors: Vec<Vec<usize>> = vec![vec![]; n];
+    for (node, succs) in successors.iter().enumerate() {
+        for &succ in succs {
+            predecessors[succ].push(node);
+        }
+    }
+
+    // Facts flow into a node from its `sources`, and out of it to its `sinks`
+    let (sources, sinks) = match direction {
+        Direction::Forward => (&predecessors[..], successors),
+        Direction::Backward => (successors, &predecessors[..]),
+    };
+
+    let mut flow_in: Vec<BitSet> = vec![BitSet::new(); n];
+    let mut flow_out: Vec<BitSet> = gen.iter().cloned().collect();
+
+    let mut queued = BitSet::with_capacity(n);
+    let mut worklist: VecDeque<usize> = VecDeque::with_capacity(n);
+    let initial: Box<Iterator<Item = usize>> = match direction {
+        Direction::Forward => Box::new(0..n),
+        Direction::Backward => Box::new((0..n).rev()),
+    };
+    for node in initial {
+        queued.insert(node);
+        worklist.push_back(node);
+    }
+
+    while let Some(node) = worklist.pop_front() {
+        queued.remove(node);
+
+        let mut facts = BitSet::new();
+        for &source in &sources[node] {
+            facts.union_with(&flow_out[source]);
+        }
+
+        let mut out = facts.clone();
+        out.subtract(&kill[node]);
+        out.union_with(&gen[node]);
+        flow_in[node] = facts;
+
+        if out != flow_out[node] {
+            flow_out[node] = out;
+            for &sink in &sinks[node] {
+                if queued.insert(sink) {
+                    worklist.push_back(sink);
+                }
+            }
+        }
+    }
+
+    match direction {
+        Direction::Forward => Solution { entry: flow_in, exit: flow_out },
+        Direction::Backward => Solution { entry: flow_out, exit: flow_in },
+    }
+}
+
+/// For each node, the set of nodes reachable from it by following at least one edge
+pub fn strict_reachability(successors: &[Vec<usize>]) -> Vec<BitSet> {
+    let n = successors.len();
+    let gen: Vec<BitSet> = (0..n).map(|node| Some(node).into_iter().collect()).collect();
+    let kill: Vec<BitSet> = vec![BitSet::new(); n];
+    solve(successors, Direction::Backward, &gen, &kill).exit
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn bitset_operations() {
+        let mut a: BitSet = vec![1, 64, 130].into_iter().collect();
+        let b: BitSet = vec![1, 2].into_iter().collect();
+        assert!(a.contains(64) && !a.contains(63));
+        assert_eq!(a.iter().collect::<Vec<_>>(), vec![1, 64, 130]);
+
+        assert!(a.union_with(&b));
+        assert!(!a.union_with(&b));
+        assert_eq!(a.len(), 4);
+
+        a.subtract(&b);
+        assert_eq!(a, vec![64, 130].into_iter().collect());
+        assert!(!a.intersects(&b));
+
+        a.intersect_with(&vec![130].into_iter().collect());
+        assert_eq!(a.iter().collect::<Vec<_>>(), vec![130]);
+    }
+
+    #[test]
+    fn reachability_through_loop() {
+        // 0 -> 1 -> 2 -> 1, 2 -> 3
+        let successors = vec![vec![1], vec![2], vec![1, 3], vec![]];
+        let reach = strict_reachability(&successors);
+        assert_eq!(reach[0].iter().collect::<Vec<_>>(), vec![1, 2, 3]);
+        assert_eq!(reach[1].iter().collect::<Vec<_>>(), vec![1, 2, 3]);
+        assert_eq!(reach[2].iter().collect::<Vec<_>>(), vec![1, 2, 3]);
+        assert!(reach[3].is_empty());
+    }
+
+    #[test]
+    fn liveness() {
+        // 0: x = ..   1: loop { use x; y = .. }   2: use y
+        let successors = vec![vec![1], vec![1, 2], vec![]];
+        let uses: Vec<BitSet> = vec![vec![], vec![0], vec![1]].into_iter().map(|u| u.into_iter().collect()).collect();
+        let defs: Vec<BitSet> = vec![vec![0], vec![1], vec![]].into_iter().map(|d| d.into_iter().collect()).collect();
+        let live = solve(&successors, Direction::Backward, &uses, &defs);
+        assert!(live.entry[0].is_empty());
+        assert_eq!(live.entry[1].iter().collect::<Vec<_>>(), vec![0]);
+        assert_eq!(live.exit[1].iter().collect::<Vec<_>>(), vec![0, 1]);
+    }
+}
@@ -0,0 +1,293 @@
+//! Dominator and loop-nesting trees of a CFG, computed once over densely indexed labels.
+//!
+//! Nodes are numbered in reverse postorder from the entry, so that the entry is node `0` and every
+//! forward edge goes from a lower number to a higher one. Only nodes reachable from the entry are
+//! numbered.
+
+use super::*;
+
+/// Dominator tree of a CFG
+pub struct Dominators {
+    /// Labels, indexed by their position in reverse postorder
+    labels: DenseIndex<Label>,
+
+    /// Successors of each node, in the order the terminator mentions them
+    successors: Vec<Vec<usize>>,
+
+    /// Predecessors of each node, without duplicates
+    predecessors: Vec<Vec<usize>>,
+
+    /// Immediate dominator of each node. The entry is its own immediate dominator.
+    idom: Vec<usize>,
+
+    /// Preorder and postorder numbers of each node in the dominator tree, which make dominance
+    /// queries constant time
+    preorder: Vec<usize>,
+    postorder: Vec<usize>,
+}
+
+impl Dominators {
+    /// `successors` has to contain every label reachable from `entry`. Labels it doesn't contain
+    /// are treated as having no successors.
+    pub fn new(entry: Label, successors: &HashMap<Label, Vec<Label>>) -> Dominators {
+        let no_successors = vec![];
+        let succs_of = |lbl: &Label| successors.get(lbl).unwrap_or(&no_successors);
+
+        // Iterative depth-first search for the postorder
+        let mut postorder_labels: Vec<Label> = vec![];
+        let mut visited: HashSet<Label> = HashSet::new();
+        let mut stack: Vec<(Label, usize)> = vec![(entry, 0)];
+        visited.insert(entry);
+        while let Some((lbl, next_succ)) = stack.pop() {
+            match succs_of(&lbl).get(next_succ) {
+                Some(&succ) => {
+                    stack.push((lbl, next_succ + 1));
+                    if visited.insert(succ) {
+                        stack.push((succ, 0));
+                    }
+                }
+                None => postorder_labels.push(lbl),
+            }
+        }
+
+        let mut labels = DenseIndex::new();
+        for &lbl in postorder_labels.iter().rev() {
+            labels.index_of(lbl);
+        }
+        let n = labels.len();
+
+        let mut succ_indices: Vec<Vec<usize>> = vec![vec![]; n];
+        let mut predecessors: Vec<Vec<usize>> = vec![vec![]; n];
+        for node in 0..n {
+            for succ in succs_of(&labels.value(node)) {
+                let succ = labels.get(succ).expect("successors of reachable nodes are reachable");
+                if !succ_indices[node].contains(&succ) {
+                    succ_indices[node].push(succ);
+                    predecessors[succ].push(node);
+                }
+            }
+        }
+
+        // Cooper, Harvey and Kennedy's iterative algorithm. With nodes in reverse postorder, a
+        // reducible CFG converges after a couple of passes.
+        const UNDEFINED: usize = !0;
+        let mut idom = vec![UNDEFINED; n];
+        if n > 0 {
+            idom[0] = 0;
+        }
+        let mut changed = true;
+        while changed {
+            changed = false;
+            for node in 1..n {
+                let mut new_idom = UNDEFINED;
+                for &pred in &predecessors[node] {
+                    if idom[pred] == UNDEFINED {
+                        continue
+                    }
+                    new_idom = if new_idom == UNDEFINED {
+                        pred
+                    } else {
+                        let (mut a, mut b) = (pred, new_idom);
+                        while a != b {
+                            while a > b { a = idom[a]; }
+                            while b > a { b = idom[b]; }
+                        }
+                        a
+                    };
+                }
+                if idom[node] != new_idom {
+                    idom[node] = new_idom;
+                    changed = true;
+                }
+            }
+        }
+
+        // Number the dominator tree, for `dominates`
+        let mut children: Vec<Vec<usize>> = vec![vec![]; n];
+        for node in 1..n {
+            children[idom[node]].push(node);
+        }
+        let mut preorder = vec![0; n];
+        let mut postorder = vec![0; n];
+        let (mut pre, mut post) = (0, 0);
+        let mut stack: Vec<(usize, usize)> = if n > 0 { vec![(0, 0)] } else { vec![] };
+        while let Some((node, next_child)) = stack.pop() {
+            if next_child == 0 {
+                preorder[node] = pre;
+                pre += 1;
+            }
+            match children[node].get(next_child) {
+                Some(&child) => {
+                    stack.push((node, next_child + 1));
+                    stack.push((child, 0));
+                }
+                None => {
+                    postorder[node] = post;
+                    post += 1;
+                }
+            }
+        }
+
+        Dominators { labels, successors: succ_indices, predecessors, idom, preorder, postorder }
+    }
+
+    pub fn len(&self) -> usize {
+        self.labels.len()
+    }
+
+    pub fn label(&self, node: usize) -> Label {
+        self.labels.value(node)
+    }
+
+    pub fn node(&self, lbl: &Label) -> Option<usize> {
+        self.labels.get(lbl)
+    }
+
+    pub fn successors(&self, node: usize) -> &[usize] {
+        &self.successors[node]
+    }
+
+    pub fn predecessors(&self, node: usize) -> &[usize] {
+        &self.predecessors[node]
+    }
+
+    /// Immediate dominator of a node, `None` for the entry
+    pub fn idom(&self, node: usize) -> Option<usize> {
+        if node == 0 { None } else { Some(self.idom[node]) }
+    }
+
+    /// Whether every path from the entry to `b` goes through `a` (so `a` dominates itself)
+    pub fn dominates(&self, a: usize, b: usize) -> bool {
+        self.preorder[a] <= self.preorder[b] && self.postorder[b] <= self.postorder[a]
+    }
+}
+
+/// Loop-nesting forest of a reducible CFG. A loop is identified by its header, and contains the
+/// nodes that can reach one of the header's back edges without going through the header.
+pub struct LoopNest {
+    /// Whether each node is the header of a loop
+    is_header: Vec<bool>,
+
+    /// Header of the innermost loop containing each node, not counting the loop a header heads
+    parent: Vec<Option<usize>>,
+}
+
+impl LoopNest {
+    /// Fails if the CFG is irreducible, in which case loops don't have a single header
+    pub fn new(doms: &Dominators) -> Result<LoopNest, String> {
+        let n = doms.len();
+        let mut is_header = vec![false; n];
+        let mut parent: Vec<Option<usize>> = vec![None; n];
+
+        // Union-find collapsing the loops found so far into their headers
+        let mut collapsed: Vec<usize> = (0..n).collect();
+        fn find(collapsed: &mut Vec<usize>, node: usize) -> usize {
+            let mut root = node;
+            while collapsed[root] != root {
+                root = collapsed[root];
+            }
+            let mut node = node;
+            while collapsed[node] != root {
+                let next = collapsed[node];
+                collapsed[node] = root;
+                node = next;
+            }
+            root
+        }
+
+        // Inner loops have headers later in reverse postorder than the loops around them, so
+        // going backwards finds the inner loops first
+        for header in (0..n).rev() {
+            let mut worklist: Vec<usize> = vec![];
+            for &pred in doms.predecessors(header) {
+                if pred >= header {
+                    if !doms.dominates(header, pred) {
+                        return Err(format!("Irreducible control flow into {:?}", doms.label(header)));
+                    }
+                    is_header[header] = true;
+                    worklist.push(find(&mut collapsed, pred));
+                }
+            }
+
+            while let Some(node) = worklist.pop() {
+                if node == header || find(&mut collapsed, node) != node {
+                    continue
+                }
+                parent[node] = Some(header);
+                collapsed[node] = header;
+                for &pred in doms.predecessors(node) {
+                    let pred = find(&mut collapsed, pred);
+                    if pred != header {
+                        worklist.push(pred);
+                    }
+                }
+            }
+        }
+
+        Ok(LoopNest { is_header, parent })
+    }
+
+    pub fn is_header(&self, node: usize) -> bool {
+        self.is_header[node]
+    }
+
+    /// Header of the innermost loop containing `node`, other than the one it heads
+    pub fn parent(&self, node: usize) -> Option<usize> {
+        self.parent[node]
+    }
+
+    /// Header of the innermost loop containing `node`, which is `node` itself for headers
+    pub fn innermost(&self, node: usize) -> Option<usize> {
+        if self.is_header[node] { Some(node) } else { self.parent[node] }
+    }
+
+    /// Whether `node` is in the loop headed by `header`
+    pub fn contains(&self, header: usize, node: usize) -> bool {
+        let mut current = self.innermost(node);
+        while let Some(h) = current {
+            if h == header {
+                return true
+            }
+            current = self.parent[h];
+        }
+        false
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn graph(edges: &[(u64, &[u64])]) -> HashMap<Label, Vec<Label>> {
+        edges
+            .iter()
+            .map(|&(from, to)| (Label::Synthetic(from), to.iter().map(|&l| Label::Synthetic(l)).collect()))
+            .collect()
+    }
+
+    #[test]
+    fn nested_loops() {
+        // 0 -> 1 -> 2 -> 3 -> 2, 3 -> 1, 1 -> 4
+        let succs = graph(&[(0, &[1]), (1, &[2, 4]), (2, &[3]), (3, &[2, 1]), (4, &[])]);
+        let doms = Dominators::new(Label::Synthetic(0), &succs);
+        let node = |l| doms.node(&Label::Synthetic(l)).unwrap();
+
+        assert_eq!(doms.idom(node(4)), Some(node(1)));
+        assert_eq!(doms.idom(node(3)), Some(node(2)));
+        assert!(doms.dominates(node(1), node(3)) && !doms.dominates(node(4), node(3)));
+
+        let loops = LoopNest::new(&doms).unwrap();
+        assert!(loops.is_header(node(1)) && loops.is_header(node(2)));
+        assert_eq!(loops.parent(node(2)), Some(node(1)));
+        assert_eq!(loops.innermost(node(3)), Some(node(2)));
+        assert!(loops.contains(node(1), node(3)) && !loops.contains(node(1), node(4)));
+    }
+
+    #[test]
+    fn irreducible() {
+        // 0 -> 1, 0 -> 2, 1 <-> 2
+        let succs = graph(&[(0, &[1, 2]), (1, &[2]), (2, &[1])]);
+        let doms = Dominators::new(Label::Synthetic(0), &succs);
+        assert!(LoopNest::new(&doms).is_err());
+    }
+}
@@ -10,6 +10,7 @@
 //!   - given an entry point C statement, translate it into a CFG consisting of `BasicBlock<Label>`
 //!   - simplify this CFG (by eliminating empty blocks that jump unconditionally to the next block)
 //!   - use the _Relooper algorithm_ to convert this CFG into a sequence of `Structure<StmtOrDecl>`s
+//!     (large CFGs are instead structured using their dominator and loop-nesting trees)
 //!   - place the declarations in the right place and produce a sequence of `Structure<Stmt>`s
 //!   - simplify that sequence of `Structure<Stmt>`s into another such sequence
 //!   - convert the `Vec<Structure<Stmt>>` back into a `Vec<Stmt>`
@@ -41,12 +42,15 @@ use c_ast::*;
 use rust_ast::mk;
 
 pub mod relooper;
+pub mod dominators;
 pub mod structures;
 pub mod loops;
 pub mod multiples;
+pub mod dataflow;
 
 use cfg::loops::*;
 use cfg::multiples::*;
+use cfg::dataflow::{BitSet, DenseIndex};
 
 /// These labels identify basic blocks in a regular CFG.
 #[derive(Copy,Clone,PartialEq,Eq,PartialOrd,Ord,Debug,Hash)]
@@ -193,11 +197,11 @@ pub struct BasicBlock<L,S> {
     /// How to find the next (if any) basic block to go to
     terminator: GenTerminator<L>,
 
-    /// Variables live at the beginning of this block
-    live: HashSet<CDeclId>,
+    /// Variables live at the beginning of this block, as indices into the `DeclStmtStore`
+    live: BitSet,
 
-    /// Variables defined in this block
-    defined: HashSet<CDeclId>,
+    /// Variables defined in this block, as indices into the `DeclStmtStore`
+    defined: BitSet,
 }
 
 impl<L: Clone, S1> BasicBlock<L, S1> {
@@ -225,7 +229,7 @@ impl<L: Serialize, St: Serialize> Serialize for BasicBlock<L, St> {
 
 impl<L,S> BasicBlock<L,S> {
     fn new(terminator: GenTerminator<L>) -> Self {
-        BasicBlock { body: vec![], terminator, live: HashSet::new(), defined: HashSet::new() }
+        BasicBlock { body: vec![], terminator, live: BitSet::new(), defined: BitSet::new() }
     }
 
     fn new_jump(target: L) -> Self {
@@ -687,7 +691,7 @@ struct CfgBuilder {
 
     /// Variables in scope right before the current statement. The wrapping `Vec` witnesses the
     /// notion of scope: later elements in the vector are always supersets of earlier elements.
-    currently_live: Vec<HashSet<CDeclId>>,
+    currently_live: Vec<BitSet>,
     /// Information about all of the C declarations we have seen so far.
     decls_seen: DeclStmtStore,
 
@@ -733,6 +737,10 @@ struct CfgBuilder {
     ///
     /// NOTE: we technically don't need the `Label` here - it is just for debugging.
     multiples: Vec<(Label, Vec<Label>)>,
+
+    /// Label of the basic block added last. The comments at the end of a compound statement go at
+    /// the end of this block.
+    last_block: Option<Label>,
 }
 
 /// Stores information about translating C declarations to Rust statements. When seeing a C
@@ -741,7 +749,10 @@ struct CfgBuilder {
 /// choosing what to do until later.
 #[derive(Clone, Debug)]
 pub struct DeclStmtStore {
-    store: HashMap<CDeclId, DeclStmtInfo>
+    store: HashMap<CDeclId, DeclStmtInfo>,
+
+    /// Dense indices of the declarations, which the sets of variables in basic blocks are made of
+    indices: DenseIndex<CDeclId>,
 }
 
 /// This contains the information one needs to convert a C declaration in all the possible ways:
@@ -779,7 +790,17 @@ impl DeclStmtInfo {
 impl DeclStmtStore {
 
     pub fn new() -> Self {
-        DeclStmtStore { store: HashMap::new() }
+        DeclStmtStore { store: HashMap::new(), indices: DenseIndex::new() }
+    }
+
+    /// Index of a declaration in the sets of variables of basic blocks
+    pub fn decl_index(&mut self, decl_id: CDeclId) -> usize {
+        self.indices.index_of(decl_id)
+    }
+
+    /// Declarations in a set of variables of a basic block
+    pub fn decls_in<'a>(&'a self, set: &'a BitSet) -> impl Iterator<Item = CDeclId> + 'a {
+        self.indices.values_of(set)
     }
 
     /// Extract _just_ the Rust statements for a declaration (without initialization). Used when you
@@ -851,10 +872,10 @@ struct WipBlock {
     body: Vec<StmtOrDecl>,
 
     /// Variables defined so far in this WIP.
-    defined: HashSet<CDeclId>,
+    defined: BitSet,
 
     /// Variables live in this WIP.
-    live: HashSet<CDeclId>,
+    live: BitSet,
 }
 
 impl Extend<Stmt> for WipBlock {
@@ -884,13 +905,10 @@ impl CfgBuilder {
 
     /// Add a basic block to the control flow graph, specifying under which label to insert it.
     fn add_block(&mut self, lbl: Label, bb: BasicBlock<Label,StmtOrDecl>) -> () {
-        let currently_live = self.currently_live
+        self.currently_live
             .last_mut()
-            .expect("Found no live currently live scope");
-
-        for decl in &bb.defined {
-            currently_live.insert(*decl);
-        }
+            .expect("Found no live currently live scope")
+            .union_with(&bb.defined);
 
         match self.graph.nodes.insert(lbl, bb) {
             None => { },
@@ -899,6 +917,7 @@ impl CfgBuilder {
 
         self.loops.last_mut().map(|&mut (_, ref mut loop_vec)| loop_vec.push(lbl));
         self.multiples.last_mut().map(|&mut (_, ref mut arm_vec)| arm_vec.push(lbl));
+        self.last_block = Some(lbl);
     }
 
     /// Create a basic block from a WIP block by tacking on the right terminator. Once this is done,
@@ -967,7 +986,7 @@ impl CfgBuilder {
         b
     }
 
-    fn current_variables(&self) -> HashSet<CDeclId> {
+    fn current_variables(&self) -> BitSet {
         self.currently_live
             .last()
             .expect("Found no live currently live scope")
@@ -979,7 +998,7 @@ impl CfgBuilder {
         WipBlock {
             label: new_label,
             body: vec![],
-            defined: HashSet::new(),
+            defined: BitSet::new(),
             live: self.current_variables(),
         }
     }
@@ -1015,11 +1034,12 @@ impl CfgBuilder {
             continue_labels: vec![],
             switch_expr_cases: vec![],
 
-            currently_live: vec![HashSet::new()],
+            currently_live: vec![BitSet::new()],
             decls_seen: DeclStmtStore::new(),
 
             loops: vec![],
             multiples: vec![],
+            last_block: None,
 
             c_labels_defined: HashSet::new(),
             c_labels_used: HashSet::new(),
@@ -1099,7 +1119,7 @@ impl CfgBuilder {
                     }
 
                     wip.push_decl(*decl);
-                    wip.defined.insert(*decl);
+                    wip.defined.insert(self.decls_seen.decl_index(*decl));
                 }
                 Ok(Some(wip))
             }
@@ -1344,11 +1364,18 @@ impl CfgBuilder {
                 Ok(None)
             }
 
-            CStmtKind::Compound(ref comp_stmts) => self.convert_stmts_help(
-                translator,
-                comp_stmts.as_slice(),
-                wip
-            ),
+            CStmtKind::Compound(ref comp_stmts) => {
+                let wip = self.convert_stmts_help(translator, comp_stmts.as_slice(), wip)?;
+
+                // Add the comments at the end of the block after its last statement, which is in
+                // the last block added whether or not control falls out of the compound statement
+                let cmmts = translator.comment_context.borrow_mut().remove_block_end_comment(stmt_id);
+                if let Some(lbl) = self.last_block {
+                    let bb = self.graph.nodes.get_mut(&lbl).expect("Cannot find the last block");
+                    bb.body.extend(cmmts.into_iter().map(StmtOrDecl::Comment));
+                }
+                Ok(wip)
+            }
 
             CStmtKind::Expr(expr) => {
                 wip.extend(translator.convert_expr(ExprUse::Unused, expr, false)?.stmts);
@@ -1543,9 +1570,8 @@ impl Cfg<Label,StmtOrDecl> {
             } else {
                 format!(
                     "\\ldefined: {{{}}}",
-                    bb.defined
-                        .iter()
-                        .filter_map(|decl| ctx.index(*decl).kind.get_name())
+                    store.decls_in(&bb.defined)
+                        .filter_map(|decl| ctx.index(decl).kind.get_name())
                         .cloned()
                         .collect::<Vec<_>>()
                         .join(", "),
@@ -1557,9 +1583,8 @@ impl Cfg<Label,StmtOrDecl> {
             } else {
                 format!(
                     "\\llive in: {{{}}}",
-                    bb.live
-                        .iter()
-                        .filter_map(|decl| ctx.index(*decl).kind.get_name())
+                    store.decls_in(&bb.live)
+                        .filter_map(|decl| ctx.index(decl).kind.get_name())
                         .cloned()
                         .collect::<Vec<_>>()
                         .join(", "),
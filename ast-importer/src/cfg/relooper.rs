@@ -2,6 +2,11 @@
 //! simplifying the latter.
 
 use super::*;
+use cfg::dataflow;
+use cfg::dominators::{Dominators, LoopNest};
+use std::mem;
+
+type StructuredBlocks = HashMap<Label, BasicBlock<StructureLabel<StmtOrDecl>, StmtOrDecl>>;
 
 /// Convert the CFG into a sequence of structures
 pub fn reloop(
@@ -10,10 +15,12 @@ pub fn reloop(
     simplify_structures: bool,    // simplify the output structure
     use_c_loop_info: bool,        // use the loop information in the CFG (slower, but better)
     use_c_multiple_info: bool,    // use the multiple information in the CFG (slower, but better)
+    large_cfg_threshold: usize,   // CFGs with more blocks than this are relooped using dominators
+    fail_on_dominator_fallback: bool, // panic instead of falling back when relooping with dominators fails
 ) -> (Vec<Stmt>, Vec<Structure<StmtOrComment>>) {
 
     let entries = cfg.entries;
-    let blocks = cfg.nodes
+    let blocks: StructuredBlocks = cfg.nodes
         .into_iter()
         .map(|(lbl, bb)| {
             let terminator = bb.terminator.map_labels(|l| StructureLabel::GoTo(*l));
@@ -25,10 +32,30 @@ pub fn reloop(
     let loop_info = if use_c_loop_info { Some(cfg.loops) } else { None };
     let multiple_info = if use_c_multiple_info { Some(cfg.multiples) } else { None };
     let mut state = RelooperState::new(loop_info, multiple_info);
-    state.relooper(entries, blocks, &mut relooped_with_decls);
+
+    // Irreducible CFGs are left to the recursive relooper, which handles them with jump tables,
+    // and so are CFGs the dominator relooper fails to place all the blocks of
+    let relooped_by_dominators = if blocks.len() > large_cfg_threshold {
+        let relooped = DominatorRelooper::new(&entries, &blocks)
+            .and_then(|relooper| relooper.reloop(&mut state, &blocks));
+        if let Err(ref e) = relooped {
+            if fail_on_dominator_fallback {
+                panic!("Relooping with dominators failed with `--fail-on-dominator-fallback': {}", e);
+            }
+            eprintln!("Relooping with dominators failed, falling back to the recursive relooper: {}", e);
+            state.reset();
+        }
+        relooped.ok()
+    } else {
+        None
+    };
+    match relooped_by_dominators {
+        Some(structures) => relooped_with_decls = structures,
+        None => state.relooper(entries, blocks, &mut relooped_with_decls),
+    }
 
     // These are declarations we need to lift
-    let lift_me: HashSet<CDeclId> = state.lifted;
+    let lift_me: HashSet<CDeclId> = store.decls_in(&state.lifted).collect();
 
     // These are the statements that emerge from these lifts
     let lifted_stmts: Vec<Stmt> = lift_me
@@ -52,11 +79,11 @@ pub fn reloop(
 /// This is the state we close over while relooping. It accumulates information about which
 /// declarations were supposed to be in scope before they were declared.
 struct RelooperState {
-    /// scopes of declarations seen so far
-    scopes: Vec<HashSet<CDeclId>>,
+    /// scopes of declarations seen so far, as indices into the `DeclStmtStore`
+    scopes: Vec<BitSet>,
 
     /// Declarations that will have to be lifted to the top of the output
-    lifted: HashSet<CDeclId>,
+    lifted: BitSet,
 
     /// Information about loops
     loop_info: Option<LoopInfo<Label>>,
@@ -72,38 +99,62 @@ impl RelooperState {
         multiple_info: Option<MultipleInfo<Label>>,
     ) -> Self {
         RelooperState {
-            scopes: vec![HashSet::new()],
-            lifted: HashSet::new(),
+            scopes: vec![BitSet::new()],
+            lifted: BitSet::new(),
             loop_info,
             multiple_info,
         }
     }
 
+    /// Forget the scopes and lifted declarations of a relooping attempt that was abandoned
+    fn reset(&mut self) {
+        self.scopes = vec![BitSet::new()];
+        self.lifted = BitSet::new();
+    }
+
     pub fn open_scope(&mut self) {
-        self.scopes.push(HashSet::new());
+        self.scopes.push(BitSet::new());
     }
 
     pub fn close_scope(&mut self) {
         self.scopes.pop();
     }
 
-    pub fn in_scope(&self, decl: CDeclId) -> bool {
-        self.scopes.iter().any(|scope| scope.contains(&decl))
+    pub fn in_scope(&self, decl: usize) -> bool {
+        self.scopes.iter().any(|scope| scope.contains(decl))
     }
 
-    pub fn add_to_scope(&mut self, decl: CDeclId) {
+    pub fn add_to_scope(&mut self, decls: &BitSet) {
         self.scopes
             .last_mut()
             .expect("add_to_scope: no scopes found")
-            .insert(decl);
+            .union_with(decls);
     }
 
-    pub fn add_to_top_scope(&mut self, decl: CDeclId) {
+    pub fn add_to_top_scope(&mut self, decl: usize) {
         self.scopes
             .first_mut()
             .expect("add_to_top_scope: no scopes found")
             .insert(decl);
     }
+
+    /// Account for the declarations of a block about to be placed in the current scope
+    fn enter_block(&mut self, live: &BitSet, defined: &BitSet) {
+        // Flag declarations for everything that is live going in but not already in scope.
+        //
+        // It is tempting to just place the declarations here, but it isn't that simple:
+        // they may end up also being live but not in scope elsewhere and we should _not_
+        // make a second declaration.
+        for l in live.iter() {
+            if !self.in_scope(l) {
+                self.add_to_top_scope(l);
+                self.lifted.insert(l);
+            }
+        }
+
+        // Being into scope things that are defined here
+        self.add_to_scope(defined);
+    }
 }
 
 impl RelooperState {
@@ -138,8 +189,6 @@ impl RelooperState {
             flipped_map
         }
 
-        type StructuredBlocks = HashMap<Label, BasicBlock<StructureLabel<StmtOrDecl>, StmtOrDecl>>;
-
         // Find all labels reachable via a `GoTo` from the current set of blocks
         let reachable_labels: HashSet<Label> = blocks
             .iter()
@@ -168,23 +217,7 @@ impl RelooperState {
             if let Some(bb) = blocks.remove(&entry) {
                 let new_entries = bb.successors();
                 let BasicBlock { body, terminator, live, defined } = bb;
-
-                // Flag declarations for everything that is live going in but not already in scope.
-                //
-                // It is tempting to just place the declarations here, but it isn't that simple:
-                // they may end up also being live but not in scope elsewhere and we should _not_
-                // make a second declaration.
-                for l in live {
-                    if !self.in_scope(l) {
-                        self.add_to_top_scope(l);
-                        self.lifted.insert(l);
-                    }
-                }
-
-                // Being into scope things that are defined here
-                for d in defined {
-                    self.add_to_scope(d);
-                }
+                self.enter_block(&live, &defined);
 
                 result.push(Structure::Simple { entries, body, terminator });
 
@@ -226,38 +259,17 @@ impl RelooperState {
         // Loops
 
 
-        // DFS transitive closure
-        fn transitive_closure<V: Copy + Hash + Eq>(adjacency_list: &HashMap<V, HashSet<V>>) -> HashMap<V, HashSet<V>> {
-            let mut edges: HashSet<(V, V)> = HashSet::new();
-            let mut to_visit: Vec<(V, V)> = adjacency_list.keys().map(|v| (*v,*v)).collect();
-
-            while let Some((s,v)) = to_visit.pop() {
-                for i in adjacency_list.get(&v).unwrap_or(&HashSet::new()) {
-                    if edges.insert((s,*i)) {
-                        to_visit.push((s, *i));
-                    }
-                }
-            }
-
-            let mut closure: HashMap<V, HashSet<V>> = HashMap::new();
-            for (f,t) in edges {
-                closure.entry(f).or_insert(HashSet::new()).insert(t);
-            }
-
-            closure
-        }
-
         // This information is necessary for both the `Loop` and `Multiple` cases
-        let (predecessor_map, strict_reachable_from) = {
-            let mut successor_map: HashMap<Label, HashSet<Label>> = blocks
+        let (predecessor_map, reachability) = {
+            let successor_map: HashMap<Label, HashSet<Label>> = blocks
                 .iter()
                 .map(|(lbl, bb)| (*lbl, bb.successors()))
                 .collect();
 
-            let strict_reachable_from = flip_edges(transitive_closure(&successor_map));
+            let reachability = Reachability::new(&successor_map);
             let predecessor_map = flip_edges(successor_map);
 
-            (predecessor_map, strict_reachable_from)
+            (predecessor_map, reachability)
         };
 
 
@@ -303,12 +315,12 @@ impl RelooperState {
 
 
         if none_branch_to.is_empty() && !recognized_c_multiple {
-            let new_returns: HashSet<Label> = strict_reachable_from
+            let present_entries: HashSet<Label> = entries
                 .iter()
-                .filter(|&(lbl, _)| blocks.contains_key(lbl) && entries.contains(lbl))
-                .flat_map(|(_, ref reachable)| reachable.iter())
+                .filter(|lbl| blocks.contains_key(lbl))
                 .cloned()
                 .collect();
+            let new_returns: HashSet<Label> = reachability.reaching(&present_entries);
 
             // Partition blocks into those belonging in or after the loop
             let (mut body_blocks, mut follow_blocks): (StructuredBlocks, StructuredBlocks) = blocks
@@ -384,19 +396,8 @@ impl RelooperState {
         // --------------------------------------
         // Multiple
 
-        // Like `strict_reachable_from`, but entries also reach themselves
-        let mut reachable_from: HashMap<Label, HashSet<Label>> = strict_reachable_from;
-        for entry in &entries {
-            reachable_from.entry(*entry).or_insert(HashSet::new()).insert(*entry);
-        }
-
-        // Blocks that are reached by only one label
-        let singly_reached: HashMap<Label, HashSet<Label>> = flip_edges(reachable_from
-            .into_iter()
-            .map(|(lbl, reachable)| (lbl, &reachable & &entries))
-            .filter(|&(_, ref reachable)| reachable.len() == 1)
-            .collect()
-        );
+        // Blocks that are reached by only one entry
+        let singly_reached: HashMap<Label, HashSet<Label>> = reachability.singly_reached(&entries);
 
         let handled_entries: HashMap<Label, StructuredBlocks> = singly_reached
             .into_iter()
@@ -461,6 +462,437 @@ impl RelooperState {
     }
 }
 
+/// Labels still to be placed that earlier code branches to, keyed by the header of the innermost
+/// `Loop` structure they will be placed in
+type Pending = HashMap<Option<usize>, HashSet<usize>>;
+
+fn merge_pending(into: &mut Pending, from: Pending) {
+    for (context, mut labels) in from {
+        let into_labels = into.entry(context).or_insert(HashSet::new());
+        if into_labels.len() < labels.len() {
+            mem::swap(into_labels, &mut labels);
+        }
+        into_labels.extend(labels);
+    }
+}
+
+/// Relooper for large CFGs. Instead of repeatedly partitioning the blocks and recomputing entries
+/// and reachability like `RelooperState::relooper`, this computes the dominator and loop-nesting
+/// trees once and reads the structure off of them, in close to linear time. It only handles
+/// reducible CFGs.
+///
+/// The code of every block is placed inside the code of its immediate dominator:
+///
+///   * a block whose only predecessor is its immediate dominator goes in a branch right after it
+///   * a block that exits loops around its immediate dominator goes right after the outermost of
+///     those loops
+///   * any other block follows the code of its immediate dominator (inside the loop it heads, if
+///     it is a loop header)
+///
+/// Blocks following the same code are placed in reverse postorder, so that nothing jumps back to
+/// one of them other than through a loop. When more than one placed block can come next, a
+/// `Multiple` dispatches on the label that was jumped to.
+struct DominatorRelooper {
+    doms: Dominators,
+    loops: LoopNest,
+
+    /// Blocks placed in the branches right after each block
+    owned: Vec<Vec<usize>>,
+
+    /// Blocks placed after the code of each block
+    follows: Vec<Vec<usize>>,
+
+    /// Blocks placed after the loop headed by each block
+    follows_loop: Vec<Vec<usize>>,
+
+    /// Header of the innermost `Loop` structure the code of each block is placed in
+    context: Vec<Option<usize>>,
+
+    /// Blocks not yet placed
+    blocks: Vec<Option<BasicBlock<StructureLabel<StmtOrDecl>, StmtOrDecl>>>,
+}
+
+impl DominatorRelooper {
+    /// Fails if the CFG doesn't have a single entry or is irreducible
+    fn new(entries: &HashSet<Label>, blocks: &StructuredBlocks) -> Result<DominatorRelooper, String> {
+        if entries.len() != 1 {
+            Err(format!("Expected a single entry, found {:?}", entries))?
+        }
+        let entry = *entries.iter().next().expect("Should find exactly one entry");
+
+        let mut successors: HashMap<Label, Vec<Label>> = HashMap::new();
+        for (lbl, bb) in blocks {
+            let mut succs: Vec<Label> = vec![];
+            for slbl in bb.terminator.get_labels() {
+                match slbl {
+                    &StructureLabel::GoTo(to) if blocks.contains_key(&to) => succs.push(to),
+                    _ => Err(format!("Unexpected branch from {:?} to {:?}", lbl, slbl))?,
+                }
+            }
+            successors.insert(*lbl, succs);
+        }
+
+        let doms = Dominators::new(entry, &successors);
+        let loops = LoopNest::new(&doms)?;
+
+        let n = doms.len();
+        let mut owned: Vec<Vec<usize>> = vec![vec![]; n];
+        let mut follows: Vec<Vec<usize>> = vec![vec![]; n];
+        let mut follows_loop: Vec<Vec<usize>> = vec![vec![]; n];
+        let mut context: Vec<Option<usize>> = vec![None; n];
+
+        // Dominators and loop headers come before the blocks they dominate in reverse postorder,
+        // so blocks are placed after the ones their placement depends on
+        for node in 1..n {
+            let idom = doms.idom(node).expect("Only the entry has no immediate dominator");
+            let inner_context = if loops.is_header(idom) { Some(idom) } else { context[idom] };
+
+            // Outermost loop around the immediate dominator that this block is outside of
+            let mut exited = None;
+            let mut enclosing = loops.innermost(idom);
+            while let Some(header) = enclosing {
+                if loops.contains(header, node) {
+                    break
+                }
+                exited = Some(header);
+                enclosing = loops.parent(header);
+            }
+
+            if let Some(header) = exited {
+                follows_loop[header].push(node);
+                context[node] = context[header];
+            } else if doms.predecessors(node) == [idom] {
+                owned[idom].push(node);
+                context[node] = inner_context;
+            } else {
+                follows[idom].push(node);
+                context[node] = inner_context;
+            }
+        }
+
+        Ok(DominatorRelooper { doms, loops, owned, follows, follows_loop, context, blocks: vec![] })
+    }
+
+    /// The structures for the CFG. `blocks` have to be the ones this relooper was built from.
+    ///
+    /// Fails if some block can't be placed, in which case the caller should reloop `blocks` some
+    /// other way, after resetting `state`. The blocks are cloned rather than consumed for that.
+    fn reloop(
+        mut self,
+        state: &mut RelooperState,
+        blocks: &StructuredBlocks,
+    ) -> Result<Vec<Structure<StmtOrDecl>>, String> {
+        // Unreachable blocks are dropped
+        self.blocks = (0..self.doms.len()).map(|_| None).collect();
+        for (lbl, bb) in blocks {
+            if let Some(node) = self.doms.node(lbl) {
+                self.blocks[node] = Some(bb.clone());
+            }
+        }
+
+        let (structures, pending) = self.emit(state, 0)?;
+        if pending.values().any(|labels| !labels.is_empty()) {
+            Err(format!("Branches to labels that were never placed: {:?}", pending))?
+        }
+        Ok(structures)
+    }
+
+    /// Structures for the code of `first` and of everything placed with it, along with the labels
+    /// they branch to that are placed elsewhere.
+    ///
+    /// The last block following some code is usually placed right after it, so it is handled
+    /// by iterating rather than recursing, which keeps the recursion depth down to the nesting
+    /// depth of the output instead of the length of the function.
+    fn emit(
+        &mut self,
+        state: &mut RelooperState,
+        first: usize,
+    ) -> Result<(Vec<Structure<StmtOrDecl>>, Pending), String> {
+        let mut seq: Vec<Structure<StmtOrDecl>> = vec![];
+        let mut pending: Pending = HashMap::new();
+
+        let mut next = Some(first);
+        while let Some(node) = next.take() {
+            let lbl = self.doms.label(node);
+
+            let (followers, chained) = if self.loops.is_header(node) {
+                let mut body = vec![];
+                self.emit_loop_body(state, node, &mut body, &mut pending)?;
+
+                seq.push(Structure::Loop { entries: vec![lbl].into_iter().collect(), body });
+                (self.follows_loop[node].clone(), None)
+            } else {
+                let chained = self.emit_block(state, node, &mut seq, &mut pending)?;
+                (self.follows[node].clone(), chained)
+            };
+
+            // A single owned successor is simply the rest of the code
+            if let Some(child) = chained {
+                if followers.is_empty() {
+                    next = Some(child);
+                    continue
+                }
+                let (structures, child_pending) = self.emit(state, child)?;
+                seq.extend(structures);
+                merge_pending(&mut pending, child_pending);
+            }
+
+            let context = self.context[node];
+            if let Some((&last, rest)) = followers.split_last() {
+                for &follower in rest {
+                    self.place(state, follower, context, &mut seq, &mut pending)?;
+                }
+
+                let only_entry = pending
+                    .get(&context)
+                    .map_or(false, |labels| labels.len() == 1 && labels.contains(&last));
+                if only_entry {
+                    pending.remove(&context);
+                    next = Some(last);
+                } else {
+                    self.place(state, last, context, &mut seq, &mut pending)?;
+                }
+            }
+        }
+
+        Ok((seq, pending))
+    }
+
+    /// Fill in the body of the loop headed by `header`
+    fn emit_loop_body(
+        &mut self,
+        state: &mut RelooperState,
+        header: usize,
+        body: &mut Vec<Structure<StmtOrDecl>>,
+        pending: &mut Pending,
+    ) -> Result<(), String> {
+        state.open_scope();
+
+        if let Some(child) = self.emit_block(state, header, body, pending)? {
+            let (structures, child_pending) = self.emit(state, child)?;
+            body.extend(structures);
+            merge_pending(pending, child_pending);
+        }
+        for follower in self.follows[header].clone() {
+            self.place(state, follower, Some(header), body, pending)?;
+        }
+
+        state.close_scope();
+
+        // Everything branched to in the loop is either placed in it or is exited to
+        if let Some(labels) = pending.remove(&Some(header)) {
+            if !labels.is_empty() {
+                Err(format!("Loop {:?} falls through to {:?}", self.doms.label(header), labels))?
+            }
+        }
+        Ok(())
+    }
+
+    /// Push a `Simple` structure for the block `node`, followed by the branches to the blocks it
+    /// owns. If it has a single successor that it owns, that successor is returned instead, for
+    /// the caller to place right after.
+    fn emit_block(
+        &mut self,
+        state: &mut RelooperState,
+        node: usize,
+        seq: &mut Vec<Structure<StmtOrDecl>>,
+        pending: &mut Pending,
+    ) -> Result<Option<usize>, String> {
+        let lbl = self.doms.label(node);
+        let BasicBlock { body, terminator, live, defined } = match self.blocks[node].take() {
+            Some(bb) => bb,
+            None => Err(format!("Block {:?} placed twice", lbl))?,
+        };
+        state.enter_block(&live, &defined);
+
+        // Branches to blocks placed in the same `Loop` structure fall through to them, the others
+        // exit loops (including `continue`-ing loops this block is in)
+        let inner_context = if self.loops.is_header(node) { Some(node) } else { self.context[node] };
+        let terminator = {
+            let doms = &self.doms;
+            let context = &self.context;
+            terminator.map_labels(|slbl| match slbl {
+                &StructureLabel::GoTo(to) => {
+                    let to_node = doms.node(&to).expect("DominatorRelooper: branch to unknown block");
+                    if context[to_node] == inner_context {
+                        StructureLabel::GoTo(to)
+                    } else {
+                        StructureLabel::ExitTo(to)
+                    }
+                }
+                other => other.clone(),
+            })
+        };
+        let targets: HashSet<Label> = terminator.get_labels()
+            .into_iter()
+            .filter_map(|slbl| match slbl {
+                &StructureLabel::GoTo(to) => Some(to),
+                _ => None,
+            })
+            .collect();
+
+        let owned = self.owned[node].clone();
+        for &succ in self.doms.successors(node) {
+            // Blocks already taken can only be loop headers being `continue`d
+            if !owned.contains(&succ) && self.blocks[succ].is_some() {
+                pending.entry(self.context[succ]).or_insert(HashSet::new()).insert(succ);
+            }
+        }
+
+        seq.push(Structure::Simple { entries: vec![lbl].into_iter().collect(), body, terminator });
+
+        if owned.len() == 1 && targets.len() == 1 {
+            return Ok(Some(owned[0]))
+        }
+
+        if !owned.is_empty() {
+            let mut branches: HashMap<Label, Vec<Structure<StmtOrDecl>>> = HashMap::new();
+            for child in owned {
+                state.open_scope();
+                let (structures, child_pending) = self.emit(state, child)?;
+                state.close_scope();
+
+                merge_pending(pending, child_pending);
+                branches.insert(self.doms.label(child), structures);
+            }
+
+            // Like in `RelooperState::relooper`, when every entry has a branch one of them becomes
+            // the `then`
+            let all_owned = targets.iter().all(|lbl| branches.contains_key(lbl));
+            let then = if all_owned {
+                let last = self.doms.label(*self.owned[node].last().expect("no owned blocks"));
+                branches.remove(&last).expect("just inserted this branch")
+            } else {
+                vec![]
+            };
+
+            seq.push(Structure::Multiple { entries: targets, branches, then });
+        }
+
+        Ok(None)
+    }
+
+    /// Append to `seq` the code of the block `node`, which follows what `seq` already contains
+    /// inside the `Loop` structure headed by `context`. When some other label could be jumped to
+    /// instead, it goes in a `Multiple`.
+    fn place(
+        &mut self,
+        state: &mut RelooperState,
+        node: usize,
+        context: Option<usize>,
+        seq: &mut Vec<Structure<StmtOrDecl>>,
+        pending: &mut Pending,
+    ) -> Result<(), String> {
+        let mut others = pending.remove(&context).unwrap_or(HashSet::new());
+        if !others.remove(&node) {
+            Err(format!("Nothing branches to {:?} before it", self.doms.label(node)))?
+        }
+
+        let lbl = self.doms.label(node);
+        if others.is_empty() {
+            let (structures, node_pending) = self.emit(state, node)?;
+            seq.extend(structures);
+            merge_pending(pending, node_pending);
+        } else {
+            state.open_scope();
+            let (structures, node_pending) = self.emit(state, node)?;
+            state.close_scope();
+
+            let mut entries: HashSet<Label> = others.iter().map(|&other| self.doms.label(other)).collect();
+            entries.insert(lbl);
+            let branches = vec![(lbl, structures)].into_iter().collect();
+            seq.push(Structure::Multiple { entries, branches, then: vec![] });
+
+            pending.insert(context, others);
+            merge_pending(pending, node_pending);
+        }
+        Ok(())
+    }
+}
+
+/// Which labels of a CFG reach which, kept as bitsets over a dense numbering of the labels. This
+/// replaces computing the transitive closure as a set of label pairs, which is quadratic in the
+/// number of blocks in both time and memory.
+struct Reachability {
+    labels: DenseIndex<Label>,
+
+    /// Labels reachable from each label by following at least one edge
+    strict: Vec<BitSet>,
+}
+
+impl Reachability {
+    fn new(successor_map: &HashMap<Label, HashSet<Label>>) -> Reachability {
+        let mut labels = DenseIndex::new();
+        let edges: Vec<(usize, Vec<usize>)> = successor_map
+            .iter()
+            .map(|(lbl, succs)| {
+                let node = labels.index_of(*lbl);
+                (node, succs.iter().map(|succ| labels.index_of(*succ)).collect())
+            })
+            .collect();
+
+        // Labels outside the sub-CFG have no successors
+        let mut successors: Vec<Vec<usize>> = vec![vec![]; labels.len()];
+        for (node, succs) in edges {
+            successors[node] = succs;
+        }
+
+        let strict = dataflow::strict_reachability(&successors);
+        Reachability { labels, strict }
+    }
+
+    /// Labels from which one of `targets` can be reached by following at least one edge
+    fn reaching(&self, targets: &HashSet<Label>) -> HashSet<Label> {
+        let targets: BitSet = targets.iter().filter_map(|lbl| self.labels.get(lbl)).collect();
+        (0..self.labels.len())
+            .filter(|&node| self.strict[node].intersects(&targets))
+            .map(|node| self.labels.value(node))
+            .collect()
+    }
+
+    /// For each entry, the labels reachable from it (itself included) that are not reachable
+    /// from any other entry. Entries reaching no such label are left out.
+    fn singly_reached(&self, entries: &HashSet<Label>) -> HashMap<Label, HashSet<Label>> {
+        let reached: Vec<(Label, BitSet)> = entries
+            .iter()
+            .map(|&entry| {
+                let mut reached = BitSet::new();
+                if let Some(node) = self.labels.get(&entry) {
+                    reached.union_with(&self.strict[node]);
+                    reached.insert(node);
+                }
+                (entry, reached)
+            })
+            .collect();
+
+        // Labels reached from at least one, and from at least two entries
+        let mut once = BitSet::new();
+        let mut twice = BitSet::new();
+        for &(_, ref reached) in &reached {
+            let mut both = once.clone();
+            both.intersect_with(reached);
+            twice.union_with(&both);
+            once.union_with(reached);
+        }
+        once.subtract(&twice);
+
+        reached
+            .into_iter()
+            .filter_map(|(entry, mut reached)| {
+                reached.intersect_with(&once);
+                let mut labels: HashSet<Label> = self.labels.values_of(&reached).collect();
+
+                // Entries outside the sub-CFG only reach themselves
+                if self.labels.get(&entry).is_none() {
+                    labels.insert(entry);
+                }
+
+                if labels.is_empty() { None } else { Some((entry, labels)) }
+            })
+            .collect()
+    }
+}
+
 /// Nested precondition: `structures` will contain no `StructureLabel::Nested` terminators.
 fn simplify_structure<Stmt: Clone>(structures: Vec<Structure<Stmt>>) -> Vec<Structure<Stmt>> {
 
@@ -581,3 +1013,129 @@ fn simplify_structure<Stmt: Clone>(structures: Vec<Structure<Stmt>>) -> Vec<Stru
     acc_structures.reverse();
     acc_structures
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use syntax::with_globals;
+
+    fn lbl(n: u64) -> Label {
+        Label::Synthetic(n)
+    }
+
+    /// Blocks with no code, from their terminators. `Branch` conditions are all `true`.
+    fn blocks(terminators: Vec<(u64, GenTerminator<Label>)>) -> StructuredBlocks {
+        terminators
+            .into_iter()
+            .map(|(n, terminator)| {
+                let terminator = terminator.map_labels(|l| StructureLabel::GoTo(*l));
+                (lbl(n), BasicBlock { body: vec![], terminator, defined: BitSet::new(), live: BitSet::new() })
+            })
+            .collect()
+    }
+
+    fn branch(then: u64, els: u64) -> GenTerminator<Label> {
+        Branch(mk().lit_expr(mk().bool_lit(true)), lbl(then), lbl(els))
+    }
+
+    /// The entries of the structures in order, with the bodies of loops and the arms of
+    /// multiples (sorted, `then` included) nested in them
+    fn shape<S>(structures: &[Structure<S>]) -> String {
+        let shapes: Vec<String> = structures.iter().map(|structure| match structure {
+            &Structure::Simple { ref entries, .. } => {
+                let mut names: Vec<String> = entries.iter().map(|l| format!("{:?}", l)).collect();
+                names.sort();
+                names.join(",")
+            }
+            &Structure::Loop { ref body, .. } => format!("loop({})", shape(body)),
+            &Structure::Multiple { ref branches, ref then, .. } => {
+                let mut arms: Vec<String> = branches.values().map(|body| shape(body)).collect();
+                if !then.is_empty() {
+                    arms.push(shape(then));
+                }
+                arms.sort();
+                format!("multiple({})", arms.join(" | "))
+            }
+        }).collect();
+        shapes.join(" ").replace("Synthetic", "")
+    }
+
+    fn reloop_by_dominators(blocks: &StructuredBlocks) -> Result<String, String> {
+        let entries = vec![lbl(0)].into_iter().collect();
+        let mut state = RelooperState::new(None, None);
+        DominatorRelooper::new(&entries, blocks)
+            .and_then(|relooper| relooper.reloop(&mut state, blocks))
+            .map(|structures| shape(&structures))
+    }
+
+    #[test]
+    fn dominators_if_else() {
+        // 0 -> 1 | 2 -> 3
+        with_globals(|| {
+            let blocks = blocks(vec![(0, branch(1, 2)), (1, Jump(lbl(3))), (2, Jump(lbl(3))), (3, End)]);
+            assert_eq!(reloop_by_dominators(&blocks).unwrap(), "(0) multiple((1) | (2)) (3)");
+        })
+    }
+
+    #[test]
+    fn dominators_loop() {
+        // 0 -> 1 -> 2 -> 1, 1 -> 3
+        with_globals(|| {
+            let blocks = blocks(vec![(0, Jump(lbl(1))), (1, branch(2, 3)), (2, Jump(lbl(1))), (3, End)]);
+            assert_eq!(reloop_by_dominators(&blocks).unwrap(), "(0) loop((1) (2)) (3)");
+        })
+    }
+
+    #[test]
+    fn dominators_drop_unreachable() {
+        // 0 -> 1, with 2 unreachable
+        with_globals(|| {
+            let blocks = blocks(vec![(0, Jump(lbl(1))), (1, End), (2, Jump(lbl(1)))]);
+            assert_eq!(reloop_by_dominators(&blocks).unwrap(), "(0) (1)");
+        })
+    }
+
+    #[test]
+    fn dominators_reject_irreducible() {
+        // 0 -> 1 | 2, 1 <-> 2
+        with_globals(|| {
+            let blocks = blocks(vec![(0, branch(1, 2)), (1, Jump(lbl(2))), (2, Jump(lbl(1)))]);
+            assert!(reloop_by_dominators(&blocks).is_err());
+        })
+    }
+
+    fn irreducible_cfg() -> Cfg<Label, StmtOrDecl> {
+        let nodes = vec![(0, branch(1, 2)), (1, Jump(lbl(2))), (2, branch(1, 3)), (3, End)]
+            .into_iter()
+            .map(|(n, terminator)| {
+                (lbl(n), BasicBlock { body: vec![], terminator, defined: BitSet::new(), live: BitSet::new() })
+            })
+            .collect();
+        Cfg {
+            entries: vec![lbl(0)].into_iter().collect(),
+            nodes,
+            loops: LoopInfo::new(),
+            multiples: MultipleInfo::new(),
+        }
+    }
+
+    #[test]
+    fn dominator_fallback() {
+        // Irreducible CFGs are relooped the recursive way, with every block placed once
+        with_globals(|| {
+            let (_, structures) = reloop(irreducible_cfg(), DeclStmtStore::new(), false, false, false, 0, false);
+            let shape = shape(&structures);
+            for n in 0..4 {
+                assert_eq!(shape.matches(&format!("({})", n)).count(), 1, "{}", shape);
+            }
+        })
+    }
+
+    #[test]
+    #[should_panic(expected = "Relooping with dominators failed")]
+    fn dominator_fallback_disabled() {
+        with_globals(|| {
+            reloop(irreducible_cfg(), DeclStmtStore::new(), false, false, false, 0, true);
+        })
+    }
+}
@@ -3,14 +3,16 @@
 use super::*;
 
 use comment_store;
+use syntax::codemap::{DUMMY_SP, Span};
 
-/// Convert a sequence of structures produced by Relooper back into Rust statements
+/// Convert a sequence of structures produced by Relooper back into Rust statements, along with the
+/// comments that none of them follows
 pub fn structured_cfg(
     root: &Vec<Structure<StmtOrComment>>,
     comment_store: &mut comment_store::CommentStore,
     current_block: P<Expr>,
     debug_labels: bool
-) -> Result<Vec<Stmt>, String> {
+) -> Result<(Vec<Stmt>, Vec<String>), String> {
 
 
     let ast: StructuredAST<P<Expr>, P<Pat>, Label, StmtOrComment> = structured_cfg_help(
@@ -28,9 +30,6 @@ pub fn structured_cfg(
     let mut queued = vec![];
     let mut stmts = vec![];
     s.into_stmt(ast, comment_store, &mut queued, &mut stmts);
-    if !queued.is_empty() {
-        eprintln!("Did not find a statement for comments {:?}", queued);
-    }
 
 
     // If the very last statement in the vector is a `return`, we can either cut it out or replace
@@ -53,7 +52,7 @@ pub fn structured_cfg(
         _ => { }
     }
 
-    Ok(stmts)
+    Ok((stmts, queued))
 }
 
 
@@ -341,6 +340,20 @@ struct StructureState {
 }
 
 impl StructureState {
+    /// Convert the structures in a block into its statements, along with the span to give the block
+    /// for the comments that none of them follows to come before its closing brace
+    fn into_block_stmts(
+        &self,
+        ast: StructuredAST<P<Expr>, P<Pat>, Label, StmtOrComment>,
+        comment_store: &mut comment_store::CommentStore,
+        queued_comments: &mut Vec<String>,
+    ) -> (Vec<Stmt>, Span) {
+        let mut output = vec![];
+        self.into_stmt(ast, comment_store, queued_comments, &mut output);
+        let end = comment_store.add_closing_comment(queued_comments.drain(..).collect());
+        (output, end)
+    }
+
     pub fn into_stmt(
         &self,
         ast: StructuredAST<P<Expr>, P<Pat>, Label, StmtOrComment>,
@@ -383,13 +396,9 @@ impl StructureState {
                 let arms: Vec<Arm> = cases
                     .into_iter()
                     .map(|(pats, stmts)| -> Arm {
-                        let stmts = {
-                            let mut output = vec![];
-                            self.into_stmt(stmts, comment_store, queued_comments, &mut output);
-                            output
-                        };
+                        let (stmts, end) = self.into_block_stmts(stmts, comment_store, queued_comments);
 
-                        let body = mk().block_expr(mk().block(stmts));
+                        let body = mk().block_expr(mk().span(end).block(stmts));
                         mk().arm(pats, None as Option<P<Expr>>, body)
                     })
                     .collect();
@@ -409,27 +418,22 @@ impl StructureState {
 
                 let s = comment_store.add_comment(queued_comments.drain(..).collect());
 
-                let then = {
-                    let mut output = vec![];
-                    self.into_stmt(*then, comment_store, queued_comments, &mut output);
-                    output
-                };
+                let (then, then_end) = self.into_block_stmts(*then, comment_store, queued_comments);
+                let (mut els, els_end) = self.into_block_stmts(*els, comment_store, queued_comments);
 
-                let mut els = {
-                    let mut output = vec![];
-                    self.into_stmt(*els, comment_store, queued_comments, &mut output);
-                    output
-                };
+                // A branch with only comments in it is kept for them
+                let then_empty = then.is_empty() && then_end == DUMMY_SP;
+                let els_empty = els.is_empty() && els_end == DUMMY_SP;
 
-                let mut if_stmt = match (then.is_empty(), els.is_empty()) {
+                let mut if_stmt = match (then_empty, els_empty) {
                     (true, true) => mk().semi_stmt(cond),
                     (false, true) => {
-                        let if_expr = mk().ifte_expr(cond, mk().block(then), None as Option<P<Expr>>);
+                        let if_expr = mk().ifte_expr(cond, mk().span(then_end).block(then), None as Option<P<Expr>>);
                         mk().expr_stmt(if_expr)
                     },
                     (true, false) => {
                         let negated_cond = not(&cond);
-                        let if_expr = mk().ifte_expr(negated_cond, mk().block(els), None as Option<P<Expr>>);
+                        let if_expr = mk().ifte_expr(negated_cond, mk().span(els_end).block(els), None as Option<P<Expr>>);
                         mk().expr_stmt(if_expr)
                     },
                     (false, false) => {
@@ -441,7 +445,7 @@ impl StructureState {
                             }
                         }
 
-                        let is_els_expr = els.len() == 1 && is_expr(&els[0].node);
+                        let is_els_expr = els.len() == 1 && is_expr(&els[0].node) && els_end == DUMMY_SP;
 
                         let els_branch = if is_els_expr {
                             match els.swap_remove(0).node {
@@ -449,10 +453,10 @@ impl StructureState {
                                 _ => panic!("is_els_expr out of sync"),
                             }
                         } else {
-                            mk().block_expr(mk().block(els))
+                            mk().block_expr(mk().span(els_end).block(els))
                         };
 
-                        let if_expr = mk().ifte_expr(cond, mk().block(then), Some(els_branch));
+                        let if_expr = mk().ifte_expr(cond, mk().span(then_end).block(then), Some(els_branch));
                         mk().expr_stmt(if_expr)
                     }
                 };
@@ -469,29 +473,21 @@ impl StructureState {
                 let mut arms: Vec<Arm> = cases
                     .into_iter()
                     .map(|(lbl, stmts)| -> Arm {
-                        let stmts = {
-                            let mut output = vec![];
-                            self.into_stmt(stmts, comment_store, queued_comments, &mut output);
-                            output
-                        };
+                        let (stmts, end) = self.into_block_stmts(stmts, comment_store, queued_comments);
 
                         let lbl_expr = if self.debug_labels { lbl.to_string_expr() } else { lbl.to_num_expr() };
                         let pat = mk().lit_pat(lbl_expr);
-                        let body = mk().block_expr(mk().block(stmts));
+                        let body = mk().block_expr(mk().span(end).block(stmts));
                         mk().arm(vec![pat], None as Option<P<Expr>>, body)
                     })
                     .collect();
 
-                let then = {
-                    let mut output = vec![];
-                    self.into_stmt(*then, comment_store, queued_comments, &mut output);
-                    output
-                };
+                let (then, then_end) = self.into_block_stmts(*then, comment_store, queued_comments);
 
                 arms.push(mk().arm(
                     vec![mk().wild_pat()],
                     None as Option<P<Expr>>,
-                    mk().block_expr(mk().block(then))
+                    mk().block_expr(mk().span(then_end).block(then))
                 ));
 
                 let e = mk().match_expr(self.current_block.clone(), arms);
@@ -507,11 +503,7 @@ impl StructureState {
 
                 let s = comment_store.add_comment(queued_comments.drain(..).collect());
 
-                let body = {
-                    let mut output = vec![];
-                    self.into_stmt(*body, comment_store, queued_comments, &mut output);
-                    output
-                };
+                let (body, body_end) = self.into_block_stmts(*body, comment_store, queued_comments);
 
 
                 // TODO: this is ugly but it needn't be. We are just pattern matching on particular ASTs.
@@ -523,7 +515,7 @@ impl StructureState {
                                     if let syntax::ast::ExprKind::Break(None, None) = expr.node {
                                         let e = mk().while_expr(
                                             not(cond),
-                                            mk().block(body.iter().skip(1).cloned().collect()),
+                                            mk().span(body_end).block(body.iter().skip(1).cloned().collect()),
                                             lbl.map(|l| l.pretty_print()),
                                         );
                                         output.push(mk().span(s).expr_stmt(e));
@@ -535,7 +527,7 @@ impl StructureState {
                     }
                 }
 
-                let e = mk().loop_expr(mk().block(body), lbl.map(|l| l.pretty_print()));
+                let e = mk().loop_expr(mk().span(body_end).block(body), lbl.map(|l| l.pretty_print()));
 
                 output.push(mk().span(s).expr_stmt(e));
             },
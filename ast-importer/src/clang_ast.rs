@@ -1,39 +1,37 @@
 use std::collections::HashMap;
-use std::io::Cursor;
-use cbor::Items;
-use cbor::Cbor;
-use cbor::CborBytes;
-use cbor::CborError;
+use std::str;
 use std;
 
 include!(concat!(env!("OUT_DIR"), "/bindings.rs"));
 
 #[derive(Debug,Clone)]
-pub struct AstNode {
+pub struct AstNode<'a> {
     pub tag: ASTEntryTag,
     pub children: Vec<Option<u64>>,
     pub fileid: u64,
     pub line: u64,
     pub column: u64,
     pub type_id: Option<u64>,
-    pub extras: Vec<Cbor>,
+    pub extras: Vec<Value<'a>>,
 }
 
 #[derive(Debug,Clone)]
-pub struct TypeNode {
+pub struct TypeNode<'a> {
     pub tag: TypeTag,
-    pub extras: Vec<Cbor>,
+    pub extras: Vec<Value<'a>>,
 }
 
 #[derive(Debug,Clone)]
-pub struct CommentNode {
+pub struct CommentNode<'a> {
+    pub owner: Option<u64>,
+    pub ends_block: bool,
     pub fileid: u64,
     pub line: u64,
     pub column: u64,
-    pub string: String,
+    pub string: &'a str,
 }
 
-impl TypeNode {
+impl<'a> TypeNode<'a> {
     // Masks used to decode the IDs given to type nodes
     pub const ID_MASK: u64 = !0b111;
     pub const CONST_MASK: u64 = 0b001;
@@ -41,89 +39,255 @@ impl TypeNode {
     pub const VOLATILE_MASK: u64 = 0b100;
 }
 
+/// The untyped AST as exported by the clang plugin. Strings and byte strings in the nodes borrow
+/// from the buffer the AST was decoded from.
 #[derive(Debug, Clone)]
-pub struct AstContext {
-    pub ast_nodes: HashMap<u64, AstNode>,
-    pub type_nodes: HashMap<u64, TypeNode>,
+pub struct AstContext<'a> {
+    pub ast_nodes: HashMap<u64, AstNode<'a>>,
+    pub type_nodes: HashMap<u64, TypeNode<'a>>,
     pub top_nodes: Vec<u64>,
-    pub comments: Vec<CommentNode>,
+    pub files: Vec<&'a str>,
+    pub comments: Vec<CommentNode<'a>>,
 }
 
 #[derive(Debug)]
 pub enum DecodeError {
-    DecodeCborError(CborError),
+    UnexpectedEof,
+    InvalidUtf8,
+    UnsupportedItem(u8),
     TypeMismatch,
 }
 
-pub fn expect_vec8(val: &Cbor) -> Result<&Vec<u8>, DecodeError> {
+/// A CBOR data item. Text and byte strings are slices of the input rather than copies.
+#[derive(Debug, Clone, PartialEq)]
+pub enum Value<'a> {
+    Unsigned(u64),
+    Signed(i64),
+    Float(f64),
+    Bool(bool),
+    Null,
+    Bytes(&'a [u8]),
+    Text(&'a str),
+    Array(Vec<Value<'a>>),
+}
+
+/// Decodes CBOR items one at a time from a byte buffer, typically a memory mapping of the
+/// exporter's output. Only the subset of CBOR the exporter produces is supported.
+pub struct Decoder<'a> {
+    input: &'a [u8],
+    pos: usize,
+}
+
+const BREAK: u8 = 0xff;
+
+impl<'a> Decoder<'a> {
+    pub fn new(input: &'a [u8]) -> Decoder<'a> {
+        Decoder { input, pos: 0 }
+    }
+
+    fn take(&mut self, len: usize) -> Result<&'a [u8], DecodeError> {
+        if self.input.len() - self.pos < len {
+            return Err(DecodeError::UnexpectedEof)
+        }
+        let bytes = &self.input[self.pos..self.pos + len];
+        self.pos += len;
+        Ok(bytes)
+    }
+
+    fn peek(&self) -> Result<u8, DecodeError> {
+        self.input.get(self.pos).cloned().ok_or(DecodeError::UnexpectedEof)
+    }
+
+    /// Read the big-endian argument that follows an initial byte
+    fn argument(&mut self, initial: u8) -> Result<u64, DecodeError> {
+        let len = match initial & 0x1f {
+            info @ 0...23 => return Ok(info as u64),
+            24 => 1,
+            25 => 2,
+            26 => 4,
+            27 => 8,
+            _ => return Err(DecodeError::UnsupportedItem(initial)),
+        };
+        Ok(self.take(len)?.iter().fold(0, |acc, &b| acc << 8 | b as u64))
+    }
+
+    /// Start reading an array, returning the number of elements if it has a definite length
+    pub fn array(&mut self) -> Result<Option<u64>, DecodeError> {
+        let initial = self.take(1)?[0];
+        match initial {
+            0x9f => Ok(None),
+            _ if initial >> 5 == 4 => Ok(Some(self.argument(initial)?)),
+            _ => Err(DecodeError::TypeMismatch),
+        }
+    }
+
+    /// Check whether the array being read has another element, consuming the break marker at the
+    /// end of an indefinite-length array.
+    pub fn has_next(&mut self, remaining: &mut Option<u64>) -> Result<bool, DecodeError> {
+        match *remaining {
+            Some(0) => Ok(false),
+            Some(ref mut n) => {
+                *n -= 1;
+                Ok(true)
+            }
+            None if self.peek()? == BREAK => {
+                self.pos += 1;
+                Ok(false)
+            }
+            None => Ok(true),
+        }
+    }
+
+    /// Read the next element of the array being read
+    pub fn element(&mut self, remaining: &mut Option<u64>) -> Result<Value<'a>, DecodeError> {
+        if self.has_next(remaining)? {
+            self.value()
+        } else {
+            Err(DecodeError::TypeMismatch)
+        }
+    }
+
+    /// Read all the remaining elements of the array being read
+    pub fn elements(&mut self, remaining: &mut Option<u64>) -> Result<Vec<Value<'a>>, DecodeError> {
+        let mut values = match *remaining {
+            Some(n) => Vec::with_capacity(n as usize),
+            None => vec![],
+        };
+        while self.has_next(remaining)? {
+            values.push(self.value()?);
+        }
+        Ok(values)
+    }
+
+    /// Read one complete data item
+    pub fn value(&mut self) -> Result<Value<'a>, DecodeError> {
+        let initial = self.peek()?;
+        match initial >> 5 {
+            0 => {
+                self.pos += 1;
+                Ok(Value::Unsigned(self.argument(initial)?))
+            }
+            1 => {
+                self.pos += 1;
+                let arg = self.argument(initial)?;
+                if arg > i64::max_value() as u64 {
+                    return Err(DecodeError::UnsupportedItem(initial))
+                }
+                Ok(Value::Signed(-1 - arg as i64))
+            }
+            2 if initial & 0x1f != 31 => {
+                self.pos += 1;
+                let len = self.argument(initial)? as usize;
+                Ok(Value::Bytes(self.take(len)?))
+            }
+            3 if initial & 0x1f != 31 => {
+                self.pos += 1;
+                let len = self.argument(initial)? as usize;
+                let bytes = self.take(len)?;
+                str::from_utf8(bytes).map(Value::Text).map_err(|_| DecodeError::InvalidUtf8)
+            }
+            4 => {
+                let mut remaining = self.array()?;
+                Ok(Value::Array(self.elements(&mut remaining)?))
+            }
+            7 => {
+                self.pos += 1;
+                match initial & 0x1f {
+                    20 => Ok(Value::Bool(false)),
+                    21 => Ok(Value::Bool(true)),
+                    22 | 23 => Ok(Value::Null),
+                    25 => Ok(Value::Float(half_to_f64(self.argument(initial)? as u16))),
+                    26 => Ok(Value::Float(f32::from_bits(self.argument(initial)? as u32) as f64)),
+                    27 => Ok(Value::Float(f64::from_bits(self.argument(initial)?))),
+                    _ => Err(DecodeError::UnsupportedItem(initial)),
+                }
+            }
+            _ => Err(DecodeError::UnsupportedItem(initial)),
+        }
+    }
+}
+
+fn half_to_f64(bits: u16) -> f64 {
+    let exponent = (bits >> 10) & 0x1f;
+    let mantissa = (bits & 0x3ff) as f64;
+    let magnitude = match exponent {
+        0 => mantissa * 2f64.powi(-24),
+        31 if mantissa == 0.0 => std::f64::INFINITY,
+        31 => std::f64::NAN,
+        _ => (mantissa + 1024.0) * 2f64.powi(exponent as i32 - 25),
+    };
+    if bits & 0x8000 != 0 { -magnitude } else { magnitude }
+}
+
+pub fn expect_bytes<'a>(val: &Value<'a>) -> Result<&'a [u8], DecodeError> {
     match val {
-        &Cbor::Bytes(CborBytes(ref bytes)) => Ok(bytes),
+        &Value::Bytes(bytes) => Ok(bytes),
         _ => Err(DecodeError::TypeMismatch),
     }
 }
 
-pub fn expect_array(val: &Cbor) -> Result<&Vec<Cbor>, DecodeError> {
+pub fn expect_array<'a, 'b>(val: &'b Value<'a>) -> Result<&'b [Value<'a>], DecodeError> {
     match val {
-        &Cbor::Array(ref xs) => Ok(xs),
+        &Value::Array(ref xs) => Ok(xs),
         _ => Err(DecodeError::TypeMismatch)
     }
 }
 
-pub fn expect_string(val: &Cbor) -> Result<String, DecodeError> {
+pub fn expect_string(val: &Value) -> Result<String, DecodeError> {
     match val {
-        &Cbor::Unicode(ref xs) => Ok(xs.clone()),
+        &Value::Text(s) => Ok(s.to_owned()),
         _ => Err(DecodeError::TypeMismatch)
     }
 }
 
-pub fn expect_u64(val: &Cbor) -> Result<u64, DecodeError> {
+pub fn expect_u64(val: &Value) -> Result<u64, DecodeError> {
     match val {
-        &Cbor::Unsigned(x) => Ok(x.into_u64()),
+        &Value::Unsigned(x) => Ok(x),
         _ => { Err(DecodeError::TypeMismatch) }
     }
 }
 
-pub fn expect_i64(val: &Cbor) -> Result<i64, DecodeError> {
+pub fn expect_i64(val: &Value) -> Result<i64, DecodeError> {
     match val {
-        &Cbor::Unsigned(x) => Ok(x.into_u64() as i64),
-        &Cbor::Signed(x) => Ok(x.into_i64()),
+        &Value::Unsigned(x) => Ok(x as i64),
+        &Value::Signed(x) => Ok(x),
         _ => { Err(DecodeError::TypeMismatch) }
     }
 }
 
-pub fn expect_f64(val: &Cbor) -> Result<f64, DecodeError> {
+pub fn expect_f64(val: &Value) -> Result<f64, DecodeError> {
     match val {
-        &Cbor::Float(x) => Ok(x.into_f64()),
+        &Value::Float(x) => Ok(x),
         _ => { Err(DecodeError::TypeMismatch) }
     }
 }
 
-pub fn expect_str(val: &Cbor) -> Result<&str, DecodeError> {
+pub fn expect_str<'a>(val: &Value<'a>) -> Result<&'a str, DecodeError> {
     match val {
-        &Cbor::Unicode(ref s) => Ok(s),
+        &Value::Text(s) => Ok(s),
         _ => { Err(DecodeError::TypeMismatch) }
     }
 }
 
-pub fn expect_opt_str(val: &Cbor) -> Result<Option<&str>, DecodeError> {
+pub fn expect_opt_str<'a>(val: &Value<'a>) -> Result<Option<&'a str>, DecodeError> {
     match val {
-        &Cbor::Null => Ok(None),
-        &Cbor::Unicode(ref s) => Ok(Some(s)),
+        &Value::Null => Ok(None),
+        &Value::Text(s) => Ok(Some(s)),
         _ => { Err(DecodeError::TypeMismatch) }
     }
 }
 
-pub fn expect_bool(val: &Cbor) -> Result<bool, DecodeError> {
+pub fn expect_bool(val: &Value) -> Result<bool, DecodeError> {
     match val {
-        &Cbor::Bool(b) => Ok(b),
+        &Value::Bool(b) => Ok(b),
         _ => { Err(DecodeError::TypeMismatch) }
     }
 }
 
-pub fn expect_opt_u64(val: &Cbor) -> Result<Option<u64>, DecodeError> {
+pub fn expect_opt_u64(val: &Value) -> Result<Option<u64>, DecodeError> {
     match val {
-        &Cbor::Null => Ok(None),
-        &Cbor::Unsigned(x) => Ok(Some(x.into_u64())),
+        &Value::Null => Ok(None),
+        &Value::Unsigned(x) => Ok(Some(x)),
         _ => { Err(DecodeError::TypeMismatch) }
     }
 }
@@ -140,81 +304,228 @@ fn import_type_tag(tag: u64) -> TypeTag {
     }
 }
 
-pub fn process(items: Items<Cursor<Vec<u8>>>) -> Result<AstContext, DecodeError> {
+/// Decode one entry of the all-nodes array straight into an `AstNode` or `TypeNode`
+fn process_entry<'a>(
+    decoder: &mut Decoder<'a>,
+    asts: &mut HashMap<u64, AstNode<'a>>,
+    types: &mut HashMap<u64, TypeNode<'a>>,
+) -> Result<(), DecodeError> {
+    let mut remaining = decoder.array()?;
+    let entry_id = expect_u64(&decoder.element(&mut remaining)?)?;
+    let tag = expect_u64(&decoder.element(&mut remaining)?)?;
+
+    if tag < 400 {
+
+        let children =
+            expect_array(&decoder.element(&mut remaining)?)?
+                .iter()
+                .map(expect_opt_u64)
+                .collect::<Result<Vec<Option<u64>>,DecodeError>>()?;
+
+        let fileid = expect_u64(&decoder.element(&mut remaining)?)?;
+        let line = expect_u64(&decoder.element(&mut remaining)?)?;
+        let column = expect_u64(&decoder.element(&mut remaining)?)?;
+        let type_id: Option<u64> = expect_opt_u64(&decoder.element(&mut remaining)?)?;
+
+        let node = AstNode {
+            tag: import_ast_tag(tag),
+            children,
+            fileid,
+            line,
+            column,
+            type_id,
+            extras: decoder.elements(&mut remaining)?,
+        };
 
+        asts.insert(entry_id, node);
+    } else {
+        let node = TypeNode {
+            tag: import_type_tag(tag),
+            extras: decoder.elements(&mut remaining)?,
+        };
+
+        types.insert(entry_id, node);
+    }
+    Ok(())
+}
+
+/// Decode the exporter's output. Node entries are decoded one at a time, so no intermediate copy
+/// of the whole tree is ever built, and strings are borrowed from `input`.
+pub fn process<'a>(input: &'a [u8]) -> Result<AstContext<'a>, DecodeError> {
+
+    let mut decoder = Decoder::new(input);
     let mut asts: HashMap<u64, AstNode> = HashMap::new();
     let mut types: HashMap<u64, TypeNode> = HashMap::new();
     let mut comments: Vec<CommentNode> = vec![];
 
-    let mut top_cbors : Vec<Cbor> = vec![];
-    for item in items {
-        top_cbors.push(item.unwrap());
+    // 1 - All nodes
+    let mut remaining = decoder.array()?;
+    while decoder.has_next(&mut remaining)? {
+        process_entry(&mut decoder, &mut asts, &mut types)?;
     }
 
-    let raw_comments = top_cbors.remove(3);
-    let raw_comments = expect_array(&raw_comments).expect("Bad comment array");
-
-    let filenames = top_cbors.remove(2);
-    let _filenames = expect_array(&filenames).expect("Bad filename array");
-
-    let top_nodes = top_cbors.remove(1);
-    let top_nodes = expect_array(&top_nodes).expect("Bad all nodes array");
+    // 2 - Top-level declarations
+    let top_nodes = decoder.value()?;
+    let top_nodes = expect_array(&top_nodes).expect("Bad top nodes array");
     let top_nodes : Vec<u64> = top_nodes.iter().map(|x| expect_u64(x).expect("top node list must contain node ids")).collect();
 
-    let all_nodes = top_cbors.remove(0);
-    let all_nodes = expect_array(&all_nodes).expect("Bad top nodes array");
+    // 3 - Filenames
+    let filenames = decoder.value()?;
+    let filenames = expect_array(&filenames).expect("Bad filename array");
+    let files = filenames.iter().map(expect_str).collect::<Result<Vec<_>, _>>()?;
 
-
-    for x in raw_comments {
-        let entry = expect_array(x).expect("comment entry should be array");
+    // 4 - Comments
+    let mut remaining = decoder.array()?;
+    while decoder.has_next(&mut remaining)? {
+        let entry = decoder.value()?;
+        let entry = expect_array(&entry).expect("comment entry should be array");
         let node = CommentNode {
-            fileid: expect_u64(&entry[0])?,
-            line: expect_u64(&entry[1])?,
-            column: expect_u64(&entry[2])?,
-            string: expect_string(&entry[3])?,
+            owner: expect_opt_u64(&entry[0])?,
+            ends_block: expect_bool(&entry[1])?,
+            fileid: expect_u64(&entry[2])?,
+            line: expect_u64(&entry[3])?,
+            column: expect_u64(&entry[4])?,
+            string: expect_str(&entry[5])?,
         };
         comments.push(node)
     }
 
-    for x in all_nodes {
-        let entry = expect_array(x).expect("All nodes entry not array");
-        let entry_id = expect_u64(&entry[0])?;
-        let tag = expect_u64(&entry[1])?;
+    Ok(AstContext {
+        top_nodes,
+        ast_nodes: asts,
+        type_nodes: types,
+        files,
+        comments,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
 
-        if tag < 400 {
+    fn decode(input: &[u8]) -> Result<Value, DecodeError> {
+        Decoder::new(input).value()
+    }
 
-            let children =
-                expect_array(&entry[2])?
-                    .iter()
-                    .map(expect_opt_u64)
-                    .collect::<Result<Vec<Option<u64>>,DecodeError>>()?;
+    fn assert_eof<T: std::fmt::Debug>(result: Result<T, DecodeError>) {
+        match result {
+            Err(DecodeError::UnexpectedEof) => {}
+            other => panic!("expected UnexpectedEof, got {:?}", other),
+        }
+    }
 
-            let type_id: Option<u64> = expect_opt_u64(&entry[6])?;
+    #[test]
+    fn scalars() {
+        assert_eq!(decode(&[0x17]).unwrap(), Value::Unsigned(23));
+        assert_eq!(decode(&[0x19, 0x01, 0x00]).unwrap(), Value::Unsigned(256));
+        assert_eq!(decode(&[0x38, 0x63]).unwrap(), Value::Signed(-100));
+        assert_eq!(decode(&[0xf9, 0x3c, 0x00]).unwrap(), Value::Float(1.0));
+        assert_eq!(decode(&[0xfb, 0x3f, 0xf8, 0, 0, 0, 0, 0, 0]).unwrap(), Value::Float(1.5));
+        assert_eq!(decode(&[0xf5]).unwrap(), Value::Bool(true));
+        assert_eq!(decode(&[0xf6]).unwrap(), Value::Null);
+
+        // Strings borrow from the input
+        let input = [0x63, b'a', b'b', b'c'];
+        match decode(&input).unwrap() {
+            Value::Text(text) => {
+                assert_eq!(text, "abc");
+                assert_eq!(text.as_ptr(), input[1..].as_ptr());
+            }
+            other => panic!("expected text, got {:?}", other),
+        }
+        match decode(&[0x62, 0xc3, 0x28]) {
+            Err(DecodeError::InvalidUtf8) => {}
+            other => panic!("expected InvalidUtf8, got {:?}", other),
+        }
+    }
 
-            let node = AstNode {
-                tag: import_ast_tag(tag),
-                children,
-                fileid: expect_u64(&entry[3])?,
-                line: expect_u64(&entry[4])?,
-                column: expect_u64(&entry[5])?,
-                type_id,
-                extras: entry[7..].to_vec(),
-            };
+    #[test]
+    fn truncated() {
+        assert_eof(decode(&[]));
+        assert_eof(decode(&[0x19, 0x01]));
+        assert_eof(decode(&[0x65, b'a', b'b']));
+        assert_eof(decode(&[0x82, 0x01]));
+        assert_eof(decode(&[0x9f, 0x01, 0x02]));
+
+        let mut decoder = Decoder::new(&[0x9f, 0x01]);
+        let mut remaining = decoder.array().unwrap();
+        assert_eq!(decoder.element(&mut remaining).unwrap(), Value::Unsigned(1));
+        assert_eof(decoder.has_next(&mut remaining));
+    }
 
-            asts.insert(entry_id, node);
-        } else {
-            let node = TypeNode {
-                tag: import_type_tag(tag),
-                extras: entry[2..].to_vec(),
-            };
+    #[test]
+    fn nested_arrays() {
+        // [1, [2, [3]], []]
+        let input = [0x83, 0x01, 0x82, 0x02, 0x81, 0x03, 0x80];
+        let expected = Value::Array(vec![
+            Value::Unsigned(1),
+            Value::Array(vec![Value::Unsigned(2), Value::Array(vec![Value::Unsigned(3)])]),
+            Value::Array(vec![]),
+        ]);
+        assert_eq!(decode(&input).unwrap(), expected);
+
+        // Reading the outer array one element at a time
+        let mut decoder = Decoder::new(&input);
+        let mut remaining = decoder.array().unwrap();
+        assert_eq!(remaining, Some(3));
+        assert_eq!(decoder.element(&mut remaining).unwrap(), Value::Unsigned(1));
+        assert_eq!(decoder.elements(&mut remaining).unwrap(), match expected {
+            Value::Array(ref elements) => elements[1..].to_vec(),
+            _ => unreachable!(),
+        });
+        match decoder.element(&mut remaining) {
+            Err(DecodeError::TypeMismatch) => {}
+            other => panic!("expected TypeMismatch past the end, got {:?}", other),
+        }
+    }
 
-            types.insert(entry_id, node);
+    #[test]
+    fn indefinite_lengths() {
+        // [_ 1, [_ 2, [3]], [_ ]]
+        let input = [0x9f, 0x01, 0x9f, 0x02, 0x81, 0x03, 0xff, 0x9f, 0xff, 0xff, 0x04];
+        let mut decoder = Decoder::new(&input);
+        let mut remaining = decoder.array().unwrap();
+        assert_eq!(remaining, None);
+        assert_eq!(decoder.element(&mut remaining).unwrap(), Value::Unsigned(1));
+        assert_eq!(
+            decoder.element(&mut remaining).unwrap(),
+            Value::Array(vec![Value::Unsigned(2), Value::Array(vec![Value::Unsigned(3)])])
+        );
+        assert_eq!(decoder.element(&mut remaining).unwrap(), Value::Array(vec![]));
+        assert!(!decoder.has_next(&mut remaining).unwrap());
+
+        // The break marker was consumed along with the array
+        assert_eq!(decoder.value().unwrap(), Value::Unsigned(4));
+
+        // Indefinite-length strings are never exported
+        match decode(&[0x7f, 0x61, b'a', 0xff]) {
+            Err(DecodeError::UnsupportedItem(0x7f)) => {}
+            other => panic!("expected UnsupportedItem, got {:?}", other),
         }
     }
-    Ok(AstContext {
-        top_nodes,
-        ast_nodes: asts,
-        type_nodes: types,
-        comments,
-    })
+
+    #[test]
+    fn empty_ast() {
+        // No nodes, no top-level declarations, one file and no comments
+        let input = [0x80, 0x9f, 0xff, 0x81, 0x63, b'a', b'.', b'c', 0x80];
+        let context = process(&input).unwrap();
+        assert!(context.ast_nodes.is_empty() && context.type_nodes.is_empty());
+        assert!(context.top_nodes.is_empty() && context.comments.is_empty());
+        assert_eq!(context.files, vec!["a.c"]);
+    }
+
+    #[test]
+    fn comments() {
+        // A top-level comment at 1:1 and a comment ending the block with ID 5 at 3:5
+        let input = [
+            0x80, 0x9f, 0xff, 0x81, 0x63, b'a', b'.', b'c', 0x82,
+            0x86, 0xf6, 0xf4, 0x00, 0x01, 0x01, 0x62, b'/', b'/',
+            0x86, 0x05, 0xf5, 0x00, 0x03, 0x05, 0x64, b'/', b'*', b'*', b'/',
+        ];
+        let context = process(&input).unwrap();
+        let comments: Vec<_> = context.comments.iter()
+            .map(|c| (c.owner, c.ends_block, c.fileid, c.line, c.column, c.string))
+            .collect();
+        assert_eq!(comments, vec![(None, false, 0, 1, 1, "//"), (Some(5), true, 0, 3, 5, "/**/")]);
+    }
 }
@@ -3,6 +3,15 @@ use syntax_pos::hygiene::SyntaxContext;
 use syntax::codemap::{DUMMY_SP, Span};
 use syntax::parse::lexer::comments;
 
+/// Keep C comments that look like Rust doc comments from turning into ones
+pub fn non_doc_comment(mut comment: String) -> String {
+    if comment.starts_with("//!") || comment.starts_with("///") ||
+        comment.starts_with("/**") || comment.starts_with("/*!") {
+        comment.insert(2,' ');
+    }
+    comment
+}
+
 ///
 pub struct CommentStore {
     output_comments: Vec<comments::Comment>,
@@ -28,13 +37,7 @@ impl CommentStore {
     pub fn add_comment(&mut self, lines: Vec<String>) -> Span {
         let lines: Vec<String> = lines
             .into_iter()
-            .map(|mut comment| {
-                if comment.starts_with("//!") || comment.starts_with("///") ||
-                    comment.starts_with("/**") || comment.starts_with("/*!") {
-                    comment.insert(2,' ');
-                }
-                comment
-            })
+            .map(non_doc_comment)
             .collect();
 
         if lines.is_empty() {
@@ -52,4 +55,12 @@ impl CommentStore {
             Span::new(BytePos(self.span_source), BytePos(self.span_source), SyntaxContext::empty())
         }
     }
+
+    /// Add a `Comment` at the current position, then return the `Span` that should be given to a
+    /// block for the comment to be printed right before its closing brace. The block starts at
+    /// position 0 so that the comments of its statements are still printed along with them.
+    pub fn add_closing_comment(&mut self, lines: Vec<String>) -> Span {
+        let span = self.add_comment(lines);
+        Span::new(BytePos(0), span.hi(), SyntaxContext::empty())
+    }
 }
\ No newline at end of file
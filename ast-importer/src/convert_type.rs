@@ -5,12 +5,47 @@ use syntax::ptr::P;
 use std::ops::Index;
 use renamer::*;
 use std::collections::{HashSet,HashMap};
+use std::mem;
 use c_ast::CDeclId;
 
 pub struct TypeConverter {
     renamer: Renamer<CDeclId>,
     fields: HashMap<CDeclId, Renamer<CFieldId>>,
     features: HashSet<&'static str>,
+
+    /// Types already converted, along with the features their conversion needs. The names of
+    /// declarations never change once declared, so neither do converted types.
+    converted: HashMap<CTypeId, (P<Ty>, Vec<&'static str>)>,
+    converted_pointers: HashMap<CQualTypeId, (P<Ty>, Vec<&'static str>)>,
+    stats: ConversionStats,
+}
+
+/// How often a type conversion was answered from the memo tables of a `TypeConverter`
+#[derive(Debug, Default, Copy, Clone)]
+pub struct ConversionStats {
+    pub hits: u64,
+    pub misses: u64,
+}
+
+impl ConversionStats {
+    pub fn add(&mut self, other: ConversionStats) {
+        self.hits += other.hits;
+        self.misses += other.misses;
+    }
+
+    /// The conversions counted since `earlier`, a snapshot of the same stats
+    pub fn since(&self, earlier: ConversionStats) -> ConversionStats {
+        ConversionStats {
+            hits: self.hits - earlier.hits,
+            misses: self.misses - earlier.misses,
+        }
+    }
+
+    /// Percentage of conversions that were memo table hits
+    pub fn hit_rate(&self) -> f64 {
+        let total = self.hits + self.misses;
+        if total == 0 { 0.0 } else { 100.0 * self.hits as f64 / total as f64 }
+    }
 }
 
 static RESERVED_NAMES: [&str; 100] = [
@@ -52,13 +87,25 @@ impl TypeConverter {
             renamer: Renamer::new(&RESERVED_NAMES),
             fields: HashMap::new(),
             features: HashSet::new(),
+            converted: HashMap::new(),
+            converted_pointers: HashMap::new(),
+            stats: ConversionStats::default(),
         }
     }
 
+    pub fn conversion_stats(&self) -> ConversionStats {
+        self.stats
+    }
+
     pub fn features_used(&self) -> &HashSet<&'static str> {
         &self.features
     }
 
+    /// Swap out the set of features used so far, e.g. to find the ones a single function needs
+    pub fn replace_features(&mut self, features: HashSet<&'static str>) -> HashSet<&'static str> {
+        mem::replace(&mut self.features, features)
+    }
+
     pub fn declare_decl_name(&mut self, decl_id: CDeclId, name: &str) -> String {
         self.renamer.insert(decl_id, name).expect("Name already assigned")
     }
@@ -117,7 +164,26 @@ impl TypeConverter {
         return Ok(mk().unsafe_().abi("C").barefn_ty(fn_ty));
     }
 
+    /// Convert a pointer to `qtype`, reusing the result of earlier conversions of the same type.
     pub fn convert_pointer(&mut self, ctxt: &TypedAstContext, qtype: CQualTypeId) -> Result<P<Ty>, String> {
+        if let Some(&(ref ty, ref features)) = self.converted_pointers.get(&qtype) {
+            self.stats.hits += 1;
+            self.features.extend(features);
+            return Ok(ty.clone())
+        }
+        self.stats.misses += 1;
+
+        let outer_features = mem::replace(&mut self.features, HashSet::new());
+        let result = self.convert_pointer_uncached(ctxt, qtype);
+        let features = mem::replace(&mut self.features, outer_features);
+        self.features.extend(&features);
+
+        let ty = result?;
+        self.converted_pointers.insert(qtype, (ty.clone(), features.into_iter().collect()));
+        Ok(ty)
+    }
+
+    fn convert_pointer_uncached(&mut self, ctxt: &TypedAstContext, qtype: CQualTypeId) -> Result<P<Ty>, String> {
         match ctxt.resolve_type(qtype.ctype).kind {
 
             // While void converts to () in function returns, it converts to c_void
@@ -155,8 +221,27 @@ impl TypeConverter {
     }
 
     /// Convert a `C` type to a `Rust` one. For the moment, these are expected to have compatible
-    /// memory layouts.
+    /// memory layouts. Each type is only built once; later conversions return a copy.
     pub fn convert(&mut self, ctxt: &TypedAstContext, ctype: CTypeId) -> Result<P<Ty>, String> {
+        if let Some(&(ref ty, ref features)) = self.converted.get(&ctype) {
+            self.stats.hits += 1;
+            self.features.extend(features);
+            return Ok(ty.clone())
+        }
+        self.stats.misses += 1;
+
+        // Record the features this type needs on its own, so that hits add them back
+        let outer_features = mem::replace(&mut self.features, HashSet::new());
+        let result = self.convert_uncached(ctxt, ctype);
+        let features = mem::replace(&mut self.features, outer_features);
+        self.features.extend(&features);
+
+        let ty = result?;
+        self.converted.insert(ctype, (ty.clone(), features.into_iter().collect()));
+        Ok(ty)
+    }
+
+    fn convert_uncached(&mut self, ctxt: &TypedAstContext, ctype: CTypeId) -> Result<P<Ty>, String> {
 
         match ctxt.index(ctype).kind {
             CTypeKind::Void => Ok(mk().tuple_ty(vec![] as Vec<P<Ty>>)),
@@ -240,7 +325,33 @@ impl TypeConverter {
 
             CTypeKind::TypeOf(ty) => self.convert(ctxt, ty),
 
+            CTypeKind::Vector(elt, count) => self.convert_vector(ctxt, elt.ctype, count),
+
             ref t => Err(format!("Unsupported type {:?}", t)),
         }
     }
+
+    /// GCC vector types are translated to the `std::arch::x86_64` SIMD type with the same total
+    /// width and element category, which is how the `<immintrin.h>` typedefs are laid out.
+    pub fn convert_vector(&mut self, ctxt: &TypedAstContext, elt: CTypeId, count: usize) -> Result<P<Ty>, String> {
+        let (elt_size, suffix) = match ctxt.resolve_type(elt).kind {
+            CTypeKind::Float => (4, ""),
+            CTypeKind::Double => (8, "d"),
+            CTypeKind::Char | CTypeKind::SChar | CTypeKind::UChar => (1, "i"),
+            CTypeKind::Short | CTypeKind::UShort => (2, "i"),
+            CTypeKind::Int | CTypeKind::UInt => (4, "i"),
+            CTypeKind::Long | CTypeKind::ULong |
+            CTypeKind::LongLong | CTypeKind::ULongLong => (8, "i"),
+            ref t => return Err(format!("Unsupported vector element type {:?}", t)),
+        };
+
+        let name = match (elt_size * count * 8, suffix) {
+            (64, "i") => "__m64".to_owned(),
+            (128, _) => format!("__m128{}", suffix),
+            (256, _) => format!("__m256{}", suffix),
+            (bits, _) => return Err(format!("Unsupported {}-bit vector type", bits)),
+        };
+
+        Ok(mk().path_ty(mk().path(vec!["", "std", "arch", "x86_64", name.as_str()])))
+    }
 }
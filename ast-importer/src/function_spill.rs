@@ -0,0 +1,81 @@
+//! Temporary file holding printed function definitions until the output reaches them. The
+//! feature attributes at the top of the crate depend on every function, so functions can't be
+//! written out as they are translated; keeping them on disk rather than in memory means peak
+//! memory doesn't grow with the size of the translated crate.
+
+use std::env;
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, Read, Seek, SeekFrom, Write};
+use std::process;
+use std::sync::Mutex;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// Numbers the spill files of this process
+static NEXT_SPILL: AtomicUsize = AtomicUsize::new(0);
+
+/// Where an item was written in the spill file
+#[derive(Debug, Copy, Clone)]
+pub struct SpilledItem {
+    offset: u64,
+    len: usize,
+}
+
+/// Append-only file of printed items, shared by the function translation threads
+#[derive(Debug)]
+pub struct FunctionSpill {
+    // The file and its length
+    file: Mutex<(File, u64)>,
+}
+
+impl FunctionSpill {
+    /// Create the spill file in the system's temporary directory. It is removed right away, so it
+    /// goes away with the process even if translation fails.
+    pub fn new() -> io::Result<FunctionSpill> {
+        let path = env::temp_dir().join(format!(
+            "c2rust-functions-{}-{}",
+            process::id(),
+            NEXT_SPILL.fetch_add(1, Ordering::SeqCst),
+        ));
+        let file = OpenOptions::new().read(true).write(true).create_new(true).open(&path)?;
+        // Open files can't be removed on Windows, where the file is left behind instead
+        let _ = fs::remove_file(&path);
+        Ok(FunctionSpill { file: Mutex::new((file, 0)) })
+    }
+
+    /// Write an item at the end of the file
+    pub fn push(&self, item: &str) -> io::Result<SpilledItem> {
+        let mut guard = self.file.lock().unwrap();
+        let (ref mut file, ref mut end) = *guard;
+        let offset = *end;
+        file.seek(SeekFrom::Start(offset))?;
+        file.write_all(item.as_bytes())?;
+        *end += item.len() as u64;
+        Ok(SpilledItem { offset, len: item.len() })
+    }
+
+    /// Read an item back
+    pub fn read(&self, item: SpilledItem) -> io::Result<String> {
+        let mut guard = self.file.lock().unwrap();
+        let (ref mut file, _) = *guard;
+        let mut bytes = vec![0; item.len];
+        file.seek(SeekFrom::Start(item.offset))?;
+        file.read_exact(&mut bytes)?;
+        String::from_utf8(bytes).map_err(|e| io::Error::new(io::ErrorKind::InvalidData, e))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_read_back() {
+        let spill = FunctionSpill::new().expect("failed to create the spill file");
+        let f = spill.push("fn f() {}").unwrap();
+        let g = spill.push("fn g() -> char { 'é' }").unwrap();
+        assert_eq!(spill.read(g).unwrap(), "fn g() -> char { 'é' }");
+        assert_eq!(spill.read(f).unwrap(), "fn f() {}");
+        let h = spill.push("").unwrap();
+        assert_eq!(spill.read(h).unwrap(), "");
+    }
+}
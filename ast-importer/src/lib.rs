@@ -1,5 +1,4 @@
 #![feature(rustc_private)]
-extern crate cbor;
 extern crate syntax;
 extern crate syntax_pos;
 extern crate rustc_target;
@@ -14,10 +13,14 @@ pub mod convert_type;
 pub mod loops;
 pub mod comment_store;
 pub mod translator;
+pub mod translation_cache;
+pub mod function_spill;
+pub mod timing;
 pub mod c_ast;
 pub mod rust_ast;
 pub mod cfg;
 pub mod with_stmts;
+pub mod simd_intrinsics;
 
 #[cfg(test)]
 mod tests {
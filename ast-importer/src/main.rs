@@ -1,19 +1,25 @@
 #[macro_use]
 extern crate clap;
-extern crate cbor;
 extern crate ast_importer;
+extern crate memmap;
 
-use std::io::{Error, stdout, Cursor};
-use std::io::prelude::*;
+use std::io::{BufWriter, Error, ErrorKind, Write, stderr, stdout};
 use std::fs::File;
-use cbor::Decoder;
+use memmap::Mmap;
 use ast_importer::clang_ast::process;
 use ast_importer::c_ast::*;
 use ast_importer::c_ast::Printer;
-use ast_importer::clang_ast::AstContext;
 use ast_importer::translator::{ReplaceMode,TranslationConfig};
+#[cfg(feature = "alloc-stats")]
+use ast_importer::timing::CountingAlloc;
+use ast_importer::timing::{Pass, PassTimer};
 use clap::{Arg, App};
 
+// Counts allocations for `--time-passes`
+#[cfg(feature = "alloc-stats")]
+#[global_allocator]
+static ALLOCATOR: CountingAlloc = CountingAlloc;
+
 fn main() {
 
     let matches = App::new("AST Importer")
@@ -98,6 +104,16 @@ fn main() {
             .long("ddebug-labels")
             .help("Generate readable 'current_block' values in relooper")
             .takes_value(false))
+        .arg(Arg::with_name("large-cfg-threshold")
+            .long("large-cfg-threshold")
+            .value_name("BLOCKS")
+            .help("Reloop CFGs with more basic blocks than this using dominator and loop-nesting trees")
+            .takes_value(true)
+            .default_value("1000"))
+        .arg(Arg::with_name("fail-on-dominator-fallback")
+            .long("fail-on-dominator-fallback")
+            .help("Fail to translate if relooping a large CFG using dominators ever fails")
+            .takes_value(false))
 
         // Cross-check related
         .arg(Arg::with_name("cross-checks")
@@ -129,6 +145,40 @@ fn main() {
              .long("fail-on-error")
              .help("Fail to translate a module when a portion is not able to be translated")
              .takes_value(false))
+        .arg(Arg::with_name("jobs")
+             .long("jobs")
+             .help("Number of threads translating function definitions; the output doesn't depend on it")
+             .takes_value(true)
+             .default_value("1"))
+        .arg(Arg::with_name("translation-cache")
+             .long("translation-cache")
+             .value_name("DIR")
+             .help("Directory caching translated function definitions between runs")
+             .takes_value(true))
+        .arg(Arg::with_name("output")
+             .long("output")
+             .value_name("FILE")
+             .help("Write the translated Rust code to FILE instead of stdout")
+             .takes_value(true))
+        .arg(Arg::with_name("time-passes")
+             .long("time-passes")
+             .help("Report the time and allocations of each pass, the total time and peak RSS, and the slowest functions")
+             .takes_value(false))
+        .arg(Arg::with_name("time-passes-trace")
+             .long("time-passes-trace")
+             .value_name("FILE")
+             .help("Write the passes timed by --time-passes to FILE as Chrome trace events")
+             .takes_value(true))
+        .arg(Arg::with_name("time-passes-top")
+             .long("time-passes-top")
+             .value_name("N")
+             .help("Number of slowest functions listed by --time-passes")
+             .takes_value(true)
+             .default_value("10"))
+        .arg(Arg::with_name("type-conversion-stats")
+             .long("type-conversion-stats")
+             .help("Report how many type conversions were answered from the memo tables")
+             .takes_value(false))
         .get_matches();
 
     // Build a TranslationConfig from the command line
@@ -152,6 +202,8 @@ fn main() {
         use_c_loop_info:        !matches.is_present("ignore-c-loop-info"),
         use_c_multiple_info:    !matches.is_present("ignore-c-multiple-info"),
         simplify_structures:    !matches.is_present("no-simplify-structures"),
+        large_cfg_threshold:    value_t!(matches, "large-cfg-threshold", usize).unwrap_or_else(|e| e.exit()),
+        fail_on_dominator_fallback: matches.is_present("fail-on-dominator-fallback"),
         emit_module:            matches.is_present("emit-module"),
         panic_on_translator_failure: {
             match matches.value_of("invalid-code") {
@@ -161,14 +213,25 @@ fn main() {
             }
         },
         replace_unsupported_decls: ReplaceMode::Extern,
+        jobs:                   value_t!(matches, "jobs", usize).unwrap_or_else(|e| e.exit()),
+        translation_cache:      matches.value_of("translation-cache").map(String::from),
+        type_conversion_stats:  matches.is_present("type-conversion-stats"),
     };
     let file = matches.value_of("INPUT").unwrap();
     let dump_untyped_context = matches.is_present("dump-untyped-clang-ast");
     let dump_typed_context = matches.is_present("dump-typed-clang-ast");
     let pretty_typed_context = matches.is_present("pretty-typed-clang-ast");
+    let time_passes = matches.is_present("time-passes");
+    let trace_file = matches.value_of("time-passes-trace");
+    let top_functions = value_t!(matches, "time-passes-top", usize).unwrap_or_else(|e| e.exit());
+    let timer = PassTimer::new(time_passes || trace_file.is_some());
 
     // Extract the untyped AST from the CBOR file 
-    let untyped_context = match parse_untyped_ast(file) {
+    let buffer = match map_input(file) {
+        Err(e) => panic!("{:#?}", e),
+        Ok(buffer) => buffer,
+    };
+    let untyped_context = match timer.time(Pass::DecodeCbor, || process(&buffer)) {
         Err(e) => panic!("{:#?}", e),
         Ok(cxt) => cxt,
     };
@@ -179,11 +242,15 @@ fn main() {
     }
 
     // Convert this into a typed AST
-    let typed_context = {
+    let typed_context = timer.time(Pass::BuildTypedAst, || {
         let mut conv = ConversionContext::new(&untyped_context);
         conv.convert(&untyped_context);
         conv.typed_context
-    };
+    });
+
+    // The untyped AST borrows from the input, and neither is needed past this point
+    drop(untyped_context);
+    drop(buffer);
 
     if dump_typed_context {
         println!("Clang AST");
@@ -207,21 +274,46 @@ fn main() {
 
     // Perform the translation
 
-    println!("{}", ast_importer::translator::translate(typed_context, tcfg));
-}
+    let mut output = match open_output(matches.value_of("output")) {
+        Err(e) => panic!("{:#?}", e),
+        Ok(output) => output,
+    };
+    let result = ast_importer::translator::translate(typed_context, tcfg, timer.clone(), &mut output);
+    if let Err(e) = result.and_then(|()| output.flush()) {
+        panic!("{:#?}", e)
+    }
 
-fn parse_untyped_ast(filename: &str) -> Result<AstContext, Error> {
-    let mut f = File::open(filename)?;
-    let mut buffer = vec![];
-    f.read_to_end(&mut buffer)?;
+    if time_passes {
+        if let Err(e) = timer.report(top_functions, &mut stderr()) {
+            panic!("{:#?}", e)
+        }
+    }
+    if let Some(trace_file) = trace_file {
+        if let Err(e) = timer.write_trace(trace_file) {
+            panic!("{:#?}", e)
+        }
+    }
+}
 
-    let mut cursor: Decoder<Cursor<Vec<u8>>> = Decoder::from_bytes(buffer);
-    let items = cursor.items();
+/// Open the buffered sink the translated Rust code is written to: the given file, or stdout.
+fn open_output(filename: Option<&str>) -> Result<Box<Write>, Error> {
+    Ok(match filename {
+        Some(filename) => Box::new(BufWriter::new(File::create(filename)?)),
+        None => Box::new(BufWriter::new(stdout())),
+    })
+}
 
-    match process(items) {
-        Ok(cxt) => Ok(cxt),
-        Err(e) => panic!("{:#?}", e),
+/// Map the CBOR file into memory rather than reading it, so the untyped AST can borrow its
+/// strings straight from the page cache without a second copy of the file in anonymous memory.
+fn map_input(filename: &str) -> Result<Mmap, Error> {
+    let file = File::open(filename)?;
+    // Empty files can't be mapped, and always mean the exporter failed before writing anything
+    if file.metadata()?.len() == 0 {
+        return Err(Error::new(ErrorKind::InvalidData,
+                              format!("{} is empty, no AST was exported", filename)));
     }
+    // The exporter's output isn't modified while we run, so the mapping stays valid
+    unsafe { Mmap::map(&file) }
 }
 
 
@@ -2,6 +2,7 @@ use std::collections::HashSet;
 use std::collections::HashMap;
 use std::hash::Hash;
 use std::iter::FromIterator;
+use std::mem;
 
 struct Scope<T> {
     name_map: HashMap<T, String>,
@@ -135,11 +136,23 @@ impl<T: Clone + Eq + Hash> Renamer<T> {
         None
     }
 
+    /// Names in use in the outermost scope, in no particular order. Names picked in the inner
+    /// scopes have to avoid these.
+    pub fn root_names<'a>(&'a self) -> impl Iterator<Item = &'a str> + 'a {
+        self.scopes[0].used.iter().map(String::as_str)
+    }
+
     pub fn fresh(&mut self) -> String {
         let fresh = self.next_fresh;
         self.next_fresh += 1;
         self.pick_name(&format!("fresh{}", fresh))
     }
+
+    /// Set the number used by the next call to `fresh`, returning the previous one. Fresh names
+    /// that are still in use are skipped regardless.
+    pub fn replace_next_fresh(&mut self, next_fresh: u64) -> u64 {
+        mem::replace(&mut self.next_fresh, next_fresh)
+    }
 }
 
 #[cfg(test)]
@@ -404,6 +404,35 @@ impl Builder {
         }
     }
 
+    pub fn call_str_attr<K,A,V>(self, func: K, key: A, value: V) -> Self
+        where K: Make<PathSegment>, A: Make<Ident>, V: IntoSymbol {
+
+        let func: Path = vec![func].make(&self);
+        let key: Ident = key.make(&self);
+
+        let tokens: TokenStream = vec![
+            Token::OpenDelim(DelimToken::Paren),
+            Token::from_ast_ident(key),
+            Token::Eq,
+            Token::Literal(token::Lit::Str_(value.into_symbol()), None),
+            Token::CloseDelim(DelimToken::Paren),
+        ].into_iter().collect();
+
+        let mut attrs = self.attrs;
+        attrs.push(Attribute {
+            id: AttrId(0),
+            style: AttrStyle::Outer,
+            path: func,
+            tokens: tokens,
+            is_sugared_doc: false,
+            span: DUMMY_SP,
+        });
+        Builder {
+            attrs: attrs,
+            ..self
+        }
+    }
+
     // Path segments with parameters
 
     pub fn path_segment_with_params<I,P>(self, identifier: I, parameters: P) -> PathSegment
@@ -1375,7 +1404,7 @@ impl Builder {
                 Unsafety::Unsafe => BlockCheckMode::Unsafe(UnsafeSource::UserProvided),
                 Unsafety::Normal => BlockCheckMode::Default,
             },
-            span: DUMMY_SP,
+            span: self.span,
             recovered: false,
         })
     }
@@ -0,0 +1,87 @@
+//! The x86 intrinsics that calls to `<immintrin.h>` functions can be translated to.
+//!
+//! The SSE to SSE4.2, AVX, AVX2 and FMA headers name their intrinsics the way
+//! `std::arch::x86_64` does, so rather than listing them, any `_mm` function these headers
+//! declare is taken to be in `std::arch`. The exceptions are the MMX intrinsics, which take or
+//! return `__m64` and are missing from `std::arch`, and the few in `NOT_IN_STD_ARCH`.
+
+use std::path::Path;
+
+/// Headers that declare the intrinsics
+const INTRINSIC_HEADERS: &[&str] = &[
+    "avx2intrin.h",
+    "avxintrin.h",
+    "emmintrin.h",
+    "fmaintrin.h",
+    "immintrin.h",
+    "nmmintrin.h",
+    "pmmintrin.h",
+    "smmintrin.h",
+    "tmmintrin.h",
+    "xmmintrin.h",
+];
+
+/// Whether `path` is one of the headers declaring the intrinsics
+pub fn is_intrinsic_header(path: &str) -> bool {
+    Path::new(path).file_name()
+        .and_then(|name| name.to_str())
+        .map_or(false, |name| INTRINSIC_HEADERS.contains(&name))
+}
+
+/// Intrinsics of these headers that `std::arch` lacks, although they don't use `__m64`
+const NOT_IN_STD_ARCH: &[&str] = &[
+    // SSE3 instructions that `std::arch` has no intrinsics for
+    "_mm_monitor",
+    "_mm_mwait",
+    // GCC's spellings of `_mm_cvtsi64_ss`, `_mm_cvtss_si64` and `_mm_cvttss_si64`
+    "_mm_cvtsi64x_ss",
+    "_mm_cvtss_si64x",
+    "_mm_cvttss_si64x",
+];
+
+/// The immediate shifts, whose count has to be a constant although the headers declare it `int`
+const IMMEDIATE_SHIFTS: &[&str] = &["slli", "srli", "srai", "bslli", "bsrli"];
+
+/// Whether `std::arch::x86_64` has the header's intrinsic called `name`. `uses_m64` tells whether
+/// the C declaration takes or returns `__m64`.
+pub fn is_std_arch_intrinsic(name: &str, uses_m64: bool) -> bool {
+    name.starts_with("_mm") && !uses_m64 && !NOT_IN_STD_ARCH.contains(&name)
+}
+
+/// Whether argument `index` of the intrinsic `name`, which takes `arity` arguments, has to be a
+/// constant. Clang's headers declare most of these `const int`, which `is_const` tells.
+pub fn is_immediate_arg(name: &str, index: usize, arity: usize, is_const: bool) -> bool {
+    is_const || (index + 1 == arity && name.split('_').any(|part| IMMEDIATE_SHIFTS.contains(&part)))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_intrinsics() {
+        assert!(is_std_arch_intrinsic("_mm_add_epi32", false));
+        assert!(is_std_arch_intrinsic("_mm256_loadu_si256", false));
+        assert!(is_std_arch_intrinsic("_mm_castps_si128", false));
+        assert!(!is_std_arch_intrinsic("_mm_abs_pi8", true));
+        assert!(!is_std_arch_intrinsic("_mm_monitor", false));
+        assert!(!is_std_arch_intrinsic("__rdtsc", false));
+    }
+
+    #[test]
+    fn test_immediates() {
+        assert!(is_immediate_arg("_mm256_extract_epi32", 1, 2, true));
+        assert!(!is_immediate_arg("_mm256_insert_epi32", 1, 3, false));
+        assert!(is_immediate_arg("_mm_slli_epi32", 1, 2, false));
+        assert!(is_immediate_arg("_mm256_bsrli_epi128", 1, 2, false));
+        assert!(!is_immediate_arg("_mm_slli_epi32", 0, 2, false));
+        assert!(!is_immediate_arg("_mm_sll_epi32", 1, 2, false));
+    }
+
+    #[test]
+    fn test_headers() {
+        assert!(is_intrinsic_header("/usr/lib/llvm-6.0/lib/clang/6.0.0/include/xmmintrin.h"));
+        assert!(!is_intrinsic_header("/usr/lib/llvm-6.0/lib/clang/6.0.0/include/mm_malloc.h"));
+        assert!(!is_intrinsic_header("simd.c"));
+    }
+}
@@ -0,0 +1,308 @@
+//! Measurements of where the importer spends its time and memory, for `--time-passes`.
+//!
+//! Every pass records its wall time, and the passes that run once per file also record how much
+//! they raised the peak resident set size of the process. When the importer is built with the `alloc-stats` feature, the number and total size
+//! of the allocations made while each pass ran are recorded too. Function definitions are also
+//! timed as a whole, to find the slowest ones. Events can be written out in the Chrome
+//! trace-event format, for viewing in `chrome://tracing`.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::fs::{self, File};
+use std::io::{self, BufWriter, Write};
+use std::process;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+use serde_json::{self, Map, Value};
+
+static ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+static ALLOCATED_BYTES: AtomicUsize = AtomicUsize::new(0);
+
+/// Global allocator counting the allocations made by the process. The importer binary installs
+/// it with `#[global_allocator]` when built with the `alloc-stats` feature, since counting costs
+/// every allocation two atomic additions. The counters are process-wide, so with `--jobs` the counts of
+/// passes running on one thread include allocations made meanwhile by the others.
+pub struct CountingAlloc;
+
+unsafe impl GlobalAlloc for CountingAlloc {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        ALLOCATED_BYTES.fetch_add(layout.size(), Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        ALLOCATED_BYTES.fetch_add(new_size, Ordering::Relaxed);
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+/// Peak resident set size of the process in kilobytes, where the OS reports it
+fn peak_rss_kb() -> Option<u64> {
+    let status = fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|line| line.starts_with("VmHWM:"))?;
+    line["VmHWM:".len()..].trim().trim_right_matches("kB").trim().parse().ok()
+}
+
+/// Whether allocations are being counted by `CountingAlloc`
+const COUNTS_ALLOCATIONS: bool = cfg!(feature = "alloc-stats");
+
+fn micros(duration: Duration) -> f64 {
+    duration.as_secs() as f64 * 1e6 + duration.subsec_nanos() as f64 / 1e3
+}
+
+/// Stages of the importer measured by a `PassTimer`
+#[derive(Debug, Copy, Clone, PartialEq, Eq)]
+pub enum Pass {
+    DecodeCbor,
+    BuildTypedAst,
+    BuildCfg,
+    Reloop,
+    StructureCfg,
+    PrettyPrint,
+    Function,
+}
+
+/// Passes in the order they are reported
+const PASSES: [Pass; 6] = [
+    Pass::DecodeCbor,
+    Pass::BuildTypedAst,
+    Pass::BuildCfg,
+    Pass::Reloop,
+    Pass::StructureCfg,
+    Pass::PrettyPrint,
+];
+
+impl Pass {
+    /// Whether the pass runs once per file, rather than once per function or item. The peak RSS
+    /// is read before and after these passes only: the others are too short for the peak to
+    /// change measurably, and with `--jobs` they overlap, so a change in the process-wide peak
+    /// couldn't be attributed to any one of them anyway.
+    fn runs_once(self) -> bool {
+        match self {
+            Pass::DecodeCbor | Pass::BuildTypedAst => true,
+            _ => false,
+        }
+    }
+
+    pub fn name(self) -> &'static str {
+        match self {
+            Pass::DecodeCbor => "decode CBOR",
+            Pass::BuildTypedAst => "build typed AST",
+            Pass::BuildCfg => "build CFG",
+            Pass::Reloop => "reloop",
+            Pass::StructureCfg => "structured_cfg",
+            Pass::PrettyPrint => "pretty print",
+            Pass::Function => "function",
+        }
+    }
+}
+
+#[derive(Debug, Clone)]
+struct Event {
+    pass: Pass,
+    function: Option<String>,
+    thread: usize,
+    start: Duration,
+    duration: Duration,
+    allocations: usize,
+    allocated_bytes: usize,
+}
+
+impl Event {
+    fn name(&self) -> &str {
+        self.function.as_ref().map_or(self.pass.name(), String::as_str)
+    }
+}
+
+struct TimerState {
+    epoch: Instant,
+    events: Mutex<Vec<Event>>,
+    /// How much each pass that runs once per file raised the peak RSS
+    peak_rss_growth_kb: Mutex<Vec<(Pass, u64)>>,
+}
+
+/// Records the passes run by the importer. Clones share their events, so a timer can be handed
+/// to each thread taking part in the translation. A disabled timer just runs the passes.
+#[derive(Clone)]
+pub struct PassTimer {
+    state: Option<Arc<TimerState>>,
+    thread: usize,
+}
+
+impl PassTimer {
+    pub fn new(enabled: bool) -> PassTimer {
+        let state = if enabled {
+            Some(Arc::new(TimerState {
+                epoch: Instant::now(),
+                events: Mutex::new(vec![]),
+                peak_rss_growth_kb: Mutex::new(vec![]),
+            }))
+        } else {
+            None
+        };
+        PassTimer { state, thread: 0 }
+    }
+
+    /// Timer sharing the events of this one, for passes run on another thread
+    pub fn for_thread(&self, thread: usize) -> PassTimer {
+        PassTimer { state: self.state.clone(), thread }
+    }
+
+    pub fn time<T, F: FnOnce() -> T>(&self, pass: Pass, run: F) -> T {
+        self.record(pass, None, run)
+    }
+
+    /// Time the translation of the function definition `name`, passes included
+    pub fn time_function<T, F: FnOnce() -> T>(&self, name: &str, run: F) -> T {
+        self.record(Pass::Function, Some(name), run)
+    }
+
+    fn record<T, F: FnOnce() -> T>(&self, pass: Pass, function: Option<&str>, run: F) -> T {
+        let state = match self.state {
+            None => return run(),
+            Some(ref state) => state,
+        };
+
+        let peak_rss_before = if pass.runs_once() { peak_rss_kb() } else { None };
+        let allocations = ALLOCATIONS.load(Ordering::Relaxed);
+        let allocated_bytes = ALLOCATED_BYTES.load(Ordering::Relaxed);
+        let start = Instant::now();
+
+        let result = run();
+
+        let event = Event {
+            pass,
+            function: function.map(String::from),
+            thread: self.thread,
+            start: start.duration_since(state.epoch),
+            duration: start.elapsed(),
+            allocations: ALLOCATIONS.load(Ordering::Relaxed).wrapping_sub(allocations),
+            allocated_bytes: ALLOCATED_BYTES.load(Ordering::Relaxed).wrapping_sub(allocated_bytes),
+        };
+        state.events.lock().unwrap().push(event);
+        if let (Some(before), Some(after)) = (peak_rss_before, peak_rss_kb()) {
+            state.peak_rss_growth_kb.lock().unwrap().push((pass, after.saturating_sub(before)));
+        }
+        result
+    }
+
+    fn events(&self) -> Vec<Event> {
+        match self.state {
+            None => vec![],
+            Some(ref state) => state.events.lock().unwrap().clone(),
+        }
+    }
+
+    fn peak_rss_growth(&self) -> Vec<(Pass, u64)> {
+        match self.state {
+            None => vec![],
+            Some(ref state) => state.peak_rss_growth_kb.lock().unwrap().clone(),
+        }
+    }
+
+    /// Wall time since the timer was created, which is at the start of the import
+    fn elapsed(&self) -> Duration {
+        self.state.as_ref().map_or(Duration::new(0, 0), |state| state.epoch.elapsed())
+    }
+
+    /// Print a table of the totals of each pass, then the total wall time and peak RSS, followed
+    /// by the `top_functions` slowest function definitions.
+    pub fn report(&self, top_functions: usize, out: &mut Write) -> io::Result<()> {
+        let events = self.events();
+        let growths = self.peak_rss_growth();
+
+        writeln!(out, "{:<16} {:>7} {:>12} {:>12} {:>14} {:>20}",
+                 "pass", "count", "time (ms)", "allocations", "allocated (kB)", "peak RSS growth (kB)")?;
+        for &pass in PASSES.iter() {
+            let pass_events: Vec<&Event> = events.iter().filter(|e| e.pass == pass).collect();
+            if pass_events.is_empty() {
+                continue
+            }
+            let duration = pass_events.iter().map(|e| e.duration).fold(Duration::new(0, 0), |a, b| a + b);
+            let (allocations, allocated_kb) = if COUNTS_ALLOCATIONS {
+                let allocations: usize = pass_events.iter().map(|e| e.allocations).sum();
+                let allocated_bytes: usize = pass_events.iter().map(|e| e.allocated_bytes).sum();
+                (allocations.to_string(), (allocated_bytes / 1024).to_string())
+            } else {
+                ("-".to_owned(), "-".to_owned())
+            };
+            let peak_rss_growth = if pass.runs_once() {
+                growths.iter().filter(|&&(p, _)| p == pass).map(|&(_, kb)| kb).max()
+                    .map_or("-".to_owned(), |kb| kb.to_string())
+            } else {
+                "-".to_owned()
+            };
+            writeln!(out, "{:<16} {:>7} {:>12.3} {:>12} {:>14} {:>20}",
+                     pass.name(), pass_events.len(), micros(duration) / 1e3,
+                     allocations, allocated_kb, peak_rss_growth)?;
+        }
+        write!(out, "total: {:.3} ms", micros(self.elapsed()) / 1e3)?;
+        match peak_rss_kb() {
+            Some(kb) => writeln!(out, ", peak RSS {} kB", kb)?,
+            None => writeln!(out)?,
+        }
+
+        let mut functions: Vec<&Event> = events.iter().filter(|e| e.pass == Pass::Function).collect();
+        if top_functions > 0 && !functions.is_empty() {
+            functions.sort_by(|a, b| b.duration.cmp(&a.duration).then_with(|| a.name().cmp(b.name())));
+            writeln!(out, "slowest functions:")?;
+            for event in functions.into_iter().take(top_functions) {
+                if COUNTS_ALLOCATIONS {
+                    writeln!(out, "{:>12.3} ms {:>12} allocations  {}",
+                             micros(event.duration) / 1e3, event.allocations, event.name())?;
+                } else {
+                    writeln!(out, "{:>12.3} ms  {}", micros(event.duration) / 1e3, event.name())?;
+                }
+            }
+        }
+        Ok(())
+    }
+
+    /// Write the events in the Chrome trace-event format. The wall time since the timer was
+    /// created and the peak RSS of the process are included under `otherData`, which is what the
+    /// regression benchmarks check.
+    pub fn write_trace(&self, path: &str) -> io::Result<()> {
+        let events = self.events();
+        let pid = process::id();
+
+        let trace_events: Vec<Value> = events.iter().map(|event| {
+            let mut args = Map::new();
+            if COUNTS_ALLOCATIONS {
+                args.insert("allocations".to_owned(), Value::from(event.allocations as u64));
+                args.insert("allocated_bytes".to_owned(), Value::from(event.allocated_bytes as u64));
+            }
+
+            let mut trace_event = Map::new();
+            trace_event.insert("name".to_owned(), Value::from(event.name()));
+            trace_event.insert("cat".to_owned(), Value::from(event.pass.name()));
+            trace_event.insert("ph".to_owned(), Value::from("X"));
+            trace_event.insert("ts".to_owned(), Value::from(micros(event.start)));
+            trace_event.insert("dur".to_owned(), Value::from(micros(event.duration)));
+            trace_event.insert("pid".to_owned(), Value::from(pid));
+            trace_event.insert("tid".to_owned(), Value::from(event.thread as u64));
+            trace_event.insert("args".to_owned(), Value::Object(args));
+            Value::Object(trace_event)
+        }).collect();
+
+        let mut other_data = Map::new();
+        other_data.insert("total_us".to_owned(), Value::from(micros(self.elapsed())));
+        if let Some(kb) = peak_rss_kb() {
+            other_data.insert("peak_rss_kb".to_owned(), Value::from(kb));
+        }
+
+        let mut trace = Map::new();
+        trace.insert("traceEvents".to_owned(), Value::Array(trace_events));
+        trace.insert("displayTimeUnit".to_owned(), Value::from("ms"));
+        trace.insert("otherData".to_owned(), Value::Object(other_data));
+
+        let mut file = BufWriter::new(File::create(path)?);
+        serde_json::to_writer(&mut file, &Value::Object(trace))?;
+        file.flush()
+    }
+}
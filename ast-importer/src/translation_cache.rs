@@ -0,0 +1,178 @@
+//! On-disk cache of translated function definitions, so that retranslating a file only redoes
+//! the functions whose C source (or anything they depend on) changed.
+
+use std::collections::HashSet;
+use std::fs;
+use std::hash::{Hash, Hasher};
+use std::path::PathBuf;
+use std::process;
+use std::thread;
+use serde_json::{self, Map, Value};
+
+/// Bump this whenever the format of the entries or their keys changes
+const CACHE_FORMAT_VERSION: u32 = 2;
+
+/// Identifies the build of the translator, so that entries written by other builds are misses
+const TRANSLATOR_BUILD_ID: &str = env!("C2RUST_BUILD_ID");
+
+/// 64-bit FNV-1a hasher. Unlike `DefaultHasher`, its algorithm is fixed, so keys computed by
+/// different builds of the translator agree whenever they hash the same values.
+#[derive(Debug, Clone)]
+pub struct StableHasher(u64);
+
+impl Default for StableHasher {
+    fn default() -> StableHasher {
+        StableHasher(0xcbf29ce484222325)
+    }
+}
+
+impl Hasher for StableHasher {
+    fn write(&mut self, bytes: &[u8]) {
+        for &byte in bytes {
+            self.0 = (self.0 ^ byte as u64).wrapping_mul(0x100000001b3);
+        }
+    }
+
+    fn finish(&self) -> u64 {
+        self.0
+    }
+}
+
+/// A function definition translated and printed on its own, along with what the crate has to
+/// provide for it to compile
+#[derive(Debug, Clone)]
+pub struct TranslatedFunction {
+    pub item: String,
+    pub features: HashSet<&'static str>,
+    pub uses_cold_path: bool,
+}
+
+/// Directory of translated functions. Entries are keyed by a hash of the function's typed AST
+/// (see `translator::function_key`) combined with a hash of the translator build and of the
+/// options that affect the translation of functions.
+#[derive(Debug, Clone)]
+pub struct TranslationCache {
+    dir: PathBuf,
+    config_hash: u64,
+}
+
+impl TranslationCache {
+    /// `options_key` has to be a hash of every option that affects how functions are translated
+    pub fn new(dir: &str, options_key: u64) -> TranslationCache {
+        let mut hasher = StableHasher::default();
+        CACHE_FORMAT_VERSION.hash(&mut hasher);
+        env!("CARGO_PKG_VERSION").hash(&mut hasher);
+        TRANSLATOR_BUILD_ID.hash(&mut hasher);
+        options_key.hash(&mut hasher);
+
+        TranslationCache {
+            dir: PathBuf::from(dir),
+            config_hash: hasher.finish(),
+        }
+    }
+
+    fn entry_path(&self, function_key: u64) -> PathBuf {
+        let mut hasher = StableHasher::default();
+        self.config_hash.hash(&mut hasher);
+        function_key.hash(&mut hasher);
+        self.dir.join(format!("{:016x}.json", hasher.finish()))
+    }
+
+    /// Look up a translated function. Missing and unreadable entries are both misses.
+    pub fn load(&self, function_key: u64) -> Option<TranslatedFunction> {
+        let contents = fs::read_to_string(self.entry_path(function_key)).ok()?;
+        let entry: Value = serde_json::from_str(&contents).ok()?;
+
+        let item = entry["item"].as_str()?.to_owned();
+        let uses_cold_path = entry["uses_cold_path"].as_bool()?;
+        let features = entry["features"].as_array()?
+            .iter()
+            .map(|feature| feature.as_str().map(leak_str))
+            .collect::<Option<HashSet<_>>>()?;
+
+        Some(TranslatedFunction { item, features, uses_cold_path })
+    }
+
+    /// Store a translated function. A failed write only costs a retranslation next time, so
+    /// errors are reported and otherwise ignored.
+    pub fn store(&self, function_key: u64, function: &TranslatedFunction) {
+        let mut features: Vec<&str> = function.features.iter().cloned().collect();
+        features.sort();
+
+        let mut entry = Map::new();
+        entry.insert("item".to_owned(), Value::String(function.item.clone()));
+        entry.insert("features".to_owned(), features.into_iter().map(Value::from).collect());
+        entry.insert("uses_cold_path".to_owned(), Value::Bool(function.uses_cold_path));
+
+        // Entries are written to a temporary file and renamed into place, so concurrent
+        // translations never see a partially written entry
+        let path = self.entry_path(function_key);
+        let tmp_path = path.with_extension(format!("{}.{:?}.tmp", process::id(), thread::current().id()));
+        let result = fs::create_dir_all(&self.dir)
+            .and_then(|()| fs::write(&tmp_path, Value::Object(entry).to_string()))
+            .and_then(|()| fs::rename(&tmp_path, &path));
+
+        if let Err(e) = result {
+            eprintln!("Failed to write translation cache entry {}: {}", path.display(), e);
+            let _ = fs::remove_file(&tmp_path);
+        }
+    }
+}
+
+/// Features are named by string literals everywhere else in the translator. There are only a
+/// handful of them per function, so the ones read back from the cache are simply leaked.
+fn leak_str(s: &str) -> &'static str {
+    Box::leak(s.to_owned().into_boxed_str())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::env;
+
+    fn function() -> TranslatedFunction {
+        TranslatedFunction {
+            item: "pub fn f() -> i32 { 1 }".to_owned(),
+            features: vec!["const_fn"].into_iter().collect(),
+            uses_cold_path: true,
+        }
+    }
+
+    fn cache_dir(name: &str) -> String {
+        let dir = env::temp_dir().join(format!("c2rust-cache-test-{}-{}", name, process::id()));
+        let _ = fs::remove_dir_all(&dir);
+        dir.to_str().unwrap().to_owned()
+    }
+
+    #[test]
+    fn test_stable_hasher() {
+        // FNV-1a test vectors
+        let mut h = StableHasher::default();
+        assert_eq!(h.finish(), 0xcbf29ce484222325);
+        h.write(b"a");
+        assert_eq!(h.finish(), 0xaf63dc4c8601ec8c);
+    }
+
+    #[test]
+    fn test_hit() {
+        let dir = cache_dir("hit");
+        let cache = TranslationCache::new(&dir, 1);
+        assert!(cache.load(42).is_none());
+        cache.store(42, &function());
+
+        let loaded = TranslationCache::new(&dir, 1).load(42).expect("cache miss");
+        assert_eq!(loaded.item, function().item);
+        assert_eq!(loaded.features, function().features);
+        assert_eq!(loaded.uses_cold_path, function().uses_cold_path);
+        assert!(cache.load(43).is_none());
+        let _ = fs::remove_dir_all(&dir);
+    }
+
+    #[test]
+    fn test_options_miss() {
+        let dir = cache_dir("options");
+        TranslationCache::new(&dir, 1).store(42, &function());
+        assert!(TranslationCache::new(&dir, 2).load(42).is_none());
+        let _ = fs::remove_dir_all(&dir);
+    }
+}
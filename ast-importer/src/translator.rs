@@ -4,23 +4,35 @@ use syntax::codemap::{DUMMY_SP, Span};
 use syntax::tokenstream::{TokenStream};
 use syntax::parse::token::{DelimToken,Token,Nonterminal};
 use std::collections::{HashMap,HashSet};
+use std::hash::{Hash, Hasher};
 use renamer::Renamer;
-use convert_type::TypeConverter;
+use convert_type::{ConversionStats, TypeConverter};
 use loops::*;
 use c_ast;
 use c_ast::*;
 use rust_ast::{mk, Builder};
 use comment_store::*;
+use translation_cache::{StableHasher, TranslatedFunction, TranslationCache};
+use function_spill::{FunctionSpill, SpilledItem};
+use timing::{Pass, PassTimer};
 use c_ast::iterators::{DFExpr, SomeId};
+use c_ast::structural_hash::{hash_reachable, NodeRef, StructuralHasher};
 use syntax::ptr::*;
 use syntax::print::pprust::*;
+use syntax::parse::lexer::comments;
+use syntax_pos::BytePos;
 use std::ops::Index;
-use std::cell::RefCell;
+use std::cell::{Cell, RefCell};
+use std::io::{self, Write};
+use std::mem;
+use std::sync::Arc;
+use std::thread;
 use std::char;
 use dtoa;
 use with_stmts::WithStmts;
 
 use cfg;
+use simd_intrinsics;
 
 #[derive(Debug, Copy, Clone)]
 pub enum ReplaceMode {
@@ -29,7 +41,7 @@ pub enum ReplaceMode {
 }
 
 /// Configuration settings for the translation process
-#[derive(Debug)]
+#[derive(Debug, Clone)]
 pub struct TranslationConfig {
     pub reloop_cfgs: bool,
     pub fail_on_multiple: bool,
@@ -46,14 +58,37 @@ pub struct TranslationConfig {
     pub use_c_loop_info: bool,
     pub use_c_multiple_info: bool,
     pub simplify_structures: bool,
+    pub large_cfg_threshold: usize,
+    pub fail_on_dominator_fallback: bool,
     pub panic_on_translator_failure: bool,
     pub emit_module: bool,
     pub fail_on_error: bool,
     pub replace_unsupported_decls: ReplaceMode,
+    pub jobs: usize,
+    pub translation_cache: Option<String>,
+    pub type_conversion_stats: bool,
+}
+
+/// Name of the `#[cold]` function called on the unexpected side of a `__builtin_expect`
+const COLD_PATH_FN: &str = "c2rust_cold_path";
+
+/// Stack size of the function translation threads. Expressions and CFGs are converted
+/// recursively, so workers get as much stack as the main thread has by default on Linux, rather
+/// than the 2 MiB of spawned threads.
+const WORKER_STACK_SIZE: usize = 8 << 20;
+
+/// A top-level value in output order: either an item, or the index in the list of function
+/// definitions of a function that is printed on its own
+enum TopLevelValue {
+    Item(P<Item>),
+    Function(usize),
 }
 
 pub struct Translation {
     pub features: RefCell<HashSet<&'static str>>,
+    uses_cold_path: Cell<bool>,
+    // Target features of the intrinsics that the function being converted calls
+    target_features: RefCell<HashSet<String>>,
     pub items: Vec<P<Item>>,
     pub foreign_items: Vec<ForeignItem>,
     type_converter: RefCell<TypeConverter>,
@@ -64,6 +99,7 @@ pub struct Translation {
     zero_inits: RefCell<HashMap<CDeclId, Result<P<Expr>, String>>>,
     pub comment_context: RefCell<CommentContext>,
     pub comment_store: RefCell<CommentStore>,
+    timer: PassTimer,
 }
 
 
@@ -136,6 +172,40 @@ fn transmute_expr(source_ty: P<Ty>, target_ty: P<Ty>, expr: P<Expr>) -> P<Expr>
     mk().call_expr(mk().path_expr(path), vec![expr])
 }
 
+/// Whether `decl_id` is an `<immintrin.h>` intrinsic. Calls to these are translated to the
+/// `std::arch::x86_64` functions of the same name rather than to the header's definitions.
+/// Other functions, like `_mm_malloc` or user functions with an `_mm_` prefix, aren't.
+fn is_simd_intrinsic(ast_context: &TypedAstContext, decl_id: CDeclId) -> bool {
+    let decl = &ast_context[decl_id];
+    let (name, typ) = match decl.kind {
+        CDeclKind::Function { ref name, typ, .. } => (name, typ),
+        _ => return false,
+    };
+    let from_header = decl.loc
+        .and_then(|loc| ast_context.c_files.get(&loc.fileid))
+        .map_or(false, |file| simd_intrinsics::is_intrinsic_header(file));
+    let uses_m64 = match ast_context.resolve_type(typ).kind {
+        CTypeKind::Function(ret, ref params, _, _) =>
+            is_m64(ast_context, ret.ctype) || params.iter().any(|param| is_m64(ast_context, param.ctype)),
+        _ => false,
+    };
+    from_header && simd_intrinsics::is_std_arch_intrinsic(name, uses_m64)
+}
+
+/// Whether `typ` is spelled `__m64`, the MMX vector type
+fn is_m64(ast_context: &TypedAstContext, typ: CTypeId) -> bool {
+    match ast_context[typ].kind {
+        CTypeKind::Typedef(decl_id) => match ast_context[decl_id].kind {
+            CDeclKind::Typedef { ref name, .. } if name == "__m64" => true,
+            CDeclKind::Typedef { typ, .. } => is_m64(ast_context, typ.ctype),
+            _ => false,
+        },
+        CTypeKind::Elaborated(typ) | CTypeKind::Paren(typ) => is_m64(ast_context, typ),
+        CTypeKind::Attributed(typ, _) => is_m64(ast_context, typ.ctype),
+        _ => false,
+    }
+}
+
 pub fn stmts_block(mut stmts: Vec<Stmt>) -> P<Block> {
     if stmts.len() == 1 {
         if let StmtKind::Expr(ref e) = stmts[0].node {
@@ -183,9 +253,14 @@ pub fn signed_int_expr(value: i64) -> P<Expr> {
 
 // This should only be used for tests
 fn prefix_names(translation: &mut Translation, prefix: String) {
+    let intrinsics: HashSet<CDeclId> = translation.ast_context.c_decls.iter()
+        .map(|(&decl_id, _)| decl_id)
+        .filter(|&decl_id| is_simd_intrinsic(&translation.ast_context, decl_id))
+        .collect();
     for (&decl_id, ref mut decl) in &mut translation.ast_context.c_decls {
         match decl.kind {
-            CDeclKind::Function { ref mut name, ref body, .. } if body.is_some() => {
+            CDeclKind::Function { ref mut name, ref body, .. }
+            if body.is_some() && !intrinsics.contains(&decl_id) => {
                 name.insert_str(0, &prefix);
 
                 translation.renamer.borrow_mut().insert(decl_id, &name);
@@ -204,15 +279,10 @@ pub fn translate_failure(tcfg: &TranslationConfig, msg: &str) {
     }
 }
 
-pub fn translate(ast_context: TypedAstContext, tcfg: TranslationConfig) -> String {
-
-    let mut t = Translation::new(ast_context, tcfg);
-
-    if !t.tcfg.translate_entry {
-        t.ast_context.c_main = None;
-    }
-
-    t.ast_context.simplify();
+/// Collapse typedefs of unnamed types, declare the names of all top-level declarations, and
+/// translate the type declarations. This sets up the state function definitions are translated
+/// against, so worker threads repeat it. Returns the messages for declarations that failed.
+fn declare_types(t: &mut Translation) -> Vec<String> {
 
     enum Name<'a> {
         VarName(&'a str),
@@ -228,92 +298,381 @@ pub fn translate(ast_context: TypedAstContext, tcfg: TranslationConfig) -> Strin
         }
     }
 
-    // Used for testing; so that we don't overlap with C function names
-    if let Some(prefix) = t.tcfg.prefix_function_names.clone() {
-        prefix_names(&mut t, prefix);
-    }
-
-    with_globals(|| {
-        // Identify typedefs that name unnamed types and collapse the two declarations
-        // into a single name and declaration, eliminating the typedef altogether.
-        let mut prenamed_decls: HashSet<CDeclId> = HashSet::new();
-        for (&decl_id, decl) in &t.ast_context.c_decls {
-            if let CDeclKind::Typedef { ref name, typ, .. } = decl.kind {
-                if let Some(subdecl_id) = t.ast_context.resolve_type(typ.ctype).kind.as_underlying_decl() {
-                    let is_unnamed = match t.ast_context[subdecl_id].kind {
-                        CDeclKind::Struct { name: None, .. } => true,
-                        CDeclKind::Union { name: None, .. } => true,
-                        CDeclKind::Enum { name: None, .. } => true,
-                        _ => false,
-                    };
+    // Identify typedefs that name unnamed types and collapse the two declarations
+    // into a single name and declaration, eliminating the typedef altogether.
+    let mut prenamed_decls: HashSet<CDeclId> = HashSet::new();
+    for (&decl_id, decl) in &t.ast_context.c_decls {
+        if let CDeclKind::Typedef { ref name, typ, .. } = decl.kind {
+            if let Some(subdecl_id) = t.ast_context.resolve_type(typ.ctype).kind.as_underlying_decl() {
+                let is_unnamed = match t.ast_context[subdecl_id].kind {
+                    CDeclKind::Struct { name: None, .. } => true,
+                    CDeclKind::Union { name: None, .. } => true,
+                    CDeclKind::Enum { name: None, .. } => true,
+                    _ => false,
+                };
 
-                    if is_unnamed && !prenamed_decls.contains(&subdecl_id) {
-                        prenamed_decls.insert(decl_id);
-                        prenamed_decls.insert(subdecl_id);
+                if is_unnamed && !prenamed_decls.contains(&subdecl_id) {
+                    prenamed_decls.insert(decl_id);
+                    prenamed_decls.insert(subdecl_id);
 
-                        t.type_converter.borrow_mut().declare_decl_name(decl_id, name);
-                        t.type_converter.borrow_mut().alias_decl_name(subdecl_id, decl_id);
-                    }
+                    t.type_converter.borrow_mut().declare_decl_name(decl_id, name);
+                    t.type_converter.borrow_mut().alias_decl_name(subdecl_id, decl_id);
                 }
             }
         }
+    }
 
-        // Populate renamer with top-level names
-        for (&decl_id, decl) in &t.ast_context.c_decls {
-            let decl_name = match decl.kind {
-                _ if prenamed_decls.contains(&decl_id) => Name::NoName,
-                CDeclKind::Struct { ref name, .. } => some_type_name(name.as_ref().map(String::as_str)),
-                CDeclKind::Enum { ref name, .. } => some_type_name(name.as_ref().map(String::as_str)),
-                CDeclKind::Union { ref name, .. } => some_type_name(name.as_ref().map(String::as_str)),
-                CDeclKind::Typedef { ref name, .. } => Name::TypeName(name),
-                CDeclKind::Function { ref name, .. } => Name::VarName(name),
-                CDeclKind::EnumConstant { ref name, .. } => Name::VarName(name),
-                CDeclKind::Variable { ref ident, .. }
-                if t.ast_context.c_decls_top.contains(&decl_id) => Name::VarName(ident),
-                _ => Name::NoName,
-            };
-            match decl_name {
-                Name::NoName => (),
-                Name::AnonymousType => { t.type_converter.borrow_mut().declare_decl_name(decl_id, "unnamed"); }
-                Name::TypeName(name) => { t.type_converter.borrow_mut().declare_decl_name(decl_id, name); }
-                Name::VarName(name) => { t.renamer.borrow_mut().insert(decl_id, &name); }
-            }
-        }
-
-        // Export all types
-        for (&decl_id, decl) in &t.ast_context.c_decls {
-            let needs_export = match decl.kind {
-                CDeclKind::Struct { .. } => true,
-                CDeclKind::Enum { .. } => true,
-                CDeclKind::EnumConstant { .. } => true,
-                CDeclKind::Union { .. } => true,
-                CDeclKind::Typedef { .. } =>
-                    !prenamed_decls.contains(&decl_id),
-                _ => false,
-            };
-            if needs_export {
-                match t.convert_decl(true, decl_id) {
-                    Ok(ConvertedDecl::Item(item)) => t.items.push(item),
-                    Ok(ConvertedDecl::ForeignItem(mut item)) => t.foreign_items.push(item),
-                    Err(e) => {
-                        let ref k = t.ast_context.c_decls.get(&decl_id).map(|x| &x.kind);
-                        let msg = format!("Skipping declaration due to error: {}, kind: {:?}", e, k);
-                        translate_failure(&t.tcfg, &msg)
-                    },
+    // Populate renamer with top-level names
+    for (&decl_id, decl) in &t.ast_context.c_decls {
+        let decl_name = match decl.kind {
+            _ if prenamed_decls.contains(&decl_id) => Name::NoName,
+            CDeclKind::Struct { ref name, .. } => some_type_name(name.as_ref().map(String::as_str)),
+            CDeclKind::Enum { ref name, .. } => some_type_name(name.as_ref().map(String::as_str)),
+            CDeclKind::Union { ref name, .. } => some_type_name(name.as_ref().map(String::as_str)),
+            CDeclKind::Typedef { ref name, .. } => Name::TypeName(name),
+            CDeclKind::Function { ref name, .. } => Name::VarName(name),
+            CDeclKind::EnumConstant { ref name, .. } => Name::VarName(name),
+            CDeclKind::Variable { ref ident, .. }
+            if t.ast_context.c_decls_top.contains(&decl_id) => Name::VarName(ident),
+            _ => Name::NoName,
+        };
+        match decl_name {
+            Name::NoName => (),
+            Name::AnonymousType => { t.type_converter.borrow_mut().declare_decl_name(decl_id, "unnamed"); }
+            Name::TypeName(name) => { t.type_converter.borrow_mut().declare_decl_name(decl_id, name); }
+            Name::VarName(name) => { t.renamer.borrow_mut().insert(decl_id, &name); }
+        }
+    }
+
+    // Export all types
+    let mut failures = vec![];
+    for (&decl_id, decl) in &t.ast_context.c_decls {
+        let needs_export = match decl.kind {
+            CDeclKind::Struct { .. } => true,
+            CDeclKind::Enum { .. } => true,
+            CDeclKind::EnumConstant { .. } => true,
+            CDeclKind::Union { .. } => true,
+            CDeclKind::Typedef { .. } =>
+                !prenamed_decls.contains(&decl_id),
+            _ => false,
+        };
+        if needs_export {
+            match t.convert_decl(true, decl_id) {
+                Ok(ConvertedDecl::Item(item)) => t.items.push(item),
+                Ok(ConvertedDecl::ForeignItem(mut item)) => t.foreign_items.push(item),
+                Err(e) => {
+                    let ref k = t.ast_context.c_decls.get(&decl_id).map(|x| &x.kind);
+                    let msg = format!("Skipping declaration due to error: {}, kind: {:?}", e, k);
+                    failures.push(msg)
+                },
+            }
+        }
+    }
+    failures
+}
+
+/// Whether a top-level declaration is a function definition to translate. These are translated
+/// one at a time by `translate_function`.
+fn is_function_definition(ast_context: &TypedAstContext, decl_id: CDeclId) -> bool {
+    match ast_context[decl_id].kind {
+        CDeclKind::Function { is_implicit, body: Some(_), .. } =>
+            !is_implicit && !is_simd_intrinsic(ast_context, decl_id),
+        _ => false,
+    }
+}
+
+/// Basenames of the local names picked while translating a function, besides the names of the
+/// C declarations and the fresh names
+const LOCAL_NAME_BASES: [&str; 2] = ["current_block", "vla"];
+
+/// Whether a local name picked for one of `bases` could have to avoid the top-level `name`. Names
+/// are picked by appending `_` and a number to the basename until they are unused.
+fn may_clash_with_local(name: &str, bases: &HashSet<&str>) -> bool {
+    let is_number = |s: &str| !s.is_empty() && s.bytes().all(|b| b.is_ascii_digit());
+    let base = match name.rfind('_') {
+        Some(pos) if is_number(&name[pos + 1..]) => &name[..pos],
+        _ => name,
+    };
+    bases.contains(name) || bases.contains(base) ||
+        (base.starts_with("fresh") && is_number(&base["fresh".len()..]))
+}
+
+/// Key of a function definition in the translation cache. This hashes every AST node reachable
+/// from the definition by structure (see `c_ast::structural_hash`), so that the key doesn't
+/// change when unrelated code is added to the file. The names already assigned to the reached
+/// declarations and their comments are hashed along with them, as are the top-level names that
+/// the function's local names could have to avoid. Other function definitions are reached through
+/// calls, but their bodies and comments are left out since they don't affect the caller.
+fn function_key(t: &Translation, decl_id: CDeclId) -> u64 {
+    let renamer = t.renamer.borrow();
+    let type_converter = t.type_converter.borrow();
+    let comment_context = t.comment_context.borrow();
+    let mut local_bases: HashSet<&str> = LOCAL_NAME_BASES.iter().cloned().collect();
+
+    let mut h = StructuralHasher::new(StableHasher::default());
+    h.write(&(t.ast_context.c_main == Some(decl_id)));
+
+    hash_reachable(&t.ast_context, decl_id, &mut h, |node, h| match node {
+        NodeRef::Decl(id) => {
+            h.write(&renamer.get(&id));
+            h.write(&type_converter.resolve_decl_name(id));
+            match t.ast_context.c_decls.get(&id).map(|decl| &decl.kind) {
+                // The comments of other functions are consumed when those functions are translated
+                Some(&CDeclKind::Function { .. }) if id != decl_id => {}
+                Some(&CDeclKind::Variable { ref ident, .. }) => {
+                    local_bases.insert(ident);
+                    h.write(comment_context.decl_comment(id))
                 }
+                _ => h.write(comment_context.decl_comment(id)),
             }
         }
+        NodeRef::Stmt(id) => {
+            h.write(comment_context.stmt_comment(id));
+            h.write(comment_context.block_end_comment(id))
+        }
+        NodeRef::Type(_) | NodeRef::Expr(_) => {}
+    });
+
+    let mut clashing_names: Vec<&str> = renamer.root_names()
+        .filter(|name| may_clash_with_local(name, &local_bases))
+        .collect();
+    clashing_names.sort();
+    h.write(&clashing_names);
+
+    h.finish()
+}
+
+/// Hash of the options that affect how function definitions are translated, for the translation
+/// cache. Function names are hashed as part of each function's key, so the prefix is left out.
+fn function_options_key(tcfg: &TranslationConfig) -> u64 {
+    let mut hasher = StableHasher::default();
+    tcfg.reloop_cfgs.hash(&mut hasher);
+    tcfg.fail_on_multiple.hash(&mut hasher);
+    tcfg.debug_relooper_labels.hash(&mut hasher);
+    tcfg.translate_asm.hash(&mut hasher);
+    tcfg.use_c_loop_info.hash(&mut hasher);
+    tcfg.use_c_multiple_info.hash(&mut hasher);
+    tcfg.simplify_structures.hash(&mut hasher);
+    tcfg.large_cfg_threshold.hash(&mut hasher);
+    tcfg.fail_on_dominator_fallback.hash(&mut hasher);
+    // Selects the macro that untranslatable expressions in function bodies become
+    tcfg.panic_on_translator_failure.hash(&mut hasher);
+    hasher.finish()
+}
 
-        // Export top-level value declarations
+/// Translate a function definition and print it on its own. The function gets its own comment
+/// store, fresh-name numbering and set of features used, so its output doesn't depend on which
+/// functions were translated before it on the same thread, and can be cached.
+fn translate_function(
+    t: &Translation,
+    cache: Option<&TranslationCache>,
+    decl_id: CDeclId,
+) -> Result<TranslatedFunction, String> {
+    let name = match t.ast_context[decl_id].kind {
+        CDeclKind::Function { ref name, .. } => name.as_str(),
+        _ => "<unnamed>",
+    };
+    t.timer.time_function(name, || translate_function_uncached(t, cache, decl_id))
+}
+
+fn translate_function_uncached(
+    t: &Translation,
+    cache: Option<&TranslationCache>,
+    decl_id: CDeclId,
+) -> Result<TranslatedFunction, String> {
+    let key = cache.map(|cache| (cache, function_key(t, decl_id)));
+    if let Some((cache, key)) = key {
+        if let Some(function) = cache.load(key) {
+            return Ok(function)
+        }
+    }
+
+    let outer_fresh = t.renamer.borrow_mut().replace_next_fresh(0);
+    let outer_store = mem::replace(&mut *t.comment_store.borrow_mut(), CommentStore::new());
+    let outer_features = mem::replace(&mut *t.features.borrow_mut(), HashSet::new());
+    let outer_type_features = t.type_converter.borrow_mut().replace_features(HashSet::new());
+    let outer_cold_path = t.uses_cold_path.replace(false);
+
+    let result = t.convert_decl(true, decl_id);
+
+    t.renamer.borrow_mut().replace_next_fresh(outer_fresh);
+    let store = mem::replace(&mut *t.comment_store.borrow_mut(), outer_store);
+    let mut features = mem::replace(&mut *t.features.borrow_mut(), outer_features);
+    features.extend(t.type_converter.borrow_mut().replace_features(outer_type_features));
+    let uses_cold_path = t.uses_cold_path.replace(outer_cold_path);
+
+    let item = match result? {
+        ConvertedDecl::Item(item) => t.timer.time(Pass::PrettyPrint, || to_string(|s| {
+            s.comments().get_or_insert(vec![]).extend(store.into_comments());
+            s.print_item(&item)
+        })),
+        ConvertedDecl::ForeignItem(_) => return Err(format!("Function definition was translated as an extern declaration")),
+    };
+
+    let function = TranslatedFunction { item, features, uses_cold_path };
+    if let Some((cache, key)) = key {
+        cache.store(key, &function);
+    }
+    Ok(function)
+}
+
+/// A translated function definition whose printed item was moved to the spill file
+#[derive(Debug, Clone)]
+struct SpilledFunction {
+    item: SpilledItem,
+    features: HashSet<&'static str>,
+    uses_cold_path: bool,
+}
+
+/// Translate a function definition and write its item to `spill` right away, so that only one
+/// printed function per thread is ever held in memory
+fn translate_and_spill(
+    t: &Translation,
+    cache: Option<&TranslationCache>,
+    spill: &FunctionSpill,
+    decl_id: CDeclId,
+) -> io::Result<Result<SpilledFunction, String>> {
+    Ok(match translate_function(t, cache, decl_id) {
+        Ok(TranslatedFunction { item, features, uses_cold_path }) => {
+            let item = spill.push(&item)?;
+            Ok(SpilledFunction { item, features, uses_cold_path })
+        },
+        Err(e) => Err(e),
+    })
+}
+
+/// Split the function definitions between `tcfg.jobs` threads. The AST `libsyntax` builds uses a
+/// thread-local interner, so each worker translates from its own copy of the typed AST, writes
+/// its functions to `spill` as they are printed, and returns where they went along with their
+/// positions in the list of function definitions and the memo table statistics of its type
+/// converter for those functions.
+fn spawn_function_workers(
+    t: &Translation,
+    cache: Option<&TranslationCache>,
+    spill: &Arc<FunctionSpill>,
+    function_ids: &[CDeclId],
+) -> Vec<thread::JoinHandle<io::Result<(Vec<(usize, Result<SpilledFunction, String>)>, ConversionStats)>>> {
+    let jobs = t.tcfg.jobs.min(function_ids.len());
+
+    (0..jobs).map(|worker| {
+        let ast_context = t.ast_context.clone();
+        let comment_context = t.comment_context.borrow().clone();
+        let tcfg = t.tcfg.clone();
+        let timer = t.timer.for_thread(worker + 1);
+        let cache = cache.cloned();
+        let spill = spill.clone();
+        let assigned: Vec<(usize, CDeclId)> = function_ids.iter()
+            .cloned()
+            .enumerate()
+            .filter(|&(index, _)| index % jobs == worker)
+            .collect();
+
+        let builder = thread::Builder::new()
+            .name(format!("translate-{}", worker + 1))
+            .stack_size(WORKER_STACK_SIZE);
+        builder.spawn(move || {
+            let mut t = Translation::new(ast_context, tcfg, timer);
+            *t.comment_context.borrow_mut() = comment_context;
+
+            with_globals(|| {
+                // Failures are reported by the main thread, which goes through the same steps and
+                // also counts the type conversions they make
+                declare_types(&mut t);
+                let declared_stats = t.type_converter.borrow().conversion_stats();
+
+                let functions = assigned.into_iter()
+                    .map(|(index, decl_id)| {
+                        translate_and_spill(&t, cache.as_ref(), &spill, decl_id)
+                            .map(|function| (index, function))
+                    })
+                    .collect::<io::Result<Vec<_>>>()?;
+                Ok((functions, t.type_converter.borrow().conversion_stats().since(declared_stats)))
+            })
+        }).expect("Failed to spawn a function translation thread")
+    }).collect()
+}
+
+/// Translate a C translation unit into a Rust crate (or module) written to `out`. Items are
+/// pretty-printed straight into `out`, in the same order for any number of jobs. Function
+/// definitions wait in a temporary file until the crate header is written.
+pub fn translate(
+    ast_context: TypedAstContext,
+    tcfg: TranslationConfig,
+    timer: PassTimer,
+    out: &mut Write,
+) -> io::Result<()> {
+
+    let mut t = Translation::new(ast_context, tcfg, timer);
+
+    if !t.tcfg.translate_entry {
+        t.ast_context.c_main = None;
+    }
+
+    t.ast_context.simplify();
+
+    // Used for testing; so that we don't overlap with C function names
+    if let Some(prefix) = t.tcfg.prefix_function_names.clone() {
+        prefix_names(&mut t, prefix);
+    }
+
+    // Top-level comments are printed along with the declaration that follows them
+    let decl_locs: Vec<(CDeclId, SrcLoc)> = t.ast_context.c_decls_top.iter()
+        .filter_map(|&decl_id| t.ast_context[decl_id].loc.map(|loc| (decl_id, loc)))
+        .collect();
+    t.comment_context.borrow_mut().attach_top_level_comments(&decl_locs);
+
+    // Function definitions are translated on their own, either below or on worker threads, and
+    // are emitted after all the other items in their original order
+    let function_ids: Vec<CDeclId> = t.ast_context.c_decls_top.iter()
+        .cloned()
+        .filter(|&decl_id| is_function_definition(&t.ast_context, decl_id))
+        .collect();
+
+    let cache = t.tcfg.translation_cache.as_ref()
+        .map(|dir| TranslationCache::new(dir, function_options_key(&t.tcfg)));
+
+    let spill = Arc::new(FunctionSpill::new()?);
+
+    let workers = if t.tcfg.jobs > 1 {
+        spawn_function_workers(&t, cache.as_ref(), &spill, &function_ids)
+    } else {
+        vec![]
+    };
+
+    with_globals(|| {
+        for msg in declare_types(&mut t) {
+            translate_failure(&t.tcfg, &msg)
+        }
+
+        // Functions are translated before the other top-level values so that each of them sees
+        // the same state no matter how the functions are split between threads
+        let mut functions: Vec<Option<Result<SpilledFunction, String>>> = if workers.is_empty() {
+            function_ids.iter()
+                .map(|&decl_id| translate_and_spill(&t, cache.as_ref(), &spill, decl_id).map(Some))
+                .collect::<io::Result<Vec<_>>>()?
+        } else {
+            vec![None; function_ids.len()]
+        };
+
+        // Export the other top-level value declarations, keeping the place of each function
+        // definition among them
+        let mut values: Vec<TopLevelValue> = vec![];
+        let mut function_index = 0;
         for top_id in &t.ast_context.c_decls_top {
+            if is_function_definition(&t.ast_context, *top_id) {
+                values.push(TopLevelValue::Function(function_index));
+                function_index += 1;
+                continue
+            }
             let needs_export = match t.ast_context.c_decls[top_id].kind {
-                CDeclKind::Function { is_implicit, .. } => !is_implicit,
+                CDeclKind::Function { is_implicit, .. } =>
+                    !is_implicit && !is_simd_intrinsic(&t.ast_context, *top_id),
                 CDeclKind::Variable { .. } => true,
                 _ => false,
             };
             if needs_export {
                 match t.convert_decl(true, *top_id) {
-                    Ok(ConvertedDecl::Item(mut item)) => t.items.push(item),
+                    Ok(ConvertedDecl::Item(item)) => values.push(TopLevelValue::Item(item)),
                     Ok(ConvertedDecl::ForeignItem(mut item)) => t.foreign_items.push(item),
                     Err(e) => {
                         let ref k = t.ast_context.c_decls.get(top_id).map(|x| &x.kind);
@@ -324,10 +683,48 @@ pub fn translate(ast_context: TypedAstContext, tcfg: TranslationConfig) -> Strin
             }
         }
 
+        // Collect the functions translated on worker threads
+        let mut conversion_stats = t.type_converter.borrow().conversion_stats();
+        for worker in workers {
+            let (translated, worker_stats) = worker.join().expect("Function translation thread panicked")?;
+            for (index, result) in translated {
+                functions[index] = Some(result);
+            }
+            conversion_stats.add(worker_stats);
+        }
+
+        if t.tcfg.type_conversion_stats {
+            eprintln!(
+                "Type conversions: {} memoized, {} built ({:.1}% hit rate)",
+                conversion_stats.hits,
+                conversion_stats.misses,
+                conversion_stats.hit_rate(),
+            );
+        }
+
+        let mut function_items: Vec<Option<SpilledItem>> = vec![];
+        for (result, decl_id) in functions.into_iter().zip(&function_ids) {
+            match result.expect("Function definition was not translated") {
+                Ok(function) => {
+                    t.features.borrow_mut().extend(function.features);
+                    if function.uses_cold_path {
+                        t.uses_cold_path.set(true);
+                    }
+                    function_items.push(Some(function.item))
+                },
+                Err(e) => {
+                    let ref k = t.ast_context.c_decls.get(decl_id).map(|x| &x.kind);
+                    let msg = format!("Failed translating declaration due to error: {}, kind: {:?}", e, k);
+                    translate_failure(&t.tcfg, &msg);
+                    function_items.push(None)
+                },
+            }
+        }
+
         // Add the main entry point
         if let Some(main_id) = t.ast_context.c_main {
             match t.convert_main(main_id) {
-                Ok(item) => t.items.push(item),
+                Ok(item) => values.push(TopLevelValue::Item(item)),
                 Err(e) => {
                     let msg = format!("Failed translating main declaration due to error: {}", e);
                     translate_failure(&t.tcfg, &msg)
@@ -335,8 +732,19 @@ pub fn translate(ast_context: TypedAstContext, tcfg: TranslationConfig) -> Strin
             }
         };
 
+        // Add the function marking unexpected branches as cold
+        if t.uses_cold_path.get() {
+            let decl = mk().fn_decl(vec![], FunctionRetTy::Default(DUMMY_SP), false);
+            let item = mk().single_attr("cold")
+                .call_attr("inline", vec!["never"])
+                .fn_item(COLD_PATH_FN, decl, mk().block(vec![] as Vec<Stmt>));
+            values.push(TopLevelValue::Item(item));
+        }
+
 
-        to_string(|s| {
+        let timer = t.timer.clone();
+        let top_level_comments = t.comment_context.borrow_mut().remove_top_level_comments();
+        let print_items = |s: &mut State| -> io::Result<()> {
             s.comments().get_or_insert(vec![]).extend(t.comment_store.into_inner().into_comments());
 
             if t.tcfg.emit_module {
@@ -359,6 +767,7 @@ pub fn translate(ast_context: TypedAstContext, tcfg: TranslationConfig) -> Strin
 
                 for (key, mut values) in pragmas {
                     values.sort();
+                    values.dedup();
                     for value in values {
                         s.print_attribute(&mk().attribute::<_, TokenStream>(
                             AttrStyle::Inner,
@@ -408,12 +817,42 @@ pub fn translate(ast_context: TypedAstContext, tcfg: TranslationConfig) -> Strin
                 s.print_item(&mk().abi("C").foreign_items(t.foreign_items))?
             }
 
-            // Add the items accumulated
+            // Add the items accumulated, then the values in their original order. Function
+            // definitions were printed as they were translated, and are read back from the spill
+            // file one at a time.
             for x in t.items {
                 s.print_item(&*x)?;
             }
+            for value in values {
+                match value {
+                    TopLevelValue::Item(item) => s.print_item(&*item)?,
+                    TopLevelValue::Function(index) => if let Some(item) = function_items[index] {
+                        s.s.hardbreak()?;
+                        s.s.word(&spill.read(item)?)?;
+                    },
+                }
+            }
+
+            // Comments from outside of any function, that no declaration follows
+            for comment in top_level_comments {
+                s.print_comment(&comments::Comment {
+                    style: comments::CommentStyle::Isolated,
+                    lines: vec![non_doc_comment(comment)],
+                    pos: BytePos(0),
+                })?
+            }
 
             Ok(())
+        };
+
+        timer.time(Pass::PrettyPrint, || {
+            {
+                let ann = NoAnn;
+                let mut printer = rust_printer(Box::new(&mut *out), &ann);
+                print_items(&mut printer)?;
+                printer.s.eof()?;
+            }
+            out.write_all(b"\n")
         })
     })
 }
@@ -460,11 +899,13 @@ enum ConvertedDecl {
 }
 
 impl Translation {
-    pub fn new(mut ast_context: TypedAstContext, tcfg: TranslationConfig) -> Translation {
+    pub fn new(mut ast_context: TypedAstContext, tcfg: TranslationConfig, timer: PassTimer) -> Translation {
         let comment_context = RefCell::new(CommentContext::new(&mut ast_context));
 
         Translation {
             features: RefCell::new(HashSet::new()),
+            uses_cold_path: Cell::new(false),
+            target_features: RefCell::new(HashSet::new()),
             items: vec![],
             foreign_items: vec![],
             type_converter: RefCell::new(TypeConverter::new()),
@@ -483,7 +924,7 @@ impl Translation {
                 "yield",
 
                 // Prevent use for other reasons
-                "main",
+                "main", COLD_PATH_FN,
 
                 // prelude names
                 "drop", "Some", "None", "Ok", "Err",
@@ -492,6 +933,7 @@ impl Translation {
             zero_inits: RefCell::new(HashMap::new()),
             comment_context,
             comment_store: RefCell::new(CommentStore::new()),
+            timer,
         }
     }
 
@@ -835,7 +1277,7 @@ impl Translation {
             }
 
             CDeclKind::Function { .. } if !toplevel => Err(format!("Function declarations must be top-level")),
-            CDeclKind::Function { is_extern, is_inline, typ, ref name, ref parameters, body, .. } => {
+            CDeclKind::Function { is_extern, is_inline, ref attrs, typ, ref name, ref parameters, body, .. } => {
                 let new_name = &self.renamer.borrow().get(&decl_id).expect("Functions should already be renamed");
 
 
@@ -856,13 +1298,13 @@ impl Translation {
                 let is_main = self.ast_context.c_main == Some(decl_id);
 
                 let converted_function =
-                    self.convert_function(s, is_extern, is_inline, is_main, is_var,
+                    self.convert_function(s, is_extern, is_inline, attrs, is_main, is_var,
                                           new_name, name, &args, ret, body);
 
                 converted_function.or_else(|e|
                     match self.tcfg.replace_unsupported_decls {
                         ReplaceMode::Extern if body.is_none() =>
-                            self.convert_function(s, is_extern, false, is_main, is_var,
+                            self.convert_function(s, is_extern, false, attrs, is_main, is_var,
                                                   new_name, name, &args, ret, None),
                         _ => Err(e),
                     })
@@ -940,6 +1382,7 @@ impl Translation {
         span: Span,
         is_extern: bool,
         is_inline: bool,
+        attrs: &HashSet<FunctionAttribute>,
         is_main: bool,
         is_variadic: bool,
         new_name: &str,
@@ -1012,8 +1455,15 @@ impl Translation {
                     CStmtKind::Compound(ref stmts) => stmts,
                     _ => panic!("function body expects to be a compound statement"),
                 };
-                body_stmts.append(&mut self.convert_function_body(name, body_ids, ret)?);
-                let block = stmts_block(body_stmts);
+                let outer_target_features = self.target_features.replace(HashSet::new());
+                let converted_body = self.convert_function_body(name, body_ids, ret);
+                let mut target_features: Vec<String> =
+                    self.target_features.replace(outer_target_features).into_iter().collect();
+                target_features.sort();
+                let (mut stmts, mut end_cmmts) = converted_body?;
+                body_stmts.append(&mut stmts);
+                end_cmmts.extend(self.comment_context.borrow_mut().remove_block_end_comment(body));
+                let block = self.close_block(stmts_block(body_stmts), end_cmmts);
 
                 // Only add linkage attributes if the function is `extern`
                 let mk_ = if is_main {
@@ -1026,6 +1476,32 @@ impl Translation {
                     mk().abi("C")
                 };
 
+                // Calling an intrinsic requires the target features it is compiled with
+                let mk_ = if target_features.is_empty() {
+                    mk_
+                } else {
+                    mk_.call_str_attr("target_feature", "enable", target_features.join(","))
+                };
+
+                // Carry over the inlining hints of the C function. Functions with target features
+                // can't be `#[inline(always)]`, so they just get `#[inline]`.
+                let mk_ = if attrs.contains(&FunctionAttribute::NoInline) {
+                    mk_.call_attr("inline", vec!["never"])
+                } else if attrs.contains(&FunctionAttribute::AlwaysInline) && target_features.is_empty() {
+                    mk_.call_attr("inline", vec!["always"])
+                } else if attrs.contains(&FunctionAttribute::AlwaysInline) || is_inline {
+                    mk_.single_attr("inline")
+                } else {
+                    mk_
+                };
+
+                // There are no Rust counterparts to `hot`, `pure`, `const` and `flatten`
+                let mk_ = if attrs.contains(&FunctionAttribute::Cold) {
+                    mk_.single_attr("cold")
+                } else {
+                    mk_
+                };
+
                 Ok(ConvertedDecl::Item(mk_.span(span).unsafe_().fn_item(new_name, decl, block)))
             } else {
                 // Translating an extern function declaration
@@ -1039,17 +1515,21 @@ impl Translation {
         })
     }
 
+    /// Translate the statements of a function body. The relooped statements come along with the
+    /// comments that none of them follows.
     fn convert_function_body(
         &self,
         name: &str,
         body_ids: &[CStmtId],
         ret: cfg::ImplicitReturnType,
-    ) -> Result<Vec<Stmt>, String> {
+    ) -> Result<(Vec<Stmt>, Vec<String>), String> {
 
         // Function body scope
         self.with_scope(|| {
             if self.tcfg.reloop_cfgs {
-                let (graph, store) = cfg::Cfg::from_stmts(self, body_ids, ret)?;
+                let (graph, store) = self.timer.time(Pass::BuildCfg, || {
+                    cfg::Cfg::from_stmts(self, body_ids, ret)
+                })?;
 
                 if self.tcfg.dump_function_cfgs {
                     graph
@@ -1066,13 +1546,17 @@ impl Translation {
                         .expect("Failed to write CFG .json file");
                 }
 
-                let (lifted_stmts, relooped) = cfg::relooper::reloop(
-                    graph,
-                    store,
-                    self.tcfg.simplify_structures,
-                    self.tcfg.use_c_loop_info,
-                    self.tcfg.use_c_multiple_info,
-                );
+                let (lifted_stmts, relooped) = self.timer.time(Pass::Reloop, || {
+                    cfg::relooper::reloop(
+                        graph,
+                        store,
+                        self.tcfg.simplify_structures,
+                        self.tcfg.use_c_loop_info,
+                        self.tcfg.use_c_multiple_info,
+                        self.tcfg.large_cfg_threshold,
+                        self.tcfg.fail_on_dominator_fallback,
+                    )
+                });
 
                 if self.tcfg.dump_structures {
                     eprintln!("Relooped structures:");
@@ -1102,23 +1586,34 @@ impl Translation {
                     stmts.push(mk().local_stmt(P(local)))
                 }
 
-                stmts.extend(cfg::structures::structured_cfg(
-                    &relooped,
-                    &mut self.comment_store.borrow_mut(),
-                    current_block,
-                    self.tcfg.debug_relooper_labels
-                )?);
-                Ok(stmts)
+                let (structured_stmts, end_cmmts) = self.timer.time(Pass::StructureCfg, || {
+                    cfg::structures::structured_cfg(
+                        &relooped,
+                        &mut self.comment_store.borrow_mut(),
+                        current_block,
+                        self.tcfg.debug_relooper_labels
+                    )
+                })?;
+                stmts.extend(structured_stmts);
+                Ok((stmts, end_cmmts))
             } else {
                 let mut res = vec![];
                 for &stmt in body_ids {
                     res.append(&mut self.convert_stmt(stmt)?)
                 }
-                Ok(res)
+                Ok((res, vec![]))
             }
         })
     }
 
+    /// Give a block the span that puts the given comments right before its closing brace
+    fn close_block(&self, mut block: P<Block>, cmmts: Vec<String>) -> P<Block> {
+        if !cmmts.is_empty() {
+            block.span = self.comment_store.borrow_mut().add_closing_comment(cmmts);
+        }
+        block
+    }
+
     fn convert_stmt(&self, stmt_id: CStmtId) -> Result<Vec<Stmt>, String> {
         let s = {
             let stmt_cmt = self.comment_context.borrow_mut().remove_stmt_comment(stmt_id);
@@ -1158,7 +1653,9 @@ impl Translation {
                         res.append(&mut self.convert_stmt(*stmt)?)
                     }
 
-                    Ok(vec![mk().expr_stmt(mk().block_expr(stmts_block(res)))])
+                    let end_cmmts = self.comment_context.borrow_mut().remove_block_end_comment(stmt_id);
+                    let block = self.close_block(stmts_block(res), end_cmmts);
+                    Ok(vec![mk().expr_stmt(mk().block_expr(block))])
                 })
             },
 
@@ -1868,8 +2365,12 @@ impl Translation {
     pub fn convert_expr(&self, use_: ExprUse, expr_id: CExprId, is_static: bool) -> Result<WithStmts<P<Expr>>, String> {
         match self.ast_context[expr_id].kind {
             CExprKind::BadExpr => Err(format!("convert_expr: expression kind not supported")),
-            CExprKind::ShuffleVector(..) => Err(format!("shuffle vector not supported")),
-            CExprKind::ConvertVector(..) => Err(format!("convert vector not supported")),
+
+            CExprKind::ShuffleVector(ty, lhs, rhs, ref indices) =>
+                self.convert_shuffle_vector(ty, lhs, rhs, indices, is_static),
+
+            CExprKind::ConvertVector(ty, expr) =>
+                self.convert_convert_vector(ty, expr, is_static),
 
             CExprKind::UnaryType(_ty, kind, opt_expr, arg_ty) => {
                 let result = match kind {
@@ -2204,9 +2705,18 @@ impl Translation {
             }
 
             CExprKind::Call(_, func, ref args) => {
+                let intrinsic = match self.ast_context.index(func).kind {
+                    CExprKind::ImplicitCast(_, fexp, CastKind::FunctionToPointerDecay, _) =>
+                        self.simd_intrinsic(fexp),
+                    _ => None,
+                };
+
                 let WithStmts { mut stmts, val: func } = match self.ast_context.index(func).kind {
                     CExprKind::ImplicitCast(_, fexp, CastKind::FunctionToPointerDecay, _) =>
-                        self.convert_expr(ExprUse::RValue, fexp, is_static)?,
+                        match intrinsic {
+                            Some(decl_id) => WithStmts::new(self.simd_intrinsic_path(decl_id)),
+                            None => self.convert_expr(ExprUse::RValue, fexp, is_static)?,
+                        },
 
                     CExprKind::ImplicitCast(_, fexp, CastKind::BuiltinFnToFnPtr, _) =>
                         return self.convert_builtin(fexp, args, is_static),
@@ -2217,7 +2727,13 @@ impl Translation {
                 };
 
                 let mut args_new: Vec<P<Expr>> = vec![];
-                for arg in args {
+                for (index, arg) in args.iter().enumerate() {
+                    if let Some(decl_id) = intrinsic {
+                        if let Some(val) = self.simd_immediate(decl_id, args, index)? {
+                            args_new.push(val);
+                            continue
+                        }
+                    }
                     let WithStmts { stmts: ss, val } = self.convert_expr(ExprUse::RValue, *arg, is_static)?;
                     stmts.extend(ss);
                     args_new.push(val);
@@ -2333,9 +2849,253 @@ impl Translation {
 
             CExprKind::VAArg(..) =>
                 Err(format!("Variable argument lists are not supported")),
+
+            CExprKind::Expect(_, value, expected) =>
+                self.convert_expect(value, expected, is_static),
+
+            CExprKind::Prefetch(_, addr, is_write, locality) => {
+                let WithStmts { mut stmts, val: addr } = self.convert_expr(ExprUse::RValue, addr, is_static)?;
+
+                self.use_feature("core_intrinsics");
+                let intrinsic = if is_write { "prefetch_write_data" } else { "prefetch_read_data" };
+                let locality = mk().lit_expr(mk().int_lit(locality as u128, "i32"));
+                let prefetch = mk().call_expr(mk().path_expr(vec!["", "std", "intrinsics", intrinsic]),
+                                              vec![addr, locality]);
+
+                if use_ == ExprUse::Unused {
+                    stmts.push(mk().semi_stmt(prefetch));
+                    let val = self.panic("Prefetch expression is not supposed to be used");
+                    Ok(WithStmts { stmts, val })
+                } else {
+                    Ok(WithStmts { stmts, val: prefetch })
+                }
+            }
+        }
+    }
+
+    /// Translate `__builtin_expect(value, expected)`. The value is evaluated once, and when it
+    /// differs from the expected one we call a `#[cold]` function. This gives LLVM the same branch
+    /// weights as the C code, and the value is what the builtin returns.
+    fn convert_expect(
+        &self,
+        value: CExprId,
+        expected: CExprId,
+        is_static: bool,
+    ) -> Result<WithStmts<P<Expr>>, String> {
+        let WithStmts { mut stmts, val } = self.convert_expr(ExprUse::RValue, value, is_static)?;
+
+        // Static initializers can't contain statements, and have no branches worth annotating
+        if is_static {
+            return Ok(WithStmts { stmts, val })
+        }
+
+        let WithStmts { stmts: expected_stmts, val: expected } =
+            self.convert_expr(ExprUse::RValue, expected, is_static)?;
+        stmts.extend(expected_stmts);
+
+        // let fresh = value;
+        let val_name = self.renamer.borrow_mut().fresh();
+        stmts.push(mk().local_stmt(P(mk().local(mk().ident_pat(&val_name),
+                                                None as Option<P<Ty>>,
+                                                Some(val)))));
+
+        // if fresh != expected { c2rust_cold_path(); }
+        let mismatch = mk().binary_expr(BinOpKind::Ne, mk().ident_expr(&val_name), expected);
+        let cold_call = mk().call_expr(mk().ident_expr(COLD_PATH_FN), vec![] as Vec<P<Expr>>);
+        let cold_branch = mk().block(vec![mk().semi_stmt(cold_call)]);
+        stmts.push(mk().semi_stmt(mk().ifte_expr(mismatch, cold_branch, None as Option<P<Expr>>)));
+        self.uses_cold_path.set(true);
+
+        Ok(WithStmts { stmts, val: mk().ident_expr(val_name) })
+    }
+
+    /// The element type and lane count of a vector type, looking through typedefs
+    fn vector_lanes(&self, ctype: CTypeId) -> Option<(CTypeId, usize)> {
+        match self.ast_context.resolve_type(ctype).kind {
+            CTypeKind::Vector(elt, count) => Some((elt.ctype, count)),
+            _ => None,
+        }
+    }
+
+    /// If `fexp` refers to one of the `<immintrin.h>` intrinsics, its declaration
+    fn simd_intrinsic(&self, fexp: CExprId) -> Option<CDeclId> {
+        match self.ast_context[fexp].kind {
+            CExprKind::DeclRef(_, decl_id) if is_simd_intrinsic(&self.ast_context, decl_id) =>
+                Some(decl_id),
+            _ => None,
+        }
+    }
+
+    /// The path of the `std::arch::x86_64` counterpart of an intrinsic. The function being
+    /// converted has to enable the target features that the intrinsic is declared with.
+    fn simd_intrinsic_path(&self, decl_id: CDeclId) -> P<Expr> {
+        match self.ast_context[decl_id].kind {
+            CDeclKind::Function { ref name, ref target_features, .. } => {
+                self.target_features.borrow_mut().extend(target_features.iter().cloned());
+                mk().path_expr(vec!["", "std", "arch", "x86_64", name.as_str()])
+            }
+            _ => panic!("{:?} is not an intrinsic", decl_id),
         }
     }
 
+    /// If argument `index` of a call to an intrinsic is an immediate operand, its value.
+    /// `std::arch` only accepts constants for these, so the C argument is folded to a literal.
+    fn simd_immediate(
+        &self,
+        decl_id: CDeclId,
+        args: &[CExprId],
+        index: usize,
+    ) -> Result<Option<P<Expr>>, String> {
+        let (name, parameters) = match self.ast_context[decl_id].kind {
+            CDeclKind::Function { ref name, ref parameters, .. } => (name, parameters),
+            _ => return Ok(None),
+        };
+        let is_const = parameters.get(index).map_or(false, |&param_id| {
+            match self.ast_context[param_id].kind {
+                CDeclKind::Variable { typ, .. } => typ.qualifiers.is_const &&
+                    self.ast_context.resolve_type(typ.ctype).kind.is_integral_type(),
+                _ => false,
+            }
+        });
+        if !simd_intrinsics::is_immediate_arg(name, index, args.len(), is_const) {
+            return Ok(None)
+        }
+        match self.const_int_value(args[index]) {
+            Some(value) => Ok(Some(signed_int_expr(value))),
+            None => Err(format!("Argument {} of `{}` must be an integer constant", index + 1, name)),
+        }
+    }
+
+    /// The value of an integer constant expression, such as `_MM_FROUND_TO_ZERO | 1`
+    fn const_int_value(&self, expr: CExprId) -> Option<i64> {
+        match self.ast_context[expr].kind {
+            CExprKind::Literal(_, CLiteral::Integer(value)) |
+            CExprKind::Literal(_, CLiteral::Character(value)) => Some(value as i64),
+
+            CExprKind::DeclRef(_, decl_id) => match self.ast_context[decl_id].kind {
+                CDeclKind::EnumConstant { value: ConstIntExpr::I(value), .. } => Some(value),
+                CDeclKind::EnumConstant { value: ConstIntExpr::U(value), .. } => Some(value as i64),
+                _ => None,
+            },
+
+            CExprKind::ImplicitCast(_, expr, CastKind::IntegralCast, _) |
+            CExprKind::ImplicitCast(_, expr, CastKind::NoOp, _) |
+            CExprKind::ExplicitCast(_, expr, CastKind::IntegralCast, _) |
+            CExprKind::ExplicitCast(_, expr, CastKind::NoOp, _) => self.const_int_value(expr),
+
+            CExprKind::Unary(_, op, expr) => {
+                let value = self.const_int_value(expr)?;
+                match op {
+                    c_ast::UnOp::Plus | c_ast::UnOp::Extension => Some(value),
+                    c_ast::UnOp::Negate => Some(value.wrapping_neg()),
+                    c_ast::UnOp::Complement => Some(!value),
+                    _ => None,
+                }
+            }
+
+            CExprKind::Binary(_, op, lhs, rhs, _, _) => {
+                let lhs = self.const_int_value(lhs)?;
+                let rhs = self.const_int_value(rhs)?;
+                match op {
+                    c_ast::BinOp::Add => Some(lhs.wrapping_add(rhs)),
+                    c_ast::BinOp::Subtract => Some(lhs.wrapping_sub(rhs)),
+                    c_ast::BinOp::Multiply => Some(lhs.wrapping_mul(rhs)),
+                    c_ast::BinOp::Divide => lhs.checked_div(rhs),
+                    c_ast::BinOp::Modulus => lhs.checked_rem(rhs),
+                    c_ast::BinOp::ShiftLeft => Some(lhs.wrapping_shl(rhs as u32)),
+                    c_ast::BinOp::ShiftRight => Some(lhs.wrapping_shr(rhs as u32)),
+                    c_ast::BinOp::BitAnd => Some(lhs & rhs),
+                    c_ast::BinOp::BitOr => Some(lhs | rhs),
+                    c_ast::BinOp::BitXor => Some(lhs ^ rhs),
+                    _ => None,
+                }
+            }
+
+            _ => None,
+        }
+    }
+
+    /// Bind a vector to a fresh local viewed as an array of its lanes, returning that local's name
+    fn vector_as_lanes(
+        &self,
+        expr: CExprId,
+        stmts: &mut Vec<Stmt>,
+        is_static: bool,
+    ) -> Result<(String, CTypeId, usize), String> {
+        let ty = self.ast_context[expr].kind.get_type().ok_or_else(|| format!("bad vector type"))?;
+        let (elt, count) = self.vector_lanes(ty).ok_or_else(|| format!("expected a vector type"))?;
+
+        let WithStmts { stmts: expr_stmts, val } = self.convert_expr(ExprUse::RValue, expr, is_static)?;
+        stmts.extend(expr_stmts);
+
+        let lanes_ty = mk().array_ty(self.convert_type(elt)?, mk().lit_expr(mk().int_lit(count as u128, LitIntType::Unsuffixed)));
+        let name = self.renamer.borrow_mut().fresh();
+        let init = transmute_expr(self.convert_type(ty)?, lanes_ty, val);
+        stmts.push(mk().local_stmt(P(mk().local(mk().ident_pat(&name),
+                                                None as Option<P<Ty>>,
+                                                Some(init)))));
+        Ok((name, elt, count))
+    }
+
+    /// Reassemble an array of lanes into a value of vector type `ty`
+    fn lanes_as_vector(&self, ty: CTypeId, lanes: Vec<P<Expr>>) -> Result<P<Expr>, String> {
+        let (elt, count) = self.vector_lanes(ty).ok_or_else(|| format!("expected a vector type"))?;
+        let lanes_ty = mk().array_ty(self.convert_type(elt)?, mk().lit_expr(mk().int_lit(count as u128, LitIntType::Unsuffixed)));
+        Ok(transmute_expr(lanes_ty, self.convert_type(ty)?, mk().array_expr(lanes)))
+    }
+
+    /// Translate `__builtin_shufflevector(lhs, rhs, indices...)`. Lane `i` of the result is lane
+    /// `indices[i]` of the concatenation of `lhs` and `rhs`; an index of -1 means the lane is
+    /// undefined, so we pick the first lane.
+    fn convert_shuffle_vector(
+        &self,
+        ty: CQualTypeId,
+        lhs: CExprId,
+        rhs: CExprId,
+        indices: &[i64],
+        is_static: bool,
+    ) -> Result<WithStmts<P<Expr>>, String> {
+        let mut stmts = vec![];
+        let (lhs_name, _, count) = self.vector_as_lanes(lhs, &mut stmts, is_static)?;
+        let (rhs_name, _, _) = self.vector_as_lanes(rhs, &mut stmts, is_static)?;
+
+        let lanes = indices.iter().map(|&idx| {
+            let (name, lane) = if idx < 0 {
+                (&lhs_name, 0)
+            } else if (idx as usize) < count {
+                (&lhs_name, idx as usize)
+            } else {
+                (&rhs_name, idx as usize - count)
+            };
+            let lane = mk().lit_expr(mk().int_lit(lane as u128, LitIntType::Unsuffixed));
+            mk().index_expr(mk().ident_expr(name), lane)
+        }).collect();
+
+        let val = self.lanes_as_vector(ty.ctype, lanes)?;
+        Ok(WithStmts { stmts, val })
+    }
+
+    /// Translate `__builtin_convertvector(expr, ty)` as a lane-by-lane `as` cast
+    fn convert_convert_vector(
+        &self,
+        ty: CQualTypeId,
+        expr: CExprId,
+        is_static: bool,
+    ) -> Result<WithStmts<P<Expr>>, String> {
+        let mut stmts = vec![];
+        let (name, _, count) = self.vector_as_lanes(expr, &mut stmts, is_static)?;
+        let (target_elt, _) = self.vector_lanes(ty.ctype).ok_or_else(|| format!("expected a vector type"))?;
+        let target_elt = self.convert_type(target_elt)?;
+
+        let lanes = (0..count).map(|lane| {
+            let lane = mk().lit_expr(mk().int_lit(lane as u128, LitIntType::Unsuffixed));
+            mk().cast_expr(mk().index_expr(mk().ident_expr(&name), lane), target_elt.clone())
+        }).collect();
+
+        let val = self.lanes_as_vector(ty.ctype, lanes)?;
+        Ok(WithStmts { stmts, val })
+    }
+
     fn convert_builtin(
         &self,
         fexp: CExprId,
@@ -2546,6 +3306,15 @@ impl Translation {
                         let source_ty = self.convert_type(source_ty_id)?;
                         let target_ty = self.convert_type(ty.ctype)?;
                         Ok(transmute_expr(source_ty, target_ty, x))
+                    } else if self.vector_lanes(ty.ctype).is_some() || self.vector_lanes(source_ty_id).is_some() {
+                        // Vector bitcasts, e.g. `__v4si` to `__m128i`, reinterpret the same bits
+                        let source_ty = self.convert_type(source_ty_id)?;
+                        let target_ty = self.convert_type(ty.ctype)?;
+                        if source_ty == target_ty {
+                            Ok(x)
+                        } else {
+                            Ok(transmute_expr(source_ty, target_ty, x))
+                        }
                     } else {
                         // Normal case
                         let target_ty = self.convert_type(ty.ctype)?;
@@ -3637,3 +4406,60 @@ impl Translation {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::env;
+    use std::fs;
+    use std::process;
+
+    fn config() -> TranslationConfig {
+        TranslationConfig {
+            reloop_cfgs: true,
+            fail_on_multiple: false,
+            dump_function_cfgs: false,
+            json_function_cfgs: false,
+            dump_cfg_liveness: false,
+            dump_structures: false,
+            debug_relooper_labels: false,
+            cross_checks: false,
+            cross_check_configs: vec![],
+            prefix_function_names: None,
+            translate_asm: false,
+            translate_entry: false,
+            use_c_loop_info: false,
+            use_c_multiple_info: false,
+            simplify_structures: true,
+            large_cfg_threshold: 1000,
+            fail_on_dominator_fallback: false,
+            panic_on_translator_failure: false,
+            emit_module: false,
+            fail_on_error: false,
+            replace_unsupported_decls: ReplaceMode::None,
+            jobs: 1,
+            translation_cache: None,
+            type_conversion_stats: false,
+        }
+    }
+
+    #[test]
+    fn test_panic_on_translator_failure_misses_cache() {
+        let dir = env::temp_dir().join(format!("c2rust-options-test-{}", process::id()));
+        let _ = fs::remove_dir_all(&dir);
+        let dir = dir.to_str().unwrap().to_owned();
+
+        let function = TranslatedFunction {
+            item: "pub fn f() -> i32 { compile_error!(\"unsupported\") }".to_owned(),
+            features: HashSet::new(),
+            uses_cold_path: false,
+        };
+        let mut tcfg = config();
+        TranslationCache::new(&dir, function_options_key(&tcfg)).store(42, &function);
+        assert!(TranslationCache::new(&dir, function_options_key(&tcfg)).load(42).is_some());
+
+        tcfg.panic_on_translator_failure = true;
+        assert!(TranslationCache::new(&dir, function_options_key(&tcfg)).load(42).is_none());
+        let _ = fs::remove_dir_all(&dir);
+    }
+}
@@ -0,0 +1,143 @@
+#ifndef CROSS_CHECK_HASHERS_H
+#define CROSS_CHECK_HASHERS_H
+
+#pragma once
+
+// Inline implementations of the aggregate hashers built into the runtime.
+// When a translation unit includes this header (cross_checks.h does),
+// the hash functions that the clang plugin generates call these instead
+// of the out-of-line __c2rust_hasher_H_* functions, so the compiler can
+// inline the whole hashing path. The plugin allocates the hasher states
+// itself, so their sizes need to match its table of built-in hashers.
+
+#include <stdint.h>
+
+#include "cross_checks.h"
+
+#define __C2RUST_HASHER_FN    DISABLE_XCHECKS(true) static inline
+
+// JodyHasher implementation
+struct __c2rust_hasher_jodyhash_state {
+    uint64_t state;
+};
+
+#define __C2RUST_JODY_HASH_CONSTANT  0x1f3d5b79UL
+
+__C2RUST_HASHER_FN
+void __c2rust_inline_hasher_jodyhash_init(char *p) {
+    struct __c2rust_hasher_jodyhash_state *jh =
+        (struct __c2rust_hasher_jodyhash_state*) p;
+    jh->state = 0;
+}
+
+__C2RUST_HASHER_FN
+void __c2rust_inline_hasher_jodyhash_update(char *p, uint64_t x) {
+    struct __c2rust_hasher_jodyhash_state *jh =
+        (struct __c2rust_hasher_jodyhash_state*) p;
+    uint64_t s = jh->state;
+    s += x;
+    s += __C2RUST_JODY_HASH_CONSTANT;
+    s = (s << 14) | (s >> 50);
+    s ^= x;
+    s = (s << 14) | (s >> 50);
+    s ^= __C2RUST_JODY_HASH_CONSTANT;
+    s += x;
+    jh->state = s;
+}
+
+__C2RUST_HASHER_FN
+uint64_t __c2rust_inline_hasher_jodyhash_finish(char *p) {
+    struct __c2rust_hasher_jodyhash_state *jh =
+        (struct __c2rust_hasher_jodyhash_state*) p;
+    return jh->state;
+}
+
+// xxh64 hasher implementation, which computes XXH64 (with a seed of 0)
+// of the little-endian bytes of the words passed to it. It spreads the
+// words over 4 independent lanes, so it needs about as many operations
+// per word as JodyHash, but without a single dependency chain through
+// all of them. The Rust runtime's Xxh64Hasher must produce the same
+// hashes, and both are tested against cross-checks/hash-test-vectors.
+struct __c2rust_hasher_xxh64_state {
+    uint64_t lanes[4];
+    uint64_t pending[4];  // Words of the current 32-byte stripe
+    uint64_t count;       // Total number of words
+};
+
+#define __C2RUST_XXH64_PRIME1 0x9e3779b185ebca87ULL
+#define __C2RUST_XXH64_PRIME2 0xc2b2ae3d27d4eb4fULL
+#define __C2RUST_XXH64_PRIME3 0x165667b19e3779f9ULL
+#define __C2RUST_XXH64_PRIME4 0x85ebca77c2b2ae63ULL
+#define __C2RUST_XXH64_PRIME5 0x27d4eb2f165667c5ULL
+
+__C2RUST_HASHER_FN
+uint64_t __c2rust_xxh64_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+__C2RUST_HASHER_FN
+uint64_t __c2rust_xxh64_round(uint64_t acc, uint64_t x) {
+    acc += x * __C2RUST_XXH64_PRIME2;
+    acc = __c2rust_xxh64_rotl(acc, 31);
+    return acc * __C2RUST_XXH64_PRIME1;
+}
+
+__C2RUST_HASHER_FN
+uint64_t __c2rust_xxh64_merge_round(uint64_t h, uint64_t lane) {
+    h ^= __c2rust_xxh64_round(0, lane);
+    return h * __C2RUST_XXH64_PRIME1 + __C2RUST_XXH64_PRIME4;
+}
+
+__C2RUST_HASHER_FN
+void __c2rust_inline_hasher_xxh64_init(char *p) {
+    struct __c2rust_hasher_xxh64_state *xh =
+        (struct __c2rust_hasher_xxh64_state*) p;
+    xh->lanes[0] = __C2RUST_XXH64_PRIME1 + __C2RUST_XXH64_PRIME2;
+    xh->lanes[1] = __C2RUST_XXH64_PRIME2;
+    xh->lanes[2] = 0;
+    xh->lanes[3] = -__C2RUST_XXH64_PRIME1;
+    xh->count = 0;
+}
+
+__C2RUST_HASHER_FN
+void __c2rust_inline_hasher_xxh64_update(char *p, uint64_t x) {
+    struct __c2rust_hasher_xxh64_state *xh =
+        (struct __c2rust_hasher_xxh64_state*) p;
+    uint64_t idx = xh->count++ & 3;
+    xh->pending[idx] = x;
+    if (idx == 3) {
+        for (int i = 0; i < 4; i++)
+            xh->lanes[i] = __c2rust_xxh64_round(xh->lanes[i], xh->pending[i]);
+    }
+}
+
+__C2RUST_HASHER_FN
+uint64_t __c2rust_inline_hasher_xxh64_finish(char *p) {
+    struct __c2rust_hasher_xxh64_state *xh =
+        (struct __c2rust_hasher_xxh64_state*) p;
+    uint64_t h;
+    if (xh->count >= 4) {
+        h = __c2rust_xxh64_rotl(xh->lanes[0], 1) +
+            __c2rust_xxh64_rotl(xh->lanes[1], 7) +
+            __c2rust_xxh64_rotl(xh->lanes[2], 12) +
+            __c2rust_xxh64_rotl(xh->lanes[3], 18);
+        for (int i = 0; i < 4; i++)
+            h = __c2rust_xxh64_merge_round(h, xh->lanes[i]);
+    } else {
+        h = __C2RUST_XXH64_PRIME5;
+    }
+    h += xh->count * sizeof(uint64_t);
+    // Mix in the words of the last, incomplete stripe
+    for (uint64_t i = 0; i < (xh->count & 3); i++) {
+        h ^= __c2rust_xxh64_round(0, xh->pending[i]);
+        h = __c2rust_xxh64_rotl(h, 27) * __C2RUST_XXH64_PRIME1 + __C2RUST_XXH64_PRIME4;
+    }
+    h ^= h >> 33;
+    h *= __C2RUST_XXH64_PRIME2;
+    h ^= h >> 29;
+    h *= __C2RUST_XXH64_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+#endif // CROSS_CHECK_HASHERS_H
@@ -11,4 +11,7 @@
 #define CUSTOM_XCHECK(x)        CROSS_CHECK("{ custom: " x " }")
 #define CUSTOM_HASH_XCHECK(x)   CROSS_CHECK("{ custom_hash: " x " }")
 
+// Lets the plugin inline the built-in hashers into the hash functions
+#include "cross_check_hashers.h"
+
 #endif // CROSS_CHECKS_H
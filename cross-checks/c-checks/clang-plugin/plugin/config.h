@@ -37,6 +37,7 @@ struct XCheck {
 LLVM_YAML_DECLARE_MAPPING_TRAITS(XCheck)
 LLVM_YAML_DECLARE_ENUM_TRAITS(XCheck::Tag)
 LLVM_YAML_IS_STRING_MAP(XCheck)
+LLVM_YAML_IS_STRING_MAP(uint64_t)
 
 namespace llvm {
 namespace yaml {
@@ -98,6 +99,8 @@ struct DefaultsConfig {
     llvm::Optional<XCheck> exit;
     llvm::Optional<XCheck> all_args;
     llvm::Optional<XCheck> ret;
+    llvm::Optional<uint64_t> sample_period;
+    llvm::Optional<uint64_t> hash_depth;
     // TODO: do we want entry/exit_extra here???
 
     DefaultsConfig() = default;
@@ -107,6 +110,8 @@ struct DefaultsConfig {
         io.mapOptional("exit",      exit);
         io.mapOptional("all_args",  all_args);
         io.mapOptional("return",    ret);
+        io.mapOptional("sample_period", sample_period);
+        io.mapOptional("hash_depth", hash_depth);
     }
 
     // Update the optionals in this config with the contents
@@ -118,6 +123,8 @@ struct DefaultsConfig {
         UPDATE_FIELD(exit);
         UPDATE_FIELD(all_args);
         UPDATE_FIELD(ret);
+        UPDATE_FIELD(sample_period);
+        UPDATE_FIELD(hash_depth);
 #undef UPDATE_FIELD
     }
 };
@@ -132,6 +139,13 @@ struct FunctionConfig {
     llvm::Optional<XCheck> ret;
     llvm::Optional<std::string> ahasher;
     llvm::Optional<std::string> shasher;
+    // Only check one out of every sample_period calls,
+    // or use the run-time global period if it's 0
+    llvm::Optional<uint64_t> sample_period;
+    // How deep to follow pointers when hashing the arguments
+    // and return value, overridden per argument by arg_hash_depths
+    llvm::Optional<uint64_t> hash_depth;
+    std::map<std::string, uint64_t> arg_hash_depths;
     // TODO: nested
     std::vector<ExtraXCheck> entry_extra;
     std::vector<ExtraXCheck> exit_extra;
@@ -147,6 +161,9 @@ struct FunctionConfig {
         io.mapOptional("return",    ret);
         io.mapOptional("ahasher",   ahasher);
         io.mapOptional("shasher",   shasher);
+        io.mapOptional("sample_period", sample_period);
+        io.mapOptional("hash_depth", hash_depth);
+        io.mapOptional("arg_hash_depths", arg_hash_depths);
         io.mapOptional("entry_extra", entry_extra);
         io.mapOptional("exit_extra",  exit_extra);
     }
@@ -161,9 +178,13 @@ struct FunctionConfig {
         UPDATE_FIELD(ret);
         UPDATE_FIELD(ahasher);
         UPDATE_FIELD(shasher);
+        UPDATE_FIELD(sample_period);
+        UPDATE_FIELD(hash_depth);
 #undef UPDATE_FIELD
         for (auto &it : other.args)
             args.insert_or_assign(it.first, it.second);
+        for (auto &it : other.arg_hash_depths)
+            arg_hash_depths.insert_or_assign(it.first, it.second);
         // Append other.entry_extra to ours
         // FIXME: should replace the existing entries instead???
         entry_extra.insert(entry_extra.end(),
@@ -183,6 +204,9 @@ struct StructConfig {
     std::map<std::string, XCheck> fields;
     llvm::Optional<std::string> ahasher;
     llvm::Optional<std::string> shasher;
+    // Maximum depth to hash this structure at; deeper
+    // callers only follow its pointers this many levels
+    llvm::Optional<uint64_t> hash_depth;
 
     StructConfig(std::string_view n) : name(n) {}
 
@@ -193,6 +217,7 @@ struct StructConfig {
         io.mapOptional("fields",        fields);
         io.mapOptional("ahasher",       ahasher);
         io.mapOptional("shasher",       shasher);
+        io.mapOptional("hash_depth",    hash_depth);
     }
 
     void update(const StructConfig &other) {
@@ -203,6 +228,7 @@ struct StructConfig {
         UPDATE_FIELD(custom_hash);
         UPDATE_FIELD(ahasher);
         UPDATE_FIELD(shasher);
+        UPDATE_FIELD(hash_depth);
 #undef UPDATE_FIELD
         for (auto &it : other.fields)
             fields.insert_or_assign(it.first, it.second);
@@ -0,0 +1,93 @@
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
+
+#include "config_index.h"
+
+namespace crosschecks {
+
+static constexpr char INDEX_MAGIC[] = "XCFGIDX1";
+static constexpr uint32_t INDEX_VERSION = 1;
+static constexpr size_t HEADER_SIZE = 32;
+static constexpr size_t SLOT_SIZE = 40;
+
+static inline uint32_t read_u32(const char *p) {
+    return llvm::support::endian::read32le(p);
+}
+
+static inline uint64_t read_u64(const char *p) {
+    return llvm::support::endian::read64le(p);
+}
+
+static llvm::Error index_error(const llvm::Twine &msg) {
+    return llvm::make_error<llvm::StringError>(msg, llvm::inconvertibleErrorCode());
+}
+
+uint64_t ConfigIndex::key_hash(llvm::StringRef file, ItemKind kind,
+                               llvm::StringRef name) {
+    // 64-bit FNV-1a over "<file>\xff<kind><name>"
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto add_byte = [&hash] (uint8_t byte) {
+        hash ^= byte;
+        hash *= 0x100000001b3ULL;
+    };
+    for (auto c : file.bytes())
+        add_byte(c);
+    add_byte(0xff);
+    add_byte(static_cast<uint8_t>(kind));
+    for (auto c : name.bytes())
+        add_byte(c);
+    // Zero marks the empty slots
+    return hash == 0 ? 1 : hash;
+}
+
+bool ConfigIndex::is_index(llvm::StringRef data) {
+    return data.startswith(llvm::StringRef(INDEX_MAGIC, sizeof(INDEX_MAGIC) - 1));
+}
+
+llvm::Expected<std::unique_ptr<ConfigIndex>>
+ConfigIndex::create(std::unique_ptr<llvm::MemoryBuffer> buffer) {
+    auto data = buffer->getBuffer();
+    if (data.size() < HEADER_SIZE || !is_index(data))
+        return index_error("invalid cross-check configuration index");
+
+    auto version = read_u32(data.data() + 8);
+    if (version != INDEX_VERSION)
+        return index_error("unsupported configuration index version: " +
+                           llvm::Twine(version));
+
+    auto num_slots = read_u32(data.data() + 12);
+    auto strings_size = read_u64(data.data() + 24);
+    uint64_t strings_pos = HEADER_SIZE + uint64_t(num_slots) * SLOT_SIZE;
+    if (!llvm::isPowerOf2_32(num_slots) || data.size() != strings_pos + strings_size)
+        return index_error("truncated cross-check configuration index");
+
+    auto slots = data.data() + HEADER_SIZE;
+    auto strings = data.substr(strings_pos);
+    return std::unique_ptr<ConfigIndex>(
+        new ConfigIndex(std::move(buffer), num_slots, slots, strings));
+}
+
+llvm::SmallVector<llvm::StringRef, 1>
+ConfigIndex::lookup(llvm::StringRef file, ItemKind kind,
+                    llvm::StringRef name) const {
+    llvm::SmallVector<llvm::StringRef, 1> res;
+    auto hash = key_hash(file, kind, name);
+    auto get_string = [this] (const char *p) {
+        return strings.substr(read_u32(p), read_u32(p + 4));
+    };
+    // Linear probing, until we hit an empty slot
+    auto slot = hash & (num_slots - 1);
+    for (uint32_t i = 0; i < num_slots; i++) {
+        auto p = slots + slot * SLOT_SIZE;
+        auto slot_hash = read_u64(p);
+        if (slot_hash == 0)
+            break;
+        if (slot_hash == hash && read_u32(p + 8) == kind &&
+            get_string(p + 16) == file && get_string(p + 24) == name)
+            res.push_back(get_string(p + 32));
+        slot = (slot + 1) & (num_slots - 1);
+    }
+    return res;
+}
+
+} // namespace crosschecks
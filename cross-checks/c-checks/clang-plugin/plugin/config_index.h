@@ -0,0 +1,55 @@
+#ifndef CROSSCHECK_PLUGIN_CONFIG_INDEX_H
+#define CROSSCHECK_PLUGIN_CONFIG_INDEX_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace crosschecks {
+
+// Binary index of configuration items built by the `xcfg-index` tool
+// from the Rust cross-check configuration crate, which describes the format.
+// The index is memory-mapped and looked up by (file, kind, name) hash,
+// and only the items we find are parsed, which is much faster than parsing
+// a large YAML configuration file for every translation unit.
+class ConfigIndex {
+public:
+    enum ItemKind : uint32_t {
+        DEFAULTS = 0,
+        FUNCTION = 1,
+        STRUCT   = 2,
+        OTHER    = 3,
+    };
+
+private:
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    uint32_t num_slots;
+    const char *slots;
+    llvm::StringRef strings;
+
+    ConfigIndex(std::unique_ptr<llvm::MemoryBuffer> buf, uint32_t ns,
+                const char *sl, llvm::StringRef str)
+        : buffer(std::move(buf)), num_slots(ns), slots(sl), strings(str) {}
+
+    static uint64_t key_hash(llvm::StringRef file, ItemKind kind,
+                             llvm::StringRef name);
+
+public:
+    static bool is_index(llvm::StringRef data);
+
+    static llvm::Expected<std::unique_ptr<ConfigIndex>>
+    create(std::unique_ptr<llvm::MemoryBuffer> buffer);
+
+    // Return the YAML of all items matching the key,
+    // in the order they appear in the configuration files
+    llvm::SmallVector<llvm::StringRef, 1>
+    lookup(llvm::StringRef file, ItemKind kind, llvm::StringRef name) const;
+};
+
+} // namespace crosschecks
+
+#endif // CROSSCHECK_PLUGIN_CONFIG_INDEX_H
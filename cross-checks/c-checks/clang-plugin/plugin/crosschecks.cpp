@@ -11,6 +11,7 @@
 #include "llvm/Option/ArgList.h"
 #include "llvm/Option/OptTable.h"
 #include "llvm/Option/Option.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/YAMLTraits.h"
 
@@ -33,6 +34,25 @@ uint32_t djb2_hash(llvm::StringRef str) {
     return hash;
 }
 
+// Value of the entry cross-check for a function, if it is known
+// at compile time; this is what libfakechecks counts calls by
+static llvm::Optional<uint64_t> entry_xcheck_value(const XCheck &xcheck,
+                                                    llvm::StringRef func_name) {
+    switch (xcheck.type) {
+    case XCheck::DEFAULT:
+        return djb2_hash(func_name);
+
+    case XCheck::FIXED:
+        return std::get<uint64_t>(xcheck.data);
+
+    case XCheck::DJB2:
+        return djb2_hash(std::get<std::string>(xcheck.data));
+
+    default:
+        return llvm::None;
+    }
+}
+
 // Code saved for later
 #if 0
                 for (auto *attr : fd->attrs()) {
@@ -252,12 +272,12 @@ CrossCheckInserter::parse_custom_xcheck(std::string_view sv,
 }
 
 template<typename DefaultFn, typename CustomArgsFn>
-CrossCheckInserter::TinyStmtVec
-CrossCheckInserter::build_xcheck(const XCheck &xcheck, XCheck::Tag tag,
-                                 ASTContext &ctx, DefaultFn default_fn,
-                                 CustomArgsFn custom_args_fn) {
+void CrossCheckInserter::build_xcheck(XCheckBatch &batch,
+                                      const XCheck &xcheck, XCheck::Tag tag,
+                                      ASTContext &ctx, DefaultFn default_fn,
+                                      CustomArgsFn custom_args_fn) {
     if (xcheck.type == XCheck::DISABLED)
-        return {};
+        return;
 
     Expr *rb_xcheck_val = nullptr;
     switch (xcheck.type) {
@@ -307,42 +327,288 @@ CrossCheckInserter::build_xcheck(const XCheck &xcheck, XCheck::Tag tag,
         llvm_unreachable("Invalid XCheck reached");
     }
     if (rb_xcheck_val == nullptr)
-        return {};
+        return;
 
-    TinyStmtVec res;
-    auto rb_xcheck_tag =
+    batch.emplace_back(tag, rb_xcheck_val);
+}
+
+std::tuple<VarDecl*, CrossCheckInserter::StmtVec>
+CrossCheckInserter::build_xcheck_sampling(uint64_t sample_period,
+                                          FunctionDecl *parent,
+                                          ASTContext &ctx) {
+    // static unsigned long __c2rust_xcheck_calls;
+    auto calls_ty = ctx.UnsignedLongTy;
+    auto calls_id = &ctx.Idents.get("__c2rust_xcheck_calls");
+    auto calls_var =
+        VarDecl::Create(ctx, parent, SourceLocation(), SourceLocation(),
+                        calls_id, calls_ty, nullptr, SC_Static);
+    auto calls_decl_stmt =
+        new (ctx) DeclStmt(DeclGroupRef(calls_var),
+                           SourceLocation(),
+                           SourceLocation());
+
+    // int __c2rust_xcheck_sampled =
+    //     __c2rust_xcheck_sample(&__c2rust_xcheck_calls, sample_period);
+    auto calls_ref =
+        new (ctx) DeclRefExpr(calls_var, false, calls_ty,
+                              VK_LValue, SourceLocation());
+    auto calls_ptr =
+        new (ctx) UnaryOperator(calls_ref, UO_AddrOf,
+                                ctx.getPointerType(calls_ty),
+                                VK_RValue, OK_Ordinary,
+                                SourceLocation());
+    auto period_lit =
         IntegerLiteral::Create(ctx,
-                               llvm::APInt(8, tag),
-                               ctx.UnsignedCharTy,
+                               llvm::APInt(ctx.getTypeSize(calls_ty),
+                                           sample_period),
+                               calls_ty, SourceLocation());
+    auto sample_call = build_call("__c2rust_xcheck_sample", ctx.IntTy,
+                                  { calls_ptr, period_lit }, ctx);
+    auto sampled_id = &ctx.Idents.get("__c2rust_xcheck_sampled");
+    auto sampled_var =
+        VarDecl::Create(ctx, parent, SourceLocation(), SourceLocation(),
+                        sampled_id, ctx.IntTy, nullptr, SC_None);
+    sampled_var->setInit(sample_call);
+    auto sampled_decl_stmt =
+        new (ctx) DeclStmt(DeclGroupRef(sampled_var),
+                           SourceLocation(),
+                           SourceLocation());
+    return { sampled_var, { calls_decl_stmt, sampled_decl_stmt } };
+}
+
+CrossCheckInserter::TinyStmtVec
+CrossCheckInserter::build_sampled_xchecks(const TinyStmtVec &xchecks,
+                                          VarDecl *sampled,
+                                          ASTContext &ctx) {
+    if (xchecks.empty())
+        return {};
+
+    // if (__c2rust_xcheck_sampled) { ... }
+    StmtVec xcheck_stmts(xchecks.begin(), xchecks.end());
+    auto xcheck_block =
+#if CLANG_VERSION_MAJOR >= 6
+        CompoundStmt::Create(ctx, xcheck_stmts,
+#else
+        new (ctx) CompoundStmt(ctx, xcheck_stmts,
+#endif
+                               SourceLocation(),
                                SourceLocation());
-    auto rb_xcheck_call = build_call("rb_xcheck", ctx.VoidTy,
-                                     { rb_xcheck_tag, rb_xcheck_val },
-                                     ctx);
-    res.push_back(rb_xcheck_call);
+    auto sampled_ref =
+        new (ctx) DeclRefExpr(sampled, false, sampled->getType(),
+                              VK_LValue, SourceLocation());
+    auto sampled_rv =
+        ImplicitCastExpr::Create(ctx, sampled->getType(),
+                                 CK_LValueToRValue,
+                                 sampled_ref, nullptr, VK_RValue);
+    TinyStmtVec res;
+    res.push_back(new (ctx) IfStmt(ctx, SourceLocation(), false,
+                                   nullptr, nullptr, sampled_rv,
+                                   xcheck_block, SourceLocation(), nullptr));
     return res;
 }
 
-CrossCheckInserter::TinyStmtVec
-CrossCheckInserter::build_parameter_xcheck(ParmVarDecl *param,
-                                           const DefaultsConfigOptRef file_defaults,
-                                           llvm::StringRef func_name,
-                                           const FunctionConfig &func_cfg,
-                                           const DeclMap &param_decls,
+// Whether hashing a value of this type can follow pointers to structures,
+// which are the only objects the hash functions memoize
+static bool hash_may_follow_pointers(QualType ty) {
+    auto cty = ty.getCanonicalType();
+    if (auto ptr_ty = dyn_cast<PointerType>(cty)) {
+        auto pointee_ty = ptr_ty->getPointeeType();
+        return pointee_ty->isStructureOrClassType() ||
+               hash_may_follow_pointers(pointee_ty);
+    }
+    if (auto array_ty = dyn_cast<ArrayType>(cty))
+        return hash_may_follow_pointers(array_ty->getElementType());
+    if (auto record_ty = dyn_cast<RecordType>(cty)) {
+        // Structures cannot contain themselves by value,
+        // so this recursion always terminates
+        auto record_def = record_ty->getDecl()->getDefinition();
+        if (record_def == nullptr || record_def->isUnion())
+            return false;
+        for (auto *field : record_def->fields())
+            if (hash_may_follow_pointers(field->getType()))
+                return true;
+    }
+    return false;
+}
+
+// Build a `void*` pointer to the table of visited objects
+static Expr *build_hash_visited_ptr(VarDecl *visited_var, ASTContext &ctx) {
+    auto visited_ty = visited_var->getType();
+    auto visited_ref =
+        new (ctx) DeclRefExpr(visited_var, false, visited_ty,
+                              VK_LValue, SourceLocation());
+    auto visited_ptr =
+        ImplicitCastExpr::Create(ctx, ctx.getArrayDecayedType(visited_ty),
+                                 CK_ArrayToPointerDecay,
+                                 visited_ref, nullptr, VK_RValue);
+    return ImplicitCastExpr::Create(ctx, ctx.getPointerType(ctx.VoidTy),
+                                    CK_BitCast, visited_ptr,
+                                    nullptr, VK_RValue);
+}
+
+Expr *CrossCheckInserter::get_hash_visited(HashVisitedTable &visited,
+                                           QualType ty,
+                                           FunctionDecl *parent,
                                            ASTContext &ctx) {
+    if (!memoize_hashes || !hash_may_follow_pointers(ty)) {
+        // (void*) 0
+        llvm::APInt zero(ctx.getTypeSize(ctx.IntTy), 0);
+        auto zero_lit = IntegerLiteral::Create(ctx, zero, ctx.IntTy,
+                                               SourceLocation());
+        return ImplicitCastExpr::Create(ctx, ctx.getPointerType(ctx.VoidTy),
+                                        CK_NullToPointer, zero_lit,
+                                        nullptr, VK_RValue);
+    }
+
+    if (visited.var == nullptr) {
+        // unsigned long long __c2rust_xcheck_entry_visited[HASH_VISITED_WORDS];
+        auto size_ty = ctx.getSizeType();
+        llvm::APInt num_words(ctx.getTypeSize(size_ty), HASH_VISITED_WORDS);
+        auto visited_ty = ctx.getConstantArrayType(ctx.UnsignedLongLongTy,
+                                                   num_words,
+                                                   ArrayType::Normal, 0);
+        auto visited_id = &ctx.Idents.get((visited.prefix + "_visited").str());
+        visited.var =
+            VarDecl::Create(ctx, parent, SourceLocation(), SourceLocation(),
+                            visited_id, visited_ty, nullptr, SC_None);
+    }
+    return build_hash_visited_ptr(visited.var, ctx);
+}
+
+CrossCheckInserter::TinyStmtVec
+CrossCheckInserter::build_xcheck_batch(const XCheckBatch &batch,
+                                       const HashVisitedTable &visited,
+                                       llvm::StringRef array_prefix,
+                                       FunctionDecl *parent,
+                                       ASTContext &ctx) {
+    TinyStmtVec res;
+    if (batch.empty())
+        return res;
+
+    if (visited.var != nullptr) {
+        // Declare the table of visited objects and clear it:
+        // unsigned long long __c2rust_xcheck_entry_visited[...];
+        // __c2rust_hash_visited_init(__c2rust_xcheck_entry_visited);
+        auto visited_decl_stmt =
+            new (ctx) DeclStmt(DeclGroupRef(visited.var),
+                               SourceLocation(),
+                               SourceLocation());
+        res.push_back(visited_decl_stmt);
+
+        auto init_call = build_call("__c2rust_hash_visited_init", ctx.VoidTy,
+                                    { build_hash_visited_ptr(visited.var, ctx) },
+                                    ctx);
+        res.push_back(init_call);
+    }
+
+    auto build_tag = [&ctx] (XCheck::Tag tag) {
+        return IntegerLiteral::Create(ctx,
+                                      llvm::APInt(8, tag),
+                                      ctx.UnsignedCharTy,
+                                      SourceLocation());
+    };
+    // Release the table of visited objects after the cross-checks,
+    // since it may have moved to the heap:
+    // __c2rust_hash_visited_free(__c2rust_xcheck_entry_visited);
+    auto add_visited_free = [&] (void) {
+        if (visited.var == nullptr)
+            return;
+        auto free_call = build_call("__c2rust_hash_visited_free", ctx.VoidTy,
+                                    { build_hash_visited_ptr(visited.var, ctx) },
+                                    ctx);
+        res.push_back(free_call);
+    };
+    if (batch.size() == 1) {
+        // No need for the arrays, just call rb_xcheck directly
+        auto [tag, val] = batch.front();
+        auto rb_xcheck_call = build_call("rb_xcheck", ctx.VoidTy,
+                                         { build_tag(tag), val }, ctx);
+        res.push_back(rb_xcheck_call);
+        add_visited_free();
+        return res;
+    }
+
+    // Build the two arrays on the stack and pass them to the runtime:
+    // unsigned char __c2rust_xcheck_entry_tags[N] = { tag0, tag1, ... };
+    // unsigned long __c2rust_xcheck_entry_vals[N] = { val0, val1, ... };
+    // __c2rust_xcheck_batch(__c2rust_xcheck_entry_tags,
+    //                       __c2rust_xcheck_entry_vals, N);
+    // which calls rb_xcheck_batch if the rb_xcheck library has it
+    auto size_ty = ctx.getSizeType();
+    llvm::APInt num_xchecks(ctx.getTypeSize(size_ty), batch.size());
+    auto build_array = [&] (llvm::StringRef suffix, QualType elem_ty,
+                            ArrayRef<Expr*> elems) -> Expr* {
+        auto array_ty = ctx.getConstantArrayType(elem_ty, num_xchecks,
+                                                 ArrayType::Normal, 0);
+        auto array_init = new (ctx) InitListExpr(ctx, SourceLocation(),
+                                                 elems, SourceLocation());
+        array_init->setType(array_ty);
+        auto array_id = &ctx.Idents.get((array_prefix + suffix).str());
+        auto array_var =
+            VarDecl::Create(ctx, parent, SourceLocation(), SourceLocation(),
+                            array_id, array_ty, nullptr, SC_None);
+        array_var->setInit(array_init);
+        auto array_decl_stmt =
+            new (ctx) DeclStmt(DeclGroupRef(array_var),
+                               SourceLocation(),
+                               SourceLocation());
+        res.push_back(array_decl_stmt);
+
+        auto array_ref =
+            new (ctx) DeclRefExpr(array_var, false, array_ty,
+                                  VK_LValue, SourceLocation());
+        return ImplicitCastExpr::Create(ctx, ctx.getArrayDecayedType(array_ty),
+                                        CK_ArrayToPointerDecay,
+                                        array_ref, nullptr, VK_RValue);
+    };
+
+    ExprVec tags, vals;
+    for (auto &[tag, val] : batch) {
+        tags.push_back(build_tag(tag));
+        vals.push_back(val);
+    }
+    auto tags_ptr = build_array("_tags", ctx.UnsignedCharTy, tags);
+    auto vals_ptr = build_array("_vals", ctx.UnsignedLongTy, vals);
+    auto num_xchecks_lit = IntegerLiteral::Create(ctx, num_xchecks, size_ty,
+                                                  SourceLocation());
+    auto xcheck_batch_call =
+        build_call("__c2rust_xcheck_batch", ctx.VoidTy,
+                   { tags_ptr, vals_ptr, num_xchecks_lit }, ctx);
+    res.push_back(xcheck_batch_call);
+    add_visited_free();
+    return res;
+}
+
+void CrossCheckInserter::build_parameter_xcheck(XCheckBatch &batch,
+                                                ParmVarDecl *param,
+                                                const DefaultsConfigOptRef file_defaults,
+                                                llvm::StringRef func_name,
+                                                const FunctionConfig &func_cfg,
+                                                const DeclMap &param_decls,
+                                                HashVisitedTable &visited,
+                                                ASTContext &ctx) {
     XCheck param_xcheck{XCheck::DISABLED};
     if (file_defaults && file_defaults->get().all_args)
         param_xcheck = *file_defaults->get().all_args;
     if (func_cfg.all_args) {
         param_xcheck = *func_cfg.all_args;
     }
-    parse_xcheck_attrs(param, [&param_xcheck] (llvm::yaml::Input &yin) {
-        yin >> param_xcheck;
+    parse_xcheck_attrs(param, xcheck_annotations,
+                       [] { return XCheck{}; },
+                       [&param_xcheck] (const XCheck &xc) {
+        param_xcheck = xc;
     });
     auto it = func_cfg.args.find(param->getName());
     if (it != func_cfg.args.end()) {
         param_xcheck = it->second;
     }
-    auto param_xcheck_default_fn = [this, &ctx, func_name, param] (void) {
+    auto param_hash_depth = get_function_hash_depth(file_defaults, func_cfg);
+    auto depth_it = func_cfg.arg_hash_depths.find(param->getName());
+    if (depth_it != func_cfg.arg_hash_depths.end()) {
+        param_hash_depth = depth_it->second;
+    }
+    auto param_xcheck_default_fn = [this, &ctx, func_name, param,
+                                    param_hash_depth, &visited] (void) {
         // By default, we just call __c2rust_hash_T(x)
         // where T is the type of the parameter
         // FIXME: include shasher/ahasher
@@ -357,10 +623,13 @@ CrossCheckInserter::build_parameter_xcheck(ParmVarDecl *param,
             new (ctx) DeclRefExpr(param, false, param->getType(),
                                   VK_LValue, SourceLocation());
         auto param_ref_rv = hash_fn.forward_argument(param_ref_lv, ctx);
-        auto hash_depth = build_max_hash_depth(ctx);
+        auto hash_depth = build_hash_depth(param_hash_depth, ctx);
+        auto hash_visited = get_hash_visited(visited, param->getOriginalType(),
+                                             cast<FunctionDecl>(param->getDeclContext()),
+                                             ctx);
         // TODO: pass PODs by value, non-PODs by pointer???
         return build_call(hash_fn.name.full_name(), ctx.UnsignedLongTy,
-                          { param_ref_rv, hash_depth }, ctx);
+                          { param_ref_rv, hash_depth, hash_visited }, ctx);
     };
     auto param_xcheck_custom_args_fn = [&ctx, &param_decls] (CustomArgVec args) {
         auto arg_build_fn = [&ctx] (DeclaratorDecl *decl) {
@@ -369,9 +638,108 @@ CrossCheckInserter::build_parameter_xcheck(ParmVarDecl *param,
         };
         return generic_custom_args(ctx, param_decls, args, arg_build_fn);
     };
-    return build_xcheck(param_xcheck, XCheck::Tag::FUNCTION_ARG, ctx,
-                        param_xcheck_default_fn,
-                        param_xcheck_custom_args_fn);
+    build_xcheck(batch, param_xcheck, XCheck::Tag::FUNCTION_ARG, ctx,
+                 param_xcheck_default_fn,
+                 param_xcheck_custom_args_fn);
+}
+
+ItemConfig *CrossCheckInserter::load_index_item(llvm::StringRef yaml,
+                                                DiagnosticsEngine &diags) {
+    ItemConfig item;
+    llvm::yaml::Input yin(yaml);
+    yin >> item;
+    if (auto yerr = yin.error()) {
+        report_clang_error(diags, "error parsing configuration index item: %0",
+                           yerr.message());
+        return nullptr;
+    }
+    index_items.push_back(std::move(item));
+    return &index_items.back();
+}
+
+DefaultsConfigOptRef
+CrossCheckInserter::get_defaults_config(const std::string &file_name,
+                                        DiagnosticsEngine &diags) {
+    // Merge the defaults from the indices into the ones
+    // from the YAML files the first time we see each file;
+    // the YAML files take priority, so we apply them last
+    if (!config_indices.empty() && index_defaults_files.insert(file_name).second) {
+        std::optional<DefaultsConfig> index_defaults;
+        for (auto &index : config_indices) {
+            for (auto yaml : index->lookup(file_name, ConfigIndex::DEFAULTS, "")) {
+                auto item = load_index_item(yaml, diags);
+                if (item == nullptr)
+                    continue;
+                if (auto defs = std::get_if<DefaultsConfig>(item)) {
+                    if (!index_defaults)
+                        index_defaults.emplace();
+                    index_defaults->update(*defs);
+                }
+            }
+        }
+        if (index_defaults) {
+            auto &index_file_name = *index_file_names.insert(file_name).first;
+            auto &file_defaults = defaults_configs[index_file_name];
+            index_defaults->update(file_defaults);
+            file_defaults = std::move(*index_defaults);
+        }
+    }
+
+    auto it = defaults_configs.find(file_name);
+    if (it != defaults_configs.end())
+        return std::make_optional(DefaultsConfigRef(it->second));
+    return {};
+}
+
+std::optional<FunctionConfigRef>
+CrossCheckInserter::get_function_config(const std::string &file_name,
+                                        const std::string &func_name,
+                                        DiagnosticsEngine &diags) {
+    StringRefPair key(std::cref(file_name), std::cref(func_name));
+    auto file_it = function_configs.find(key);
+    if (file_it != function_configs.end())
+        return std::make_optional(file_it->second);
+
+    // Like for the YAML files, the first configuration for a function wins
+    for (auto &index : config_indices) {
+        for (auto yaml : index->lookup(file_name, ConfigIndex::FUNCTION, func_name)) {
+            auto item = load_index_item(yaml, diags);
+            if (item == nullptr)
+                return {};
+            if (auto func = std::get_if<FunctionConfig>(item)) {
+                auto &index_file_name = *index_file_names.insert(file_name).first;
+                StringRefPair index_key(std::cref(index_file_name), std::cref(func->name));
+                function_configs.emplace(index_key, *func);
+                return std::make_optional(FunctionConfigRef(*func));
+            }
+        }
+    }
+    return {};
+}
+
+std::optional<StructConfigRef>
+CrossCheckInserter::get_struct_config(const std::string &file_name,
+                                      const std::string &struct_name,
+                                      DiagnosticsEngine &diags) {
+    StringRefPair key(std::cref(file_name), std::cref(struct_name));
+    auto file_it = struct_configs.find(key);
+    if (file_it != struct_configs.end())
+        return std::make_optional(file_it->second);
+
+    for (auto &index : config_indices) {
+        for (auto yaml : index->lookup(file_name, ConfigIndex::STRUCT, struct_name)) {
+            auto item = load_index_item(yaml, diags);
+            if (item == nullptr)
+                return {};
+            if (auto struc = std::get_if<StructConfig>(item)) {
+                auto &index_file_name = *index_file_names.insert(file_name).first;
+                StringRefPair index_key(std::cref(index_file_name), std::cref(struc->name));
+                struct_configs.emplace(index_key, *struc);
+                return std::make_optional(StructConfigRef(*struc));
+            }
+        }
+    }
+    return {};
 }
 
 bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
@@ -399,9 +767,13 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
 
             FunctionConfig func_cfg{llvm_string_ref_to_sv(func_name)};
             // Read the inline function configurations
-            parse_xcheck_attrs(fd, [&func_cfg, func_name] (llvm::yaml::Input &yin) {
-                FunctionConfig fcfg{llvm_string_ref_to_sv(func_name)};
-                yin >> fcfg;
+            parse_xcheck_attrs(fd, function_annotations,
+                               [] { return FunctionConfig{""}; },
+                               [&func_cfg] (const FunctionConfig &cached) {
+                // The cached configuration is shared by
+                // all functions with the same annotation
+                FunctionConfig fcfg{cached};
+                fcfg.name = func_cfg.name;
                 func_cfg.update(fcfg);
             });
             // Read the external function configuration
@@ -409,11 +781,8 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
             auto ploc = ctx.getSourceManager().getPresumedLoc(fd->getLocStart());
             if (ploc.isValid()) {
                 std::string file_name(ploc.getFilename());
-                auto it = defaults_configs.find(file_name);
-                if (it != defaults_configs.end()) {
-                    file_defaults = it->second;
-                }
-                auto fcfg = get_function_config(file_name, func_name);
+                file_defaults = get_defaults_config(file_name, diags);
+                auto fcfg = get_function_config(file_name, func_name, diags);
                 if (fcfg)
                     func_cfg.update(*fcfg);
             }
@@ -426,6 +795,30 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
             if (disable_xchecks)
                 continue;
 
+            XCheck entry_xcheck{XCheck::DEFAULT};
+            if (file_defaults && file_defaults->get().entry)
+                entry_xcheck = *file_defaults->get().entry;
+            if (func_cfg.entry)
+                entry_xcheck = *func_cfg.entry;
+
+            // Downgrade the cross-checks on functions that the profile
+            // says are too hot to cross-check on every call
+            if (hot_policy && ploc.isValid()) {
+                auto entry_value = entry_xcheck_value(entry_xcheck, func_name);
+                auto action = hot_policy->check_function(ploc.getFilename(),
+                                                         func_name, entry_value);
+                if (action && *action == HotFunctionPolicy::DISABLE)
+                    continue;
+                if (action && *action == HotFunctionPolicy::ENTRY_ONLY) {
+                    func_cfg.exit = XCheck{XCheck::DISABLED};
+                    func_cfg.ret = XCheck{XCheck::DISABLED};
+                    func_cfg.all_args = XCheck{XCheck::DISABLED};
+                    func_cfg.args.clear();
+                    func_cfg.entry_extra.clear();
+                    func_cfg.exit_extra.clear();
+                }
+            }
+
             // Add the function entry-point cross-check
             StmtVec new_body_stmts;
             auto add_body_stmts = [&new_body_stmts] (const TinyStmtVec &stmts) {
@@ -434,11 +827,30 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
                                       std::make_move_iterator(stmts.end()));
             };
 
-            XCheck entry_xcheck{XCheck::DEFAULT};
-            if (file_defaults && file_defaults->get().entry)
-                entry_xcheck = *file_defaults->get().entry;
-            if (func_cfg.entry)
-                entry_xcheck = *func_cfg.entry;
+            // If sampling is enabled, only perform the cross-checks
+            // for some of the calls, deciding which ones on entry
+            llvm::Optional<uint64_t> sample_period;
+            if (this->sample_xchecks)
+                sample_period = 0;
+            if (file_defaults && file_defaults->get().sample_period)
+                sample_period = *file_defaults->get().sample_period;
+            if (func_cfg.sample_period)
+                sample_period = *func_cfg.sample_period;
+            VarDecl *sampled_var = nullptr;
+            if (sample_period && *sample_period != 1) {
+                auto [var, stmts] = build_xcheck_sampling(*sample_period, fd, ctx);
+                sampled_var = var;
+                new_body_stmts.append(stmts.begin(), stmts.end());
+            }
+            auto add_xcheck_batch = [&] (const XCheckBatch &batch,
+                                         const HashVisitedTable &visited) {
+                auto xcheck_stmts = build_xcheck_batch(batch, visited,
+                                                       visited.prefix, fd, ctx);
+                if (sampled_var != nullptr)
+                    xcheck_stmts = build_sampled_xchecks(xcheck_stmts, sampled_var, ctx);
+                add_body_stmts(xcheck_stmts);
+            };
+
             auto entry_xcheck_default_fn = [&ctx, fd] (void) {
                 auto rb_xcheck_hash = djb2_hash(fd->getName());
                 return IntegerLiteral::Create(ctx,
@@ -446,12 +858,13 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
                                               ctx.UnsignedLongTy,
                                               SourceLocation());
             };
-            auto entry_xcheck_stmts = build_xcheck(entry_xcheck,
-                                                   XCheck::Tag::FUNCTION_ENTRY,
-                                                   ctx,
-                                                   entry_xcheck_default_fn,
-                                                   no_custom_args);
-            add_body_stmts(entry_xcheck_stmts);
+            // All the entry-point cross-checks, i.e., the function entry,
+            // parameters and entry_extra, go to the runtime in one batch
+            XCheckBatch entry_batch;
+            HashVisitedTable entry_visited{"__c2rust_xcheck_entry"};
+            build_xcheck(entry_batch, entry_xcheck,
+                         XCheck::Tag::FUNCTION_ENTRY, ctx,
+                         entry_xcheck_default_fn, no_custom_args);
 
             // Custom cross-check functions accept either function parameters
             // or global variables as their own arguments
@@ -469,10 +882,9 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
             };
             // Add cross-checks for the function parameters
             for (auto &param : fd->parameters()) {
-                auto param_xcheck_stmts =
-                    build_parameter_xcheck(param, file_defaults, func_name,
-                                           func_cfg, param_decls, ctx);
-                add_body_stmts(param_xcheck_stmts);
+                build_parameter_xcheck(entry_batch, param, file_defaults,
+                                       func_name, func_cfg, param_decls,
+                                       entry_visited, ctx);
             }
 
             // Add any extra cross-checks
@@ -482,12 +894,10 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
             };
             for (auto &ex : func_cfg.entry_extra) {
                 XCheck extra_xcheck{XCheck::CUSTOM, ex.custom};
-                auto extra_xcheck_stmts = build_xcheck(extra_xcheck,
-                                                       ex.tag, ctx,
-                                                       extra_xcheck_default_fn,
-                                                       param_custom_args_fn);
-                add_body_stmts(extra_xcheck_stmts);
+                build_xcheck(entry_batch, extra_xcheck, ex.tag, ctx,
+                             extra_xcheck_default_fn, param_custom_args_fn);
             }
+            add_xcheck_batch(entry_batch, entry_visited);
 
             // Build the body function and call it
             auto dni = fd->getNameInfo();
@@ -513,10 +923,9 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
             // Build the new body from all the cross-checks, plus a call
             // to the wrapper, e.g.:
             // int foo(int x) {
-            //   rb_xcheck(...);
-            //   ...
+            //   rb_xcheck_batch(...);
             //   int __c2rust_fn_result = __c2rust_wrapper_foo(x);
-            //   ...
+            //   rb_xcheck_batch(...);
             //   return __c2rust_fn_result;
             // }
             auto result_ty = fd->getReturnType();
@@ -563,10 +972,12 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
                 exit_xcheck = *file_defaults->get().exit;
             if (func_cfg.exit)
                 exit_xcheck = *func_cfg.exit;
-            auto exit_xcheck_stmts =
-                build_xcheck(exit_xcheck, XCheck::Tag::FUNCTION_EXIT,
-                             ctx, entry_xcheck_default_fn, no_custom_args);
-            add_body_stmts(exit_xcheck_stmts);
+            // The function may have modified the objects we hashed on
+            // entry, so the exit cross-checks get their own table
+            XCheckBatch exit_batch;
+            HashVisitedTable exit_visited{"__c2rust_xcheck_exit"};
+            build_xcheck(exit_batch, exit_xcheck, XCheck::Tag::FUNCTION_EXIT,
+                         ctx, entry_xcheck_default_fn, no_custom_args);
 
             // Post-exit return value and exit_extra checks
             if (result_var) {
@@ -580,8 +991,12 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
                 if (func_cfg.ret)
                     result_xcheck = *func_cfg.ret;
 
-                auto result_xcheck_default_fn = [this, &ctx, func_name,
-                                                 result_var, result_ty] (void) {
+                auto result_hash_depth = get_function_hash_depth(file_defaults,
+                                                                 func_cfg);
+                auto result_xcheck_default_fn = [this, &ctx, fd, func_name,
+                                                 result_var, result_ty,
+                                                 result_hash_depth,
+                                                 &exit_visited] (void) {
                     // By default, we just call __c2rust_hash_T(x)
                     // where T is the type of the parameter
                     // FIXME: include shasher/ahasher
@@ -591,23 +1006,23 @@ bool CrossCheckInserter::HandleTopLevelDecl(DeclGroupRef dg) {
                     auto result_lv = new (ctx) DeclRefExpr(result_var, false, result_ty,
                                                            VK_LValue, SourceLocation());
                     auto result_rv = hash_fn.forward_argument(result_lv, ctx);
-                    auto hash_depth = build_max_hash_depth(ctx);
+                    auto hash_depth = build_hash_depth(result_hash_depth, ctx);
+                    auto hash_visited = get_hash_visited(exit_visited, result_ty,
+                                                         fd, ctx);
                     return build_call(hash_fn.name.full_name(), ctx.UnsignedLongTy,
-                                      { result_rv, hash_depth }, ctx);
+                                      { result_rv, hash_depth, hash_visited }, ctx);
                 };
-                auto result_xcheck_stmts =
-                    build_xcheck(result_xcheck, XCheck::Tag::FUNCTION_RETURN,
-                                 ctx, result_xcheck_default_fn, param_custom_args_fn);
-                add_body_stmts(result_xcheck_stmts);
+                build_xcheck(exit_batch, result_xcheck,
+                             XCheck::Tag::FUNCTION_RETURN, ctx,
+                             result_xcheck_default_fn, param_custom_args_fn);
             }
             // Add exit_extra checks
             for (auto &ex : func_cfg.exit_extra) {
                 XCheck extra_xcheck{XCheck::CUSTOM, ex.custom};
-                auto extra_xcheck_stmts =
-                    build_xcheck(extra_xcheck, ex.tag, ctx,
-                                 extra_xcheck_default_fn, param_custom_args_fn);
-                add_body_stmts(extra_xcheck_stmts);
+                build_xcheck(exit_batch, extra_xcheck, ex.tag, ctx,
+                             extra_xcheck_default_fn, param_custom_args_fn);
             }
+            add_xcheck_batch(exit_batch, exit_visited);
 
             // Add the final return
             auto return_stmt = new (ctx) ReturnStmt(SourceLocation(),
@@ -686,6 +1101,23 @@ static const OptTable::Info InfoTable[] = {
 #undef OPTION
 };
 
+void CrossCheckInserter::write_downgrade_report(ASTContext &ctx) {
+    if (!hot_policy || downgrade_report_file.empty())
+        return;
+
+    // Every translation unit appends its own functions to the report
+    std::error_code ec;
+    llvm::raw_fd_ostream os(downgrade_report_file, ec,
+                            llvm::sys::fs::F_Append | llvm::sys::fs::F_Text);
+    if (ec) {
+        report_clang_error(ctx.getDiagnostics(),
+                           "error opening downgrade report '%0': %1",
+                           downgrade_report_file, ec.message());
+        return;
+    }
+    hot_policy->write_report(os);
+}
+
 class CrossCheckOptTable : public OptTable {
 public:
     CrossCheckOptTable() : OptTable(InfoTable) {}
@@ -694,12 +1126,24 @@ public:
 class CrossCheckInsertionAction : public PluginASTAction {
 private:
     bool disable_xchecks = false;
+    bool sample_xchecks = false;
+    bool memoize_hashes = true;
+    std::string default_ahasher{"jodyhash"};
+    std::optional<HotFunctionPolicy> hot_policy;
+    std::string downgrade_report_file;
     Config config;
+    ConfigIndexVec config_indices;
 
 protected:
     std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &ci,
                                                    llvm::StringRef) override {
-        return llvm::make_unique<CrossCheckInserter>(disable_xchecks, std::move(config));
+        return llvm::make_unique<CrossCheckInserter>(disable_xchecks, sample_xchecks,
+                                                   memoize_hashes,
+                                                   std::move(default_ahasher),
+                                                   std::move(hot_policy),
+                                                   std::move(downgrade_report_file),
+                                                   std::move(config),
+                                                   std::move(config_indices));
     }
 
     bool ParseArgs(const CompilerInstance &ci,
@@ -734,15 +1178,84 @@ bool CrossCheckInsertionAction::ParseArgs(const CompilerInstance &ci,
         disable_xchecks = true;
     }
 
+    if (parsed_args.hasArg(OPT_sample_xchecks)) {
+        sample_xchecks = true;
+    }
+
+    if (parsed_args.hasArg(OPT_disable_hash_memoization)) {
+        memoize_hashes = false;
+    }
+
+    if (auto ahasher_arg = parsed_args.getLastArg(OPT_ahasher)) {
+        default_ahasher = ahasher_arg->getValue();
+        if (default_ahasher.empty()) {
+            report_clang_error(diags, "empty hasher name for --ahasher");
+            return false;
+        }
+    }
+
+    if (auto profile_arg = parsed_args.getLastArg(OPT_profile)) {
+        llvm::StringRef profile_file = profile_arg->getValue();
+        auto profile_data = llvm::MemoryBuffer::getFile(profile_file);
+        if (!profile_data) {
+            report_clang_error(diags, "error reading profile '%0': %1",
+                               profile_file, profile_data.getError().message());
+            return false;
+        }
+
+        CallProfile profile;
+        if (auto err = profile.parse((*profile_data)->getBuffer())) {
+            report_clang_error(diags, "error parsing profile '%0': %1",
+                               profile_file, llvm::toString(std::move(err)));
+            return false;
+        }
+
+        uint64_t threshold = HotFunctionPolicy::DEFAULT_THRESHOLD;
+        if (auto threshold_arg = parsed_args.getLastArg(OPT_hot_call_threshold)) {
+            if (llvm::StringRef(threshold_arg->getValue()).getAsInteger(10, threshold)) {
+                report_clang_error(diags, "invalid call threshold: '%0'",
+                                   threshold_arg->getValue());
+                return false;
+            }
+        }
+
+        auto action = HotFunctionPolicy::ENTRY_ONLY;
+        if (auto action_arg = parsed_args.getLastArg(OPT_hot_xchecks)) {
+            auto parsed_action = HotFunctionPolicy::parse_action(action_arg->getValue());
+            if (!parsed_action) {
+                report_clang_error(diags, "invalid hot function cross-checks: '%0', "
+                                          "expected 'entry-only' or 'disabled'",
+                                   action_arg->getValue());
+                return false;
+            }
+            action = *parsed_action;
+        }
+        hot_policy.emplace(std::move(profile), threshold, action);
+        downgrade_report_file = parsed_args.getLastArgValue(OPT_downgrade_report);
+    }
+
     auto config_files = parsed_args.getAllArgValues(OPT_config_files);
     for (auto &config_file : config_files) {
-        auto config_data = llvm::MemoryBuffer::getFile(config_file);
+        // Don't require a null terminator, so that
+        // large indices always get memory-mapped
+        auto config_data = llvm::MemoryBuffer::getFile(config_file, -1, false);
         if (!config_data) {
             report_clang_error(diags, "error reading configuration file '%0': %1",
                                config_file, config_data.getError().message());
             return false;
         }
 
+        if (ConfigIndex::is_index((*config_data)->getBuffer())) {
+            auto index = ConfigIndex::create(std::move(*config_data));
+            if (!index) {
+                report_clang_error(diags, "error reading configuration index '%0': %1",
+                                   config_file, llvm::toString(index.takeError()));
+                return false;
+            }
+            config_indices.push_back(std::move(*index));
+            continue;
+        }
+
         Config new_config;
         llvm::yaml::Input yin((*config_data)->getBuffer());
         yin >> new_config;
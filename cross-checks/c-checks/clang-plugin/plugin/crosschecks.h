@@ -6,11 +6,21 @@
 #include "clang/AST/ASTMutationListener.h"
 #include "clang/Sema/Sema.h"
 #include "clang/Sema/SemaConsumer.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/TinyPtrVector.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/Regex.h"
 
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
 #include "config.h"
+#include "config_index.h"
+#include "profile.h"
 
 namespace crosschecks {
 
@@ -74,6 +84,34 @@ struct StringRefPairCompare {
     }
 };
 
+struct StringRefHash {
+    size_t operator()(const StringRef &s) const {
+        return llvm::hash_value(llvm::StringRef(s.get()));
+    }
+};
+
+struct StringRefEqual {
+    bool operator()(const StringRef &lhs, const StringRef &rhs) const {
+        return lhs.get() == rhs.get();
+    }
+};
+
+struct StringRefPairHash {
+    size_t operator()(const StringRefPair &p) const {
+        return llvm::hash_combine(llvm::StringRef(p.first.get()),
+                                  llvm::StringRef(p.second.get()));
+    }
+};
+
+struct StringRefPairEqual {
+    bool operator()(const StringRefPair &lhs, const StringRefPair &rhs) const {
+        return lhs.first.get() == rhs.first.get() &&
+               lhs.second.get() == rhs.second.get();
+    }
+};
+
+using ConfigIndexVec = std::vector<std::unique_ptr<ConfigIndex>>;
+
 static inline
 llvm::StringRef llvm_string_ref_from_sv(std::string_view sv) {
     return { sv.data(), sv.length() };
@@ -181,54 +219,94 @@ class CrossCheckInserter : public SemaConsumer {
 private:
     bool disable_xchecks;
 
+    bool sample_xchecks;
+
+    bool memoize_hashes;
+
+    // Hasher for the structures and arrays that don't configure their own
+    std::string default_ahasher;
+
+    std::optional<HotFunctionPolicy> hot_policy;
+
+    std::string downgrade_report_file;
+
     Config config;
 
+    // Precompiled configuration indices, which we look items up in
+    // when they are not in the YAML configuration
+    ConfigIndexVec config_indices;
+
+    // Items loaded from the indices, and the names of their files;
+    // the maps below reference both, so they need stable addresses
+    std::deque<ItemConfig> index_items;
+    std::set<std::string> index_file_names;
+
+    // Files we already loaded the defaults for from the indices
+    std::unordered_set<std::string> index_defaults_files;
+
     // Cache the (file, function) => config mapping
     // for fast lookup
-    // FIXME: uses std::map which is O(logN), would be nice
-    // to use std::unordered_map, but that one doesn't compile
-    // with StringRefPair keys
-    std::map<StringRef, DefaultsConfig,
-        StringRefCompare> defaults_configs;
-    std::map<StringRefPair, FunctionConfigRef,
-        StringRefPairCompare> function_configs;
-    std::map<StringRefPair, StructConfigRef,
-        StringRefPairCompare> struct_configs;
+    std::unordered_map<StringRef, DefaultsConfig,
+        StringRefHash, StringRefEqual> defaults_configs;
+    std::unordered_map<StringRefPair, FunctionConfigRef,
+        StringRefPairHash, StringRefPairEqual> function_configs;
+    std::unordered_map<StringRefPair, StructConfigRef,
+        StringRefPairHash, StringRefPairEqual> struct_configs;
+
+    ItemConfig *load_index_item(llvm::StringRef yaml, DiagnosticsEngine &diags);
+
+    DefaultsConfigOptRef
+    get_defaults_config(const std::string &file_name,
+                        DiagnosticsEngine &diags);
 
     std::optional<FunctionConfigRef>
     get_function_config(const std::string &file_name,
-                        const std::string &func_name) {
-        StringRefPair key(std::cref(file_name), std::cref(func_name));
-        auto file_it = function_configs.find(key);
-        if (file_it != function_configs.end())
-            return std::make_optional(file_it->second);
-        return {};
-    }
+                        const std::string &func_name,
+                        DiagnosticsEngine &diags);
 
     std::optional<StructConfigRef>
     get_struct_config(const std::string &file_name,
-                      const std::string &struct_name) {
-        StringRefPair key(std::cref(file_name), std::cref(struct_name));
-        auto file_it = struct_configs.find(key);
-        if (file_it != struct_configs.end())
-            return std::make_optional(file_it->second);
-        return {};
-    }
+                      const std::string &struct_name,
+                      DiagnosticsEngine &diags);
 
     // Regex that matches cross-check annotations
     llvm::Regex xcheck_ann_regex{"^[:space:]*cross_check[:space:]*:(.*)$"};
 
-    template<typename Fn>
-    void parse_xcheck_attrs(Decl *decl, Fn fn) {
+    // Parsed cross-check annotations, keyed by the whole annotation string.
+    // Annotations usually come from a few CROSS_CHECK macros, and
+    // declarations in headers inherit them on every redeclaration, so
+    // the same strings show up many times; we only match and parse each
+    // one once. Annotations that are not cross-check configurations
+    // are cached as None.
+    template<typename T>
+    using AnnotationCache = llvm::StringMap<llvm::Optional<T>>;
+    AnnotationCache<FunctionConfig> function_annotations;
+    AnnotationCache<StructConfig> struct_annotations;
+    AnnotationCache<XCheck> xcheck_annotations;
+
+    // Call `fn` on the configuration parsed from each cross-check annotation
+    // on `decl`, in order; `make` builds the empty configuration to parse into
+    template<typename T, typename MakeFn, typename Fn>
+    void parse_xcheck_attrs(Decl *decl, AnnotationCache<T> &cache,
+                            MakeFn make, Fn fn) {
         for (const auto *aa : decl->specific_attrs<clang::AnnotateAttr>()) {
             auto ann = aa->getAnnotation();
-            llvm::SmallVector<llvm::StringRef, 2> groups;
-            if (xcheck_ann_regex.match(ann, &groups)) {
-                std::string xcheck_str = groups[1];
-                llvm::yaml::Input yin{xcheck_str};
-                fn(yin);
-                // TODO: check yin.error()
+            auto it = cache.find(ann);
+            if (it == cache.end()) {
+                llvm::Optional<T> parsed;
+                llvm::SmallVector<llvm::StringRef, 2> groups;
+                if (xcheck_ann_regex.match(ann, &groups)) {
+                    std::string xcheck_str = groups[1];
+                    llvm::yaml::Input yin{xcheck_str};
+                    T cfg = make();
+                    yin >> cfg;
+                    // TODO: check yin.error()
+                    parsed = std::move(cfg);
+                }
+                it = cache.insert(std::make_pair(ann, std::move(parsed))).first;
             }
+            if (it->second)
+                fn(*it->second);
         }
     }
 
@@ -345,29 +423,92 @@ private:
 
     using TinyStmtVec = llvm::TinyPtrVector<Stmt*>;
 
+    // Cross-checks performed together at the same point in a function,
+    // as (tag, value) pairs; we send them all to the runtime in a single
+    // call, instead of calling rb_xcheck once for each of them
+    using XCheckBatch = llvm::SmallVector<std::pair<XCheck::Tag, Expr*>, 8>;
+
     template<typename DefaultFn, typename CustomArgsFn>
-    TinyStmtVec
-    build_xcheck(const XCheck &xcheck, XCheck::Tag tag,
-                 ASTContext &ctx, DefaultFn default_fn,
-                 CustomArgsFn custom_args_fn);
+    void build_xcheck(XCheckBatch &batch,
+                      const XCheck &xcheck, XCheck::Tag tag,
+                      ASTContext &ctx, DefaultFn default_fn,
+                      CustomArgsFn custom_args_fn);
+
+    // Table of the objects already hashed by the cross-checks in a batch,
+    // allocated on the stack of the checked function; we only declare it
+    // once one of the cross-checks needs it
+    struct HashVisitedTable {
+        llvm::StringRef prefix;
+        VarDecl *var = nullptr;
+
+        HashVisitedTable(llvm::StringRef p) : prefix(p) {}
+    };
+
+    // Size of the table in 64-bit words, which
+    // needs to match hash_visited_t in runtime/hash.c
+    static const size_t HASH_VISITED_WORDS = 131;
+
+    // Build the `visited` argument for a top-level hash function call
+    // on a value of type `ty`, which is either a pointer to the table
+    // or NULL if memoization is disabled or pointless for `ty`
+    Expr *get_hash_visited(HashVisitedTable &visited, QualType ty,
+                           FunctionDecl *parent, ASTContext &ctx);
 
+    TinyStmtVec
+    build_xcheck_batch(const XCheckBatch &batch,
+                       const HashVisitedTable &visited,
+                       llvm::StringRef array_prefix,
+                       FunctionDecl *parent,
+                       ASTContext &ctx);
+
+    // Get the hash function for values of type `ty`, building it
+    // if `build_it` is set. Arrays and records get hashed with
+    // the aggregate hasher `ahasher`, or `default_ahasher` if empty;
+    // the functions for any other hasher get its name as a suffix.
     const HashFunction
     get_type_hash_function(QualType ty,
                            llvm::StringRef candidate_name,
                            ASTContext &ctx,
-                           bool build_it);
+                           bool build_it,
+                           std::string_view ahasher = {});
 
     using StmtVec = llvm::SmallVector<Stmt*, 16>;
 
+    // Build the call counter of a function with sampled cross-checks,
+    // along with the variable that says whether the current call
+    // gets checked
+    std::tuple<VarDecl*, StmtVec>
+    build_xcheck_sampling(uint64_t sample_period,
+                          FunctionDecl *parent,
+                          ASTContext &ctx);
+
+    // Only run the given cross-checks if `sampled` is true
+    TinyStmtVec
+    build_sampled_xchecks(const TinyStmtVec &xchecks,
+                          VarDecl *sampled,
+                          ASTContext &ctx);
+
     static std::set<std::pair<std::string_view, std::string_view>> struct_xcheck_blacklist;
 
-    // TODO: make it configurable via both a plugin argument
-    // and an external configuration item
-    static const size_t MAX_HASH_DEPTH = 8;
+    // Depth to hash arguments and return values at, unless the
+    // configuration sets a different `hash_depth` for them;
+    // this needs to match DEFAULT_HASH_DEPTH in the Rust runtime
+    static const uint64_t DEFAULT_HASH_DEPTH = 8;
+
+    // Depth to hash the arguments and return value of a function at
+    uint64_t get_function_hash_depth(const DefaultsConfigOptRef file_defaults,
+                                     const FunctionConfig &func_cfg) {
+        uint64_t depth = DEFAULT_HASH_DEPTH;
+        if (file_defaults && file_defaults->get().hash_depth)
+            depth = *file_defaults->get().hash_depth;
+        if (func_cfg.hash_depth)
+            depth = *func_cfg.hash_depth;
+        return depth;
+    }
 
-    Expr *build_max_hash_depth(ASTContext &ctx) {
+    Expr *build_hash_depth(uint64_t depth, ASTContext &ctx) {
         auto hash_depth_ty = ctx.getSizeType();
-        llvm::APInt hash_depth(ctx.getTypeSize(hash_depth_ty), MAX_HASH_DEPTH);
+        llvm::APInt hash_depth(ctx.getTypeSize(hash_depth_ty), depth);
         return IntegerLiteral::Create(ctx, hash_depth,
                                       hash_depth_ty,
                                       SourceLocation());
@@ -393,10 +534,21 @@ private:
                                                FPOptions{});
     }
 
+    Expr *get_visited(FunctionDecl *fn_decl, ASTContext &ctx) {
+        // Build `visited` as an Expr
+        auto visited = fn_decl->getParamDecl(2);
+        return new (ctx) DeclRefExpr(visited, false, visited->getType(),
+                                     VK_RValue, SourceLocation());
+    }
+
     Stmt *build_depth_check(FunctionDecl *fn_decl,
                             std::string_view item,
                             ASTContext &ctx);
 
+    Stmt *build_depth_limit(FunctionDecl *fn_decl,
+                            uint64_t max_depth,
+                            ASTContext &ctx);
+
     // Set of functions we're in the process of building
     // We need to keep track of which hash functions we've started
     // building, so we avoid an infinite recursion when we build
@@ -409,8 +561,12 @@ private:
     // to be careful when building them to avoid infinite recursion
     std::set<StringRef, StringRefCompare> pending_hash_functions;
 
+    std::string get_hasher_prefix(const std::string &hasher_name,
+                                  ASTContext &ctx);
+
     std::tuple<VarDecl*, Expr*, StmtVec>
-    build_hasher_init(const std::string &hasher_prefix,
+    build_hasher_init(const std::string &hasher_name,
+                      const std::string &hasher_prefix,
                       FunctionDecl *parent,
                       ASTContext &ctx);
 
@@ -426,24 +582,35 @@ private:
     void build_array_hash_function(const HashFunction &func,
                                    const HashFunction &element,
                                    const llvm::APInt &num_elements,
+                                   const std::string &ahasher,
                                    ASTContext &ctx);
 
     void build_record_hash_function(const HashFunction &func,
                                     const std::string &record_name,
+                                    const std::string &ahasher,
                                     ASTContext &ctx);
 
-    TinyStmtVec
-    build_parameter_xcheck(ParmVarDecl *param,
-                           const DefaultsConfigOptRef file_defaults,
-                           llvm::StringRef func_name,
-                           const FunctionConfig &func_cfg,
-                           const DeclMap &param_decls,
-                           ASTContext &ctx);
+    void build_parameter_xcheck(XCheckBatch &batch,
+                                ParmVarDecl *param,
+                                const DefaultsConfigOptRef file_defaults,
+                                llvm::StringRef func_name,
+                                const FunctionConfig &func_cfg,
+                                const DeclMap &param_decls,
+                                HashVisitedTable &visited,
+                                ASTContext &ctx);
 
 public:
     CrossCheckInserter() = delete;
-    CrossCheckInserter(bool dx, Config &&cfg)
-            : disable_xchecks(dx), config(std::move(cfg)) {
+    CrossCheckInserter(bool dx, bool sx, bool mh, std::string &&ahasher,
+                       std::optional<HotFunctionPolicy> &&hp,
+                       std::string &&report_file, Config &&cfg,
+                       ConfigIndexVec &&indices)
+            : disable_xchecks(dx), sample_xchecks(sx), memoize_hashes(mh),
+              default_ahasher(std::move(ahasher)),
+              hot_policy(std::move(hp)),
+              downgrade_report_file(std::move(report_file)),
+              config(std::move(cfg)),
+              config_indices(std::move(indices)) {
         for (auto &file_config : config) {
             auto &file_name = file_config.first;
             for (auto &item : file_config.second)
@@ -477,7 +644,10 @@ public:
             toplevel_consumer->HandleTopLevelDecl(DeclGroupRef(func));
         new_funcs.clear();
         decl_cache.clear();
+        write_downgrade_report(ctx);
     }
+
+    void write_downgrade_report(ASTContext &ctx);
 };
 
 } // namespace crosschecks
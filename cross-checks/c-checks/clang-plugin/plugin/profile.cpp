@@ -0,0 +1,146 @@
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSwitch.h"
+
+#include "profile.h"
+
+namespace crosschecks {
+
+static llvm::Error parse_error(const llvm::Twine &msg, size_t line_number) {
+    return llvm::make_error<llvm::StringError>(
+        "line " + llvm::Twine(line_number) + ": " + msg,
+        llvm::inconvertibleErrorCode());
+}
+
+llvm::Error CallProfile::parse(llvm::StringRef buffer) {
+    if (buffer.startswith("# fakechecks call counts"))
+        return parse_fakechecks(buffer);
+    return parse_profdata(buffer);
+}
+
+llvm::Error CallProfile::parse_profdata(llvm::StringRef buffer) {
+    // Each function is a block of lines separated from the next one
+    // by an empty line, e.g.:
+    //   foo
+    //   # Func Hash:
+    //   1234
+    //   # Num Counters:
+    //   2
+    //   # Counter Values:
+    //   100
+    //   42
+    // We only need the name and the first counter; lines starting
+    // with '#' are comments, and the optional header line(s) at the top
+    // of the file, e.g., ":fe", start with ':'
+    llvm::SmallVector<llvm::StringRef, 8> record;
+    size_t line_number = 0;
+    auto end_record = [this, &record, &line_number] () -> llvm::Error {
+        if (record.empty())
+            return llvm::Error::success();
+        if (record.size() < 3)
+            return parse_error("truncated function record", line_number);
+
+        uint64_t num_counters = 0, calls = 0;
+        if (record[2].getAsInteger(10, num_counters))
+            return parse_error("invalid number of counters", line_number);
+        if (num_counters > 0) {
+            if (record.size() < 4 || record[3].getAsInteger(10, calls))
+                return parse_error("invalid counter value", line_number);
+        }
+        // Functions with internal linkage are named "file.c:foo"
+        auto name = record[0].rsplit(':').second;
+        if (name.empty())
+            name = record[0];
+        calls_by_name[name] += calls;
+        record.clear();
+        return llvm::Error::success();
+    };
+
+    llvm::SmallVector<llvm::StringRef, 0> lines;
+    buffer.split(lines, '\n');
+    for (auto line : lines) {
+        line_number++;
+        line = line.trim();
+        if (line.empty()) {
+            if (auto err = end_record())
+                return err;
+            continue;
+        }
+        if (line.startswith("#") || (record.empty() && line.startswith(":")))
+            continue;
+        record.push_back(line);
+    }
+    return end_record();
+}
+
+llvm::Error CallProfile::parse_fakechecks(llvm::StringRef buffer) {
+    llvm::SmallVector<llvm::StringRef, 0> lines;
+    buffer.split(lines, '\n');
+    size_t line_number = 0;
+    for (auto line : lines) {
+        line_number++;
+        line = line.trim();
+        if (line.empty() || line.startswith("#"))
+            continue;
+
+        llvm::StringRef value_str, calls_str;
+        std::tie(value_str, calls_str) = line.split(' ');
+        uint64_t value, calls;
+        if (value_str.getAsInteger(10, value) ||
+            calls_str.trim().getAsInteger(10, calls))
+            return parse_error("expected '<entry value> <calls>'", line_number);
+        calls_by_entry_value[value] += calls;
+    }
+    return llvm::Error::success();
+}
+
+llvm::Optional<uint64_t>
+CallProfile::lookup(llvm::StringRef name,
+                    llvm::Optional<uint64_t> entry_value) const {
+    auto name_it = calls_by_name.find(name);
+    if (name_it != calls_by_name.end())
+        return name_it->second;
+    if (entry_value) {
+        auto value_it = calls_by_entry_value.find(*entry_value);
+        if (value_it != calls_by_entry_value.end())
+            return value_it->second;
+    }
+    return llvm::None;
+}
+
+llvm::Optional<HotFunctionPolicy::Action>
+HotFunctionPolicy::parse_action(llvm::StringRef action) {
+    return llvm::StringSwitch<llvm::Optional<Action>>(action)
+        .Case("entry-only", ENTRY_ONLY)
+        .Case("disabled",   DISABLE)
+        .Default(llvm::None);
+}
+
+llvm::StringRef HotFunctionPolicy::action_name(Action action) {
+    switch (action) {
+    case ENTRY_ONLY: return "entry-only";
+    case DISABLE:    return "disabled";
+    }
+    llvm_unreachable("Unknown HotFunctionPolicy::Action");
+}
+
+llvm::Optional<HotFunctionPolicy::Action>
+HotFunctionPolicy::check_function(llvm::StringRef file_name,
+                                  llvm::StringRef func_name,
+                                  llvm::Optional<uint64_t> entry_value) {
+    auto calls = profile.lookup(func_name, entry_value);
+    if (!calls || *calls <= threshold)
+        return llvm::None;
+
+    downgraded.push_back({file_name.str(), func_name.str(), *calls});
+    return action;
+}
+
+void HotFunctionPolicy::write_report(llvm::raw_ostream &os) const {
+    for (auto &func : downgraded) {
+        os << func.file_name << ":" << func.func_name << ": "
+           << func.calls << " calls, cross-checks "
+           << action_name(action) << "\n";
+    }
+}
+
+} // namespace crosschecks
@@ -0,0 +1,85 @@
+#ifndef CROSSCHECK_PLUGIN_PROFILE_H
+#define CROSSCHECK_PLUGIN_PROFILE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace crosschecks {
+
+// Number of calls to each function in a profiling run of the program,
+// which we use to downgrade the cross-checks on the hottest functions.
+// We read two formats:
+//  * the output of `llvm-profdata merge -text` for a program built with
+//    -fprofile-instr-generate, where the first counter of each function
+//    is the number of calls to it
+//  * the call counts written by libfakechecks when FAKECHECKS_STATS_FILE
+//    is set, which start with a "# fakechecks call counts" line followed
+//    by "<entry cross-check value> <calls>" pairs, one per line
+class CallProfile {
+private:
+    llvm::StringMap<uint64_t> calls_by_name;
+    llvm::DenseMap<uint64_t, uint64_t> calls_by_entry_value;
+
+    llvm::Error parse_profdata(llvm::StringRef buffer);
+    llvm::Error parse_fakechecks(llvm::StringRef buffer);
+
+public:
+    llvm::Error parse(llvm::StringRef buffer);
+
+    // Look up the calls to a function, first by name
+    // and then by the value of its entry cross-check
+    llvm::Optional<uint64_t> lookup(llvm::StringRef name,
+                                    llvm::Optional<uint64_t> entry_value) const;
+};
+
+// Downgrades the cross-checks on the functions that the profile
+// says are called more often than the threshold
+class HotFunctionPolicy {
+public:
+    enum Action {
+        ENTRY_ONLY,
+        DISABLE,
+    };
+
+    static constexpr uint64_t DEFAULT_THRESHOLD = 100000;
+
+    static llvm::Optional<Action> parse_action(llvm::StringRef action);
+    static llvm::StringRef action_name(Action action);
+
+private:
+    CallProfile profile;
+    uint64_t threshold;
+    Action action;
+
+    struct DowngradedFunction {
+        std::string file_name;
+        std::string func_name;
+        uint64_t calls;
+    };
+    std::vector<DowngradedFunction> downgraded;
+
+public:
+    HotFunctionPolicy(CallProfile &&profile, uint64_t threshold, Action action)
+        : profile(std::move(profile)), threshold(threshold), action(action) {}
+
+    // Returns the action to take for the given function, if any,
+    // and records it for the report
+    llvm::Optional<Action> check_function(llvm::StringRef file_name,
+                                          llvm::StringRef func_name,
+                                          llvm::Optional<uint64_t> entry_value);
+
+    // Write one line per downgraded function to `os`
+    void write_report(llvm::raw_ostream &os) const;
+};
+
+} // namespace crosschecks
+
+#endif // CROSSCHECK_PLUGIN_PROFILE_H
@@ -16,7 +16,13 @@ using namespace std::literals;
 
 const HashFunction
 CrossCheckInserter::get_type_hash_function(QualType ty, llvm::StringRef candidate_name,
-                                           ASTContext &ctx, bool build_it) {
+                                           ASTContext &ctx, bool build_it,
+                                           std::string_view ahasher) {
+    std::string hasher_name{ahasher.empty() ? std::string_view{default_ahasher} : ahasher};
+    auto append_hasher_suffix = [this, &hasher_name] (HashFunction &func) {
+        if (hasher_name != default_ahasher)
+            func.name.append("$" + hasher_name);
+    };
     switch (ty->getTypeClass()) {
     case Type::Builtin: {
         switch (cast<BuiltinType>(ty)->getKind()) {
@@ -65,7 +71,7 @@ CrossCheckInserter::get_type_hash_function(QualType ty, llvm::StringRef candidat
         // Cross-check an enum type as the underlying integer type
         auto *ed = cast<EnumType>(ty)->getDecl();
         return get_type_hash_function(ed->getIntegerType(),
-                                      candidate_name, ctx, build_it);
+                                      candidate_name, ctx, build_it, ahasher);
     }
 
     case Type::FunctionNoProto:
@@ -74,7 +80,9 @@ CrossCheckInserter::get_type_hash_function(QualType ty, llvm::StringRef candidat
 
     case Type::Pointer: {
         auto pointee_ty = cast<PointerType>(ty)->getPointeeType();
-        auto pointee = get_type_hash_function(pointee_ty, candidate_name, ctx, build_it);
+        // The pointee's name already includes the hasher, if it uses one
+        auto pointee = get_type_hash_function(pointee_ty, candidate_name, ctx,
+                                              build_it, ahasher);
         HashFunction func{pointee.name, ty, ctx.getPointerType(pointee.actual_ty)};
         func.name.append("ptr"sv);
         if (build_it) {
@@ -86,13 +94,15 @@ CrossCheckInserter::get_type_hash_function(QualType ty, llvm::StringRef candidat
     case Type::ConstantArray: {
         auto array_ty = cast<ConstantArrayType>(ty);
         auto element_ty = array_ty->getElementType();
-        auto element = get_type_hash_function(element_ty, candidate_name, ctx, build_it);
+        auto element = get_type_hash_function(element_ty, candidate_name, ctx,
+                                              build_it, ahasher);
         auto num_elements = array_ty->getSize();
         HashFunction func{element.name, ty, ctx.getPointerType(element.actual_ty)};
         func.name.append("array"sv);
         func.name.append(llvm::utostr(num_elements.getZExtValue()));
+        append_hasher_suffix(func);
         if (build_it) {
-            build_array_hash_function(func, element, num_elements, ctx);
+            build_array_hash_function(func, element, num_elements, hasher_name, ctx);
         }
         return func;
     }
@@ -102,12 +112,14 @@ CrossCheckInserter::get_type_hash_function(QualType ty, llvm::StringRef candidat
         // FIXME: the array may be empty
         auto array_ty = cast<IncompleteArrayType>(ty);
         auto element_ty = array_ty->getElementType();
-        auto element = get_type_hash_function(element_ty, candidate_name, ctx, build_it);
+        auto element = get_type_hash_function(element_ty, candidate_name, ctx,
+                                              build_it, ahasher);
         HashFunction func{element.name, ty, ctx.getPointerType(element.actual_ty)};
         func.name.append("incarray"sv);
+        append_hasher_suffix(func);
         if (build_it) {
             llvm::APInt one(ctx.getTypeSize(ctx.getSizeType()), 1);
-            build_array_hash_function(func, element, one, ctx);
+            build_array_hash_function(func, element, one, hasher_name, ctx);
         }
         return func;
     }
@@ -133,8 +145,9 @@ CrossCheckInserter::get_type_hash_function(QualType ty, llvm::StringRef candidat
         HashFunction func{candidate_name, ty,
             ctx.getPointerType(ty.getUnqualifiedType())};
         func.name.append(record_decl->getKindName().str());
+        append_hasher_suffix(func);
         if (build_it) {
-            build_record_hash_function(func, candidate_name, ctx);
+            build_record_hash_function(func, candidate_name, hasher_name, ctx);
         }
         return func;
     }
@@ -149,24 +162,25 @@ CrossCheckInserter::get_type_hash_function(QualType ty, llvm::StringRef candidat
         auto td_id = td->getDecl()->getIdentifier();
         if (td_id != nullptr)
             candidate_name = td_id->getName();
-        return get_type_hash_function(td->desugar(), candidate_name, ctx, build_it);
+        return get_type_hash_function(td->desugar(), candidate_name, ctx,
+                                      build_it, ahasher);
     }
 
     case Type::Elaborated:
         return get_type_hash_function(ty->getAs<ElaboratedType>()->desugar(),
-                                      candidate_name, ctx, build_it);
+                                      candidate_name, ctx, build_it, ahasher);
 
     case Type::Paren:
         return get_type_hash_function(ty->getAs<ParenType>()->desugar(),
-                                      candidate_name, ctx, build_it);
+                                      candidate_name, ctx, build_it, ahasher);
 
     case Type::Attributed:
         return get_type_hash_function(ty->getAs<AttributedType>()->desugar(),
-                                      candidate_name, ctx, build_it);
+                                      candidate_name, ctx, build_it, ahasher);
 
     case Type::Adjusted:
         return get_type_hash_function(ty->getAs<AdjustedType>()->getOriginalType(),
-                                      candidate_name, ctx, build_it);
+                                      candidate_name, ctx, build_it, ahasher);
 
     default:
         ty->dump(llvm::errs());
@@ -202,17 +216,99 @@ Stmt *CrossCheckInserter::build_depth_check(FunctionDecl *fn_decl,
 
 }
 
+Stmt *CrossCheckInserter::build_depth_limit(FunctionDecl *fn_decl,
+                                            uint64_t max_depth,
+                                            ASTContext &ctx) {
+    // Build the following code:
+    // if (depth > max_depth)
+    //   depth = max_depth;
+    auto depth = fn_decl->getParamDecl(1);
+    auto depth_ty = depth->getType();
+    auto depth_lv = new (ctx) DeclRefExpr(depth, false, depth_ty,
+                                          VK_LValue, SourceLocation());
+    auto depth_cmp = new (ctx) BinaryOperator(get_depth(fn_decl, false, ctx),
+                                              build_hash_depth(max_depth, ctx),
+                                              BO_GT, ctx.IntTy,
+                                              VK_RValue, OK_Ordinary,
+                                              SourceLocation(),
+                                              FPOptions{});
+    auto depth_assign = new (ctx) BinaryOperator(depth_lv,
+                                                 build_hash_depth(max_depth, ctx),
+                                                 BO_Assign, depth_ty,
+                                                 VK_RValue, OK_Ordinary,
+                                                 SourceLocation(),
+                                                 FPOptions{});
+    return new (ctx) IfStmt(ctx, SourceLocation(), false,
+                            nullptr, nullptr, depth_cmp,
+                            depth_assign, SourceLocation(), nullptr);
+}
+
+// Sizes in bytes of the states of the hashers built into the runtime,
+// which must match the structures in cross_check_hashers.h
+static const std::map<std::string_view, uint64_t> builtin_hasher_state_sizes = {
+    { "jodyhash"sv,  8 },
+    { "xxh64"sv,    72 },
+};
+
+std::string
+CrossCheckInserter::get_hasher_prefix(const std::string &hasher_name,
+                                      ASTContext &ctx) {
+    // Use the inline implementation of the hasher if the translation
+    // unit has one (by including cross_check_hashers.h), and fall back
+    // to the runtime's out-of-line functions otherwise
+    std::string inline_prefix{"__c2rust_inline_hasher_"};
+    inline_prefix += hasher_name;
+    auto tu_decl = ctx.getTranslationUnitDecl();
+    SmallVector<std::pair<std::string, FunctionDecl*>, 3> inline_fns;
+    for (auto suffix : { "_init"sv, "_update"sv, "_finish"sv }) {
+        std::string fn_name{inline_prefix};
+        fn_name += suffix;
+        auto fn_id = &ctx.Idents.get(fn_name);
+        FunctionDecl *fn_def = nullptr;
+        for (auto decl : tu_decl->lookup(DeclarationName{fn_id})) {
+            if (auto fn_decl = dyn_cast<FunctionDecl>(decl)) {
+                fn_def = fn_decl->getDefinition();
+                if (fn_def != nullptr)
+                    break;
+            }
+        }
+        if (fn_def == nullptr) {
+            std::string hasher_prefix{"__c2rust_hasher_"};
+            hasher_prefix += hasher_name;
+            return hasher_prefix;
+        }
+        inline_fns.emplace_back(std::move(fn_name), fn_def);
+    }
+    for (auto &[fn_name, fn_def] : inline_fns)
+        decl_cache.try_emplace(fn_name, fn_def);
+    return inline_prefix;
+}
+
 std::tuple<VarDecl*, Expr*, CrossCheckInserter::StmtVec>
-CrossCheckInserter::build_hasher_init(const std::string &hasher_prefix,
+CrossCheckInserter::build_hasher_init(const std::string &hasher_name,
+                                      const std::string &hasher_prefix,
                                       FunctionDecl *parent,
                                       ASTContext &ctx) {
-    auto hasher_size_call =
-        build_call(hasher_prefix + "_size", ctx.UnsignedIntTy,
-                   {}, ctx);
-    auto hasher_ty = ctx.getVariableArrayType(ctx.CharTy,
-                                              hasher_size_call,
-                                              ArrayType::Normal,
-                                              0, SourceRange());
+    // Allocate the state of built-in hashers as a fixed-size array
+    // uint64_t hasher[N], and ask the runtime for the size of others
+    QualType hasher_ty;
+    auto it = builtin_hasher_state_sizes.find(hasher_name);
+    if (it != builtin_hasher_state_sizes.end()) {
+        auto word_ty = ctx.getIntTypeForBitwidth(64, false);
+        auto word_size = ctx.getTypeSizeInChars(word_ty).getQuantity();
+        llvm::APInt num_words(ctx.getTypeSize(ctx.getSizeType()),
+                              (it->second + word_size - 1) / word_size);
+        hasher_ty = ctx.getConstantArrayType(word_ty, num_words,
+                                             ArrayType::Normal, 0);
+    } else {
+        auto hasher_size_call =
+            build_call(hasher_prefix + "_size", ctx.UnsignedIntTy,
+                       {}, ctx);
+        hasher_ty = ctx.getVariableArrayType(ctx.CharTy,
+                                             hasher_size_call,
+                                             ArrayType::Normal,
+                                             0, SourceRange());
+    }
     auto hasher_ptr_ty = ctx.getArrayDecayedType(hasher_ty);
     auto hasher_id = &ctx.Idents.get("hasher");
     auto hasher_var =
@@ -227,10 +323,17 @@ CrossCheckInserter::build_hasher_init(const std::string &hasher_prefix,
     auto hasher_var_ref =
         new (ctx) DeclRefExpr(hasher_var, false, hasher_ty,
                               VK_LValue, SourceLocation());
-    auto hasher_var_ptr =
+    Expr *hasher_var_ptr =
         ImplicitCastExpr::Create(ctx, hasher_ptr_ty,
                                  CK_ArrayToPointerDecay,
                                  hasher_var_ref, nullptr, VK_RValue);
+    auto char_ptr_ty = ctx.getPointerType(ctx.CharTy);
+    if (hasher_ptr_ty != char_ptr_ty) {
+        // The hasher functions take a char*
+        hasher_var_ptr =
+            ImplicitCastExpr::Create(ctx, char_ptr_ty, CK_BitCast,
+                                     hasher_var_ptr, nullptr, VK_RValue);
+    }
     auto init_call = build_call(hasher_prefix + "_init",
                                 ctx.VoidTy,
                                 { hasher_var_ptr }, ctx);
@@ -244,7 +347,8 @@ void CrossCheckInserter::build_generic_hash_function(const HashFunction &func,
     auto full_name = func.name.full_name();
     auto fn_decl = get_function_decl(full_name,
                                      ctx.UnsignedLongTy,
-                                     { func.actual_ty, ctx.getSizeType() },
+                                     { func.actual_ty, ctx.getSizeType(),
+                                       ctx.getPointerType(ctx.VoidTy) },
                                      SC_Extern,
                                      ctx);
     if (fn_decl->hasBody())
@@ -293,17 +397,27 @@ void CrossCheckInserter::build_pointer_hash_function(const HashFunction &func,
     }
 
     // Build the pointer hash function using this template:
-    // uint64_t __c2rust_hash_T_ptr(T *x, size_t depth) {
+    // uint64_t __c2rust_hash_T_ptr(T *x, size_t depth, void *visited) {
     //   if (__c2rust_pointer_is_invalid(x))
     //      return __c2rust_hash_invalid_pointer(x);
     //   if (depth == 0)
     //      return __c2rust_hash_pointer_leaf();
-    //   return __c2rust_hash_T(*x, depth - 1);
+    //   return __c2rust_hash_T(*x, depth - 1, visited);
     // }
     //
-    // TODO: add a depth parameter and decrement it on recursion
+    // For pointers to structures, we look the hash up in the
+    // table of visited objects first, and add it there after
+    // computing it, so each structure only gets hashed once:
+    //   uint64_t hash;
+    //   if (__c2rust_hash_visited_lookup(visited, x, __c2rust_hash_T_ptr,
+    //                                    depth, &hash))
+    //      return hash;
+    //   hash = __c2rust_hash_T(*x, depth - 1, visited);
+    //   __c2rust_hash_visited_insert(visited, x, __c2rust_hash_T_ptr,
+    //                                depth, hash);
+    //   return hash;
     auto body_fn = [this, &ctx, &pointee] (FunctionDecl *fn_decl) -> StmtVec {
-        assert(fn_decl->getNumParams() == 2 &&
+        assert(fn_decl->getNumParams() == 3 &&
                "Invalid hash function signature");
         auto param = fn_decl->getParamDecl(0);
         auto param_ty = param->getType();
@@ -342,21 +456,138 @@ void CrossCheckInserter::build_pointer_hash_function(const HashFunction &func,
                                     SourceLocation());
         auto param_deref_rv = pointee.forward_argument(param_deref_lv, ctx);
         auto param_depth = get_depth(fn_decl, true, ctx);
+        auto param_visited = get_visited(fn_decl, ctx);
         auto param_hash_call =
             build_call(pointee.name.full_name(), ctx.UnsignedLongTy,
-                       { param_deref_rv, param_depth }, ctx);
+                       { param_deref_rv, param_depth, param_visited }, ctx);
+        if (!pointee.orig_ty->isStructureOrClassType()) {
+            // Build the conditional expression and return statement
+            auto return_hash_stmt =
+                new (ctx) ReturnStmt(SourceLocation(), param_hash_call, nullptr);
+            return { if_invalid, depth_check, return_hash_stmt };
+        }
+
+        // uint64_t hash;
+        auto hash_ty = ctx.UnsignedLongTy;
+        auto hash_id = &ctx.Idents.get("hash");
+        auto hash_var =
+            VarDecl::Create(ctx, fn_decl, SourceLocation(), SourceLocation(),
+                            hash_id, hash_ty, nullptr, SC_None);
+        auto hash_decl_stmt =
+            new (ctx) DeclStmt(DeclGroupRef(hash_var),
+                               SourceLocation(),
+                               SourceLocation());
+        auto hash_ref_lv =
+            new (ctx) DeclRefExpr(hash_var, false, hash_ty,
+                                  VK_LValue, SourceLocation());
+        auto hash_ref_rv =
+            ImplicitCastExpr::Create(ctx, hash_ty, CK_LValueToRValue,
+                                     hash_ref_lv, nullptr, VK_RValue);
+
+        // We key the table on the address of this function, which is
+        // unique to the pointer type; the same address may hold objects
+        // of different types, e.g., a structure and its first field
+        auto fn_ty = fn_decl->getType();
+        auto fn_ref =
+            new (ctx) DeclRefExpr(fn_decl, false, fn_ty,
+                                  VK_LValue, SourceLocation());
+        auto fn_ptr =
+            ImplicitCastExpr::Create(ctx, ctx.getPointerType(fn_ty),
+                                     CK_FunctionToPointerDecay,
+                                     fn_ref, nullptr, VK_RValue);
+        auto fn_void_ptr =
+            ImplicitCastExpr::Create(ctx, ctx.getPointerType(ctx.VoidTy),
+                                     CK_BitCast, fn_ptr, nullptr, VK_RValue);
 
-        // Build the conditional expression and return statement
+        auto hash_ptr =
+            new (ctx) UnaryOperator(hash_ref_lv, UO_AddrOf,
+                                    ctx.getPointerType(hash_ty),
+                                    VK_RValue, OK_Ordinary,
+                                    SourceLocation());
+        auto lookup_call =
+            build_call("__c2rust_hash_visited_lookup", ctx.BoolTy,
+                       { get_visited(fn_decl, ctx), param_void_ref_rv,
+                         fn_void_ptr, get_depth(fn_decl, false, ctx),
+                         hash_ptr }, ctx);
+        auto return_found =
+            new (ctx) ReturnStmt(SourceLocation(), hash_ref_rv, nullptr);
+        auto if_found =
+            new (ctx) IfStmt(ctx, SourceLocation(), false,
+                             nullptr, nullptr, lookup_call,
+                             return_found, SourceLocation(), nullptr);
+
+        auto hash_assign =
+            new (ctx) BinaryOperator(hash_ref_lv, param_hash_call,
+                                     BO_Assign, hash_ty,
+                                     VK_RValue, OK_Ordinary,
+                                     SourceLocation(),
+                                     FPOptions{});
+        auto insert_call =
+            build_call("__c2rust_hash_visited_insert", ctx.VoidTy,
+                       { get_visited(fn_decl, ctx), param_void_ref_rv,
+                         fn_void_ptr, get_depth(fn_decl, false, ctx),
+                         hash_ref_rv }, ctx);
         auto return_hash_stmt =
-            new (ctx) ReturnStmt(SourceLocation(), param_hash_call, nullptr);
-        return { if_invalid, depth_check, return_hash_stmt };
+            new (ctx) ReturnStmt(SourceLocation(), hash_ref_rv, nullptr);
+        return { if_invalid, depth_check, hash_decl_stmt, if_found,
+                 hash_assign, insert_call, return_hash_stmt };
     };
     build_generic_hash_function(func, ctx, body_fn);
 }
 
+// Element kinds for __c2rust_hasher_H_update_bytes,
+// which need to match hash_elem_kind_t in the runtime
+enum HashElementKind : unsigned {
+    HASH_ELEM_U8,
+    HASH_ELEM_U16,
+    HASH_ELEM_U32,
+    HASH_ELEM_U64,
+    HASH_ELEM_I8,
+    HASH_ELEM_I16,
+    HASH_ELEM_I32,
+    HASH_ELEM_I64,
+    HASH_ELEM_BOOL,
+    HASH_ELEM_FLOAT,
+    HASH_ELEM_DOUBLE,
+};
+
+// Return the kind of the elements of an array if the runtime
+// can hash them in bulk, i.e., if the element hash function
+// is one of the runtime's functions for primitive types
+static llvm::Optional<HashElementKind>
+get_hash_element_kind(QualType ty, ASTContext &ctx) {
+    auto builtin_ty = ty->getAs<BuiltinType>();
+    if (builtin_ty == nullptr)
+        return llvm::None;
+    switch (builtin_ty->getKind()) {
+    case BuiltinType::Bool:
+        return HASH_ELEM_BOOL;
+    case BuiltinType::Float:
+        return HASH_ELEM_FLOAT;
+    case BuiltinType::Double:
+        return HASH_ELEM_DOUBLE;
+    case BuiltinType::LongDouble:
+        return llvm::None;
+    default:
+        break;
+    }
+    if (!builtin_ty->isInteger())
+        return llvm::None;
+
+    bool is_signed = builtin_ty->isSignedInteger();
+    switch (ctx.getTypeSize(builtin_ty)) {
+    case 8:  return is_signed ? HASH_ELEM_I8  : HASH_ELEM_U8;
+    case 16: return is_signed ? HASH_ELEM_I16 : HASH_ELEM_U16;
+    case 32: return is_signed ? HASH_ELEM_I32 : HASH_ELEM_U32;
+    case 64: return is_signed ? HASH_ELEM_I64 : HASH_ELEM_U64;
+    default: return llvm::None;
+    }
+}
+
 void CrossCheckInserter::build_array_hash_function(const HashFunction &func,
                                                    const HashFunction &element,
                                                    const llvm::APInt &num_elements,
+                                                   const std::string &ahasher,
                                                    ASTContext &ctx) {
     if (element.orig_ty->isIncompleteType()) {
         // TODO: figure out what to do about this
@@ -365,23 +596,33 @@ void CrossCheckInserter::build_array_hash_function(const HashFunction &func,
     }
 
     // Build the following code:
-    // uint64_t __c2rust_hash_T_array_N(T x[N], size_t depth) {
+    // uint64_t __c2rust_hash_T_array_N(T x[N], size_t depth, void *visited) {
     //   if (depth == 0)
     //      return __c2rust_hash_array_leaf();
     //
-    //   char hasher[__c2rust_hasher_H_size()];
-    //   __c2rust_hasher_H_init(hasher);
+    //   uint64_t hasher[N_H];
+    //   __c2rust_hasher_H_init((char*)hasher);
     //   for (size_t i = 0; i < N; i++)
-    //      __c2rust_hasher_H_update(hasher, __c2rust_hash_T(x[i]));
-    //   return __c2rust_hasher_H_finish(hasher);
+    //      __c2rust_hasher_H_update((char*)hasher, __c2rust_hash_T(x[i], depth - 1, visited));
+    //   return __c2rust_hasher_H_finish((char*)hasher);
     // }
     //
-    // TODO: allow custom hashers instead of the default "jodyhash"
-    std::string hasher_name{"jodyhash"};
-    std::string hasher_prefix{"__c2rust_hasher_"};
-    hasher_prefix += hasher_name;
+    // For primitive element types, the loop is replaced by a single call
+    // that hashes all the elements at once:
+    //   __c2rust_hasher_H_update_bytes((char*)hasher, x, N * sizeof(T), KIND);
+    // The runtime only provides that call for its built-in hashers,
+    // so arrays hashed with any other hasher always use the loop.
+    //
+    // The init, update and finish calls go to __c2rust_inline_hasher_H_*
+    // instead if cross_check_hashers.h is included.
+    auto hasher_name = ahasher;
+    auto hasher_prefix = get_hasher_prefix(hasher_name, ctx);
+    llvm::Optional<HashElementKind> element_kind;
+    if (builtin_hasher_state_sizes.count(hasher_name) != 0)
+        element_kind = get_hash_element_kind(element.actual_ty, ctx);
     auto body_fn =
-            [this, &ctx, &element, &num_elements,
+            [this, &ctx, &element, &num_elements, element_kind,
+             hasher_name = std::move(hasher_name),
              hasher_prefix = std::move(hasher_prefix)]
             (FunctionDecl *fn_decl) -> StmtVec {
         StmtVec stmts;
@@ -389,11 +630,51 @@ void CrossCheckInserter::build_array_hash_function(const HashFunction &func,
         stmts.push_back(depth_check);
 
         auto [hasher_var, hasher_var_ptr, hasher_init_stmts] =
-            build_hasher_init(hasher_prefix, fn_decl, ctx);
+            build_hasher_init(hasher_name, hasher_prefix, fn_decl, ctx);
         stmts.insert(stmts.end(),
                      std::make_move_iterator(hasher_init_stmts.begin()),
                      std::make_move_iterator(hasher_init_stmts.end()));
 
+        auto param = fn_decl->getParamDecl(0);
+        auto param_ty = param->getType();
+        auto param_ref_lv =
+            new (ctx) DeclRefExpr(param, false, param_ty,
+                                  VK_LValue, SourceLocation());
+        if (element_kind) {
+            // __c2rust_hasher_H_update_bytes(hasher, (void*)x, N * sizeof(T), KIND);
+            auto param_ref_rv =
+                ImplicitCastExpr::Create(ctx, param_ty,
+                                         CK_LValueToRValue,
+                                         param_ref_lv, nullptr, VK_RValue);
+            auto param_void_ref_rv =
+                ImplicitCastExpr::Create(ctx, ctx.getPointerType(ctx.VoidTy),
+                                         CK_BitCast, param_ref_rv,
+                                         nullptr, VK_RValue);
+            auto size_ty = ctx.getSizeType();
+            auto elem_size = ctx.getTypeSizeInChars(element.actual_ty).getQuantity();
+            llvm::APInt num_bytes(ctx.getTypeSize(size_ty),
+                                  num_elements.getZExtValue() * elem_size);
+            auto num_bytes_lit = IntegerLiteral::Create(ctx, num_bytes, size_ty,
+                                                        SourceLocation());
+            llvm::APInt kind(ctx.getTypeSize(ctx.UnsignedIntTy), *element_kind);
+            auto kind_lit = IntegerLiteral::Create(ctx, kind, ctx.UnsignedIntTy,
+                                                   SourceLocation());
+            // Only the runtime has the bulk update
+            auto update_call = build_call("__c2rust_hasher_" + hasher_name + "_update_bytes",
+                                          ctx.VoidTy,
+                                          { hasher_var_ptr, param_void_ref_rv,
+                                            num_bytes_lit, kind_lit }, ctx);
+            stmts.push_back(update_call);
+
+            auto finish_call = build_call(hasher_prefix + "_finish",
+                                          ctx.UnsignedLongTy,
+                                          { hasher_var_ptr }, ctx);
+            auto return_stmt =
+                new (ctx) ReturnStmt(SourceLocation(), finish_call, nullptr);
+            stmts.push_back(return_stmt);
+            return stmts;
+        }
+
         // size_t i = 0;
         auto i_id = &ctx.Idents.get("i");
         auto i_ty = ctx.getSizeType();
@@ -425,19 +706,16 @@ void CrossCheckInserter::build_array_hash_function(const HashFunction &func,
         // Loop body: __c2rust_hasher_H_update(hasher, __c2rust_hash_T(x[i]));
         assert(!element.orig_ty->isIncompleteType() &&
                "Attempting to dereference incomplete type");
-        auto param = fn_decl->getParamDecl(0);
-        auto param_ty = param->getType();
-        auto param_ref_lv =
-            new (ctx) DeclRefExpr(param, false, param_ty,
-                                  VK_LValue, SourceLocation());
         auto param_i_lv = new (ctx) ArraySubscriptExpr(param_ref_lv, i_var_rv,
                                                        element.orig_ty, VK_LValue,
                                                        OK_Ordinary, SourceLocation());
         auto param_i_rv = element.forward_argument(param_i_lv, ctx);
         auto param_i_hash_fn = element.name.full_name();
         auto param_i_depth = get_depth(fn_decl, true, ctx);
+        auto param_i_visited = get_visited(fn_decl, ctx);
         auto param_i_hash = build_call(param_i_hash_fn, ctx.UnsignedLongTy,
-                                       { param_i_rv, param_i_depth }, ctx);
+                                       { param_i_rv, param_i_depth,
+                                         param_i_visited }, ctx);
         auto update_call = build_call(hasher_prefix + "_update", ctx.VoidTy,
                                       { hasher_var_ptr, param_i_hash }, ctx);
 
@@ -462,6 +740,7 @@ void CrossCheckInserter::build_array_hash_function(const HashFunction &func,
 
 void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
                                                     const std::string &record_name,
+                                                    const std::string &ahasher,
                                                     ASTContext &ctx) {
     auto &diags = ctx.getDiagnostics();
     auto record_ty = cast<RecordType>(func.orig_ty);
@@ -470,19 +749,18 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
     DefaultsConfigOptRef file_defaults;
     StructConfig record_cfg{record_name};
     // Read the inline function configurations
-    parse_xcheck_attrs(record_decl, [&record_cfg, &record_name] (llvm::yaml::Input &yin) {
-        StructConfig scfg{record_name};
-        yin >> scfg;
+    parse_xcheck_attrs(record_decl, struct_annotations,
+                       [] { return StructConfig{""}; },
+                       [&record_cfg] (const StructConfig &cached) {
+        StructConfig scfg{cached};
+        scfg.name = record_cfg.name;
         record_cfg.update(scfg);
     });
     auto ploc = ctx.getSourceManager().getPresumedLoc(record_decl->getLocStart());
     if (ploc.isValid()) {
         std::string file_name(ploc.getFilename());
-        auto it = defaults_configs.find(file_name);
-        if (it != defaults_configs.end()) {
-            file_defaults = it->second;
-        }
-        auto scfg = get_struct_config(file_name, record_name);
+        file_defaults = get_defaults_config(file_name, ctx.getDiagnostics());
+        auto scfg = get_struct_config(file_name, record_name, ctx.getDiagnostics());
         if (scfg)
             record_cfg.update(*scfg);
 
@@ -502,6 +780,16 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
         return;
     }
 
+    // Deeper callers only get to follow the pointers
+    // inside this record hash_depth levels deep
+    auto build_depth_limit_stmts = [this, &ctx,
+                                    hash_depth = record_cfg.hash_depth]
+                                   (FunctionDecl *fn_decl) -> StmtVec {
+        if (!hash_depth)
+            return {};
+        return { build_depth_limit(fn_decl, *hash_depth, ctx) };
+    };
+
     if (record_cfg.custom_hash) {
         // The user specified a "custom_hash" function, so just forward
         // the structure to it
@@ -509,7 +797,9 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
         // and instead declare our function using "alias", e.g.:
         // uint64_t __c2rust_hash_T_struct(struct T *x) __attribute__((alias("...")));
         auto &hash_fn_name = *record_cfg.custom_hash;
-        auto body_fn = [this, &ctx, &hash_fn_name, &func] (FunctionDecl *fn_decl) -> StmtVec {
+        auto body_fn = [this, &ctx, &hash_fn_name, &func,
+                        &build_depth_limit_stmts] (FunctionDecl *fn_decl) -> StmtVec {
+            auto stmts = build_depth_limit_stmts(fn_decl);
             auto param = fn_decl->getParamDecl(0);
             auto param_ty = param->getType();
             auto param_ref_lv =
@@ -517,31 +807,39 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
                                       VK_LValue, SourceLocation());
             auto param_ref_rv = func.forward_argument(param_ref_lv, ctx);
             auto new_depth = get_depth(fn_decl, false, ctx);
+            auto visited = get_visited(fn_decl, ctx);
             auto hash_fn_call = build_call(hash_fn_name,
                                            ctx.UnsignedLongTy,
-                                           { param_ref_rv, new_depth }, ctx);
+                                           { param_ref_rv, new_depth, visited }, ctx);
             auto return_stmt =
                 new (ctx) ReturnStmt(SourceLocation(), hash_fn_call, nullptr);
-            return { return_stmt };
+            stmts.push_back(return_stmt);
+            return stmts;
         };
         build_generic_hash_function(func, ctx, body_fn);
         return;
     }
 
     // Build the following code:
-    // uint64_t __c2rust_hash_T_struct(struct T *x, size_t depth) {
+    // uint64_t __c2rust_hash_T_struct(struct T *x, size_t depth, void *visited) {
+    //   if (depth > hash_depth)    // Only if configured
+    //      depth = hash_depth;
     //   if (depth == 0)
     //      return __c2rust_hash_record_leaf();
     //
-    //   char hasher[__c2rust_hasher_H_size()];
-    //   __c2rust_hasher_H_init(hasher);
-    //   __c2rust_hasher_H_update(hasher, __c2rust_hash_F1(x.field1, depth - 1));
-    //   __c2rust_hasher_H_update(hasher, __c2rust_hash_F2(x.field2, depth - 1));
+    //   uint64_t hasher[N_H];
+    //   __c2rust_hasher_H_init((char*)hasher);
+    //   __c2rust_hasher_H_update((char*)hasher, __c2rust_hash_F1(x.field1, depth - 1, visited));
+    //   __c2rust_hasher_H_update((char*)hasher, __c2rust_hash_F2(x.field2, depth - 1, visited));
     //   ...
-    //   return __c2rust_hasher_H_finish(hasher);
+    //   return __c2rust_hasher_H_finish((char*)hasher);
     // }
     //
-    // TODO: allow custom hashers instead of the default "jodyhash"
+    // where H is the record's field_hasher or ahasher, or the ahasher
+    // of the enclosing record (ultimately the --ahasher plugin argument,
+    // "jodyhash" by default) and N_H the size of its state (see
+    // build_hasher_init). Like the Rust derive, the record's ahasher
+    // is passed down to the hash functions of its fields.
     auto record_def = record_decl->getDefinition();
     if (record_def == nullptr) {
 #if 0 // Assume some other file provides an implementation for this
@@ -555,18 +853,22 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
         report_clang_warning(diags, "emitting generic 'AnyUnion' cross-check for union, "
                                     "please use a custom cross-check for '%0'",
                                     record_name);
-        // uint64_t __c2rust_hash_T_union(struct T *x, size_t depth) {
+        // uint64_t __c2rust_hash_T_union(struct T *x, size_t depth, void *visited) {
         //   if (depth == 0)
         //      return __c2rust_hash_record_leaf();
         //   return __c2rust_hash_anyunion();
         // }
-        auto body_fn = [this, &ctx] (FunctionDecl *fn_decl) -> StmtVec {
+        auto body_fn = [this, &ctx, &build_depth_limit_stmts]
+                       (FunctionDecl *fn_decl) -> StmtVec {
+            auto stmts = build_depth_limit_stmts(fn_decl);
             auto depth_check = build_depth_check(fn_decl, "record"sv, ctx);
             auto anyunion_call = build_call("__c2rust_hash_anyunion",
                                              ctx.UnsignedLongTy, { }, ctx);
             auto return_stmt =
                 new (ctx) ReturnStmt(SourceLocation(), anyunion_call, nullptr);
-            return { depth_check, return_stmt };
+            stmts.push_back(depth_check);
+            stmts.push_back(return_stmt);
+            return stmts;
         };
         build_generic_hash_function(func, ctx, body_fn);
         return;
@@ -574,23 +876,29 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
     assert((record_def->isStruct() || record_def->isClass()) &&
            "Called build_record_hash_function on neither a struct nor a class");
 
-    std::string hasher_name{"jodyhash"};
+    std::string fields_ahasher{ahasher};
+    if (record_cfg.ahasher) {
+        fields_ahasher = *record_cfg.ahasher;
+    }
+    std::string hasher_name{fields_ahasher};
     if (record_cfg.field_hasher) {
         hasher_name = *record_cfg.field_hasher;
     }
-    std::string hasher_prefix{"__c2rust_hasher_"};
-    hasher_prefix += hasher_name;
+    auto hasher_prefix = get_hasher_prefix(hasher_name, ctx);
     auto body_fn =
             [this, &ctx, &record_def, &record_name,
+             &build_depth_limit_stmts,
              record_cfg = std::move(record_cfg),
+             fields_ahasher = std::move(fields_ahasher),
+             hasher_name = std::move(hasher_name),
              hasher_prefix = std::move(hasher_prefix)]
             (FunctionDecl *fn_decl) -> StmtVec {
-        StmtVec stmts;
+        auto stmts = build_depth_limit_stmts(fn_decl);
         auto depth_check = build_depth_check(fn_decl, "record"sv, ctx);
         stmts.push_back(depth_check);
 
         auto [hasher_var, hasher_var_ptr, hasher_init_stmts] =
-            build_hasher_init(hasher_prefix, fn_decl, ctx);
+            build_hasher_init(hasher_name, hasher_prefix, fn_decl, ctx);
         stmts.insert(stmts.end(),
                      std::make_move_iterator(hasher_init_stmts.begin()),
                      std::make_move_iterator(hasher_init_stmts.end()));
@@ -598,6 +906,7 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
         // Add the field calls
         auto param = fn_decl->getParamDecl(0);
         auto field_depth = get_depth(fn_decl, true, ctx);
+        auto field_visited = get_visited(fn_decl, ctx);
         DeclMap field_decls;
         for (auto *field : record_def->fields()) {
             field_decls.emplace(llvm_string_ref_to_sv(field->getName()), field);
@@ -615,8 +924,10 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
             }
 
             XCheck field_xcheck;
-            parse_xcheck_attrs(field, [&field_xcheck] (llvm::yaml::Input &yin) {
-                yin >> field_xcheck;
+            parse_xcheck_attrs(field, xcheck_annotations,
+                               [] { return XCheck{}; },
+                               [&field_xcheck] (const XCheck &xc) {
+                field_xcheck = xc;
             });
             auto it = record_cfg.fields.find(field->getName());
             if (it != record_cfg.fields.end()) {
@@ -658,7 +969,8 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
                     field_ty_name += "$field$";
                     field_ty_name += field->getName();
                     auto field_ty = field->getType();
-                    auto field_hash_fn = get_type_hash_function(field_ty, field_ty_name, ctx, true);
+                    auto field_hash_fn = get_type_hash_function(field_ty, field_ty_name, ctx,
+                                                                true, fields_ahasher);
                     field_hash_fn_name = field_hash_fn.name.full_name();
                     auto field_ref_lv =
                         new (ctx) MemberExpr(param_ref_rv, true, SourceLocation(),
@@ -668,6 +980,7 @@ void CrossCheckInserter::build_record_hash_function(const HashFunction &func,
                     field_hash_args.push_back(field_ref_rv);
                 }
                 field_hash_args.push_back(field_depth);
+                field_hash_args.push_back(field_visited);
                 field_hash = build_call(field_hash_fn_name,
                                         ctx.UnsignedLongTy,
                                         field_hash_args, ctx);
@@ -1,5 +1,9 @@
 #include <stdint.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cross_check_hashers.h>
 
 #define _WIDTH_HASH_FUNCTION(SIGN, WIDTH) __c2rust_hash_##SIGN##WIDTH
 #define WIDTH_HASH_FUNCTION(SIGN, WIDTH)  _WIDTH_HASH_FUNCTION(SIGN, WIDTH)
@@ -9,10 +13,12 @@
 #define _STRINGIFY(x)   #x
 #define STRINGIFY(x)    _STRINGIFY(x)
 #define DEFINE_FIXED_HASH(short_ty, short_byte_ty, val_ty, xor_const)     \
-    static uint64_t __c2rust_hash_ ## short_ty (val_ty x, size_t depth) { \
+    static uint64_t __c2rust_hash_ ## short_ty (val_ty x, size_t depth,   \
+                                                void *visited) {          \
         return (0x ## xor_const ## ULL) ^ (uint64_t) x;                   \
     }                                                                     \
-    uint64_t __c2rust_hash_ ## short_byte_ty (val_ty x, size_t depth)     \
+    uint64_t __c2rust_hash_ ## short_byte_ty (val_ty x, size_t depth,     \
+                                              void *visited)              \
     __attribute__((alias(STRINGIFY(__c2rust_hash_ ## short_ty))));
 
 DEFINE_FIXED_HASH(u8,  U1, uint8_t,  0000000000000000)
@@ -27,7 +33,8 @@ DEFINE_FIXED_HASH(i64, I8,  int64_t, d2d2d2d2d2d2d2d0)
 // Now define __c2rust_hash_T functions for primitive C types
 // as aliases to the fixed-size functions defined above
 #define DEFINE_CTYPE_HASH(c_ty_name, c_ty, sign, width)         \
-    uint64_t __c2rust_hash_ ## c_ty_name (c_ty x, size_t depth) \
+    uint64_t __c2rust_hash_ ## c_ty_name (c_ty x, size_t depth, \
+                                          void *visited)        \
     __attribute__((alias(STRINGIFY(WIDTH_HASH_FUNCTION(sign, width)))));
 DEFINE_CTYPE_HASH(uchar,  unsigned char,      U, 1);
 DEFINE_CTYPE_HASH(ushort, unsigned short,     U, __SIZEOF_SHORT__);
@@ -45,14 +52,14 @@ DEFINE_CTYPE_HASH(char,   char,               U, 1);
 DEFINE_CTYPE_HASH(char,   char,               I, 1);
 #endif
 
-uint64_t __c2rust_hash_bool(_Bool x, size_t depth) {
+uint64_t __c2rust_hash_bool(_Bool x, size_t depth, void *visited) {
     return x ? 0x8787878787878785ULL : 0x8787878787878784ULL;
 }
 
 // TODO: implement more types, e.g., bool, char, double, float
 
 #if __SIZEOF_FLOAT__ == 4
-uint64_t __c2rust_hash_float(float x, size_t depth) {
+uint64_t __c2rust_hash_float(float x, size_t depth, void *visited) {
     union {
         float f;
         uint32_t u;
@@ -64,7 +71,7 @@ uint64_t __c2rust_hash_float(float x, size_t depth) {
 #endif
 
 #if __SIZEOF_DOUBLE__ == 8
-uint64_t __c2rust_hash_double(double x, size_t depth) {
+uint64_t __c2rust_hash_double(double x, size_t depth, void *visited) {
     union {
         double d;
         uint64_t u;
@@ -107,7 +114,7 @@ uint64_t __c2rust_hash_anyunion() {
     return ANY_UNION_HASH;
 }
 
-uint64_t __c2rust_hash_void_ptr(void *p, size_t depth) {
+uint64_t __c2rust_hash_void_ptr(void *p, size_t depth, void *visited) {
     if (p == NULL)
         return NULL_POINTER_HASH;
     if (depth == 0)
@@ -115,7 +122,7 @@ uint64_t __c2rust_hash_void_ptr(void *p, size_t depth) {
     return VOID_POINTER_HASH;
 }
 
-uint64_t __c2rust_hash_function(void *f, size_t depth) {
+uint64_t __c2rust_hash_function(void *f, size_t depth, void *visited) {
     if (f == NULL)
         return NULL_POINTER_HASH;
     if (depth == 0)
@@ -123,34 +130,289 @@ uint64_t __c2rust_hash_function(void *f, size_t depth) {
     return FUNC_POINTER_HASH;
 }
 
-// JodyHasher implementation
-struct hasher_jodyhash_t {
-    uint64_t state;
+// Table of the objects already hashed during one cross-check,
+// so that structures reachable through several pointers, e.g.,
+// the nodes of a doubly-linked list or a hash table, only get
+// hashed once instead of once for every path that reaches them.
+// The plugin allocates it on the stack of the checked function
+// as an array of 64-bit words, so its size is part of the ABI
+// and needs to match HASH_VISITED_WORDS in the plugin.
+//
+// An object's hash depends on the depth it gets hashed at,
+// so we key the entries on the depth as well as on the object
+// and the hash function, which keeps all hashes identical to the
+// ones computed without the table. Since every object can get an
+// entry for each depth it is reached at, the table starts out with
+// a few slots on the stack and moves to the heap, doubling in size,
+// when it fills up; the plugin calls __c2rust_hash_visited_free
+// at the end of the cross-check to release it. Past
+// HASH_VISITED_MAX_SLOTS, we just stop memoizing new objects.
+#define HASH_VISITED_INLINE_SLOTS 32
+#define HASH_VISITED_MAX_SLOTS    (1 << 20)
+
+struct hash_visited_slot_t {
+    uint64_t ptr;   // Address of the object, or 0 for empty slots
+    uint64_t tag;   // Address of the pointer hash function
+    uint64_t depth;
+    uint64_t hash;
+};
+
+struct hash_visited_t {
+    uint64_t count;
+    uint64_t num_slots; // Always a power of two
+    struct hash_visited_slot_t *slots;
+    struct hash_visited_slot_t inline_slots[HASH_VISITED_INLINE_SLOTS];
 };
 
-#define JODY_HASH_CONSTANT  0x1f3d5b79UL
+_Static_assert(sizeof(struct hash_visited_t) == 131 * sizeof(uint64_t),
+               "hash_visited_t does not match the plugin's HASH_VISITED_WORDS");
+
+void __c2rust_hash_visited_init(void *visited) {
+    struct hash_visited_t *hv = visited;
+    hv->count = 0;
+    hv->num_slots = HASH_VISITED_INLINE_SLOTS;
+    hv->slots = hv->inline_slots;
+    memset(hv->inline_slots, 0, sizeof(hv->inline_slots));
+}
 
-unsigned int __c2rust_hasher_jodyhash_size() {
-    return sizeof(struct hasher_jodyhash_t) / sizeof(char);
+void __c2rust_hash_visited_free(void *visited) {
+    struct hash_visited_t *hv = visited;
+    if (hv->slots != hv->inline_slots)
+        free(hv->slots);
 }
 
-void __c2rust_hasher_jodyhash_init(char *p) {
-    struct hasher_jodyhash_t *jh = (struct hasher_jodyhash_t*) p;
-    jh->state = 0;
+static struct hash_visited_slot_t *
+hash_visited_find(struct hash_visited_slot_t *slots, uint64_t num_slots,
+                  uint64_t ptr, uint64_t tag, uint64_t depth) {
+    uint64_t h = (ptr ^ (tag << 1) ^ depth) * 0x9e3779b97f4a7c15ULL;
+    // Use the top bits of the product, which depend on all the key bits
+    size_t idx = h >> (64 - __builtin_ctzll(num_slots));
+    // The table never fills up completely, so this always terminates
+    for (;;) {
+        struct hash_visited_slot_t *slot = &slots[idx];
+        if (slot->ptr == 0 ||
+            (slot->ptr == ptr && slot->tag == tag && slot->depth == depth))
+            return slot;
+        idx = (idx + 1) & (num_slots - 1);
+    }
 }
 
-void __c2rust_hasher_jodyhash_update(char *p, uint64_t x) {
-    struct hasher_jodyhash_t *jh = (struct hasher_jodyhash_t*) p;
-    jh->state += x;
-    jh->state += JODY_HASH_CONSTANT;
-    jh->state = (jh->state << 14) | (jh->state >> 50);
-    jh->state ^= x;
-    jh->state = (jh->state << 14) | (jh->state >> 50);
-    jh->state ^= JODY_HASH_CONSTANT;
-    jh->state += x;
+// Move all the entries to a heap table twice the size,
+// returning false if we cannot or should not grow any further
+static _Bool hash_visited_grow(struct hash_visited_t *hv) {
+    uint64_t num_slots = hv->num_slots * 2;
+    if (num_slots > HASH_VISITED_MAX_SLOTS)
+        return 0;
+    struct hash_visited_slot_t *slots = calloc(num_slots, sizeof(*slots));
+    if (slots == NULL)
+        return 0;
+    for (uint64_t i = 0; i < hv->num_slots; i++) {
+        struct hash_visited_slot_t *old = &hv->slots[i];
+        if (old->ptr != 0)
+            *hash_visited_find(slots, num_slots, old->ptr,
+                               old->tag, old->depth) = *old;
+    }
+    __c2rust_hash_visited_free(hv);
+    hv->slots = slots;
+    hv->num_slots = num_slots;
+    return 1;
 }
 
-uint64_t __c2rust_hasher_jodyhash_finish(char *p) {
-    struct hasher_jodyhash_t *jh = (struct hasher_jodyhash_t*) p;
-    return jh->state;
+_Bool __c2rust_hash_visited_lookup(void *visited, void *p, void *tag,
+                                   size_t depth, uint64_t *hash) {
+    struct hash_visited_t *hv = visited;
+    if (hv == NULL)
+        return 0;
+    struct hash_visited_slot_t *slot =
+        hash_visited_find(hv->slots, hv->num_slots,
+                          (uintptr_t) p, (uintptr_t) tag, depth);
+    if (slot->ptr == 0)
+        return 0;
+    *hash = slot->hash;
+    return 1;
 }
+
+void __c2rust_hash_visited_insert(void *visited, void *p, void *tag,
+                                  size_t depth, uint64_t hash) {
+    struct hash_visited_t *hv = visited;
+    if (hv == NULL)
+        return;
+    // Keep the load factor at or below 3/4
+    if (hv->count >= hv->num_slots * 3 / 4 && !hash_visited_grow(hv))
+        return;
+    struct hash_visited_slot_t *slot =
+        hash_visited_find(hv->slots, hv->num_slots,
+                          (uintptr_t) p, (uintptr_t) tag, depth);
+    if (slot->ptr == 0) {
+        slot->ptr = (uintptr_t) p;
+        slot->tag = (uintptr_t) tag;
+        slot->depth = depth;
+        slot->hash = hash;
+        hv->count++;
+    }
+}
+
+// Bulk hashing of arrays of primitive values, which computes the
+// same hashes as calling __c2rust_hash_T on each element, but
+// in batches the compiler can vectorize. The element kinds
+// need to match HashElementKind in the plugin.
+enum hash_elem_kind_t {
+    HASH_ELEM_U8,
+    HASH_ELEM_U16,
+    HASH_ELEM_U32,
+    HASH_ELEM_U64,
+    HASH_ELEM_I8,
+    HASH_ELEM_I16,
+    HASH_ELEM_I32,
+    HASH_ELEM_I64,
+    HASH_ELEM_BOOL,
+    HASH_ELEM_FLOAT,
+    HASH_ELEM_DOUBLE,
+};
+
+#define HASH_BULK_CHUNK 64
+
+static size_t hash_elem_size(unsigned int elem_kind) {
+    switch (elem_kind) {
+    case HASH_ELEM_U8:     return sizeof(uint8_t);
+    case HASH_ELEM_U16:    return sizeof(uint16_t);
+    case HASH_ELEM_U32:    return sizeof(uint32_t);
+    case HASH_ELEM_U64:    return sizeof(uint64_t);
+    case HASH_ELEM_I8:     return sizeof(int8_t);
+    case HASH_ELEM_I16:    return sizeof(int16_t);
+    case HASH_ELEM_I32:    return sizeof(int32_t);
+    case HASH_ELEM_I64:    return sizeof(int64_t);
+    case HASH_ELEM_BOOL:   return sizeof(_Bool);
+    case HASH_ELEM_FLOAT:  return sizeof(float);
+    case HASH_ELEM_DOUBLE: return sizeof(double);
+    default:               __builtin_unreachable();
+    }
+}
+
+// We load the elements using memcpy, since the array may have
+// a different but same-sized type, e.g., `long long` for int64_t
+#define DEFINE_BULK_ELEM_HASH(short_ty, val_ty, hash_fn)                   \
+    static void hash_elements_ ## short_ty(uint64_t *out, const char *in,  \
+                                           size_t n) {                     \
+        for (size_t i = 0; i < n; i++) {                                   \
+            val_ty x;                                                      \
+            memcpy(&x, in + i * sizeof(val_ty), sizeof(val_ty));           \
+            out[i] = hash_fn(x, 0, NULL);                                  \
+        }                                                                  \
+    }
+
+DEFINE_BULK_ELEM_HASH(u8,     uint8_t,  __c2rust_hash_u8)
+DEFINE_BULK_ELEM_HASH(u16,    uint16_t, __c2rust_hash_u16)
+DEFINE_BULK_ELEM_HASH(u32,    uint32_t, __c2rust_hash_u32)
+DEFINE_BULK_ELEM_HASH(u64,    uint64_t, __c2rust_hash_u64)
+DEFINE_BULK_ELEM_HASH(i8,     int8_t,   __c2rust_hash_i8)
+DEFINE_BULK_ELEM_HASH(i16,    int16_t,  __c2rust_hash_i16)
+DEFINE_BULK_ELEM_HASH(i32,    int32_t,  __c2rust_hash_i32)
+DEFINE_BULK_ELEM_HASH(i64,    int64_t,  __c2rust_hash_i64)
+DEFINE_BULK_ELEM_HASH(bool,   _Bool,    __c2rust_hash_bool)
+DEFINE_BULK_ELEM_HASH(float,  float,    __c2rust_hash_float)
+DEFINE_BULK_ELEM_HASH(double, double,   __c2rust_hash_double)
+
+static void hash_elements(uint64_t *out, const char *in, size_t n,
+                          unsigned int elem_kind) {
+    switch (elem_kind) {
+    case HASH_ELEM_U8:     hash_elements_u8(out, in, n);     break;
+    case HASH_ELEM_U16:    hash_elements_u16(out, in, n);    break;
+    case HASH_ELEM_U32:    hash_elements_u32(out, in, n);    break;
+    case HASH_ELEM_U64:    hash_elements_u64(out, in, n);    break;
+    case HASH_ELEM_I8:     hash_elements_i8(out, in, n);     break;
+    case HASH_ELEM_I16:    hash_elements_i16(out, in, n);    break;
+    case HASH_ELEM_I32:    hash_elements_i32(out, in, n);    break;
+    case HASH_ELEM_I64:    hash_elements_i64(out, in, n);    break;
+    case HASH_ELEM_BOOL:   hash_elements_bool(out, in, n);   break;
+    case HASH_ELEM_FLOAT:  hash_elements_float(out, in, n);  break;
+    case HASH_ELEM_DOUBLE: hash_elements_double(out, in, n); break;
+    default:               __builtin_unreachable();
+    }
+}
+
+// Define __c2rust_hasher_H_update_bytes for a hasher H,
+// given an inline H_update_words function for it
+#define DEFINE_HASHER_UPDATE_BYTES(hasher)                                 \
+    void __c2rust_hasher_ ## hasher ## _update_bytes(                      \
+            char *p, const void *data, size_t len,                         \
+            unsigned int elem_kind) {                                      \
+        struct __c2rust_hasher_ ## hasher ## _state *hs =                  \
+            (struct __c2rust_hasher_ ## hasher ## _state*) p;              \
+        uint64_t elem_hashes[HASH_BULK_CHUNK];                             \
+        size_t elem_size = hash_elem_size(elem_kind);                      \
+        size_t count = len / elem_size;                                    \
+        const char *elems = data;                                          \
+        while (count > 0) {                                                \
+            size_t n = count < HASH_BULK_CHUNK ? count : HASH_BULK_CHUNK;  \
+            hash_elements(elem_hashes, elems, n, elem_kind);               \
+            hasher ## _update_words(hs, elem_hashes, n);                   \
+            elems += n * elem_size;                                        \
+            count -= n;                                                    \
+        }                                                                  \
+    }
+
+// Out-of-line versions of the built-in hashers from cross_check_hashers.h,
+// for the code that doesn't include it. The plugin allocates
+// the hasher states itself, using the sizes checked here.
+#define DEFINE_BUILTIN_HASHER(hasher, state_size)                          \
+    _Static_assert(sizeof(struct __c2rust_hasher_ ## hasher ## _state) ==  \
+                   (state_size), "hasher state size mismatch");            \
+    unsigned int __c2rust_hasher_ ## hasher ## _size() {                   \
+        return sizeof(struct __c2rust_hasher_ ## hasher ## _state) /       \
+               sizeof(char);                                               \
+    }                                                                      \
+    void __c2rust_hasher_ ## hasher ## _init(char *p) {                    \
+        __c2rust_inline_hasher_ ## hasher ## _init(p);                     \
+    }                                                                      \
+    void __c2rust_hasher_ ## hasher ## _update(char *p, uint64_t x) {      \
+        __c2rust_inline_hasher_ ## hasher ## _update(p, x);                \
+    }                                                                      \
+    uint64_t __c2rust_hasher_ ## hasher ## _finish(char *p) {              \
+        return __c2rust_inline_hasher_ ## hasher ## _finish(p);            \
+    }
+
+// JodyHasher implementation
+DEFINE_BUILTIN_HASHER(jodyhash, 8)
+
+static inline void jodyhash_update_words(
+        struct __c2rust_hasher_jodyhash_state *jh,
+        const uint64_t *words, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        __c2rust_inline_hasher_jodyhash_update((char*) jh, words[i]);
+}
+
+// JodyHash itself is a serial chain over the element hashes,
+// but at least this avoids the calls
+DEFINE_HASHER_UPDATE_BYTES(jodyhash)
+
+// xxh64 hasher implementation
+DEFINE_BUILTIN_HASHER(xxh64, 72)
+
+static inline void xxh64_update_words(struct __c2rust_hasher_xxh64_state *xh,
+                                      const uint64_t *words, size_t n) {
+    while (n > 0 && (xh->count & 3) != 0) {
+        __c2rust_inline_hasher_xxh64_update((char*) xh, *words++);
+        n--;
+    }
+    // Run whole stripes straight from the input, with the lanes
+    // in registers instead of going through the pending words
+    uint64_t l0 = xh->lanes[0], l1 = xh->lanes[1];
+    uint64_t l2 = xh->lanes[2], l3 = xh->lanes[3];
+    size_t stripe_words = n & ~(size_t)3;
+    for (size_t i = 0; i < stripe_words; i += 4) {
+        l0 = __c2rust_xxh64_round(l0, words[i + 0]);
+        l1 = __c2rust_xxh64_round(l1, words[i + 1]);
+        l2 = __c2rust_xxh64_round(l2, words[i + 2]);
+        l3 = __c2rust_xxh64_round(l3, words[i + 3]);
+    }
+    xh->lanes[0] = l0;
+    xh->lanes[1] = l1;
+    xh->lanes[2] = l2;
+    xh->lanes[3] = l3;
+    xh->count += stripe_words;
+    for (size_t i = stripe_words; i < n; i++)
+        __c2rust_inline_hasher_xxh64_update((char*) xh, words[i]);
+}
+
+DEFINE_HASHER_UPDATE_BYTES(xxh64)
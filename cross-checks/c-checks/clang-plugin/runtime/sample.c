@@ -0,0 +1,40 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+
+// Global sampling period, read from the RB_XCHECK_SAMPLE_PERIOD
+// environment variable on first use; 0 means not read yet
+static unsigned long global_sample_period = 0;
+
+static unsigned long get_global_sample_period(void) {
+    unsigned long period = __atomic_load_n(&global_sample_period, __ATOMIC_RELAXED);
+    if (period != 0)
+        return period;
+
+    // Invalid or missing values disable sampling, so every call
+    // gets checked; the Rust runtime does the exact same thing
+    period = 1;
+    const char *period_var = getenv("RB_XCHECK_SAMPLE_PERIOD");
+    if (period_var != NULL && isdigit((unsigned char) *period_var)) {
+        char *end;
+        errno = 0;
+        unsigned long env_period = strtoul(period_var, &end, 10);
+        if (*end == '\0' && errno == 0 && env_period != 0)
+            period = env_period;
+    }
+    __atomic_store_n(&global_sample_period, period, __ATOMIC_RELAXED);
+    return period;
+}
+
+// Called on every invocation of a function that has sampling enabled,
+// with a pointer to that function's call counter. Returns non-zero if
+// this invocation should be cross-checked, which is the case for calls
+// 0, period, 2*period, ... of each function, so that the C and Rust
+// versions of a program check the same calls. A zero period
+// selects the global period.
+int __c2rust_xcheck_sample(unsigned long *calls, unsigned long period) {
+    unsigned long call = __atomic_fetch_add(calls, 1, __ATOMIC_RELAXED);
+    if (period == 0)
+        period = get_global_sample_period();
+    return call % period == 0;
+}
@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include <stddef.h>
+
+extern void rb_xcheck(uint8_t tag, uint64_t item);
+
+// Backends that predate rb_xcheck_batch only provide rb_xcheck,
+// so the reference to rb_xcheck_batch is weak, and is null
+// when none of the libraries the program is linked against defines it
+extern void rb_xcheck_batch(const uint8_t *tags, const uint64_t *items,
+                            size_t n) __attribute__((weak));
+
+// Called by the code the plugin inserts with all the cross-checks at
+// function entry or exit; falls back to one rb_xcheck call per check
+void __c2rust_xcheck_batch(const uint8_t *tags, const uint64_t *items,
+                           size_t n) {
+    if (rb_xcheck_batch != NULL) {
+        rb_xcheck_batch(tags, items, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        rb_xcheck(tags[i], items[i]);
+}
@@ -0,0 +1,39 @@
+// RUN: %clang_xcheck -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t > %t.jodyhash 2>&1
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang --ahasher=xxh64 -O2 -o %t.xxh64 %s %xcheck_runtime %fakechecks
+// RUN: %t.xxh64 > %t.xxh64.out 2>&1
+// RUN: not diff %t.jodyhash %t.xxh64.out
+// RUN: FileCheck %s < %t.xxh64.out
+
+#include <stdio.h>
+
+#include <cross_checks.h>
+
+struct Point {
+    int x;
+    int y;
+    long z;
+};
+
+struct Buf {
+    struct Point pts[2];
+    int vals[5];
+};
+
+int sum(struct Buf *buf DEFAULT_XCHECK) {
+    int res = 0;
+    for (int i = 0; i < 5; i++)
+        res += buf->vals[i];
+    return res + buf->pts[0].x + buf->pts[1].y;
+}
+
+int main() {
+    struct Buf buf = { { { 1, 2, 3 }, { 4, 5, 6 } }, { 1, 2, 3, 4, 5 } };
+    sum(&buf);
+    return 0;
+}
+// Only the hashes of the structure and its arrays change
+// CHECK: XCHECK(1):2090499946/0x7c9a7f6a
+// CHECK: XCHECK(1):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK-NEXT: XCHECK(3):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK: XCHECK(2):2090499946/0x7c9a7f6a
@@ -0,0 +1,46 @@
+// A structure's ahasher also applies to the arrays and structures
+// nested in it, like in Rust, so setting it on the outer structure
+// gives the same hashes as setting it for the whole program
+// RUN: %clang_xcheck -DBUF_AHASHER -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t > %t.struct 2>&1
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang --ahasher=xxh64 -O2 -o %t.global %s %xcheck_runtime %fakechecks
+// RUN: %t.global > %t.global.out 2>&1
+// RUN: diff %t.struct %t.global.out
+// RUN: FileCheck %s < %t.struct
+
+#include <stdio.h>
+
+#include <cross_checks.h>
+
+struct Point {
+    int x;
+    int y;
+    long z;
+};
+
+struct Buf {
+    struct Point pts[2];
+    int vals[5];
+    struct Point *first;
+}
+#ifdef BUF_AHASHER
+CROSS_CHECK("{ ahasher: xxh64 }")
+#endif
+;
+
+int sum(struct Buf *buf DEFAULT_XCHECK) {
+    int res = 0;
+    for (int i = 0; i < 5; i++)
+        res += buf->vals[i];
+    return res + buf->first->x + buf->pts[1].y;
+}
+
+int main() {
+    struct Buf buf = { { { 1, 2, 3 }, { 4, 5, 6 } }, { 1, 2, 3, 4, 5 }, NULL };
+    buf.first = &buf.pts[0];
+    sum(&buf);
+    return 0;
+}
+// CHECK: XCHECK(1):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK-NEXT: XCHECK(3):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK: XCHECK(2):{{[0-9]+}}/0x{{[0-9a-f]+}}
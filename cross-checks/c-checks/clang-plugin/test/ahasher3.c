@@ -0,0 +1,51 @@
+// Arrays of primitive values hashed with a hasher from outside the
+// runtime go through its update function one element at a time, since
+// only the built-in hashers have a bulk update
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang --ahasher=counting -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <cross_checks.h>
+
+// Hasher that hashes any sequence of values to its length
+static unsigned long num_updates;
+
+unsigned int __c2rust_hasher_counting_size(void) DISABLE_XCHECKS(true) {
+    return sizeof(uint64_t);
+}
+
+void __c2rust_hasher_counting_init(char *p) DISABLE_XCHECKS(true) {
+    *(uint64_t*)p = 0;
+}
+
+void __c2rust_hasher_counting_update(char *p, uint64_t x) DISABLE_XCHECKS(true) {
+    *(uint64_t*)p += 1;
+    num_updates++;
+}
+
+uint64_t __c2rust_hasher_counting_finish(char *p) DISABLE_XCHECKS(true) {
+    return *(uint64_t*)p;
+}
+
+struct Buf {
+    int vals[5];
+};
+
+int sum(struct Buf *buf DEFAULT_XCHECK) {
+    int res = 0;
+    for (int i = 0; i < 5; i++)
+        res += buf->vals[i];
+    return res;
+}
+
+int main() {
+    struct Buf buf = { { 1, 2, 3, 4, 5 } };
+    sum(&buf);
+    printf("updates: %lu\n", num_updates);
+    return 0;
+}
+// One update for the field of the structure, and one per array element
+// CHECK-DAG: XCHECK(3):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK-DAG: updates: 6
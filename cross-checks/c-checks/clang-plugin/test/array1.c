@@ -0,0 +1,29 @@
+// RUN: %clang_xcheck -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+
+#include <cross_checks.h>
+
+// Arrays of primitive types get hashed in bulk by the runtime,
+// which should produce the same hash as hashing each element
+struct Buf {
+    char data[8];
+    int vals[3];
+};
+
+int foo(struct Buf x DEFAULT_XCHECK) {
+    return x.vals[0];
+}
+
+int main() {
+    struct Buf x = { "abcdefg", { 1, -2, 3 } };
+    foo(x);
+    return 0;
+}
+// CHECK: XCHECK(1):2090499946/0x7c9a7f6a
+// CHECK: XCHECK(1):193491849/0x0b887389
+// CHECK: XCHECK(3):13445211046975670745/0xba96fc36212489d9
+// CHECK: XCHECK(2):193491849/0x0b887389
+// CHECK: XCHECK(4):8680820740569200759/0x7878787878787877
+// CHECK: XCHECK(2):2090499946/0x7c9a7f6a
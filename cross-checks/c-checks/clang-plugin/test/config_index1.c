@@ -0,0 +1,28 @@
+// Defaults from the YAML files take priority over the ones from an index,
+// which only fill in the settings the YAML files leave out
+// RUN: echo '"%s": [ { item: defaults, entry: { fixed: 0x1111 }, exit: { fixed: 0x2222 } } ]' > %t.index.yaml
+// RUN: %xcfg_index %t.idx %t.index.yaml
+// RUN: echo '"%s": [ { item: defaults, entry: { fixed: 0x3333 } } ]' > %t.yaml
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang -C%t.idx -Xclang -plugin-arg-crosschecks -Xclang -C%t.yaml -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+
+#include <cross_checks.h>
+
+int foo() {
+    return 1;
+}
+
+int main() {
+    foo();
+    return 0;
+}
+// CHECK-NOT: 0x00001111
+// CHECK: XCHECK(1):13107/0x00003333
+// CHECK-NOT: 0x00001111
+// CHECK: XCHECK(1):13107/0x00003333
+// CHECK-NOT: 0x00001111
+// CHECK: XCHECK(2):8738/0x00002222
+// CHECK-NOT: 0x00001111
+// CHECK: XCHECK(2):8738/0x00002222
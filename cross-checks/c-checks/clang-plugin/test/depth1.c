@@ -0,0 +1,43 @@
+// RUN: %clang_xcheck -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+
+#include <cross_checks.h>
+
+struct Node {
+    int value;
+    struct Node *next;
+};
+
+struct Leaf {
+    int a;
+    int b;
+} CROSS_CHECK("{ hash_depth: 0 }");
+
+int foo(struct Node *a DEFAULT_XCHECK, struct Node *b DEFAULT_XCHECK)
+CROSS_CHECK("{ hash_depth: 0, arg_hash_depths: { b: 1 } }") {
+    return 0;
+}
+
+int bar(struct Leaf x DEFAULT_XCHECK) {
+    return 0;
+}
+
+int main() {
+    struct Node n2 = { 2, NULL };
+    struct Node n1 = { 1, &n2 };
+    foo(&n1, &n1);
+    struct Leaf l = { 1000, 1337 };
+    bar(l);
+    return 0;
+}
+// At depth 0, `a` is just a non-NULL pointer, and at depth 1
+// `b` points to a structure too deep to follow any further
+// CHECK: XCHECK(1):193491849/0x0b887389
+// CHECK-NEXT: XCHECK(3):8241996694613484876/0x726174536661654c
+// CHECK-NEXT: XCHECK(3):7237956756693935436/0x647263526661654c
+// The structure caps its own depth at 0, even at the default depth
+// CHECK: XCHECK(1):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK-NEXT: XCHECK(3):7237956756693935436/0x647263526661654c
+// CHECK: XCHECK(2):2090499946/0x7c9a7f6a
@@ -0,0 +1,47 @@
+// RUN: %clang_xcheck -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t > %t.inline 2>&1
+// RUN: %clang_xcheck -DNO_INLINE_HASHERS -O2 -o %t.runtime %s %xcheck_runtime %fakechecks
+// RUN: %t.runtime > %t.runtime.out 2>&1
+// RUN: diff %t.inline %t.runtime.out
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang --ahasher=xxh64 -O2 -o %t.xxh64 %s %xcheck_runtime %fakechecks
+// RUN: %t.xxh64 > %t.xxh64.inline 2>&1
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang --ahasher=xxh64 -DNO_INLINE_HASHERS -O2 -o %t.xxh64.runtime %s %xcheck_runtime %fakechecks
+// RUN: %t.xxh64.runtime > %t.xxh64.runtime.out 2>&1
+// RUN: diff %t.xxh64.inline %t.xxh64.runtime.out
+// RUN: FileCheck %s < %t.inline
+
+// The inline hashers from cross_check_hashers.h and the runtime's
+// out-of-line ones must compute the same hashes
+#ifdef NO_INLINE_HASHERS
+#define DEFAULT_XCHECK  __attribute__((annotate("cross_check:default")))
+#else
+#include <cross_checks.h>
+#endif
+
+struct Point {
+    int x;
+    int y;
+    long z;
+};
+
+struct Buf {
+    struct Point pts[2];
+    int vals[5];
+};
+
+int sum(struct Buf *buf DEFAULT_XCHECK) {
+    int res = 0;
+    for (int i = 0; i < 5; i++)
+        res += buf->vals[i];
+    return res + buf->pts[0].x + buf->pts[1].y;
+}
+
+int main() {
+    struct Buf buf = { { { 1, 2, 3 }, { 4, 5, 6 } }, { 1, 2, 3, 4, 5 } };
+    sum(&buf);
+    return 0;
+}
+// CHECK: XCHECK(1):2090499946/0x7c9a7f6a
+// CHECK: XCHECK(1):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK-NEXT: XCHECK(3):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK: XCHECK(2):2090499946/0x7c9a7f6a
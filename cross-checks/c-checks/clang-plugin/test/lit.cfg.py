@@ -52,3 +52,14 @@ fakechecks_args = " -L{fakechecks_dir} -lfakechecks"\
 config.substitutions.append(("%clang_xcheck", config.clang + clang_xcheck_args))
 config.substitutions.append(("%xcheck_runtime", xcheck_runtime_lib))
 config.substitutions.append(("%fakechecks", fakechecks_args))
+
+# Path to the xcfg-index tool, used for %xcfg_index; it is built into the
+# plugin build directory by scripts/build_cross_checks.py
+xcfg_index_bin = os.path.abspath(
+        os.path.join(config.test_exec_root, os.pardir,
+                     "xcfg-index", "release", "xcfg-index"))
+if not os.path.isfile(xcfg_index_bin):
+    lit_config.warning("{} not found, tests using %xcfg_index will fail; "
+                       "build it with scripts/build_cross_checks.py".format(
+                           xcfg_index_bin))
+config.substitutions.append(("%xcfg_index", xcfg_index_bin))
@@ -0,0 +1,49 @@
+// RUN: %clang_xcheck -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t > %t.memo 2>&1
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang --disable-hash-memoization -O2 -o %t.nomemo %s %xcheck_runtime %fakechecks
+// RUN: %t.nomemo > %t.nomemo.out 2>&1
+// RUN: diff %t.memo %t.nomemo.out
+// RUN: FileCheck %s < %t.memo
+
+#include <stdio.h>
+
+#include <cross_checks.h>
+
+// Doubly-linked list, where every node is reachable
+// through many different paths from the head
+struct Node {
+    int value;
+    struct Node *next;
+    struct Node *prev;
+};
+
+int sum(struct Node *head DEFAULT_XCHECK) {
+    int res = 0;
+    struct Node *n = head;
+    for (int i = 0; i < 4 && n != NULL; i++, n = n->next)
+        res += n->value;
+    return res;
+}
+
+int main() {
+    struct Node nodes[4];
+    for (int i = 0; i < 4; i++) {
+        nodes[i].value = i;
+        nodes[i].next = i < 3 ? &nodes[i + 1] : NULL;
+        nodes[i].prev = i > 0 ? &nodes[i - 1] : NULL;
+    }
+    sum(&nodes[0]);
+    // Close the cycle, the hash should still be computed
+    nodes[3].next = &nodes[0];
+    nodes[0].prev = &nodes[3];
+    sum(&nodes[1]);
+    return 0;
+}
+// The hashes with and without memoization are identical,
+// since the diff above passes
+// CHECK: XCHECK(1):2090499946/0x7c9a7f6a
+// CHECK: XCHECK(1):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK-NEXT: XCHECK(3):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK: XCHECK(1):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK-NEXT: XCHECK(3):{{[0-9]+}}/0x{{[0-9a-f]+}}
+// CHECK: XCHECK(2):2090499946/0x7c9a7f6a
@@ -0,0 +1,78 @@
+// Objects reachable through several pointers only get hashed once
+// for each depth, even when there are more of them than fit on the stack
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang --ahasher=counting -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t 2>&1 | FileCheck %s --check-prefix=MEMO
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang --ahasher=counting -Xclang -plugin-arg-crosschecks -Xclang --disable-hash-memoization -O2 -o %t.nomemo %s %xcheck_runtime %fakechecks
+// RUN: %t.nomemo small 2>&1 | FileCheck %s --check-prefix=NOMEMO
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <cross_checks.h>
+
+// Hasher that counts its updates, one for each field of a hashed structure
+static unsigned long num_updates;
+
+unsigned int __c2rust_hasher_counting_size(void) DISABLE_XCHECKS(true) {
+    return sizeof(uint64_t);
+}
+
+void __c2rust_hasher_counting_init(char *p) DISABLE_XCHECKS(true) {
+    *(uint64_t*)p = 0;
+}
+
+void __c2rust_hasher_counting_update(char *p, uint64_t x) DISABLE_XCHECKS(true) {
+    *(uint64_t*)p += x;
+    num_updates++;
+}
+
+uint64_t __c2rust_hasher_counting_finish(char *p) DISABLE_XCHECKS(true) {
+    return *(uint64_t*)p;
+}
+
+// Ladder where both pointers of each node point to the next one,
+// so the number of paths doubles with every node
+#define NUM_NODES 40
+
+struct Node {
+    int value;
+    struct Node *left;
+    struct Node *right;
+};
+
+// With the default depth of 8, the structures get hashed at
+// depths 7, 5, 3 and 1, i.e., the first 4 nodes of the ladder
+int small(struct Node *n DEFAULT_XCHECK) {
+    return n->value;
+}
+
+// Reaches all the nodes, which needs more table entries than fit
+// on the stack; without memoization, this would take 2^40 hashes
+int large(struct Node *n DEFAULT_XCHECK)
+CROSS_CHECK("{ hash_depth: 80 }") {
+    return n->value;
+}
+
+int main(int argc, char *argv[]) {
+    static struct Node nodes[NUM_NODES];
+    for (int i = 0; i < NUM_NODES; i++) {
+        nodes[i].value = i;
+        nodes[i].left = nodes[i].right = i + 1 < NUM_NODES ? &nodes[i + 1] : NULL;
+    }
+
+    num_updates = 0;
+    small(&nodes[0]);
+    printf("small: %lu\n", num_updates);
+    if (argc > 1)
+        return 0;
+
+    num_updates = 0;
+    large(&nodes[0]);
+    printf("large: %lu\n", num_updates);
+    return 0;
+}
+// Three updates for each structure hash: 4 of them with the table,
+// and 1 + 2 + 4 + 8 without it
+// MEMO: small: 12
+// MEMO: large: 120
+// NOMEMO: small: 45
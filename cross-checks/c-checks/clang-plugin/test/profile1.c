@@ -0,0 +1,31 @@
+// RUN: %clang_xcheck -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: env FAKECHECKS_STATS_FILE=%t.counts %t > /dev/null 2>&1
+// RUN: rm -f %t.report
+// RUN: %clang_xcheck -Xclang -plugin-arg-crosschecks -Xclang --profile=%t.counts -Xclang -plugin-arg-crosschecks -Xclang --hot-call-threshold=2 -Xclang -plugin-arg-crosschecks -Xclang --downgrade-report=%t.report -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t 2>&1 | FileCheck %s
+// RUN: FileCheck --check-prefix=REPORT %s < %t.report
+
+#include <stdio.h>
+
+#include <cross_checks.h>
+
+int foo() {
+    return 1;
+}
+
+int main() {
+    // foo is called more often than the threshold,
+    // so it only keeps its entry cross-check
+    foo();
+    foo();
+    foo();
+    return 0;
+}
+// CHECK: XCHECK(1):2090499946/0x7c9a7f6a
+// CHECK-NEXT: XCHECK(1):193491849/0x0b887389
+// CHECK-NEXT: XCHECK(1):193491849/0x0b887389
+// CHECK-NEXT: XCHECK(1):193491849/0x0b887389
+// CHECK-NEXT: XCHECK(2):2090499946/0x7c9a7f6a
+// CHECK-NEXT: XCHECK(4):8680820740569200758/0x7878787878787876
+// REPORT: profile1.c:foo: 3 calls, cross-checks entry-only
+// REPORT-NOT: main
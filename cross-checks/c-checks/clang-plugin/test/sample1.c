@@ -0,0 +1,27 @@
+// RUN: %clang_xcheck -O2 -o %t %s %xcheck_runtime %fakechecks
+// RUN: %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+
+#include <cross_checks.h>
+
+int foo() CROSS_CHECK("{ sample_period: 2 }") {
+    return 1;
+}
+
+int main() {
+    // Only the first and third calls get checked
+    foo();
+    foo();
+    foo();
+    return 0;
+}
+// CHECK: XCHECK(1):2090499946/0x7c9a7f6a
+// CHECK-NEXT: XCHECK(1):193491849/0x0b887389
+// CHECK-NEXT: XCHECK(2):193491849/0x0b887389
+// CHECK-NEXT: XCHECK(4):8680820740569200759/0x7878787878787877
+// CHECK-NEXT: XCHECK(1):193491849/0x0b887389
+// CHECK-NEXT: XCHECK(2):193491849/0x0b887389
+// CHECK-NEXT: XCHECK(4):8680820740569200759/0x7878787878787877
+// CHECK-NEXT: XCHECK(2):2090499946/0x7c9a7f6a
+// CHECK-NEXT: XCHECK(4):8680820740569200758/0x7878787878787876
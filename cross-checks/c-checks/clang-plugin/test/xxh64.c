@@ -0,0 +1,42 @@
+// RUN: %clang -std=c11 -O2 -o %t %s %xcheck_runtime
+// RUN: %t < %S/../../../hash-test-vectors/xxh64.txt | FileCheck %s
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Check the runtime's xxh64 hasher against the test vectors
+// that the Rust runtime's Xxh64Hasher also gets tested against
+unsigned int __c2rust_hasher_xxh64_size();
+void __c2rust_hasher_xxh64_init(char *p);
+void __c2rust_hasher_xxh64_update(char *p, uint64_t x);
+uint64_t __c2rust_hasher_xxh64_finish(char *p);
+
+int main() {
+    char line[4096];
+    unsigned int num_vectors = 0;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        char *p = line, *end;
+        uint64_t expected = strtoull(p, &end, 16);
+        char hasher[__c2rust_hasher_xxh64_size()];
+        __c2rust_hasher_xxh64_init(hasher);
+        for (p = end; ; p = end) {
+            uint64_t word = strtoull(p, &end, 16);
+            if (end == p)
+                break;
+            __c2rust_hasher_xxh64_update(hasher, word);
+        }
+        uint64_t hash = __c2rust_hasher_xxh64_finish(hasher);
+        if (hash != expected)
+            printf("MISMATCH: %016llx != %s", (unsigned long long) hash, line);
+        num_vectors++;
+    }
+    printf("%u vectors\n", num_vectors);
+    return 0;
+}
+// CHECK-NOT: MISMATCH
+// CHECK: 17 vectors
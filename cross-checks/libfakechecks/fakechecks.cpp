@@ -5,6 +5,7 @@
 #include <cstring>
 #include <atomic>
 #include <mutex>
+#include <unordered_map>
 
 #include <alloca.h>
 #include <pthread.h>
@@ -16,8 +17,44 @@ std::mutex fout_mutex;
 bool append_pid = false;
 std::once_flag append_pid_flag;
 
+// Statistics mode: if FAKECHECKS_STATS_FILE is set, we count the calls
+// to each function by their entry cross-check values, and write the
+// counts to that file on exit; the cross-check plugins can then use
+// them as a call-count profile
+const char *stats_file = nullptr;
+std::unordered_map<uint64_t, uint64_t> *entry_counts = nullptr;
+std::mutex entry_counts_mutex;
+
+static void write_stats() {
+    std::lock_guard<std::mutex> lock(entry_counts_mutex);
+    FILE *fstats = fopen(stats_file, "w");
+    if (fstats == nullptr) {
+        fprintf(stderr, "Error opening fakechecks statistics file '%s'\n",
+                stats_file);
+        return;
+    }
+    fprintf(fstats, "# fakechecks call counts\n");
+    for (auto &count : *entry_counts)
+        fprintf(fstats, "%lu %lu\n", count.first, count.second);
+    fclose(fstats);
+}
+
+static inline void count_xcheck(uint8_t tag, uint64_t item) {
+    // FUNCTION_ENTRY
+    if (tag == 1 && entry_counts != nullptr) {
+        std::lock_guard<std::mutex> lock(entry_counts_mutex);
+        (*entry_counts)[item]++;
+    }
+}
+
 static void init_flags() {
     std::call_once(append_pid_flag, [] () {
+        stats_file = getenv("FAKECHECKS_STATS_FILE");
+        if (stats_file != nullptr) {
+            entry_counts = new std::unordered_map<uint64_t, uint64_t>();
+            atexit(write_stats);
+        }
+
         auto append_pid_var = getenv("FAKECHECKS_APPEND_PID");
         if (append_pid_var != nullptr &&
             (strcmp(append_pid_var, "1") == 0 ||
@@ -76,5 +113,19 @@ static FILE *get_fout() {
 extern "C"
 void rb_xcheck(uint8_t tag, uint64_t item) {
     auto *fout = get_fout();
+    count_xcheck(tag, item);
     fprintf(fout, "XCHECK(%hhd):%lu/0x%08lx\n", tag, item, item);
 }
+
+extern "C"
+void rb_xcheck_batch(const uint8_t *tags, const uint64_t *items, size_t n) {
+    auto *fout = get_fout();
+    // Hold the lock for the whole batch, so checks from
+    // other threads do not get interleaved with ours
+    flockfile(fout);
+    for (size_t i = 0; i < n; i++) {
+        count_xcheck(tags[i], items[i]);
+        fprintf(fout, "XCHECK(%hhd):%lu/0x%08lx\n", tags[i], items[i], items[i]);
+    }
+    funlockfile(fout);
+}
@@ -2,3 +2,12 @@ extern {
     #[no_mangle]
     pub fn rb_xcheck(tag: u8, val: u64);
 }
+
+// libclevrbuf only implements rb_xcheck,
+// so we implement the batched version on top of it
+#[no_mangle]
+pub unsafe extern fn rb_xcheck_batch(tags: *const u8, vals: *const u64, len: usize) {
+    for i in 0..len {
+        rb_xcheck(*tags.offset(i as isize), *vals.offset(i as isize));
+    }
+}
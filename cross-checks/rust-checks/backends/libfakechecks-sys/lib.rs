@@ -1,4 +1,7 @@
 extern {
     #[no_mangle]
     pub fn rb_xcheck(tag: u8, val: u64);
+
+    #[no_mangle]
+    pub fn rb_xcheck_batch(tags: *const u8, vals: *const u64, len: usize);
 }
@@ -2,14 +2,11 @@
 
 extern crate libc;
 
-// Wrapper for rb_xcheck that uses dlsym() to locate rb_xcheck dynamically
-// at run-time, loading it from a library specified with the RB_XCHECK_LIB variable
-#[no_mangle]
-pub unsafe extern fn rb_xcheck(tag: u8, val: u64) {
-    extern crate libc;
-    static mut RB_XCHECK_FN: Option<unsafe extern fn(u8, u64)> = None;
-    static RB_XCHECK_INIT: ::std::sync::Once = std::sync::ONCE_INIT;
-    RB_XCHECK_INIT.call_once(|| {
+// Load the rb_xcheck library specified with the RB_XCHECK_LIB variable
+unsafe fn rb_xcheck_lib() -> *mut libc::c_void {
+    static mut RB_XCHECK_LIB: *mut libc::c_void = 0 as *mut libc::c_void;
+    static RB_XCHECK_LIB_INIT: ::std::sync::Once = std::sync::ONCE_INIT;
+    RB_XCHECK_LIB_INIT.call_once(|| {
         use std::os::unix::ffi::OsStrExt;
         let lib_path = std::env::var_os("RB_XCHECK_LIB")
             .expect("Variable RB_XCHECK_LIB not set");
@@ -17,13 +14,46 @@ pub unsafe extern fn rb_xcheck(tag: u8, val: u64) {
         if lib.is_null() {
             panic!("Could not load rb_xcheck library from: {:?}", lib_path);
         }
+        RB_XCHECK_LIB = lib;
+    });
+    RB_XCHECK_LIB
+}
 
+// Wrapper for rb_xcheck that uses dlsym() to locate rb_xcheck dynamically
+// at run-time, loading it from a library specified with the RB_XCHECK_LIB variable
+#[no_mangle]
+pub unsafe extern fn rb_xcheck(tag: u8, val: u64) {
+    static mut RB_XCHECK_FN: Option<unsafe extern fn(u8, u64)> = None;
+    static RB_XCHECK_INIT: ::std::sync::Once = std::sync::ONCE_INIT;
+    RB_XCHECK_INIT.call_once(|| {
         let rb_xcheck_name = std::ffi::CString::new("rb_xcheck").unwrap();
-        let rb_xcheck_sym = libc::dlsym(lib, rb_xcheck_name.as_ptr());
+        let rb_xcheck_sym = libc::dlsym(rb_xcheck_lib(), rb_xcheck_name.as_ptr());
         if rb_xcheck_sym.is_null() {
-            panic!("Could not find rb_xcheck() symbol in: {:?}", lib_path);
+            panic!("Could not find rb_xcheck() symbol in: {:?}",
+                   std::env::var_os("RB_XCHECK_LIB"));
         }
         RB_XCHECK_FN = Some(std::mem::transmute(rb_xcheck_sym))
     });
     RB_XCHECK_FN.unwrap()(tag, val);
 }
+
+// Same as above for rb_xcheck_batch, which falls back to calling
+// rb_xcheck for each check if the library doesn't implement it
+#[no_mangle]
+pub unsafe extern fn rb_xcheck_batch(tags: *const u8, vals: *const u64, len: usize) {
+    static mut RB_XCHECK_BATCH_FN: Option<unsafe extern fn(*const u8, *const u64, usize)> = None;
+    static RB_XCHECK_BATCH_INIT: ::std::sync::Once = std::sync::ONCE_INIT;
+    RB_XCHECK_BATCH_INIT.call_once(|| {
+        let rb_xcheck_batch_name = std::ffi::CString::new("rb_xcheck_batch").unwrap();
+        let rb_xcheck_batch_sym = libc::dlsym(rb_xcheck_lib(), rb_xcheck_batch_name.as_ptr());
+        if !rb_xcheck_batch_sym.is_null() {
+            RB_XCHECK_BATCH_FN = Some(std::mem::transmute(rb_xcheck_batch_sym))
+        }
+    });
+    match RB_XCHECK_BATCH_FN {
+        Some(rb_xcheck_batch_fn) => rb_xcheck_batch_fn(tags, vals, len),
+        None => for i in 0..len {
+            rb_xcheck(*tags.offset(i as isize), *vals.offset(i as isize));
+        }
+    }
+}
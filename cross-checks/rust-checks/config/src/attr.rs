@@ -45,6 +45,17 @@ impl<'a> ArgValue<'a> {
         self.get_list().expect("argument expects list value")
     }
 
+    pub fn get_int(&self) -> Option<u128> {
+        match *self {
+            ArgValue::Int(i) => Some(i),
+            _ => None
+        }
+    }
+
+    pub fn as_int(&self) -> u128 {
+        self.get_int().expect("argument expects integer value")
+    }
+
     #[cfg(feature="parse-syn")]
     pub fn get_str_ident(&self) -> syn::Ident {
         syn::Ident::from(self.as_str())
@@ -0,0 +1,32 @@
+//! Build a binary cross-check configuration index from YAML files:
+//!   xcfg-index <output index> <config.yaml>...
+
+extern crate cross_check_config as xcfg;
+
+use std::env;
+use std::fs;
+use std::process;
+
+fn main() {
+    let args = env::args().collect::<Vec<_>>();
+    if args.len() < 3 {
+        eprintln!("Usage: {} <output index> <config.yaml>...", args[0]);
+        process::exit(1);
+    }
+
+    let mut writer = xcfg::index::IndexWriter::new();
+    for config_file in &args[2..] {
+        let config = fs::read_to_string(config_file).unwrap_or_else(|e| {
+            eprintln!("could not read config file {}: {}", config_file, e);
+            process::exit(1);
+        });
+        writer.add_config(&config).unwrap_or_else(|e| {
+            eprintln!("could not parse config file {}: {}", config_file, e);
+            process::exit(1);
+        });
+    }
+    fs::write(&args[1], writer.finish()).unwrap_or_else(|e| {
+        eprintln!("could not write index {}: {}", args[1], e);
+        process::exit(1);
+    });
+}
@@ -0,0 +1,351 @@
+//! Binary index of cross-check configuration items, built once from the
+//! YAML configuration files and shared by all compiler invocations.
+//! The clang plugin memory-maps the index and only parses the items it
+//! looks up, instead of parsing every configuration file for every
+//! translation unit.
+//!
+//! The index is laid out as follows, with all integers in little-endian:
+//!  * a 32-byte header: the `XCFGIDX1` magic, then the `u32` format version,
+//!    the `u32` number of slots (a power of two), the `u32` number of items,
+//!    a reserved `u32` and the `u64` size of the string table
+//!  * the hash table, as an array of 40-byte slots, each containing
+//!    the `u64` hash of the item key (0 for empty slots), the `u32` item
+//!    kind, the `u32` position of the item in the configuration files, then
+//!    the `u32` offset and length in the string table of the file name,
+//!    item name and item YAML, in this order
+//!  * the string table
+//!
+//! Items are hashed by (file name, kind, item name) using 64-bit FNV-1a
+//! and placed using linear probing, so all the items with the same key
+//! are found in the order they appear in the configuration files.
+
+use std::collections::HashMap;
+use std::str;
+
+use serde_yaml;
+
+use super::{Config, FileConfig, ItemConfig, ItemList};
+
+pub const MAGIC: &'static [u8; 8] = b"XCFGIDX1";
+pub const VERSION: u32 = 1;
+
+const HEADER_SIZE: usize = 32;
+const SLOT_SIZE: usize = 40;
+
+#[derive(Debug, PartialEq, Eq, Clone, Copy)]
+pub enum ItemKind {
+    Defaults = 0,
+    Function = 1,
+    Struct = 2,
+    Other = 3,
+}
+
+impl ItemKind {
+    fn from_u32(kind: u32) -> Option<ItemKind> {
+        match kind {
+            0 => Some(ItemKind::Defaults),
+            1 => Some(ItemKind::Function),
+            2 => Some(ItemKind::Struct),
+            3 => Some(ItemKind::Other),
+            _ => None
+        }
+    }
+
+    fn from_item_type(item_type: &str) -> ItemKind {
+        match item_type {
+            "defaults" => ItemKind::Defaults,
+            "function" => ItemKind::Function,
+            "struct"   => ItemKind::Struct,
+            _          => ItemKind::Other,
+        }
+    }
+}
+
+/// Hash of an item key; never 0, since that marks empty slots
+pub fn key_hash(file: &str, kind: ItemKind, name: &str) -> u64 {
+    const FNV_OFFSET_BASIS: u64 = 0xcbf29ce484222325;
+    const FNV_PRIME: u64 = 0x100000001b3;
+    let mut hash = FNV_OFFSET_BASIS;
+    let key = file.bytes()
+        .chain(Some(0xff).into_iter())
+        .chain(Some(kind as u8).into_iter())
+        .chain(name.bytes());
+    for byte in key {
+        hash ^= byte as u64;
+        hash = hash.wrapping_mul(FNV_PRIME);
+    }
+    if hash == 0 { 1 } else { hash }
+}
+
+fn put_u32(buf: &mut [u8], pos: usize, val: u32) {
+    for i in 0..4 {
+        buf[pos + i] = (val >> (8 * i)) as u8;
+    }
+}
+
+fn put_u64(buf: &mut [u8], pos: usize, val: u64) {
+    for i in 0..8 {
+        buf[pos + i] = (val >> (8 * i)) as u8;
+    }
+}
+
+fn get_u32(buf: &[u8], pos: usize) -> u32 {
+    (0..4).fold(0, |val, i| val | (buf[pos + i] as u32) << (8 * i))
+}
+
+fn get_u64(buf: &[u8], pos: usize) -> u64 {
+    (0..8).fold(0, |val, i| val | (buf[pos + i] as u64) << (8 * i))
+}
+
+struct IndexEntry {
+    kind: ItemKind,
+    file: String,
+    name: String,
+    data: String,
+}
+
+/// Builds an index from a sequence of configuration items
+#[derive(Default)]
+pub struct IndexWriter {
+    entries: Vec<IndexEntry>,
+}
+
+impl IndexWriter {
+    pub fn new() -> IndexWriter {
+        Default::default()
+    }
+
+    pub fn add_item(&mut self, kind: ItemKind, file: &str, name: &str, data: &str) {
+        self.entries.push(IndexEntry {
+            kind,
+            file: String::from(file),
+            name: String::from(name),
+            data: String::from(data),
+        });
+    }
+
+    /// Add all the items in a YAML configuration file
+    pub fn add_config(&mut self, s: &str) -> Result<(), String> {
+        let files: serde_yaml::Mapping = serde_yaml::from_str(s)
+            .map_err(|e| format!("serde_yaml error: {}", e))?;
+        for (file, items) in files.into_iter() {
+            let file = file.as_str()
+                .ok_or_else(|| format!("invalid file name: {:?}", file))?;
+            let items = items.as_sequence()
+                .ok_or_else(|| format!("invalid item list for file: {}", file))?;
+            for item in items.iter() {
+                // Check the item here, so the plugins
+                // do not have to report errors later
+                let _: ItemConfig = serde_yaml::from_value(item.clone())
+                    .map_err(|e| format!("invalid item in file {}: {}", file, e))?;
+                let mapping = item.as_mapping()
+                    .ok_or_else(|| format!("invalid item in file {}", file))?;
+                let field = |name: &str| mapping.get(&serde_yaml::Value::String(String::from(name)))
+                    .and_then(|val| val.as_str());
+                let kind = ItemKind::from_item_type(field("item").unwrap_or(""));
+                let name = field("name").unwrap_or("");
+                let data = serde_yaml::to_string(item)
+                    .map_err(|e| format!("serde_yaml error: {}", e))?;
+                self.add_item(kind, file, name, &data);
+            }
+        }
+        Ok(())
+    }
+
+    pub fn finish(self) -> Vec<u8> {
+        let num_slots = (2 * self.entries.len()).next_power_of_two().max(8);
+        let slots_size = num_slots * SLOT_SIZE;
+        let mut strings: Vec<u8> = vec![];
+        let mut slots = vec![0u8; slots_size];
+        for (seq, entry) in self.entries.iter().enumerate() {
+            let hash = key_hash(&entry.file, entry.kind, &entry.name);
+            let mut slot = (hash as usize) & (num_slots - 1);
+            while get_u64(&slots, slot * SLOT_SIZE) != 0 {
+                slot = (slot + 1) & (num_slots - 1);
+            }
+            let pos = slot * SLOT_SIZE;
+            put_u64(&mut slots, pos, hash);
+            put_u32(&mut slots, pos + 8, entry.kind as u32);
+            put_u32(&mut slots, pos + 12, seq as u32);
+            for (i, s) in [&entry.file, &entry.name, &entry.data].iter().enumerate() {
+                put_u32(&mut slots, pos + 16 + 8 * i, strings.len() as u32);
+                put_u32(&mut slots, pos + 20 + 8 * i, s.len() as u32);
+                strings.extend_from_slice(s.as_bytes());
+            }
+        }
+
+        let mut res = vec![0u8; HEADER_SIZE];
+        res[..8].copy_from_slice(MAGIC);
+        put_u32(&mut res, 8, VERSION);
+        put_u32(&mut res, 12, num_slots as u32);
+        put_u32(&mut res, 16, self.entries.len() as u32);
+        put_u64(&mut res, 24, strings.len() as u64);
+        res.extend(slots);
+        res.extend(strings);
+        res
+    }
+}
+
+pub fn is_index(data: &[u8]) -> bool {
+    data.starts_with(MAGIC)
+}
+
+/// An item read from the index
+pub struct IndexItem<'a> {
+    pub kind: ItemKind,
+    pub file: &'a str,
+    pub name: &'a str,
+    pub data: &'a str,
+    seq: u32,
+}
+
+pub struct IndexReader<'a> {
+    num_slots: usize,
+    slots: &'a [u8],
+    strings: &'a [u8],
+}
+
+impl<'a> IndexReader<'a> {
+    pub fn new(data: &'a [u8]) -> Result<IndexReader<'a>, String> {
+        if data.len() < HEADER_SIZE || !is_index(data) {
+            return Err(String::from("invalid cross-check configuration index"));
+        }
+        let version = get_u32(data, 8);
+        if version != VERSION {
+            return Err(format!("unsupported configuration index version: {}", version));
+        }
+        let num_slots = get_u32(data, 12) as usize;
+        let strings_size = get_u64(data, 24) as usize;
+        let strings_pos = HEADER_SIZE + num_slots * SLOT_SIZE;
+        if !num_slots.is_power_of_two() || data.len() != strings_pos + strings_size {
+            return Err(String::from("truncated cross-check configuration index"));
+        }
+        Ok(IndexReader {
+            num_slots,
+            slots: &data[HEADER_SIZE..strings_pos],
+            strings: &data[strings_pos..],
+        })
+    }
+
+    fn item(&self, slot: usize) -> Result<Option<IndexItem<'a>>, String> {
+        let pos = slot * SLOT_SIZE;
+        if get_u64(self.slots, pos) == 0 {
+            return Ok(None);
+        }
+        let kind = ItemKind::from_u32(get_u32(self.slots, pos + 8))
+            .ok_or_else(|| String::from("invalid item kind in configuration index"))?;
+        let string = |i: usize| {
+            let off = get_u32(self.slots, pos + 16 + 8 * i) as usize;
+            let len = get_u32(self.slots, pos + 20 + 8 * i) as usize;
+            self.strings.get(off..off + len)
+                .and_then(|s| str::from_utf8(s).ok())
+                .ok_or_else(|| String::from("invalid string in configuration index"))
+        };
+        Ok(Some(IndexItem {
+            kind,
+            file: string(0)?,
+            name: string(1)?,
+            data: string(2)?,
+            seq: get_u32(self.slots, pos + 12),
+        }))
+    }
+
+    /// All the items with the given key, in configuration file order
+    pub fn lookup(&self, file: &str, kind: ItemKind, name: &str)
+            -> Result<Vec<IndexItem<'a>>, String> {
+        let hash = key_hash(file, kind, name);
+        let mut res = vec![];
+        let mut slot = (hash as usize) & (self.num_slots - 1);
+        for _ in 0..self.num_slots {
+            let item = match self.item(slot)? {
+                Some(item) => item,
+                None => break
+            };
+            if get_u64(self.slots, slot * SLOT_SIZE) == hash &&
+               item.kind == kind && item.file == file && item.name == name {
+                res.push(item);
+            }
+            slot = (slot + 1) & (self.num_slots - 1);
+        }
+        Ok(res)
+    }
+
+    /// All the items in the index, in configuration file order
+    pub fn items(&self) -> Result<Vec<IndexItem<'a>>, String> {
+        let mut res = vec![];
+        for slot in 0..self.num_slots {
+            if let Some(item) = self.item(slot)? {
+                res.push(item);
+            }
+        }
+        res.sort_by_key(|item| item.seq);
+        Ok(res)
+    }
+}
+
+/// Load a whole `Config` from an index
+pub fn parse_index(data: &[u8]) -> Result<Config, String> {
+    let reader = IndexReader::new(data)?;
+    let mut files: HashMap<String, FileConfig> = HashMap::new();
+    for item in reader.items()? {
+        let item_config: ItemConfig = serde_yaml::from_str(item.data)
+            .map_err(|e| format!("serde_yaml error: {}", e))?;
+        let file_config = files.entry(String::from(item.file))
+            .or_insert_with(|| FileConfig(ItemList(vec![])));
+        ((file_config.0).0).push(item_config);
+    }
+    Ok(Config(files))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_lookup() {
+        let mut writer = IndexWriter::new();
+        writer.add_item(ItemKind::Defaults, "foo.c", "", "defaults 1");
+        writer.add_item(ItemKind::Function, "foo.c", "foo", "function foo 1");
+        writer.add_item(ItemKind::Struct, "foo.c", "foo", "struct foo");
+        writer.add_item(ItemKind::Function, "bar.c", "foo", "function foo 2");
+        writer.add_item(ItemKind::Defaults, "foo.c", "", "defaults 2");
+        let index = writer.finish();
+        assert!(is_index(&index));
+
+        let reader = IndexReader::new(&index).unwrap();
+        let data = |file, kind, name| reader.lookup(file, kind, name).unwrap()
+            .into_iter().map(|item| item.data).collect::<Vec<_>>();
+        assert_eq!(data("foo.c", ItemKind::Function, "foo"), vec!["function foo 1"]);
+        assert_eq!(data("foo.c", ItemKind::Struct, "foo"), vec!["struct foo"]);
+        assert_eq!(data("bar.c", ItemKind::Function, "foo"), vec!["function foo 2"]);
+        assert_eq!(data("foo.c", ItemKind::Defaults, ""), vec!["defaults 1", "defaults 2"]);
+        assert!(data("bar.c", ItemKind::Function, "bar").is_empty());
+
+        let items = reader.items().unwrap();
+        assert_eq!(items.len(), 5);
+        assert_eq!(items[4].data, "defaults 2");
+        assert!(IndexReader::new(&index[..index.len() - 1]).is_err());
+    }
+
+    #[test]
+    fn test_config() {
+        let mut writer = IndexWriter::new();
+        writer.add_config("foo.c:\n\
+                           - item: defaults\n  \
+                             disable_xchecks: true\n\
+                           - item: function\n  \
+                             name: foo\n  \
+                             entry: { fixed: 1234 }\n").unwrap();
+        assert!(writer.add_config("foo.c:\n- item: function\n  entry: 1\n").is_err());
+        let config = parse_index(&writer.finish()).unwrap();
+        let items = config.get_file_items("foo.c").unwrap().items();
+        assert_eq!(items.len(), 2);
+        match items[1] {
+            ItemConfig::Function(ref func) => {
+                assert_eq!(func.name, "foo");
+                assert_eq!(func.entry, Some(::XCheckType::Fixed(1234)));
+            }
+            _ => panic!("expected function item")
+        }
+    }
+}
@@ -8,6 +8,8 @@ extern crate serde;
 extern crate serde_yaml;
 
 pub mod attr;
+pub mod index;
+pub mod profile;
 
 use std::collections::HashMap;
 
@@ -85,6 +87,10 @@ pub struct DefaultsConfig {
 
     #[serde(rename = "return")]
     pub ret: Option<XCheckType>,
+
+    pub sample_period: Option<u64>,
+
+    pub hash_depth: Option<usize>,
 }
 
 impl DefaultsConfig {
@@ -101,6 +107,8 @@ impl DefaultsConfig {
         update_field!(exit);
         update_field!(all_args);
         update_field!(ret);
+        update_field!(sample_period);
+        update_field!(hash_depth);
     }
 }
 
@@ -131,6 +139,15 @@ pub struct FunctionConfig {
     pub ahasher: Option<String>,
     pub shasher: Option<String>,
 
+    // Only check one out of every `sample_period` calls,
+    // or use the run-time global period if it's 0
+    pub sample_period: Option<u64>,
+
+    // How deep to follow pointers when hashing the arguments
+    // and return value, overridden per argument by `arg_hash_depths`
+    pub hash_depth: Option<usize>,
+    pub arg_hash_depths: HashMap<String, usize>,
+
     // Nested items
     nested: Option<ItemList>,
 
@@ -153,6 +170,9 @@ impl FunctionConfig {
             ret: self.ret.clone(),
             ahasher: self.ahasher.clone(),
             shasher: self.shasher.clone(),
+            sample_period: self.sample_period,
+            hash_depth: self.hash_depth,
+            arg_hash_depths: self.arg_hash_depths.clone(),
             nested: Default::default(),
             entry_extra: self.entry_extra.clone(),
             exit_extra: self.exit_extra.clone(),
@@ -195,6 +215,10 @@ pub struct StructConfig {
 
     pub fields: HashMap<FieldIndex, XCheckType>,
 
+    // Maximum depth to hash this structure at; deeper
+    // callers only follow its pointers this many levels
+    pub hash_depth: Option<usize>,
+
     // Nested items; in this context, it means
     // methods implemented in impl's
     nested: Option<ItemList>,
@@ -286,6 +310,16 @@ pub fn parse_string(s: &str) -> Result<Config, String> {
     serde_yaml::from_str(s).map_err(|e| format!("serde_yaml error: {}", e))
 }
 
+/// Parse either a YAML configuration file or a binary index built by `xcfg-index`
+pub fn parse_bytes(data: &[u8]) -> Result<Config, String> {
+    if index::is_index(data) {
+        index::parse_index(data)
+    } else {
+        let s = std::str::from_utf8(data).map_err(|e| format!("invalid UTF-8: {}", e))?;
+        parse_string(s)
+    }
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
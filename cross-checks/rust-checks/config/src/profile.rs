@@ -0,0 +1,162 @@
+//! Function call counts from a profiling run of the program, used to
+//! downgrade the cross-checks on the hottest functions. Two formats are
+//! supported, the same ones as in the clang plugin:
+//!  * the output of `llvm-profdata merge -text`, where the first counter
+//!    of each function is the number of calls to it
+//!  * the call counts written by libfakechecks when `FAKECHECKS_STATS_FILE`
+//!    is set, which start with a `# fakechecks call counts` line followed
+//!    by `<entry cross-check value> <calls>` pairs, one per line
+
+use std::collections::HashMap;
+
+const FAKECHECKS_HEADER: &'static str = "# fakechecks call counts";
+
+pub const DEFAULT_HOT_CALL_THRESHOLD: u64 = 100000;
+
+#[derive(Debug, Default)]
+pub struct CallProfile {
+    calls_by_name: HashMap<String, u64>,
+    calls_by_entry_value: HashMap<u64, u64>,
+}
+
+impl CallProfile {
+    fn parse_profdata(&mut self, s: &str) -> Result<(), String> {
+        let mut record: Vec<&str> = vec![];
+        let mut end_record = |record: &mut Vec<&str>, line_number: usize| {
+            if record.is_empty() {
+                return Ok(());
+            }
+            if record.len() < 3 {
+                return Err(format!("line {}: truncated function record", line_number));
+            }
+            let num_counters: u64 = record[2].parse().map_err(|_| {
+                format!("line {}: invalid number of counters", line_number)
+            })?;
+            let calls: u64 = if num_counters > 0 {
+                record.get(3).and_then(|c| c.parse().ok()).ok_or_else(|| {
+                    format!("line {}: invalid counter value", line_number)
+                })?
+            } else {
+                0
+            };
+            // Functions with internal linkage are named "file.c:foo"
+            let name = match record[0].rsplit(':').next() {
+                Some(name) if !name.is_empty() => name,
+                _ => record[0],
+            };
+            *self.calls_by_name.entry(String::from(name)).or_insert(0) += calls;
+            record.clear();
+            Ok(())
+        };
+
+        let mut line_number = 0;
+        for line in s.lines() {
+            line_number += 1;
+            let line = line.trim();
+            if line.is_empty() {
+                end_record(&mut record, line_number)?;
+                continue;
+            }
+            if line.starts_with('#') || (record.is_empty() && line.starts_with(':')) {
+                continue;
+            }
+            record.push(line);
+        }
+        end_record(&mut record, line_number)
+    }
+
+    fn parse_fakechecks(&mut self, s: &str) -> Result<(), String> {
+        for (idx, line) in s.lines().enumerate() {
+            let line = line.trim();
+            if line.is_empty() || line.starts_with('#') {
+                continue;
+            }
+            let mut fields = line.split_whitespace().map(str::parse::<u64>);
+            match (fields.next(), fields.next(), fields.next()) {
+                (Some(Ok(value)), Some(Ok(calls)), None) => {
+                    *self.calls_by_entry_value.entry(value).or_insert(0) += calls;
+                }
+                _ => return Err(format!("line {}: expected '<entry value> <calls>'", idx + 1))
+            }
+        }
+        Ok(())
+    }
+
+    /// Look up the calls to a function, first by name
+    /// and then by the value of its entry cross-check
+    pub fn lookup(&self, name: &str, entry_value: Option<u64>) -> Option<u64> {
+        self.calls_by_name.get(name).cloned().or_else(|| {
+            entry_value.and_then(|value| self.calls_by_entry_value.get(&value).cloned())
+        })
+    }
+}
+
+pub fn parse_string(s: &str) -> Result<CallProfile, String> {
+    let mut profile = CallProfile::default();
+    if s.starts_with(FAKECHECKS_HEADER) {
+        profile.parse_fakechecks(s)?;
+    } else {
+        profile.parse_profdata(s)?;
+    }
+    Ok(profile)
+}
+
+/// What to do with the cross-checks on functions
+/// called more often than the threshold
+#[derive(Debug, PartialEq, Eq, Clone, Copy)]
+pub enum HotAction {
+    EntryOnly,
+    Disable,
+}
+
+impl HotAction {
+    pub fn parse(s: &str) -> Option<HotAction> {
+        match s {
+            "entry-only" => Some(HotAction::EntryOnly),
+            "disabled"   => Some(HotAction::Disable),
+            _ => None
+        }
+    }
+
+    pub fn name(&self) -> &'static str {
+        match *self {
+            HotAction::EntryOnly => "entry-only",
+            HotAction::Disable   => "disabled",
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_profdata() {
+        let profile = parse_string(":ir\n\
+                                    foo\n# Func Hash:\n1234\n# Num Counters:\n2\n\
+                                    # Counter Values:\n100\n42\n\n\
+                                    main.c:bar\n# Func Hash:\n1\n# Num Counters:\n1\n\
+                                    # Counter Values:\n7\n").unwrap();
+        assert_eq!(profile.lookup("foo", None), Some(100));
+        assert_eq!(profile.lookup("bar", None), Some(7));
+        assert_eq!(profile.lookup("baz", Some(100)), None);
+        assert!(parse_string("foo\n1234\n").is_err());
+    }
+
+    #[test]
+    fn test_fakechecks() {
+        let profile = parse_string("# fakechecks call counts\n\
+                                    2090499946 1\n\
+                                    193491849 5000\n").unwrap();
+        assert_eq!(profile.lookup("foo", Some(193491849)), Some(5000));
+        assert_eq!(profile.lookup("foo", None), None);
+        assert!(parse_string("# fakechecks call counts\n1 2 3\n").is_err());
+    }
+
+    #[test]
+    fn test_hot_action() {
+        assert_eq!(HotAction::parse("entry-only"), Some(HotAction::EntryOnly));
+        assert_eq!(HotAction::parse("disabled"), Some(HotAction::Disable));
+        assert_eq!(HotAction::parse("exit-only"), None);
+    }
+}
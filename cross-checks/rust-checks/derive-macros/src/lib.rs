@@ -42,7 +42,8 @@ fn xcheck_hash_derive(s: synstructure::Structure) -> quote::Tokens {
             // Default implementation
             quote! {
                 use cross_check_runtime::hash::CrossCheckHash;
-                h.write_u64(CrossCheckHash::cross_check_hash_depth::<#ahasher, #shasher>(#f, _depth - 1));
+                h.write_u64(CrossCheckHash::cross_check_hash_visited::<#ahasher, #shasher>(
+                    #f, _depth - 1, _visited));
             }
         })
     });
@@ -65,11 +66,31 @@ fn xcheck_hash_derive(s: synstructure::Structure) -> quote::Tokens {
             }
         }
     });
+    // Cap the depth we hash this value at, if requested
+    let depth_limit = top_args.get("hash_depth").map(|sub_arg| {
+        let max_depth = sub_arg.as_int() as usize;
+        quote! { let _depth = ::std::cmp::min(_depth, #max_depth); }
+    }).unwrap_or_else(quote::Tokens::new);
+
+    // The fields get hashed as part of the same cross-check,
+    // so they share the table of visited objects. We keep the
+    // default MAY_FOLLOW_POINTERS, since computing it from the
+    // field types would recurse forever on self-referential types
     s.bound_impl("::cross_check_runtime::hash::CrossCheckHash", quote! {
         fn cross_check_hash_depth<__XCHA, __XCHS>(&self, _depth: usize) -> u64
                 where __XCHA: ::cross_check_runtime::hash::CrossCheckHasher,
                       __XCHS: ::cross_check_runtime::hash::CrossCheckHasher {
+            let mut _visited = ::cross_check_runtime::hash::HashVisited::new();
+            self.cross_check_hash_visited::<__XCHA, __XCHS>(_depth, &mut _visited)
+        }
+
+        fn cross_check_hash_visited<__XCHA, __XCHS>(
+            &self, _depth: usize,
+            _visited: &mut ::cross_check_runtime::hash::HashVisited) -> u64
+                where __XCHA: ::cross_check_runtime::hash::CrossCheckHasher,
+                      __XCHS: ::cross_check_runtime::hash::CrossCheckHasher {
             #[allow(unused_imports)] use std::hash::Hasher;
+            #depth_limit
             #hash_code
         }
     })
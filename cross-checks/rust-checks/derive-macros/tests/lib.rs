@@ -201,3 +201,48 @@ fn test_multi_field_hash() {
     });
 
 }
+
+#[test]
+fn test_shared_pointer_fields() {
+    use std::hash::Hasher;
+
+    // Both fields point to the same value, which only gets hashed once,
+    // but the hash is the same as for two separately hashed pointers
+    let x = 0x12345678_u64;
+    let px: *const u64 = &x;
+    let ptr_hash = XCH::cross_check_hash_depth::<Djb2Hasher, SimpleHasher>(&px, 7);
+    test_struct!([]
+                 { [] a: *const u64 = px,
+                   [] b: *const u64 = px }
+                 |ts| {
+        let mut h = Djb2Hasher::default();
+        h.write_u64(ptr_hash);
+        h.write_u64(ptr_hash);
+        assert_eq!(
+            XCH::cross_check_hash::<Djb2Hasher, SimpleHasher>(&ts),
+            Some(h.finish()));
+    });
+}
+
+#[test]
+fn test_hash_depth() {
+    use std::hash::Hasher;
+
+    // With hash_depth=1, the pointer field is hashed as a leaf
+    // even though the default depth would follow it
+    let x = 0x12345678_u64;
+    let px: *const u64 = &x;
+    let leaf_hash = XCH::cross_check_hash_depth::<Djb2Hasher, SimpleHasher>(&px, 0);
+    test_struct!([hash_depth=1]
+                 { [] a: *const u64 = px }
+                 |ts| {
+        let mut h = Djb2Hasher::default();
+        h.write_u64(leaf_hash);
+        assert_eq!(
+            XCH::cross_check_hash::<Djb2Hasher, SimpleHasher>(&ts),
+            Some(h.finish()));
+        assert_eq!(
+            XCH::cross_check_hash_with_depth::<Djb2Hasher, SimpleHasher>(&ts, 1),
+            Some(h.finish()));
+    });
+}
@@ -8,8 +8,119 @@ use libc;
 pub mod djb2;
 pub mod simple;
 pub mod jodyhash;
+pub mod xxh64;
+
+// Depth to hash values at, unless the cross-check configuration
+// sets a different `hash_depth` for the function or argument;
+// this needs to match DEFAULT_HASH_DEPTH in the clang plugin
+pub const DEFAULT_HASH_DEPTH: usize = 8;
+
+// Number of element hashes to compute at once when hashing
+// slices of primitive values, same as in the C runtime
+const HASH_BULK_CHUNK: usize = 64;
+
+// Initial and maximum number of slots in HashVisited,
+// same as in the C runtime's hash.c
+const HASH_VISITED_INITIAL_SLOTS: usize = 32;
+const HASH_VISITED_MAX_SLOTS: usize = 1 << 20;
+
+// Table of the objects already hashed during one cross-check,
+// so that values reachable through several pointers, e.g.,
+// the nodes of a doubly-linked list, only get hashed once
+// instead of once for every path that reaches them.
+// This mirrors the table in the C runtime's hash.c.
+//
+// An object's hash depends on the depth it gets hashed at,
+// so we key the entries on the depth as well as on the object
+// and its type, which keeps all hashes identical to the ones
+// computed without the table. Since every object can get an
+// entry for each depth it is reached at, the table doubles in
+// size whenever it fills up, until HASH_VISITED_MAX_SLOTS,
+// after which we just stop memoizing new objects.
+//
+// The slots only get allocated on the first insertion, so creating
+// a table for a cross-check that never memoizes anything, e.g.,
+// one hashing a slice of integers, costs next to nothing.
+pub struct HashVisited {
+    count: usize,
+    // (address, type tag, depth, hash), with address 0 for empty slots;
+    // the length is either 0 or a power of two
+    slots: Vec<HashVisitedSlot>,
+}
+
+type HashVisitedSlot = (usize, usize, usize, u64);
+
+impl HashVisited {
+    #[inline]
+    pub fn new() -> HashVisited {
+        HashVisited {
+            count: 0,
+            slots: Vec::new(),
+        }
+    }
+
+    #[inline]
+    fn find(slots: &[HashVisitedSlot], ptr: usize, tag: usize, depth: usize) -> usize {
+        let h = ((ptr ^ (tag << 1) ^ depth) as u64)
+            .wrapping_mul(0x9e3779b97f4a7c15_u64);
+        // Use the top bits of the product, which depend on all the key bits
+        let mut idx = (h >> (64 - slots.len().trailing_zeros())) as usize;
+        // The table never fills up completely, so this always terminates
+        loop {
+            let slot = &slots[idx];
+            if slot.0 == 0 || (slot.0 == ptr && slot.1 == tag && slot.2 == depth) {
+                return idx;
+            }
+            idx = (idx + 1) & (slots.len() - 1);
+        }
+    }
+
+    // Move all the entries to a table twice the size, returning
+    // false if the table already reached its maximum size
+    fn grow(&mut self) -> bool {
+        let num_slots = if self.slots.is_empty() {
+            HASH_VISITED_INITIAL_SLOTS
+        } else {
+            self.slots.len() * 2
+        };
+        if num_slots > HASH_VISITED_MAX_SLOTS {
+            return false;
+        }
+        let mut slots = vec![(0, 0, 0, 0); num_slots];
+        for old in self.slots.iter().filter(|old| old.0 != 0) {
+            let idx = Self::find(&slots, old.0, old.1, old.2);
+            slots[idx] = *old;
+        }
+        self.slots = slots;
+        true
+    }
 
-const MAX_DEPTH: usize = 8;
+    #[inline]
+    pub fn lookup(&self, ptr: usize, tag: usize, depth: usize) -> Option<u64> {
+        if self.slots.is_empty() {
+            return None;
+        }
+        let slot = &self.slots[Self::find(&self.slots, ptr, tag, depth)];
+        if slot.0 == 0 {
+            None
+        } else {
+            Some(slot.3)
+        }
+    }
+
+    #[inline]
+    pub fn insert(&mut self, ptr: usize, tag: usize, depth: usize, hash: u64) {
+        // Keep the load factor at or below 3/4
+        if self.count >= self.slots.len() * 3 / 4 && !self.grow() {
+            return;
+        }
+        let idx = Self::find(&self.slots, ptr, tag, depth);
+        if self.slots[idx].0 == 0 {
+            self.slots[idx] = (ptr, tag, depth, hash);
+            self.count += 1;
+        }
+    }
+}
 
 // Trait alias for Hasher + Default
 pub trait CrossCheckHasher: Hasher + Default {
@@ -35,19 +146,84 @@ pub trait CrossCheckHasher: Hasher + Default {
 //   HA = the hasher for aggregate types, e.g., structs/enums
 //   HS = the (fast) hasher to use for simple types, e.g., u32
 pub trait CrossCheckHash {
+    // Whether hashing a value of this type can follow pointers to
+    // values worth memoizing; when it can't, e.g., for primitive
+    // types, pointers to values of this type skip the table of
+    // visited objects, same as hash_may_follow_pointers in the
+    // clang plugin. Types that may contain pointers keep the default.
+    const MAY_FOLLOW_POINTERS: bool = true;
+
     #[inline]
     fn cross_check_hash<HA, HS>(&self) -> Option<u64>
             where HA: CrossCheckHasher, HS: CrossCheckHasher {
-        Some(self.cross_check_hash_depth::<HA, HS>(MAX_DEPTH))
+        self.cross_check_hash_with_depth::<HA, HS>(DEFAULT_HASH_DEPTH)
+    }
+
+    // Same as `cross_check_hash`, but follows pointers
+    // at most `depth` levels deep instead of the default
+    #[inline]
+    fn cross_check_hash_with_depth<HA, HS>(&self, depth: usize) -> Option<u64>
+            where HA: CrossCheckHasher, HS: CrossCheckHasher {
+        Some(self.cross_check_hash_depth::<HA, HS>(depth))
     }
 
     fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
             where HA: CrossCheckHasher, HS: CrossCheckHasher;
+
+    // Hash this value as part of a larger cross-check, looking up and
+    // recording the objects behind pointers in `visited`; types that
+    // contain pointers override this and pass `visited` down to them,
+    // and start a new table in `cross_check_hash_depth`
+    #[inline]
+    fn cross_check_hash_visited<HA, HS>(&self, depth: usize,
+                                        _visited: &mut HashVisited) -> u64
+            where HA: CrossCheckHasher, HS: CrossCheckHasher {
+        self.cross_check_hash_depth::<HA, HS>(depth)
+    }
+
+    // Hash all the elements of a slice into `h`, one element at a time;
+    // primitive types override this to compute the element hashes
+    // in batches, like __c2rust_hasher_H_update_bytes in the C runtime,
+    // which lets the compiler vectorize them
+    #[inline]
+    fn cross_check_hash_elements<HA, HS>(elems: &[Self], h: &mut HA, depth: usize,
+                                         visited: &mut HashVisited)
+            where Self: Sized, HA: CrossCheckHasher, HS: CrossCheckHasher {
+        for elem in elems {
+            h.write_u64(elem.cross_check_hash_visited::<HA, HS>(depth, visited));
+        }
+    }
+}
+
+// Hash the object behind a non-NULL pointer or reference,
+// or retrieve its hash from `visited` if we already computed it
+#[inline]
+fn cross_check_hash_pointee<T, HA, HS>(r: &T, depth: usize,
+                                       visited: &mut HashVisited) -> u64
+        where T: ?Sized + CrossCheckHash, HA: CrossCheckHasher, HS: CrossCheckHasher {
+    if !T::MAY_FOLLOW_POINTERS {
+        // Cheaper to hash again than to look up
+        return r.cross_check_hash_visited::<HA, HS>(depth - 1, visited);
+    }
+    // The same address may hold values of different types,
+    // e.g., a structure and its first field, so we also key
+    // the table on the address of this instance of the function
+    let ptr = r as *const T as *const u8 as usize;
+    let tag = cross_check_hash_pointee::<T, HA, HS>
+        as fn(&T, usize, &mut HashVisited) -> u64 as usize;
+    if let Some(hash) = visited.lookup(ptr, tag, depth) {
+        return hash;
+    }
+    let hash = r.cross_check_hash_visited::<HA, HS>(depth - 1, visited);
+    visited.insert(ptr, tag, depth, hash);
+    hash
 }
 
 impl CrossCheckHash for ! {
+    const MAY_FOLLOW_POINTERS: bool = false;
+
     #[inline]
-    fn cross_check_hash<HA, HS>(&self) -> Option<u64>
+    fn cross_check_hash_with_depth<HA, HS>(&self, _depth: usize) -> Option<u64>
             where HA: CrossCheckHasher, HS: CrossCheckHasher {
         panic!("Attempted to CrossCheckHash a 'never' value")
     }
@@ -60,8 +236,10 @@ impl CrossCheckHash for ! {
 }
 
 impl CrossCheckHash for () {
+    const MAY_FOLLOW_POINTERS: bool = false;
+
     #[inline]
-    fn cross_check_hash<HA, HS>(&self) -> Option<u64>
+    fn cross_check_hash_with_depth<HA, HS>(&self, _depth: usize) -> Option<u64>
             where HA: CrossCheckHasher, HS: CrossCheckHasher {
         None
     }
@@ -84,6 +262,8 @@ macro_rules! impl_primitive_hash {
     // to the argument of $write_meth just before the call
     ($in_ty:ident, $write_meth:ident, $val_filter:expr) => {
         impl CrossCheckHash for $in_ty {
+            const MAY_FOLLOW_POINTERS: bool = false;
+
             #[inline]
             fn cross_check_hash_depth<HA, HS>(&self, _: usize) -> u64
                     where HA: CrossCheckHasher, HS: CrossCheckHasher {
@@ -96,6 +276,23 @@ macro_rules! impl_primitive_hash {
                 h.$write_meth($val_filter(*self));
                 h.finish()
             }
+
+            #[inline]
+            fn cross_check_hash_elements<HA, HS>(elems: &[Self], h: &mut HA, _depth: usize,
+                                                 _visited: &mut HashVisited)
+                    where HA: CrossCheckHasher, HS: CrossCheckHasher {
+                let mut elem_hashes = [0u64; HASH_BULK_CHUNK];
+                for chunk in elems.chunks(HASH_BULK_CHUNK) {
+                    for (elem_hash, elem) in elem_hashes.iter_mut().zip(chunk) {
+                        let mut hs = HS::default();
+                        hs.$write_meth($val_filter(*elem));
+                        *elem_hash = hs.finish();
+                    }
+                    for elem_hash in &elem_hashes[..chunk.len()] {
+                        h.write_u64(*elem_hash);
+                    }
+                }
+            }
         }
     };
 }
@@ -135,17 +332,23 @@ pub const ANY_UNION_HASH:    u64 = 0x6e6f696e55796e41_u64; // "AnyUnion" in ASCI
 
 // Hash implementation for slices
 impl<'a, T: CrossCheckHash> CrossCheckHash for [T] {
+    const MAY_FOLLOW_POINTERS: bool = T::MAY_FOLLOW_POINTERS;
+
     #[inline]
     fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
             where HA: CrossCheckHasher, HS: CrossCheckHasher {
+        self.cross_check_hash_visited::<HA, HS>(depth, &mut HashVisited::new())
+    }
+
+    #[inline]
+    fn cross_check_hash_visited<HA, HS>(&self, depth: usize,
+                                        visited: &mut HashVisited) -> u64
+            where HA: CrossCheckHasher, HS: CrossCheckHasher {
         if depth == 0 {
             LEAF_ARRAY_HASH
         } else {
             let mut h = HA::default();
-            for elem in self {
-                let elem_hash = elem.cross_check_hash_depth::<HA, HS>(depth - 1);
-                h.write_u64(elem_hash);
-            }
+            T::cross_check_hash_elements::<HA, HS>(self, &mut h, depth - 1, visited);
             h.finish()
         }
     }
@@ -153,56 +356,92 @@ impl<'a, T: CrossCheckHash> CrossCheckHash for [T] {
 
 // Hash implementation for references
 impl<'a, T: ?Sized + CrossCheckHash> CrossCheckHash for &'a T {
+    const MAY_FOLLOW_POINTERS: bool = T::MAY_FOLLOW_POINTERS;
+
     #[inline]
     fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
             where HA: CrossCheckHasher, HS: CrossCheckHasher {
+        self.cross_check_hash_visited::<HA, HS>(depth, &mut HashVisited::new())
+    }
+
+    #[inline]
+    fn cross_check_hash_visited<HA, HS>(&self, depth: usize,
+                                        visited: &mut HashVisited) -> u64
+            where HA: CrossCheckHasher, HS: CrossCheckHasher {
         if depth == 0 {
             CrossCheckHash::cross_check_hash_depth::<HA, HS>(&LEAF_REFERENCE_VALUE, 1)
         } else {
             // FIXME: don't decrease the depth when following references?
-            (**self).cross_check_hash_depth::<HA, HS>(depth - 1)
+            cross_check_hash_pointee::<T, HA, HS>(&**self, depth, visited)
         }
     }
 }
 
 impl<'a, T: ?Sized + CrossCheckHash> CrossCheckHash for &'a mut T {
+    const MAY_FOLLOW_POINTERS: bool = T::MAY_FOLLOW_POINTERS;
+
     #[inline]
     fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
             where HA: CrossCheckHasher, HS: CrossCheckHasher {
+        self.cross_check_hash_visited::<HA, HS>(depth, &mut HashVisited::new())
+    }
+
+    #[inline]
+    fn cross_check_hash_visited<HA, HS>(&self, depth: usize,
+                                        visited: &mut HashVisited) -> u64
+            where HA: CrossCheckHasher, HS: CrossCheckHasher {
         if depth == 0 {
             CrossCheckHash::cross_check_hash_depth::<HA, HS>(&LEAF_REFERENCE_VALUE, 1)
         } else {
             // FIXME: don't decrease the depth when following references?
-            (**self).cross_check_hash_depth::<HA, HS>(depth - 1)
+            cross_check_hash_pointee::<T, HA, HS>(&**self, depth, visited)
         }
     }
 }
 
 // Hash implementation for raw pointers
 impl<T: ?Sized + CrossCheckHash> CrossCheckHash for *const T {
+    const MAY_FOLLOW_POINTERS: bool = T::MAY_FOLLOW_POINTERS;
+
     #[inline]
     fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
             where HA: CrossCheckHasher, HS: CrossCheckHasher {
+        self.cross_check_hash_visited::<HA, HS>(depth, &mut HashVisited::new())
+    }
+
+    #[inline]
+    fn cross_check_hash_visited<HA, HS>(&self, depth: usize,
+                                        visited: &mut HashVisited) -> u64
+            where HA: CrossCheckHasher, HS: CrossCheckHasher {
         let r = unsafe { self.as_ref() };
         match (r, depth) {
             (None, _) => NULL_POINTER_HASH,
             (_,    0) => LEAF_POINTER_HASH,
             // FIXME: even non-NULL pointers may be invalid
-            (Some(r), _) => (*r).cross_check_hash_depth::<HA, HS>(depth - 1)
+            (Some(r), _) => cross_check_hash_pointee::<T, HA, HS>(r, depth, visited)
         }
     }
 }
 
 impl<T: ?Sized + CrossCheckHash> CrossCheckHash for *mut T {
+    const MAY_FOLLOW_POINTERS: bool = T::MAY_FOLLOW_POINTERS;
+
     #[inline]
     fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
             where HA: CrossCheckHasher, HS: CrossCheckHasher {
+        self.cross_check_hash_visited::<HA, HS>(depth, &mut HashVisited::new())
+    }
+
+    #[inline]
+    fn cross_check_hash_visited<HA, HS>(&self, depth: usize,
+                                        visited: &mut HashVisited) -> u64
+            where HA: CrossCheckHasher, HS: CrossCheckHasher {
         let r = unsafe { self.as_ref() };
         match (r, depth) {
             (None, _) => NULL_POINTER_HASH,
             (_,    0) => LEAF_POINTER_HASH,
             // FIXME: even non-NULL pointers may be invalid
-            (Some(r), _) => (*r).cross_check_hash_depth::<HA, HS>(depth - 1)
+            (Some(r), _) => cross_check_hash_pointee::<T, HA, HS>(r, depth, visited)
         }
     }
 }
@@ -210,6 +449,8 @@ impl<T: ?Sized + CrossCheckHash> CrossCheckHash for *mut T {
 macro_rules! impl_fnopt_hash {
     (<$($arg:ident),*> + $($pfx:tt)*) => {
         impl <Ret, $($arg),*> CrossCheckHash for $($pfx)* fn($($arg),*) -> Ret {
+            const MAY_FOLLOW_POINTERS: bool = false;
+
             #[inline]
             fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
                     where HA: CrossCheckHasher, HS: CrossCheckHasher {
@@ -222,6 +463,8 @@ macro_rules! impl_fnopt_hash {
         }
 
         impl <Ret, $($arg),*> CrossCheckHash for Option<$($pfx)* fn($($arg),*) -> Ret> {
+            const MAY_FOLLOW_POINTERS: bool = false;
+
             #[inline]
             fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
                     where HA: CrossCheckHasher, HS: CrossCheckHasher {
@@ -261,11 +504,20 @@ impl_fnopt_hash!(A, B, C, D, E, F, G, H, I, J, K, L);
 macro_rules! impl_array_hash {
     ($($N:expr)+) => { $(
         impl<T: CrossCheckHash> CrossCheckHash for [T; $N] {
+            const MAY_FOLLOW_POINTERS: bool = T::MAY_FOLLOW_POINTERS;
+
             #[inline]
             fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
                     where HA: CrossCheckHasher, HS: CrossCheckHasher {
                 self[..].cross_check_hash_depth::<HA, HS>(depth)
             }
+
+            #[inline]
+            fn cross_check_hash_visited<HA, HS>(&self, depth: usize,
+                                                visited: &mut HashVisited) -> u64
+                    where HA: CrossCheckHasher, HS: CrossCheckHasher {
+                self[..].cross_check_hash_visited::<HA, HS>(depth, visited)
+            }
         }
     )+ }
 }
@@ -290,20 +542,33 @@ impl_array_hash!{
 macro_rules! cross_check_hash_array {
     [$ET:ty; [$($N:expr),+]] => { $(
         impl $crate::hash::CrossCheckHash for [$ET; $N] {
+            const MAY_FOLLOW_POINTERS: bool =
+                <$ET as $crate::hash::CrossCheckHash>::MAY_FOLLOW_POINTERS;
+
             #[inline]
             fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
                     where HA: $crate::hash::CrossCheckHasher,
                           HS: $crate::hash::CrossCheckHasher {
                 self[..].cross_check_hash_depth::<HA, HS>(depth)
             }
+
+            #[inline]
+            fn cross_check_hash_visited<HA, HS>(&self, depth: usize,
+                                                visited: &mut $crate::hash::HashVisited) -> u64
+                    where HA: $crate::hash::CrossCheckHasher,
+                          HS: $crate::hash::CrossCheckHasher {
+                self[..].cross_check_hash_visited::<HA, HS>(depth, visited)
+            }
         }
     )+ }
 }
 
 #[cfg(feature="libc-hash")]
 impl CrossCheckHash for libc::c_void {
+    const MAY_FOLLOW_POINTERS: bool = false;
+
     #[inline]
-    fn cross_check_hash<HA, HS>(&self) -> Option<u64>
+    fn cross_check_hash_with_depth<HA, HS>(&self, _depth: usize) -> Option<u64>
             where HA: CrossCheckHasher, HS: CrossCheckHasher {
         None
     }
@@ -317,3 +582,116 @@ impl CrossCheckHash for libc::c_void {
         VOID_POINTER_HASH
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use std::cell::Cell;
+    use std::ptr;
+    use super::{CrossCheckHash, CrossCheckHasher, HashVisited};
+    use super::djb2::Djb2Hasher;
+    use super::simple::SimpleHasher;
+
+    #[test]
+    fn test_visited_lazy_table() {
+        let mut visited = HashVisited::new();
+        assert!(visited.slots.is_empty());
+        assert_eq!(visited.lookup(0x1000, 1, 2), None);
+        assert!(visited.slots.is_empty());
+        visited.insert(0x1000, 1, 2, 0x1234);
+        assert_eq!(visited.lookup(0x1000, 1, 2), Some(0x1234));
+        assert_eq!(visited.lookup(0x1000, 1, 3), None);
+    }
+
+    #[test]
+    fn test_visited_table_grows() {
+        let mut visited = HashVisited::new();
+        for ptr in 1..5001 {
+            for depth in 1..9 {
+                visited.insert(ptr * 8, 1, depth, (ptr * 10 + depth) as u64);
+            }
+        }
+        assert_eq!(visited.count, 40000);
+        for ptr in 1..5001 {
+            for depth in 1..9 {
+                assert_eq!(visited.lookup(ptr * 8, 1, depth),
+                           Some((ptr * 10 + depth) as u64));
+            }
+        }
+        assert_eq!(visited.lookup(8, 1, 9), None);
+    }
+
+    // Doubly-linked list node that counts how many times it gets hashed,
+    // and can hash its neighbors without sharing the table of visited objects
+    struct Node {
+        next: *const Node,
+        prev: *const Node,
+    }
+
+    thread_local! {
+        static NODE_HASHES: Cell<usize> = Cell::new(0);
+        static NODE_SHARES_VISITED: Cell<bool> = Cell::new(true);
+    }
+
+    impl CrossCheckHash for Node {
+        fn cross_check_hash_depth<HA, HS>(&self, depth: usize) -> u64
+                where HA: CrossCheckHasher, HS: CrossCheckHasher {
+            self.cross_check_hash_visited::<HA, HS>(depth, &mut HashVisited::new())
+        }
+
+        fn cross_check_hash_visited<HA, HS>(&self, depth: usize,
+                                            visited: &mut HashVisited) -> u64
+                where HA: CrossCheckHasher, HS: CrossCheckHasher {
+            NODE_HASHES.with(|n| n.set(n.get() + 1));
+            let mut h = HA::default();
+            for p in &[self.next, self.prev] {
+                let hash = if NODE_SHARES_VISITED.with(|s| s.get()) {
+                    p.cross_check_hash_visited::<HA, HS>(depth, visited)
+                } else {
+                    p.cross_check_hash_depth::<HA, HS>(depth)
+                };
+                h.write_u64(hash);
+            }
+            h.finish()
+        }
+    }
+
+    fn count_node_hashes(node: &Node, shared: bool) -> (u64, usize) {
+        NODE_SHARES_VISITED.with(|s| s.set(shared));
+        NODE_HASHES.with(|n| n.set(0));
+        let hash = node.cross_check_hash_depth::<Djb2Hasher, SimpleHasher>(8);
+        (hash, NODE_HASHES.with(|n| n.get()))
+    }
+
+    #[test]
+    fn test_visited_fewer_hashes() {
+        let null = ptr::null();
+        let mut nodes = (0..8).map(|_| Node { next: null, prev: null })
+                              .collect::<Vec<_>>();
+        for i in 0..8 {
+            let next: *const Node = if i < 7 { &nodes[i + 1] } else { null };
+            let prev: *const Node = if i > 0 { &nodes[i - 1] } else { null };
+            nodes[i].next = next;
+            nodes[i].prev = prev;
+        }
+
+        // Without the table, every path through the list gets hashed again
+        let (unshared_hash, unshared_hashes) = count_node_hashes(&nodes[0], false);
+        let (shared_hash, shared_hashes) = count_node_hashes(&nodes[0], true);
+        assert_eq!(shared_hash, unshared_hash);
+        // With it, each node gets hashed at most once for each depth
+        assert!(shared_hashes <= 1 + 8 * 8);
+        assert!(shared_hashes * 4 < unshared_hashes);
+    }
+
+    #[test]
+    fn test_primitive_pointees_not_memoized() {
+        let x = 0x12345678_u32;
+        let px: *const u32 = &x;
+        let mut visited = HashVisited::new();
+        let hash = px.cross_check_hash_visited::<Djb2Hasher, SimpleHasher>(4, &mut visited);
+        assert!(visited.slots.is_empty());
+        assert_eq!(hash, x.cross_check_hash_depth::<Djb2Hasher, SimpleHasher>(3));
+        assert!(!<*const u32 as CrossCheckHash>::MAY_FOLLOW_POINTERS);
+        assert!(!<[u8] as CrossCheckHash>::MAY_FOLLOW_POINTERS);
+    }
+}
@@ -0,0 +1,221 @@
+// xxh64: XXH64 with a seed of 0, from https://github.com/Cyan4973/xxHash
+// This needs to match the xxh64 hasher in the C runtime, which only
+// hashes 64-bit words; both get tested against the same test vectors.
+
+use std::cmp;
+use std::hash::Hasher;
+use std::mem;
+use std::ptr;
+use super::CrossCheckHasher;
+
+const PRIME1: u64 = 0x9e3779b185ebca87u64;
+const PRIME2: u64 = 0xc2b2ae3d27d4eb4fu64;
+const PRIME3: u64 = 0x165667b19e3779f9u64;
+const PRIME4: u64 = 0x85ebca77c2b2ae63u64;
+const PRIME5: u64 = 0x27d4eb2f165667c5u64;
+
+const STRIPE_LEN: usize = 32;
+
+#[derive(Debug, Clone)]
+pub struct Xxh64Hasher {
+    lanes: [u64; 4],
+    // Bytes of the current stripe
+    pending: [u8; STRIPE_LEN],
+    pending_len: usize,
+    total_len: u64,
+}
+
+impl Default for Xxh64Hasher {
+    #[inline]
+    fn default() -> Xxh64Hasher {
+        Xxh64Hasher {
+            lanes: [PRIME1.wrapping_add(PRIME2), PRIME2, 0, 0u64.wrapping_sub(PRIME1)],
+            pending: [0; STRIPE_LEN],
+            pending_len: 0,
+            total_len: 0,
+        }
+    }
+}
+
+#[inline]
+fn read_u64(bytes: &[u8]) -> u64 {
+    assert!(bytes.len() >= 8);
+    u64::from_le(unsafe { ptr::read_unaligned(bytes.as_ptr() as *const u64) })
+}
+
+#[inline]
+fn read_u32(bytes: &[u8]) -> u32 {
+    assert!(bytes.len() >= 4);
+    u32::from_le(unsafe { ptr::read_unaligned(bytes.as_ptr() as *const u32) })
+}
+
+#[inline]
+fn round(acc: u64, x: u64) -> u64 {
+    acc.wrapping_add(x.wrapping_mul(PRIME2))
+        .rotate_left(31)
+        .wrapping_mul(PRIME1)
+}
+
+#[inline]
+fn merge_round(h: u64, lane: u64) -> u64 {
+    (h ^ round(0, lane)).wrapping_mul(PRIME1).wrapping_add(PRIME4)
+}
+
+impl Xxh64Hasher {
+    #[inline]
+    pub fn new() -> Xxh64Hasher {
+        Default::default()
+    }
+
+    #[inline]
+    fn process_stripe(&mut self, stripe: &[u8]) {
+        for (i, lane) in self.lanes.iter_mut().enumerate() {
+            *lane = round(*lane, read_u64(&stripe[i * 8..]));
+        }
+    }
+
+    #[inline]
+    fn process_pending(&mut self) {
+        let stripe = self.pending;
+        self.process_stripe(&stripe);
+        self.pending_len = 0;
+    }
+}
+
+impl Hasher for Xxh64Hasher {
+    fn finish(&self) -> u64 {
+        let mut h = if self.total_len >= STRIPE_LEN as u64 {
+            let l = &self.lanes;
+            let h = l[0].rotate_left(1)
+                .wrapping_add(l[1].rotate_left(7))
+                .wrapping_add(l[2].rotate_left(12))
+                .wrapping_add(l[3].rotate_left(18));
+            l.iter().fold(h, |h, &lane| merge_round(h, lane))
+        } else {
+            PRIME5
+        };
+        h = h.wrapping_add(self.total_len);
+
+        let mut tail = &self.pending[..self.pending_len];
+        while tail.len() >= 8 {
+            h ^= round(0, read_u64(tail));
+            h = h.rotate_left(27).wrapping_mul(PRIME1).wrapping_add(PRIME4);
+            tail = &tail[8..];
+        }
+        if tail.len() >= 4 {
+            h ^= (read_u32(tail) as u64).wrapping_mul(PRIME1);
+            h = h.rotate_left(23).wrapping_mul(PRIME2).wrapping_add(PRIME3);
+            tail = &tail[4..];
+        }
+        for &b in tail {
+            h ^= (b as u64).wrapping_mul(PRIME5);
+            h = h.rotate_left(11).wrapping_mul(PRIME1);
+        }
+
+        h ^= h >> 33;
+        h = h.wrapping_mul(PRIME2);
+        h ^= h >> 29;
+        h = h.wrapping_mul(PRIME3);
+        h ^= h >> 32;
+        h
+    }
+
+    fn write(&mut self, mut bytes: &[u8]) {
+        self.total_len += bytes.len() as u64;
+        if self.pending_len > 0 {
+            let n = cmp::min(STRIPE_LEN - self.pending_len, bytes.len());
+            self.pending[self.pending_len..self.pending_len + n]
+                .copy_from_slice(&bytes[..n]);
+            self.pending_len += n;
+            bytes = &bytes[n..];
+            if self.pending_len < STRIPE_LEN {
+                return;
+            }
+            self.process_pending();
+        }
+        while bytes.len() >= STRIPE_LEN {
+            self.process_stripe(&bytes[..STRIPE_LEN]);
+            bytes = &bytes[STRIPE_LEN..];
+        }
+        self.pending[..bytes.len()].copy_from_slice(bytes);
+        self.pending_len = bytes.len();
+    }
+
+    #[inline]
+    fn write_u64(&mut self, i: u64) {
+        if self.pending_len % 8 != 0 {
+            let bytes: [u8; 8] = unsafe { mem::transmute(i.to_le()) };
+            self.write(&bytes);
+            return;
+        }
+        // Fast path for the common case of hashing a sequence of words
+        unsafe {
+            let dst = self.pending.as_mut_ptr().offset(self.pending_len as isize);
+            ptr::write_unaligned(dst as *mut u64, i.to_le());
+        }
+        self.pending_len += 8;
+        self.total_len += 8;
+        if self.pending_len == STRIPE_LEN {
+            self.process_pending();
+        }
+    }
+}
+
+impl CrossCheckHasher for Xxh64Hasher {}
+
+#[cfg(test)]
+mod tests {
+    use super::{Hasher, Xxh64Hasher};
+
+    fn xxh64_bytes(bytes: &[u8]) -> u64 {
+        let mut h = Xxh64Hasher::default();
+        h.write(bytes);
+        h.finish()
+    }
+
+    #[test]
+    fn test_xxh64_bytes() {
+        assert_eq!(xxh64_bytes(b""), 0xef46db3751d8e999u64);
+        assert_eq!(xxh64_bytes(b"a"), 0xd24ec4f1a98c6e5bu64);
+        assert_eq!(xxh64_bytes(b"abc"), 0x44bc2cf5ad770999u64);
+        assert_eq!(xxh64_bytes(b"Nobody inspects the spammish repetition"),
+                   0xfbcea83c8a378bf1u64);
+    }
+
+    #[test]
+    fn test_xxh64_vectors() {
+        // The same vectors as the C runtime's xxh64 test
+        let vectors = include_str!("../../../../hash-test-vectors/xxh64.txt");
+        let mut num_vectors = 0;
+        for line in vectors.lines() {
+            if line.starts_with('#') || line.is_empty() {
+                continue;
+            }
+            let mut words = line.split_whitespace()
+                .map(|w| u64::from_str_radix(w, 16).unwrap());
+            let expected = words.next().unwrap();
+            let mut h = Xxh64Hasher::default();
+            for w in words {
+                h.write_u64(w);
+            }
+            assert_eq!(h.finish(), expected, "test vector: {}", line);
+            num_vectors += 1;
+        }
+        assert_eq!(num_vectors, 17);
+    }
+
+    #[test]
+    fn test_xxh64_mixed_writes() {
+        // Words written after unaligned bytes take the slow path
+        let mut h = Xxh64Hasher::default();
+        h.write_u8(0x12);
+        h.write_u64(0x0123456789abcdefu64);
+        h.write_u32(0xdeadbeefu32);
+        h.write_u64(0xfedcba9876543210u64);
+        let bytes = [0x12u8,
+                     0xef, 0xcd, 0xab, 0x89, 0x67, 0x45, 0x23, 0x01,
+                     0xef, 0xbe, 0xad, 0xde,
+                     0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe];
+        assert_eq!(h.finish(), xxh64_bytes(&bytes));
+    }
+}
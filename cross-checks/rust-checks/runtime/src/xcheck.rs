@@ -1,3 +1,4 @@
+use std::sync::atomic::{AtomicUsize, Ordering};
 
 pub const UNKNOWN_TAG: u8 = 0;
 pub const FUNCTION_ENTRY_TAG: u8 = 1;
@@ -17,6 +18,23 @@ unsafe fn call_rb_xcheck_sym<T>(sym: *mut T, tag: u8, val: u64) {
     }
 }
 
+// Backends that predate rb_xcheck_batch only provide rb_xcheck,
+// so we fall back to calling it once for each check
+#[cfg(any(feature="xcheck-with-dlsym", feature="xcheck-with-weak"))]
+#[inline]
+unsafe fn call_rb_xcheck_batch_sym<T>(sym: *mut T, tags: *const u8,
+                                      vals: *const u64, len: usize) {
+    if !sym.is_null() {
+        let rb_xcheck_batch_fn: unsafe extern fn(*const u8, *const u64, usize) =
+            ::std::mem::transmute(sym);
+        rb_xcheck_batch_fn(tags, vals, len);
+    } else {
+        for i in 0..len {
+            rb_xcheck(*tags.offset(i as isize), *vals.offset(i as isize));
+        }
+    }
+}
+
 // Wrapper for rb_xcheck that uses dlsym() to locate rb_xcheck dynamically
 // at run-time, allowing us to override it with LD_PRELOAD
 #[cfg(feature="xcheck-with-dlsym")]
@@ -31,6 +49,18 @@ unsafe fn rb_xcheck(tag: u8, val: u64) {
     call_rb_xcheck_sym(RB_XCHECK_SYM, tag, val);
 }
 
+#[cfg(feature="xcheck-with-dlsym")]
+unsafe fn rb_xcheck_batch(tags: *const u8, vals: *const u64, len: usize) {
+    extern crate libc;
+    static mut RB_XCHECK_BATCH_SYM: *mut libc::c_void = ::std::ptr::null_mut();
+    static RB_XCHECK_BATCH_INIT: ::std::sync::Once = ::std::sync::ONCE_INIT;
+    RB_XCHECK_BATCH_INIT.call_once(|| {
+        let rb_xcheck_batch_name = ::std::ffi::CString::new("rb_xcheck_batch").unwrap();
+        RB_XCHECK_BATCH_SYM = libc::dlsym(libc::RTLD_DEFAULT, rb_xcheck_batch_name.as_ptr());
+    });
+    call_rb_xcheck_batch_sym(RB_XCHECK_BATCH_SYM, tags, vals, len);
+}
+
 // Wrapper for rb_xcheck that uses (unsuccessfully) weak symbols to locate
 // rb_xcheck in such a way that LD_PRELOAD can override it
 #[cfg(feature="xcheck-with-weak")]
@@ -44,17 +74,84 @@ unsafe fn rb_xcheck(tag: u8, val: u64) {
     call_rb_xcheck_sym(RB_XCHECK_SYM, tag, val);
 }
 
+#[cfg(feature="xcheck-with-weak")]
+#[deprecated(note="this does not work correctly, please use xcheck-with-dlsym for now")]
+unsafe fn rb_xcheck_batch(tags: *const u8, vals: *const u64, len: usize) {
+    extern {
+        #[link_name = "rb_xcheck_batch"]
+        #[linkage = "extern_weak"]
+        static RB_XCHECK_BATCH_SYM: *mut u8;
+    }
+    call_rb_xcheck_batch_sym(RB_XCHECK_BATCH_SYM, tags, vals, len);
+}
+
 // The default wrapper for rb_xcheck, which uses a strong global symbol
 // This is the only approach that requires that libclevrbuf.so is linked in
 #[cfg(not(any(feature="xcheck-with-dlsym", feature="xcheck-with-weak")))]
 extern {
     #[no_mangle]
     fn rb_xcheck(tag: u8, val: u64);
+
+    #[no_mangle]
+    fn rb_xcheck_batch(tags: *const u8, vals: *const u64, len: usize);
+}
+
+// Global sampling period, read from the RB_XCHECK_SAMPLE_PERIOD
+// environment variable; invalid or missing values disable sampling,
+// same as in the C runtime
+fn global_sample_period() -> u64 {
+    static mut GLOBAL_SAMPLE_PERIOD: u64 = 1;
+    static GLOBAL_SAMPLE_PERIOD_INIT: ::std::sync::Once = ::std::sync::ONCE_INIT;
+    unsafe {
+        GLOBAL_SAMPLE_PERIOD_INIT.call_once(|| {
+            let period = ::std::env::var("RB_XCHECK_SAMPLE_PERIOD").ok()
+                .and_then(|s| if s.starts_with(|c: char| c.is_digit(10)) {
+                    s.parse::<u64>().ok()
+                } else {
+                    None
+                });
+            if let Some(period) = period {
+                if period != 0 {
+                    GLOBAL_SAMPLE_PERIOD = period;
+                }
+            }
+        });
+        GLOBAL_SAMPLE_PERIOD
+    }
 }
 
+// Called on every invocation of a function that has sampling enabled,
+// with that function's call counter. Returns whether this invocation
+// should be cross-checked, which is the case for calls 0, period,
+// 2*period, ... of each function, exactly like __c2rust_xcheck_sample
+// in the C runtime. A zero period selects the global period.
+#[inline]
+pub fn sample_xcheck(calls: &AtomicUsize, period: u64) -> bool {
+    let call = calls.fetch_add(1, Ordering::Relaxed) as u64;
+    let period = if period == 0 { global_sample_period() } else { period };
+    call % period == 0
+}
+
+// Maximum number of checks we pass to rb_xcheck_batch at once
+const XCHECK_BATCH_LEN: usize = 16;
+
 #[inline]
 pub fn xcheck<I: Iterator<Item=(u8, u64)>>(checks: I) {
+    // Collect the checks on the stack, and pass them all
+    // to the backend in as few calls as possible
+    let mut tags = [0u8; XCHECK_BATCH_LEN];
+    let mut vals = [0u64; XCHECK_BATCH_LEN];
+    let mut len = 0;
     for (tag, val) in checks {
-        unsafe { rb_xcheck(tag, val) }
+        if len == XCHECK_BATCH_LEN {
+            unsafe { rb_xcheck_batch(tags.as_ptr(), vals.as_ptr(), len) }
+            len = 0;
+        }
+        tags[len] = tag;
+        vals[len] = val;
+        len += 1;
+    }
+    if len > 0 {
+        unsafe { rb_xcheck_batch(tags.as_ptr(), vals.as_ptr(), len) }
     }
 }
@@ -8,6 +8,7 @@ use syntax::ext::quote::rt::ExtParseUtils;
 use syntax::tokenstream::TokenTree;
 
 use std::collections::HashMap;
+use std::convert::TryInto;
 
 use xcfg;
 use xcheck_util;
@@ -26,6 +27,13 @@ pub struct InheritedCheckConfig {
     // Overrides for ahasher/shasher
     pub ahasher: Option<Vec<TokenTree>>,
     pub shasher: Option<Vec<TokenTree>>,
+
+    // Call sampling period, if sampling is enabled
+    pub sample_period: Option<u64>,
+
+    // Hashing depth for arguments and return values,
+    // if not the runtime's default
+    pub hash_depth: Option<usize>,
 }
 
 impl Default for InheritedCheckConfig {
@@ -38,6 +46,8 @@ impl Default for InheritedCheckConfig {
             ret: xcfg::XCheckType::Default,
             ahasher: None,
             shasher: None,
+            sample_period: None,
+            hash_depth: None,
         }
     }
 }
@@ -45,6 +55,7 @@ impl Default for InheritedCheckConfig {
 #[derive(Debug)]
 pub struct FunctionCheckConfig {
     pub args: HashMap<xcfg::FieldIndex, xcfg::XCheckType>,
+    pub arg_hash_depths: HashMap<xcfg::FieldIndex, usize>,
     pub entry_extra: Vec<xcfg::ExtraXCheck>,
     pub exit_extra: Vec<xcfg::ExtraXCheck>,
 }
@@ -54,6 +65,7 @@ impl Default for FunctionCheckConfig {
     fn default() -> FunctionCheckConfig {
         FunctionCheckConfig {
             args: Default::default(),
+            arg_hash_depths: Default::default(),
             entry_extra: Default::default(),
             exit_extra: Default::default(),
         }
@@ -65,6 +77,7 @@ pub struct StructCheckConfig {
     pub custom_hash: Option<String>,
     pub field_hasher: Option<String>,
     pub fields: HashMap<xcfg::FieldIndex, xcfg::XCheckType>,
+    pub hash_depth: Option<usize>,
 }
 
 #[derive(Debug)]
@@ -171,6 +184,21 @@ impl ScopeCheckConfig {
                     Rc::make_mut(&mut self.inherited).shasher =
                         Some(cx.parse_tts(String::from(arg.as_str())));
                 }
+                ("sample_period", _) => {
+                    let period = arg.as_int().try_into()
+                        .expect("invalid u64 for sample_period");
+                    Rc::make_mut(&mut self.inherited).sample_period = Some(period);
+                }
+
+                ("hash_depth", &mut ItemCheckConfig::Struct(ref mut struc)) => {
+                    struc.hash_depth = Some(arg.as_int().try_into()
+                        .expect("invalid usize for hash_depth"));
+                }
+                ("hash_depth", _) => {
+                    let depth = arg.as_int().try_into()
+                        .expect("invalid usize for hash_depth");
+                    Rc::make_mut(&mut self.inherited).hash_depth = Some(depth);
+                }
 
                 // Function-specific attributes
                 ("entry", &mut ItemCheckConfig::FileDefaults) |
@@ -216,6 +244,15 @@ impl ScopeCheckConfig {
                         .unwrap_or(xcfg::XCheckType::Default);
                 }
 
+                ("arg_hash_depths", &mut ItemCheckConfig::Function(ref mut func)) => {
+                    func.arg_hash_depths.extend(arg.as_list().iter().map(|(name, arg)| {
+                        let depth = arg.as_int().try_into()
+                            .expect(&format!("invalid usize for hash depth \
+                                              of argument: {}", name));
+                        (xcfg::FieldIndex::from_str(name), depth)
+                    }));
+                }
+
                 // TODO: handle entry_extra and exit_extra for Function
 
                 // Structure-specific attributes
@@ -255,6 +292,8 @@ impl ScopeCheckConfig {
                 parse_optional_field!(^exit,     xcfg_defs, exit,     exit.clone());
                 parse_optional_field!(^all_args, xcfg_defs, all_args, all_args.clone());
                 parse_optional_field!(^ret,      xcfg_defs, ret,      ret.clone());
+                parse_optional_field!(^sample_period, xcfg_defs, sample_period, Some(*sample_period));
+                parse_optional_field!(^hash_depth, xcfg_defs, hash_depth, Some(*hash_depth));
             },
 
             (&mut ItemCheckConfig::Function(ref mut self_func), &xcfg::ItemConfig::Function(ref xcfg_func)) => {
@@ -267,10 +306,15 @@ impl ScopeCheckConfig {
                 // TODO: add a way for the external config to reset these to default
                 parse_optional_field!(^ahasher, xcfg_func, ahasher, Some(cx.parse_tts(ahasher.clone())));
                 parse_optional_field!(^shasher, xcfg_func, shasher, Some(cx.parse_tts(shasher.clone())));
+                parse_optional_field!(^sample_period, xcfg_func, sample_period, Some(*sample_period));
+                parse_optional_field!(^hash_depth, xcfg_func, hash_depth, Some(*hash_depth));
                 // Function-specific fields
                 self_func.args.extend(xcfg_func.args.iter().map(|(k, v)| {
                     (xcfg::FieldIndex::from_str(k), v.clone())
                 }));
+                self_func.arg_hash_depths.extend(xcfg_func.arg_hash_depths.iter().map(|(k, v)| {
+                    (xcfg::FieldIndex::from_str(k), *v)
+                }));
                 self_func.entry_extra.extend(xcfg_func.entry_extra.iter().cloned());
                 self_func.exit_extra.extend(xcfg_func.exit_extra.iter().cloned());
                 // TODO: parse more fields: exit, ret
@@ -285,6 +329,7 @@ impl ScopeCheckConfig {
                 // Structure-specific fields
                 parse_optional_field!(>custom_hash,  self_struc, xcfg_struc, custom_hash,  Some(custom_hash.clone()));
                 parse_optional_field!(>field_hasher, self_struc, xcfg_struc, field_hasher, Some(field_hasher.clone()));
+                parse_optional_field!(>hash_depth,   self_struc, xcfg_struc, hash_depth,   Some(*hash_depth));
                 self_struc.fields.extend(xcfg_struc.fields.clone().into_iter());
             },
 
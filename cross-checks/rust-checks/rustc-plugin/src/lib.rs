@@ -18,6 +18,8 @@ use syntax::fold;
 use std::borrow::Cow;
 use std::cell::{Cell, RefCell};
 use std::collections::{HashSet, HashMap};
+use std::fs::{self, OpenOptions};
+use std::io::Write;
 use std::path::PathBuf;
 use std::rc::Rc;
 
@@ -209,8 +211,20 @@ impl<'a, 'cx, 'exp> CrossChecker<'a, 'cx, 'exp> {
          self.config().inherited.shasher.as_ref().unwrap_or(self.default_shasher.as_ref()))
     }
 
+    // Build the call that hashes `val_ref`, following pointers
+    // at most `depth` levels deep if the configuration sets it
+    fn build_hash_call(&self, depth: Option<usize>) -> P<ast::Expr> {
+        let (ahasher, shasher) = self.get_hasher_pair();
+        match depth {
+            Some(depth) => quote_expr!(self.cx,
+                XCH::cross_check_hash_with_depth::<$ahasher, $shasher>(val_ref, $depth)),
+            None => quote_expr!(self.cx,
+                XCH::cross_check_hash::<$ahasher, $shasher>(val_ref)),
+        }
+    }
+
     // Get the cross-check block for this argument
-    fn build_arg_xcheck(&self, arg: &ast::Arg) -> Option<ast::Stmt> {
+    fn build_arg_xcheck(&self, arg: &ast::Arg) -> Option<P<ast::Expr>> {
         match arg.pat.node {
             ast::PatKind::Ident(_, ref ident, _) => {
                 // Parameter pattern is just an identifier,
@@ -219,16 +233,19 @@ impl<'a, 'cx, 'exp> CrossChecker<'a, 'cx, 'exp> {
                 let arg_xcheck_cfg = self.config().function_config()
                     .args.get(&arg_idx)
                     .unwrap_or(&self.config().inherited.all_args);
+                let arg_hash_depth = self.config().function_config()
+                    .arg_hash_depths.get(&arg_idx).cloned()
+                    .or(self.config().inherited.hash_depth);
                 arg_xcheck_cfg.build_xcheck(self.cx, "FUNCTION_ARG_TAG", "val_ref",
                                             |tag, pre_hash_stmts| {
                     // By default, we use cross_check_hash
                     // to hash the value of the identifier
-                    let (ahasher, shasher) = self.get_hasher_pair();
+                    let hash_call = self.build_hash_call(arg_hash_depth);
                     quote_expr!(self.cx, {
                         use cross_check_runtime::hash::CrossCheckHash as XCH;
                         let val_ref = &$ident;
                         $pre_hash_stmts
-                        let hash = XCH::cross_check_hash::<$ahasher, $shasher>(val_ref);
+                        let hash = $hash_call;
                         hash.map(|hash| ($tag, hash))
                     })
                 })
@@ -263,11 +280,15 @@ impl<'a, 'cx, 'exp> CrossChecker<'a, 'cx, 'exp> {
             let mi = format!("custom_hash=\"{}\"", custom_hash);
             res.push(mi);
         }
+        if let Some(hash_depth) = struct_config.hash_depth {
+            let mi = format!("hash_depth={}", hash_depth);
+            res.push(mi);
+        }
         res
     }
 
-    fn build_extra_xchecks(&self, extra_xchecks: &[xcfg::ExtraXCheck]) -> Vec<ast::Stmt> {
-        extra_xchecks.iter().flat_map(|ex| {
+    fn build_extra_xchecks(&self, extra_xchecks: &[xcfg::ExtraXCheck]) -> Vec<P<ast::Expr>> {
+        extra_xchecks.iter().map(|ex| {
             // TODO: allow the custom functions to return Option or an iterator???
             let expr = self.cx.parse_expr(ex.custom.clone());
             let tag_str = match ex.tag {
@@ -278,60 +299,119 @@ impl<'a, 'cx, 'exp> CrossChecker<'a, 'cx, 'exp> {
                 xcfg::XCheckTag::FunctionReturn => "FUNCTION_RETURN_TAG",
             };
             let tag = ast::Ident::from_str(tag_str);
-            quote_stmt!(self.cx, cross_check_raw!($tag, $expr))
-        }).collect::<Vec<ast::Stmt>>()
+            quote_expr!(self.cx, {
+                use cross_check_runtime::xcheck::$tag;
+                Some(($tag, $expr as u64))
+            })
+        }).collect::<Vec<_>>()
+    }
+
+    // Check the profile for functions too hot to cross-check fully
+    fn hot_function_action(&self, fn_ident: &ast::Ident) -> Option<xcfg::profile::HotAction> {
+        let entry_value = match self.config().inherited.entry {
+            xcfg::XCheckType::Default => Some(xcheck_util::djb2_hash(&*fn_ident.name.as_str()) as u64),
+            xcfg::XCheckType::Fixed(id) => Some(id),
+            xcfg::XCheckType::Djb2(ref s) => Some(xcheck_util::djb2_hash(s) as u64),
+            _ => None
+        };
+        self.expander.hot_functions.as_ref().and_then(|hot_functions| {
+            hot_functions.check_function(&self.last_scope().file_name,
+                                         &*fn_ident.name.as_str(),
+                                         entry_value)
+        })
     }
 
     fn build_function_xchecks(&mut self, fn_ident: &ast::Ident,
                               fn_decl: &ast::FnDecl,
                               block: P<ast::Block>) -> P<ast::Block> {
-        let checked_block = if self.config().inherited.enabled {
+        let hot_action = if self.config().inherited.enabled {
+            self.hot_function_action(fn_ident)
+        } else { None };
+        let checked_block = if self.config().inherited.enabled &&
+                               hot_action != Some(xcfg::profile::HotAction::Disable) {
+            // Functions that the profile says are hot only get the entry cross-check
+            let entry_only = hot_action == Some(xcfg::profile::HotAction::EntryOnly);
             // Add the cross-check to the beginning of the function
             // TODO: only add the checks to C abi functions???
             let ref cfg = self.config();
             let entry_xcheck = cfg.inherited.entry
                 .build_ident_xcheck(self.cx, "FUNCTION_ENTRY_TAG", fn_ident);
-            let exit_xcheck = cfg.inherited.exit
-                .build_ident_xcheck(self.cx, "FUNCTION_EXIT_TAG", fn_ident);
+            let exit_xcheck = if entry_only { None } else {
+                cfg.inherited.exit
+                    .build_ident_xcheck(self.cx, "FUNCTION_EXIT_TAG", fn_ident)
+            };
             // Insert cross-checks for function arguments
-            let arg_xchecks = fn_decl.inputs.iter()
-                .flat_map(|ref arg| self.build_arg_xcheck(arg))
-                .collect::<Vec<ast::Stmt>>();
-            let result_xcheck = cfg.inherited.ret
+            let arg_xchecks = if entry_only { vec![] } else {
+                fn_decl.inputs.iter()
+                    .flat_map(|ref arg| self.build_arg_xcheck(arg))
+                    .collect::<Vec<_>>()
+            };
+            let result_xcheck = if entry_only { None } else { cfg.inherited.ret
                 .build_xcheck(self.cx, "FUNCTION_RETURN_TAG", "val_ref",
                               |tag, pre_hash_stmts| {
                 // By default, we use cross_check_hash
                 // to hash the value of the identifier
-                let (ahasher, shasher) = self.get_hasher_pair();
+                let hash_call = self.build_hash_call(cfg.inherited.hash_depth);
                 quote_expr!(self.cx, {
                     use cross_check_runtime::hash::CrossCheckHash as XCH;
                     let val_ref = &__c2rust_fn_result;
                     $pre_hash_stmts
-                    let hash = XCH::cross_check_hash::<$ahasher, $shasher>(val_ref);
+                    let hash = $hash_call;
                     hash.map(|hash| ($tag, hash))
                 })
-            });
+            }) };
 
             let ref fcfg = cfg.function_config();
-            let entry_extra_xchecks = self.build_extra_xchecks(&fcfg.entry_extra);
-            let exit_extra_xchecks = self.build_extra_xchecks(&fcfg.exit_extra);
+            let (entry_extra_xchecks, exit_extra_xchecks) = if entry_only {
+                (vec![], vec![])
+            } else {
+                (self.build_extra_xchecks(&fcfg.entry_extra),
+                 self.build_extra_xchecks(&fcfg.exit_extra))
+            };
             // Extract the result type from the function signature,
             // so we can attach it to the __c2rust_fn_body closure
             let result_ty = match fn_decl.output {
                 ast::FunctionRetTy::Default(_) => quote_ty!(self.cx, ()),
                 ast::FunctionRetTy::Ty(ref ty) => ty.clone(),
             };
-            quote_block!(self.cx, {
-                $entry_xcheck
-                $arg_xchecks
-                $entry_extra_xchecks
-                let mut __c2rust_fn_body = || -> $result_ty { $block };
-                let __c2rust_fn_result = __c2rust_fn_body();
-                $exit_xcheck
-                $result_xcheck
-                $exit_extra_xchecks
-                __c2rust_fn_result
-            })
+            // Pass all the checks on each side of the call
+            // to the runtime together, as a single batch
+            let entry_xchecks = entry_xcheck.into_iter()
+                .chain(arg_xchecks.into_iter())
+                .chain(entry_extra_xchecks.into_iter())
+                .collect::<Vec<_>>();
+            let exit_xchecks = exit_xcheck.into_iter()
+                .chain(result_xcheck.into_iter())
+                .chain(exit_extra_xchecks.into_iter())
+                .collect::<Vec<_>>();
+            let entry_batch = xcheck_util::build_xcheck_batch(self.cx, entry_xchecks);
+            let exit_batch = xcheck_util::build_xcheck_batch(self.cx, exit_xchecks);
+            match cfg.inherited.sample_period {
+                Some(period) if period != 1 => {
+                    // Only check the calls picked by the runtime, using
+                    // a call counter private to this function
+                    quote_block!(self.cx, {
+                        let __c2rust_xcheck_sampled = {
+                            use std::sync::atomic::{AtomicUsize, ATOMIC_USIZE_INIT};
+                            use cross_check_runtime::xcheck::sample_xcheck;
+                            static __C2RUST_XCHECK_CALLS: AtomicUsize = ATOMIC_USIZE_INIT;
+                            sample_xcheck(&__C2RUST_XCHECK_CALLS, $period)
+                        };
+                        if __c2rust_xcheck_sampled { $entry_batch }
+                        let mut __c2rust_fn_body = || -> $result_ty { $block };
+                        let __c2rust_fn_result = __c2rust_fn_body();
+                        if __c2rust_xcheck_sampled { $exit_batch }
+                        __c2rust_fn_result
+                    })
+                }
+                _ => quote_block!(self.cx, {
+                    $entry_batch
+                    let mut __c2rust_fn_body = || -> $result_ty { $block };
+                    let __c2rust_fn_result = __c2rust_fn_body();
+                    $exit_batch
+                    __c2rust_fn_result
+                })
+            }
         } else {
             block
         };
@@ -397,7 +477,8 @@ impl<'a, 'cx, 'exp> CrossChecker<'a, 'cx, 'exp> {
         let (ahasher, shasher) = self.get_hasher_pair();
         Some(quote_item!(self.cx,
             #[no_mangle]
-            pub unsafe extern "C" fn $hash_fn(x: *mut $ty_ident, depth: usize) -> u64 {
+            pub unsafe extern "C" fn $hash_fn(x: *mut $ty_ident, depth: usize,
+                                              _visited: *mut ::std::os::raw::c_void) -> u64 {
                 use ::cross_check_runtime::hash::CrossCheckHash;
                 CrossCheckHash::cross_check_hash_depth::<$ahasher, $shasher>(&*x, depth)
             }
@@ -692,9 +773,13 @@ impl<'a, 'cx, 'exp> Folder for CrossChecker<'a, 'cx, 'exp> {
                                       HS: ::cross_check_runtime::hash::CrossCheckHasher {
                             extern {
                                 #[no_mangle]
-                                fn $hash_fn(_: *const $ty_name, _: usize) -> u64;
+                                fn $hash_fn(_: *const $ty_name, _: usize,
+                                            _: *mut ::std::os::raw::c_void) -> u64;
                             }
-                            unsafe { $hash_fn(self as *const $ty_name, depth) }
+                            // The C hash functions have their own table
+                            // of visited objects, which we do not share
+                            unsafe { $hash_fn(self as *const $ty_name, depth,
+                                              ::std::ptr::null_mut()) }
                         }
                     }
                 ).expect(&format!("unable to implement CrossCheckHash for foreign type '{}'", ty_name));
@@ -709,11 +794,40 @@ impl<'a, 'cx, 'exp> Folder for CrossChecker<'a, 'cx, 'exp> {
     }
 }
 
+// Downgrades the cross-checks on the functions that the profile
+// says are called more often than the threshold
+struct HotFunctions {
+    profile: xcfg::profile::CallProfile,
+    threshold: u64,
+    action: xcfg::profile::HotAction,
+    report_file: Option<PathBuf>,
+}
+
+impl HotFunctions {
+    fn check_function(&self, file_name: &str, fn_name: &str,
+                      entry_value: Option<u64>) -> Option<xcfg::profile::HotAction> {
+        let calls = self.profile.lookup(fn_name, entry_value)?;
+        if calls <= self.threshold {
+            return None;
+        }
+        if let Some(ref report_file) = self.report_file {
+            let mut report = OpenOptions::new().create(true).append(true)
+                .open(report_file)
+                .expect(&format!("could not open downgrade report: {:?}", report_file));
+            writeln!(report, "{}:{}: {} calls, cross-checks {}",
+                     file_name, fn_name, calls, self.action.name())
+                .expect(&format!("could not write downgrade report: {:?}", report_file));
+        }
+        Some(self.action)
+    }
+}
+
 #[derive(Default)]
 struct CrossCheckExpander {
     // Arguments passed to plugin
     // TODO: pre-parse them???
     external_config: xcfg::Config,
+    hot_functions: Option<HotFunctions>,
     macro_scopes: RefCell<HashMap<Span, Rc<config::InheritedCheckConfig>>>,
 
     // List of already emitted C ABI hash functions,
@@ -726,6 +840,7 @@ impl CrossCheckExpander {
     fn new(args: &[ast::NestedMetaItem]) -> CrossCheckExpander {
         CrossCheckExpander {
             external_config: CrossCheckExpander::parse_config_files(args),
+            hot_functions: CrossCheckExpander::parse_profile_args(args),
             macro_scopes: Default::default(),
             ..Default::default()
         }
@@ -734,6 +849,7 @@ impl CrossCheckExpander {
     fn parse_config_files(args: &[ast::NestedMetaItem]) -> xcfg::Config {
         // Parse arguments of the form
         // #[plugin(cross_check_plugin(config_file = "..."))]
+        // where each file is either YAML or a binary index
         let fl = RealFileLoader;
         args.iter()
             .filter(|nmi| nmi.check_name("config_file"))
@@ -741,14 +857,47 @@ impl CrossCheckExpander {
             .map(|fsym| PathBuf::from(&*fsym.as_str()))
             .map(|fp| fl.abs_path(&fp)
                         .expect(&format!("invalid path to config file: {:?}", fp)))
-            .map(|fp| fl.read_file(&fp)
+            .map(|fp| fs::read(&fp)
                         .expect(&format!("could not read config file: {:?}", fp)))
             // TODO: use a Reader to read&parse each configuration file
             // without storing its contents in an intermediate String buffer???
-            .map(|fd| xcfg::parse_string(&fd).expect("could not parse config file"))
+            .map(|fd| xcfg::parse_bytes(&fd).expect("could not parse config file"))
             .fold(Default::default(), |acc, fc| acc.merge(fc))
     }
 
+    fn parse_profile_args(args: &[ast::NestedMetaItem]) -> Option<HotFunctions> {
+        // Parse arguments of the form
+        // #[plugin(cross_check_plugin(profile_file = "...",
+        //                             hot_call_threshold = "...",
+        //                             hot_xchecks = "entry-only",
+        //                             downgrade_report = "..."))]
+        let arg_str = |name: &str| args.iter()
+            .filter(|nmi| nmi.check_name(name))
+            .map(|mi| mi.value_str().expect(&format!("invalid string for {}", name)))
+            .last();
+        let profile_file = arg_str("profile_file")?;
+        let fl = RealFileLoader;
+        let fp = PathBuf::from(&*profile_file.as_str());
+        let fp = fl.abs_path(&fp)
+            .expect(&format!("invalid path to profile: {:?}", fp));
+        let fd = fl.read_file(&fp)
+            .expect(&format!("could not read profile: {:?}", fp));
+        let profile = xcfg::profile::parse_string(&fd)
+            .expect("could not parse profile");
+
+        let threshold = arg_str("hot_call_threshold")
+            .map(|t| t.as_str().parse().expect("invalid value for hot_call_threshold"))
+            .unwrap_or(xcfg::profile::DEFAULT_HOT_CALL_THRESHOLD);
+        let action = arg_str("hot_xchecks")
+            .map(|a| xcfg::profile::HotAction::parse(&*a.as_str())
+                         .expect("invalid value for hot_xchecks, \
+                                  expected \"entry-only\" or \"disabled\""))
+            .unwrap_or(xcfg::profile::HotAction::EntryOnly);
+        let report_file = arg_str("downgrade_report")
+            .map(|r| PathBuf::from(&*r.as_str()));
+        Some(HotFunctions { profile, threshold, action, report_file })
+    }
+
     fn insert_macro_scope(&self, sp: Span, config: &config::ScopeCheckConfig) {
         self.macro_scopes.borrow_mut().insert(sp, Rc::clone(&config.inherited));
     }
@@ -1,7 +1,9 @@
 
 use syntax::ast;
 
+use syntax::codemap::DUMMY_SP;
 use syntax::ext::base::ExtCtxt;
+use syntax::ext::build::AstBuilder;
 use syntax::ext::quote::rt::{ExtParseUtils};
 use syntax::ptr::P;
 
@@ -10,18 +12,21 @@ use std::convert::TryInto;
 use xcfg;
 use xcfg::attr::{ArgValue, ArgList};
 
-fn djb2_hash(s: &str) -> u32 {
+pub fn djb2_hash(s: &str) -> u32 {
     s.bytes().fold(5381u32, |h, c| h.wrapping_mul(33).wrapping_add(c as u32))
 }
 
+// Cross-checks are built as expressions of type `Option<(u8, u64)>`,
+// and all the checks performed at the same point in a function
+// are passed to the runtime together by `build_xcheck_batch`
 pub trait CrossCheckBuilder {
-    fn build_ident_xcheck(&self, cx: &ExtCtxt, tag_str: &str, ident: &ast::Ident) -> Option<ast::Stmt>;
-    fn build_xcheck<F>(&self, cx: &ExtCtxt, tag_str: &str, val_ref_str: &str, f: F) -> Option<ast::Stmt>
+    fn build_ident_xcheck(&self, cx: &ExtCtxt, tag_str: &str, ident: &ast::Ident) -> Option<P<ast::Expr>>;
+    fn build_xcheck<F>(&self, cx: &ExtCtxt, tag_str: &str, val_ref_str: &str, f: F) -> Option<P<ast::Expr>>
         where F: FnOnce(ast::Ident, Vec<ast::Stmt>) -> P<ast::Expr>;
 }
 
 impl CrossCheckBuilder for xcfg::XCheckType {
-    fn build_ident_xcheck(&self, cx: &ExtCtxt, tag_str: &str, ident: &ast::Ident) -> Option<ast::Stmt> {
+    fn build_ident_xcheck(&self, cx: &ExtCtxt, tag_str: &str, ident: &ast::Ident) -> Option<P<ast::Expr>> {
         self.build_xcheck(cx, tag_str, &"$INVALID$", |tag, pre_hash_stmts| {
             assert!(pre_hash_stmts.is_empty());
             let id = djb2_hash(&*ident.name.as_str()) as u64;
@@ -33,7 +38,7 @@ impl CrossCheckBuilder for xcfg::XCheckType {
     // #[cross_check(name = "foo")]
     // #[cross_check(id = 0x12345678)]
     fn build_xcheck<F>(&self, cx: &ExtCtxt, tag_str: &str,
-                       val_ref_str: &str, f: F) -> Option<ast::Stmt>
+                       val_ref_str: &str, f: F) -> Option<P<ast::Expr>>
             where F: FnOnce(ast::Ident, Vec<ast::Stmt>) -> P<ast::Expr> {
         let tag = ast::Ident::from_str(tag_str);
         let check = match *self {
@@ -49,7 +54,7 @@ impl CrossCheckBuilder for xcfg::XCheckType {
             },
 
             xcfg::XCheckType::None |
-            xcfg::XCheckType::Disabled => quote_expr!(cx, None),
+            xcfg::XCheckType::Disabled => return None,
             xcfg::XCheckType::Fixed(id) => quote_expr!(cx, Some(($tag, $id))),
             xcfg::XCheckType::Djb2(ref s) => {
                 let id = djb2_hash(s) as u64;
@@ -61,11 +66,20 @@ impl CrossCheckBuilder for xcfg::XCheckType {
                 quote_expr!(cx, Some(($tag, $custom_expr)))
             },
         };
-        quote_stmt!(cx, {
+        Some(quote_expr!(cx, {
             use cross_check_runtime::xcheck::$tag;
-            cross_check_iter!($check.into_iter())
-        })
+            $check
+        }))
+    }
+}
+
+// Pass a group of cross-checks to the runtime in a single call
+pub fn build_xcheck_batch(cx: &ExtCtxt, checks: Vec<P<ast::Expr>>) -> Option<ast::Stmt> {
+    if checks.is_empty() {
+        return None;
     }
+    let checks = cx.expr_vec(DUMMY_SP, checks);
+    quote_stmt!(cx, cross_check_iter!($checks.iter().filter_map(|xc| *xc)))
 }
 
 fn parse_xcheck_type(name: &'static str, arg: &ArgValue) -> xcfg::XCheckType {
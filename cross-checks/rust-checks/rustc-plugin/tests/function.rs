@@ -6,7 +6,7 @@
 extern crate cross_check_runtime;
 
 mod xcheck;
-pub use xcheck::rb_xcheck; // Export rb_xcheck for the runtime
+pub use xcheck::{rb_xcheck, rb_xcheck_batch}; // Export both for the runtime
 
 use xcheck::{expect_xcheck, expect_no_xchecks};
 use cross_check_runtime::xcheck::{FUNCTION_ENTRY_TAG, FUNCTION_ARG_TAG, FUNCTION_EXIT_TAG};
@@ -76,6 +76,38 @@ fn test_exit_disabled() {
     expect_no_xchecks();
 }
 
+#[test]
+fn test_sample_period() {
+    #[cross_check(yes, sample_period=2)]
+    fn abcd() { }
+
+    // Only the first and third calls get checked
+    for _ in 0..3 {
+        abcd();
+    }
+    expect_xcheck(FUNCTION_ENTRY_TAG, 0x7c93ee4f_u64);
+    expect_xcheck(FUNCTION_EXIT_TAG,  0x7c93ee4f_u64);
+    expect_xcheck(FUNCTION_ENTRY_TAG, 0x7c93ee4f_u64);
+    expect_xcheck(FUNCTION_EXIT_TAG,  0x7c93ee4f_u64);
+    expect_no_xchecks();
+}
+
+#[test]
+fn test_hash_depth() {
+    #[cross_check(yes, all_args, hash_depth=0, arg_hash_depths(_b=1))]
+    fn abcd(_a: *const u64, _b: *const u64) { }
+
+    // At depth 0, `_a` is just a non-NULL pointer,
+    // while `_b` gets hashed one level deeper
+    let x = 1u64;
+    abcd(&x, &x);
+    expect_xcheck(FUNCTION_ENTRY_TAG, 0x7c93ee4f_u64);
+    expect_xcheck(FUNCTION_ARG_TAG, 0x72617453_6661654c_u64);
+    expect_xcheck(FUNCTION_ARG_TAG, 0x0f0f0f0f_0f0f0f0f_u64);
+    expect_xcheck(FUNCTION_EXIT_TAG,  0x7c93ee4f_u64);
+    expect_no_xchecks();
+}
+
 #[test]
 fn test_all_args_default() {
     #[cross_check(yes, all_args)]
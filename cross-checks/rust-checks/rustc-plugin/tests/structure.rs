@@ -9,7 +9,7 @@ extern crate cross_check_derive;
 extern crate cross_check_runtime;
 
 mod xcheck;
-pub use xcheck::rb_xcheck; // Export rb_xcheck for the runtime
+pub use xcheck::{rb_xcheck, rb_xcheck_batch}; // Export both for the runtime
 
 use xcheck::{expect_xcheck, expect_no_xchecks};
 
@@ -13,6 +13,13 @@ pub extern fn rb_xcheck(tag: u8, val: u64) {
     XCHECKS.with(|xc| xc.borrow_mut().push_back(XCheck(tag, val)));
 }
 
+#[no_mangle]
+pub unsafe extern fn rb_xcheck_batch(tags: *const u8, vals: *const u64, len: usize) {
+    for i in 0..len {
+        rb_xcheck(*tags.offset(i as isize), *vals.offset(i as isize));
+    }
+}
+
 pub fn expect_xcheck(tag: u8, val: u64) {
     let xc = XCHECKS.with(|xc| xc.borrow_mut().pop_front().unwrap());
     assert_eq!(xc, XCheck(tag, val));
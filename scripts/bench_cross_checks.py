@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""
+Compile-time benchmark for the clang cross-check plugin.
+
+Generates a header-heavy translation unit, with many annotated structures and
+inline functions that share a handful of CROSS_CHECK annotations, and compiles
+it with and without the plugin, reporting the time the plugin adds.
+"""
+
+import os
+import time
+import logging
+import argparse
+import tempfile
+import statistics
+
+from common import (
+    config as c,
+    pb,
+    die,
+    setup_logging,
+)
+
+# The few distinct annotations that the generated declarations share,
+# like the CROSS_CHECK macros of a real project would
+FUNCTION_ANNOTATIONS = [
+    'CROSS_CHECK("{ entry: default, all_args: default }")',
+    'CROSS_CHECK("{ exit: disabled, return: default }")',
+    'CROSS_CHECK("{ entry: { djb2: \\"shared_entry\\" } }")',
+]
+PARAM_ANNOTATIONS = ["DEFAULT_XCHECK", "DISABLED_XCHECK", 'FIXED_XCHECK("42")']
+STRUCT_ANNOTATIONS = [
+    'CROSS_CHECK("{ disable_xchecks: false }")',
+    'CROSS_CHECK("{ fields: { b: disabled } }")',
+]
+
+
+def generate_header(num_decls: int) -> str:
+    lines = ["#pragma once", "#include <cross_checks.h>", ""]
+    for i in range(num_decls):
+        struct_ann = STRUCT_ANNOTATIONS[i % len(STRUCT_ANNOTATIONS)]
+        field_ann = PARAM_ANNOTATIONS[i % len(PARAM_ANNOTATIONS)]
+        lines.append("struct s{i} {{ int a {fa}; long b; }} {sa};".format(
+            i=i, fa=field_ann, sa=struct_ann))
+
+        # Annotate the prototype, and let the definition inherit
+        # the annotations, like for functions declared in headers
+        func_ann = FUNCTION_ANNOTATIONS[i % len(FUNCTION_ANNOTATIONS)]
+        param_ann = PARAM_ANNOTATIONS[(i + 1) % len(PARAM_ANNOTATIONS)]
+        lines.append("static inline int f{i}(int x {pa}, struct s{i} *s) {fa};"
+                     .format(i=i, pa=param_ann, fa=func_ann))
+        lines.append("static inline int f{i}(int x, struct s{i} *s) "
+                     "{{ return x + s->a; }}".format(i=i))
+    return "\n".join(lines) + "\n"
+
+
+def generate_source(num_decls: int) -> str:
+    lines = ['#include "bench.h"', "", "int main(void) {", "    int r = 0;"]
+    for i in range(num_decls):
+        lines.append("    {{ struct s{i} s = {{ {i}, 0 }}; r += f{i}(r, &s); }}"
+                     .format(i=i))
+    lines += ["    return r & 1;", "}"]
+    return "\n".join(lines) + "\n"
+
+
+def time_compile(cmd, args, repeat: int) -> list:
+    times = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        cmd(*args)
+        times.append(time.perf_counter() - start)
+    return times
+
+
+def main():
+    setup_logging()
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--decls", type=int, default=2000,
+                        help="number of annotated structures and functions")
+    parser.add_argument("--repeat", type=int, default=5,
+                        help="number of compilations to time")
+    args = parser.parse_args()
+
+    clang_path = os.path.join(c.LLVM_BIN, "clang")
+    plugin_path = os.path.join(c.CLANG_XCHECK_PLUGIN_BLD,
+                               "plugin", "CrossChecks.so")
+    for path in [clang_path, plugin_path]:
+        if not os.path.isfile(path):
+            die("missing {}, run build_cross_checks.py first".format(path))
+    clang = pb.local[clang_path]
+    include_dir = os.path.join(c.CLANG_XCHECK_PLUGIN_SRC, "include")
+
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        with open(os.path.join(tmp_dir, "bench.h"), "w") as fh:
+            fh.write(generate_header(args.decls))
+        source = os.path.join(tmp_dir, "bench.c")
+        with open(source, "w") as fh:
+            fh.write(generate_source(args.decls))
+
+        common_args = ["-std=c11", "-O0", "-I" + include_dir,
+                       "-c", source, "-o", os.devnull]
+        plugin_args = ["-Xclang", "-load", "-Xclang", plugin_path,
+                       "-Xclang", "-add-plugin", "-Xclang", "crosschecks"]
+        # Warm up the file cache
+        clang(*common_args)
+
+        logging.info("compiling %d annotated declarations, %d times each",
+                     args.decls, args.repeat)
+        base = time_compile(clang, common_args, args.repeat)
+        xcheck = time_compile(clang, plugin_args + common_args, args.repeat)
+
+    base_med = statistics.median(base)
+    xcheck_med = statistics.median(xcheck)
+    print("{:<16} {:>12} {:>12}".format("", "median (s)", "min (s)"))
+    print("{:<16} {:>12.3f} {:>12.3f}".format("clang", base_med, min(base)))
+    print("{:<16} {:>12.3f} {:>12.3f}".format("clang+xchecks",
+                                              xcheck_med, min(xcheck)))
+    print("plugin overhead: {:.3f} s ({:.1f}%)".format(
+        xcheck_med - base_med, 100.0 * (xcheck_med - base_med) / base_med))
+
+
+if __name__ == "__main__":
+    main()
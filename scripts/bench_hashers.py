@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""
+Run-time benchmark for the cross-check aggregate hashers.
+
+Generates a program that cross-checks many calls taking large structures
+(nested records and arrays), builds it with the clang cross-check plugin
+once per hasher selected with --ahasher, and reports how long each
+build takes to run.
+"""
+
+import os
+import time
+import logging
+import argparse
+import tempfile
+import statistics
+
+from common import (
+    config as c,
+    pb,
+    die,
+    setup_logging,
+)
+
+HASHERS = ["jodyhash", "xxh64"]
+
+
+def generate_source(num_structs: int, array_len: int, calls: int) -> str:
+    lines = ["#include <cross_checks.h>", ""]
+    for i in range(num_structs):
+        inner = "struct s{}".format(i - 1) if i > 0 else "long"
+        lines.append("struct s{i} {{ int a; double d; {inner} prev; "
+                     "int vals[{n}]; char name[{n}]; }};"
+                     .format(i=i, inner=inner, n=array_len))
+    last = num_structs - 1
+    lines += [
+        "",
+        "int use(struct s{l} *s DEFAULT_XCHECK, int i) {{".format(l=last),
+        "    return s->a + s->vals[i % {n}];".format(n=array_len),
+        "}",
+        "",
+        "static struct s{l} obj;".format(l=last),
+        "",
+        "int main(void) {",
+        "    int r = 0;",
+        "    for (int i = 0; i < {}; i++) {{".format(calls),
+        "        obj.a = i;",
+        "        r += use(&obj, i);",
+        "    }",
+        "    return r & 1;",
+        "}",
+    ]
+    return "\n".join(lines) + "\n"
+
+
+def time_runs(cmd, repeat: int) -> list:
+    times = []
+    for _ in range(repeat):
+        start = time.perf_counter()
+        cmd()
+        times.append(time.perf_counter() - start)
+    return times
+
+
+def main():
+    setup_logging()
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--structs", type=int, default=8,
+                        help="nesting depth of the hashed structure")
+    parser.add_argument("--array-len", type=int, default=64,
+                        help="length of the arrays in each structure")
+    parser.add_argument("--calls", type=int, default=200000,
+                        help="number of cross-checked calls")
+    parser.add_argument("--repeat", type=int, default=5,
+                        help="number of runs to time")
+    args = parser.parse_args()
+
+    clang_path = os.path.join(c.LLVM_BIN, "clang")
+    plugin_path = os.path.join(c.CLANG_XCHECK_PLUGIN_BLD,
+                               "plugin", "CrossChecks.so")
+    runtime_path = os.path.join(c.CLANG_XCHECK_PLUGIN_BLD,
+                                "runtime", "libruntime.a")
+    fakechecks_path = os.path.join(c.LIBFAKECHECKS_DIR, "libfakechecks.so")
+    for path in [clang_path, plugin_path, runtime_path, fakechecks_path]:
+        if not os.path.isfile(path):
+            die("missing {}, run build_cross_checks.py first".format(path))
+    clang = pb.local[clang_path]
+    include_dir = os.path.join(c.CLANG_XCHECK_PLUGIN_SRC, "include")
+
+    results = {}
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        source = os.path.join(tmp_dir, "bench.c")
+        with open(source, "w") as fh:
+            fh.write(generate_source(args.structs, args.array_len,
+                                     args.calls))
+
+        for hasher in HASHERS:
+            binary = os.path.join(tmp_dir, "bench-" + hasher)
+            clang("-std=c11", "-O2", "-I" + include_dir,
+                  "-Xclang", "-load", "-Xclang", plugin_path,
+                  "-Xclang", "-add-plugin", "-Xclang", "crosschecks",
+                  "-Xclang", "-plugin-arg-crosschecks",
+                  "-Xclang", "--ahasher=" + hasher,
+                  "-o", binary, source, runtime_path,
+                  "-L" + c.LIBFAKECHECKS_DIR, "-lfakechecks",
+                  "-Wl,--rpath," + c.LIBFAKECHECKS_DIR)
+
+            # Only count the cross-checks, so printing them
+            # doesn't drown out the hashing time
+            stats_file = os.path.join(tmp_dir, "stats-" + hasher)
+            cmd = pb.local[binary].with_env(FAKECHECKS_STATS_FILE=stats_file)
+            # Warm up
+            cmd(retcode=None)
+
+            logging.info("running %d cross-checked calls with %s, %d times",
+                         args.calls, hasher, args.repeat)
+            results[hasher] = time_runs(lambda: cmd(retcode=None),
+                                        args.repeat)
+
+    base_med = statistics.median(results[HASHERS[0]])
+    print("{:<16} {:>12} {:>12} {:>10}".format(
+        "", "median (s)", "min (s)", "speedup"))
+    for hasher in HASHERS:
+        med = statistics.median(results[hasher])
+        print("{:<16} {:>12.3f} {:>12.3f} {:>9.2f}x".format(
+            hasher, med, min(results[hasher]), base_med / med))
+
+
+if __name__ == "__main__":
+    main()
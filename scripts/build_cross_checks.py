@@ -73,6 +73,22 @@ def build_clang_plugin(args: str) -> None:
         invoke(ninja)
 
 
+def build_xcfg_index() -> None:
+    """
+    build the xcfg-index tool into the clang plugin build directory, where
+    the plugin's lit tests look for it; it is always built in release mode,
+    since the tests only run it.
+    """
+    cargo = get_cmd_or_die("cargo")
+    config_dir = os.path.join(c.CROSS_CHECKS_DIR, "rust-checks", "config")
+    target_dir = os.path.join(c.CLANG_XCHECK_PLUGIN_BLD, "xcfg-index")
+    with pb.local.cwd(config_dir):
+        with pb.local.env(CARGO_TARGET_DIR=target_dir):
+            # build with custom rust toolchain
+            invoke(cargo, "+" + c.CUSTOM_RUST_NAME,
+                   "build", "--release", "--bin", "xcfg-index")
+
+
 def _parse_args():
     """
     define and parse command line arguments here.
@@ -119,6 +135,7 @@ def _main():
     git_ignore_dir(c.DEPS_DIR)
 
     build_clang_plugin(args)
+    build_xcfg_index()
 
 
 if __name__ == "__main__":
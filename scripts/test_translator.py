@@ -1,10 +1,12 @@
 #!/usr/bin/env python3
 
 import errno
+import json
 import os
 import sys
 import logging
 import argparse
+import difflib
 import re
 
 from common import (
@@ -44,6 +46,14 @@ intermediate_files = [
     'cc_db', 'cbor', 'c_obj', 'c_lib', 'rust_src', 'rust_test_exec',
 ]
 
+# Extra ast-importer arguments for the rerun of the suite that
+# `--dominator-relooper` asks for. It sends every relooped CFG through the
+# dominator relooper, which the small CFGs in the tests would otherwise never
+# reach, and fails the translation when it has to fall back.
+dominator_relooper_args = [
+    "--large-cfg-threshold", "0", "--fail-on-dominator-fallback",
+]
+
 
 class TestOutcome(Enum):
     Success = "successes"
@@ -52,6 +62,35 @@ class TestOutcome(Enum):
     UnexpectedSuccess = "unexpected successes"
 
 
+class ImportBudget:
+    """
+    Upper bounds on the wall time and peak RSS of each import, checked against
+    the trace written by `ast-importer --time-passes-trace`.
+    """
+
+    def __init__(self, max_ms: Optional[float],
+                 max_rss_kb: Optional[int]) -> None:
+        self.max_ms = max_ms
+        self.max_rss_kb = max_rss_kb
+
+    def check(self, trace_path: str) -> Optional[str]:
+        with open(trace_path) as trace_file:
+            totals = json.load(trace_file)["otherData"]
+
+        total_ms = totals["total_us"] / 1000
+        if self.max_ms is not None and total_ms > self.max_ms:
+            return "import took {:.1f} ms, over the budget of {} ms\n".format(
+                total_ms, self.max_ms)
+
+        peak_rss_kb = totals.get("peak_rss_kb")
+        if (self.max_rss_kb is not None and peak_rss_kb is not None and
+                peak_rss_kb > self.max_rss_kb):
+            return "import peaked at {} kB RSS, over the budget of {} kB\n".format(
+                peak_rss_kb, self.max_rss_kb)
+
+        return None
+
+
 class CborFile:
     def __init__(self, path: str, enable_relooper: bool = False,
                  disallow_current_block: bool = False) -> None:
@@ -59,10 +98,16 @@ class CborFile:
         self.enable_relooper = enable_relooper
         self.disallow_current_block = disallow_current_block
 
-    def translate(self) -> RustFile:
+    def translate(self, budget: Optional[ImportBudget] = None,
+                  extra_args: Optional[List[str]] = None,
+                  rust_src: Optional[str] = None) -> RustFile:
+        if not extra_args:
+            extra_args = []
+
         c_file_path, _ = os.path.splitext(self.path)
         extensionless_file, _ = os.path.splitext(c_file_path)
-        rust_src = extensionless_file + ".rs"
+        rust_src = rust_src or extensionless_file + ".rs"
+        trace_file = extensionless_file + ".trace.json"
 
         # help plumbum find rust
         ld_lib_path = get_rust_toolchain_libpath(c.CUSTOM_RUST_NAME)
@@ -84,6 +129,9 @@ class CborFile:
             #  args.append("--use-c-multiple-info")
         if self.disallow_current_block:
             args.append("--fail-on-multiple")
+        if budget:
+            args.extend(["--time-passes-trace", trace_file])
+        args.extend(extra_args)
 
         with pb.local.env(RUST_BACKTRACE='1', LD_LIBRARY_PATH=ld_lib_path):
             # log the command in a format that's easy to re-run
@@ -98,7 +146,13 @@ class CborFile:
         if retcode != 0:
             raise NonZeroReturn(stderr)
 
-        return RustFile(extensionless_file + ".rs")
+        if budget:
+            over_budget = budget.check(trace_file)
+            os.remove(trace_file)
+            if over_budget:
+                raise NonZeroReturn(over_budget)
+
+        return RustFile(rust_src)
 
 
 class CStaticLibrary:
@@ -117,12 +171,16 @@ class CFile:
         self.path = path
         self.enable_relooper = "enable_relooper" in flags
         self.disallow_current_block = "disallow_current_block" in flags
+        self.compare_canonical_types = "compare_canonical_types" in flags
+
+    def export(self, extra_args: Optional[List[str]] = None) -> CborFile:
+        if not extra_args:
+            extra_args = []
 
-    def export(self) -> CborFile:
         ast_exporter = get_cmd_or_die(c.AST_EXPO)
 
         # run the exporter
-        args = [self.path]
+        args = extra_args + [self.path]
 
         # NOTE: it doesn't seem necessary to specify system include
         # directories and in fact it may cause problems on macOS.
@@ -142,6 +200,31 @@ class CFile:
         return CborFile(self.path + ".cbor", self.enable_relooper,
                         self.disallow_current_block)
 
+    def check_canonical_types(self) -> None:
+        """
+        Check that exporting with -canonical-types doesn't change the
+        translation. Leaves no files behind.
+        """
+        extensionless_file, _ = os.path.splitext(self.path)
+        outputs = []
+        for extra_args in [[], ["-canonical-types"]]:
+            cbor_file = self.export(extra_args)
+            rust_src = "{}.{}.rs".format(extensionless_file, len(outputs))
+            try:
+                cbor_file.translate(rust_src=rust_src)
+                with open(rust_src, 'r') as rust_file:
+                    outputs.append(rust_file.readlines())
+            finally:
+                os.remove(cbor_file.path)
+                if os.path.isfile(rust_src):
+                    os.remove(rust_src)
+
+        if outputs[0] != outputs[1]:
+            diff_lines = difflib.unified_diff(
+                outputs[0], outputs[1], "without -canonical-types",
+                "with -canonical-types")
+            raise NonZeroReturn("".join(diff_lines))
+
 
 def build_static_library(c_files: Iterable[CFile],
                          output_path: str) -> Optional[CStaticLibrary]:
@@ -205,13 +288,20 @@ class TestFile(RustFile):
 
 
 class TestDirectory:
-    def __init__(self, full_path: str, files: str, keep: List[str]) -> None:
+    def __init__(self, full_path: str, files: str, keep: List[str],
+                 budget: Optional[ImportBudget] = None,
+                 importer_args: Optional[List[str]] = None) -> None:
+        if not importer_args:
+            importer_args = []
+
         self.c_files = []
         self.rs_test_files = []
         self.full_path = full_path
         self.files = files
         self.name = full_path.split('/')[-1]
         self.keep = keep
+        self.budget = budget
+        self.importer_args = importer_args
         self.generated_files = {
             "rust_src": [],
             "cbor": [],
@@ -364,6 +454,19 @@ class TestDirectory:
 
             self._generate_cc_db(c_file.path)
 
+            if c_file.compare_canonical_types:
+                try:
+                    c_file.check_canonical_types()
+                except NonZeroReturn as exception:
+                    self.print_status(Colors.FAIL, "FAILED",
+                                      "compare canonical types for " +
+                                      c_file_short)
+                    sys.stdout.write('\n')
+                    sys.stdout.write(str(exception))
+
+                    outcomes.append(TestOutcome.UnexpectedFailure)
+                    continue
+
             try:
                 cbor_file = c_file.export()
             except NonZeroReturn as exception:
@@ -388,7 +491,8 @@ class TestDirectory:
             self.print_status(Colors.WARNING, "RUNNING", description)
 
             try:
-                translated_rust_file = cbor_file.translate()
+                translated_rust_file = cbor_file.translate(self.budget,
+                                                         self.importer_args)
             except NonZeroReturn as exception:
                 self.print_status(Colors.FAIL, "FAILED", "translate " +
                                   cbor_file_short)
@@ -555,13 +659,14 @@ def readable_directory(directory: str) -> str:
 
 
 def get_testdirectories(
-        directory: str, files: str,
-        keep: List[str]) -> Generator[TestDirectory, None, None]:
+        directory: str, files: str, keep: List[str],
+        budget: Optional[ImportBudget],
+        importer_args: List[str]) -> Generator[TestDirectory, None, None]:
     for entry in os.listdir(directory):
         path = os.path.abspath(os.path.join(directory, entry))
 
         if os.path.isdir(path):
-            yield TestDirectory(path, files, keep)
+            yield TestDirectory(path, files, keep, budget, importer_args)
 
 
 def main() -> None:
@@ -586,12 +691,30 @@ def main() -> None:
         choices=intermediate_files + ['all'], default=[],
         help="Which intermediate files to not clear"
     )
+    parser.add_argument(
+        '--import-time-budget', dest='import_time_budget', type=float,
+        default=None, help="Fail translations whose import takes longer "
+        "than this many milliseconds"
+    )
+    parser.add_argument(
+        '--import-rss-budget', dest='import_rss_budget', type=int,
+        default=None, help="Fail translations whose import peaks above this "
+        "many kilobytes of resident memory"
+    )
+    parser.add_argument(
+        '--dominator-relooper', dest='dominator_relooper',
+        action='store_true', default=False,
+        help="Rerun the tests with every relooped CFG sent through the "
+        "dominator relooper"
+    )
     c.add_args(parser)
 
     args = parser.parse_args()
     c.update_args(args)
-    test_directories = get_testdirectories(args.directory, args.regex_files,
-                                           args.keep)
+    budget = None
+    if (args.import_time_budget is not None or
+            args.import_rss_budget is not None):
+        budget = ImportBudget(args.import_time_budget, args.import_rss_budget)
     setup_logging(args.logLevel)
 
     logging.debug("args: %s", " ".join(sys.argv))
@@ -606,9 +729,6 @@ def main() -> None:
     ensure_dir(c.DEPS_DIR)
     ensure_rustc_version(c.CUSTOM_RUST_RUSTC_VERSION)
 
-    if not test_directories:
-        die("nothing to test")
-
     # Accumulate test case stats
     test_results = {
         "unexpected failures": 0,
@@ -617,22 +737,34 @@ def main() -> None:
         "successes": 0
     }
 
-    for test_directory in test_directories:
-        if args.regex_directories.fullmatch(test_directory.name):
-            # Testdirectories are run one after another. Only test directories
-            # that match the '--only-directories' or tests that match the
-            # '--only-files' arguments are run.  We make a best effort to clean
-            # up files we left behind.
-            try:
-                statuses = test_directory.run()
-            except (KeyboardInterrupt, SystemExit):
-                test_directory.cleanup()
-                raise
-            finally:
-                test_directory.cleanup()
-
-            for status in statuses:
-                test_results[status.value] += 1
+    importer_arg_passes = [[]]
+    if args.dominator_relooper:
+        importer_arg_passes.append(dominator_relooper_args)
+
+    for importer_args in importer_arg_passes:
+        if importer_args:
+            sys.stdout.write("\nRerunning the tests with ast-importer {}:\n"
+                             .format(" ".join(importer_args)))
+
+        test_directories = get_testdirectories(args.directory,
+                                               args.regex_files, args.keep,
+                                               budget, importer_args)
+        for test_directory in test_directories:
+            if args.regex_directories.fullmatch(test_directory.name):
+                # Testdirectories are run one after another. Only test
+                # directories that match the '--only-directories' or tests
+                # that match the '--only-files' arguments are run.  We make a
+                # best effort to clean up files we left behind.
+                try:
+                    statuses = test_directory.run()
+                except (KeyboardInterrupt, SystemExit):
+                    test_directory.cleanup()
+                    raise
+                finally:
+                    test_directory.cleanup()
+
+                for status in statuses:
+                    test_results[status.value] += 1
 
     # Print out test case stats
     sys.stdout.write("\nTest summary:\n")
@@ -245,16 +245,14 @@ def transpile_files(cc_db: TextIO,
             translation_cmd += str(
                 ast_impo[cbor_file, impo_args, extra_impo_args])
             logging.debug("translation command:\n %s", translation_cmd)
+            e = "Expected file suffix `.c.cbor`; actual: " + cbor_basename
+            assert cbor_file.endswith(".c.cbor"), e
+            rust_file = cbor_file[:-7] + ".rs"
             try:
                 retcode, stdout, stderr = ast_impo[cbor_file, impo_args,
-                                                   extra_impo_args].run()
-
-                e = "Expected file suffix `.c.cbor`; actual: " + cbor_basename
-                assert cbor_file.endswith(".c.cbor"), e
-                rust_file = cbor_file[:-7] + ".rs"
-                with open(rust_file, "w") as rust_fh:
-                    rust_fh.writelines(stdout)
-                    logging.debug("wrote output rust to %s", rust_file)
+                                                   extra_impo_args,
+                                                   '--output', rust_file].run()
+                logging.debug("wrote output rust to %s", rust_file)
 
                 return (file_basename, retcode, stdout, stderr,
                         os.path.abspath(rust_file))
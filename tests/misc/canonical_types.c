@@ -0,0 +1,32 @@
+//! compare_canonical_types
+
+// The same types spelled with different sugar, which -canonical-types
+// exports only once
+struct point {
+    int x;
+    int y;
+};
+
+typedef struct point point_t;
+
+static int (sum_coords)(struct point *(p), unsigned n) {
+    int total = 0;
+    for (unsigned i = 0; i < n; i++) {
+        __typeof__(p->x) x = p[i].x;
+        total += x + (p + i)->y;
+    }
+    return total;
+}
+
+int canonical_types(unsigned n, int buffer[]) {
+    point_t points[2] = { { 1, 2 }, { 3, 4 } };
+    struct point *first = &points[0];
+    int (*sum)(struct point *, unsigned) = sum_coords;
+    __typeof__(struct point) last __attribute__((aligned(8))) = points[1];
+
+    if (n < 2)
+        return 0;
+    buffer[0] = sum(first, 2);
+    buffer[1] = last.x * last.y;
+    return buffer[0] + buffer[1];
+}
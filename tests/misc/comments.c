@@ -0,0 +1,24 @@
+/*
+ * License header, which belongs to no declaration
+ */
+
+/** Section separator, kept with the declaration after it **/
+
+int count_up(int n) {
+    // Comment on the first statement
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        /* Comment in a nested block */
+        total += i;
+        // Trailing comment, which no statement follows
+    }
+    return total;
+    // Comment after the last statement, not moved to comment_sum
+}
+
+/// Comment documenting comment_sum
+int comment_sum(int n) {
+    return count_up(n) + 1;
+}
+
+// Comment at the end of the file
@@ -0,0 +1,17 @@
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+void hints(const unsigned n, int * const buffer) {
+    for (unsigned i = 0; i < n; i++) {
+        __builtin_prefetch(&buffer[i], 1, 0);
+        __builtin_prefetch(buffer);
+
+        if (unlikely(i % 5 == 0)) {
+            buffer[i] = -1;
+        } else if (likely(i % 2)) {
+            buffer[i] = (int)__builtin_expect(i * 3, 0);
+        } else {
+            buffer[i] = 1;
+        }
+    }
+}
@@ -0,0 +1,30 @@
+static inline int square(int x) {
+    return x * x;
+}
+
+__attribute__((always_inline)) static inline int cube(int x) {
+    return x * square(x);
+}
+
+__attribute__((noinline)) int add_one(int x) {
+    return x + 1;
+}
+
+__attribute__((cold)) int slow_path(int x) {
+    return x - 1;
+}
+
+__attribute__((hot, flatten)) int fast_path(int x) {
+    return add_one(cube(x));
+}
+
+__attribute__((const)) int twice(int x) {
+    return x + x;
+}
+
+void inline_attrs(const unsigned n, int * const buffer) {
+    for (unsigned i = 0; i < n; i++) {
+        int x = (int)i;
+        buffer[i] = i % 2 ? fast_path(x) : slow_path(twice(x));
+    }
+}
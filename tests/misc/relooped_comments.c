@@ -0,0 +1,12 @@
+//! enable_relooper
+
+/* Comment before the relooped function */
+int count_down(int n) {
+    int total = 0;
+    while (n > 0) {
+        total += n--;
+        // Trailing comment of the loop body
+    }
+    return total;
+    // Comment after the last relooped statement
+}
@@ -0,0 +1,49 @@
+#include <immintrin.h>
+
+typedef int v4si __attribute__((__vector_size__(16)));
+typedef float v4sf __attribute__((__vector_size__(16)));
+
+void simd(const unsigned n, int * const buffer) {
+    for (unsigned i = 0; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)&buffer[i]);
+        __m128i y = _mm_add_epi32(x, _mm_set1_epi32(i));
+
+        v4si reversed = __builtin_shufflevector((v4si)x, (v4si)y, 7, 2, 5, 0);
+        v4sf floats = __builtin_convertvector(reversed, v4sf);
+        v4sf halves = (v4sf)_mm_mul_ps((__m128)floats, _mm_set1_ps(0.5f));
+        v4si truncated = __builtin_convertvector(halves, v4si);
+
+        _mm_storeu_si128((__m128i *)&buffer[i], (__m128i)truncated);
+    }
+}
+
+#define SHIFT (1 << 1)
+
+// SSE4.1 isn't part of the x86_64 baseline, so its intrinsics can only be
+// called from functions that enable it. The shift counts are immediates.
+__attribute__((target("sse4.1")))
+void simd_sse41(const unsigned n, int * const buffer) {
+    for (unsigned i = 0; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)&buffer[i]);
+        __m128i y = _mm_mullo_epi32(x, _mm_set1_epi32(-3));
+        __m128i z = _mm_srai_epi32(_mm_slli_epi32(y, SHIFT + 1), SHIFT);
+        _mm_storeu_si128((__m128i *)&buffer[i], _mm_max_epi32(z, x));
+    }
+}
+
+// Not intrinsics, despite their names: _mm_malloc and _mm_free come from
+// mm_malloc.h, and _mm_sum4 is ours, so all of these get translated
+static int _mm_sum4(const int *p) {
+    return p[0] + p[1] + p[2] + p[3];
+}
+
+int simd_not_intrinsics(const unsigned n, int * const buffer) {
+    int *aligned = _mm_malloc(n * sizeof(int), 16);
+    int total = 0;
+    for (unsigned i = 0; i < n; i++)
+        aligned[i] = buffer[i];
+    for (unsigned i = 0; i + 4 <= n; i += 4)
+        total += _mm_sum4(&aligned[i]);
+    _mm_free(aligned);
+    return total;
+}
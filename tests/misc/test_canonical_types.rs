@@ -0,0 +1,26 @@
+extern crate libc;
+
+use canonical_types::rust_canonical_types;
+use self::libc::{c_int, c_uint};
+
+#[link(name = "test")]
+extern "C" {
+    #[no_mangle]
+    fn canonical_types(_: c_uint, _: *mut c_int) -> c_int;
+}
+
+const BUFFER_SIZE: usize = 2;
+
+pub fn test_canonical_types() {
+    let mut buffer = [0; BUFFER_SIZE];
+    let mut rust_buffer = [0; BUFFER_SIZE];
+    let expected_buffer = [10, 12];
+
+    let ret = unsafe { canonical_types(BUFFER_SIZE as u32, buffer.as_mut_ptr()) };
+    let rust_ret = unsafe { rust_canonical_types(BUFFER_SIZE as u32, rust_buffer.as_mut_ptr()) };
+
+    assert_eq!(buffer, rust_buffer);
+    assert_eq!(buffer, expected_buffer);
+    assert_eq!(ret, rust_ret);
+    assert_eq!(ret, 22);
+}
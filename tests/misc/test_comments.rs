@@ -0,0 +1,74 @@
+extern crate libc;
+
+use comments::rust_comment_sum;
+use relooped_comments::rust_count_down;
+
+use self::libc::c_int;
+
+#[link(name = "test")]
+extern "C" {
+    #[no_mangle]
+    fn comment_sum(_: c_int) -> c_int;
+
+    #[no_mangle]
+    fn count_down(_: c_int) -> c_int;
+}
+
+/// Check that every one of `needles` is in the translated `source`, in the given order
+fn assert_in_order(source: &str, needles: &[&str]) {
+    let positions: Vec<usize> = needles.iter()
+        .map(|needle| source.find(needle).unwrap_or_else(|| panic!("{:?} is not in the translation", needle)))
+        .collect();
+    for (i, pair) in positions.windows(2).enumerate() {
+        assert!(pair[0] < pair[1], "{:?} is translated after {:?}", needles[i], needles[i + 1]);
+    }
+}
+
+pub fn test_comment_sum() {
+    let ret = unsafe {
+        comment_sum(10)
+    };
+    let rust_ret = unsafe {
+        rust_comment_sum(10)
+    };
+
+    assert_eq!(ret, 46);
+    assert_eq!(rust_ret, 46);
+}
+
+pub fn test_count_down() {
+    let ret = unsafe {
+        count_down(10)
+    };
+    let rust_ret = unsafe {
+        rust_count_down(10)
+    };
+
+    assert_eq!(ret, 55);
+    assert_eq!(rust_ret, 55);
+}
+
+pub fn test_comment_placement() {
+    assert_in_order(include_str!("comments.rs"), &[
+        "License header",
+        "Section separator",
+        "fn rust_count_up",
+        "Comment on the first statement",
+        "Comment in a nested block",
+        "total += i",
+        "Trailing comment, which no statement follows",
+        "return total",
+        "Comment after the last statement",
+        "Comment documenting comment_sum",
+        "fn rust_comment_sum",
+        "Comment at the end of the file",
+    ]);
+
+    assert_in_order(include_str!("relooped_comments.rs"), &[
+        "Comment before the relooped function",
+        "fn rust_count_down",
+        "Trailing comment of the loop body",
+        "return total",
+        "Comment after the last relooped statement",
+    ]);
+}
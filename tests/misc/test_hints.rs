@@ -0,0 +1,27 @@
+extern crate libc;
+
+use hints::rust_hints;
+use self::libc::c_int;
+use self::libc::c_uint;
+
+#[link(name = "test")]
+extern "C" {
+    #[no_mangle]
+    fn hints(_: c_uint, _: *mut c_int);
+}
+
+const BUFFER_SIZE: usize = 12;
+
+pub fn test_hints() {
+    let mut buffer = [0; BUFFER_SIZE];
+    let mut rust_buffer = [0; BUFFER_SIZE];
+    let expected_buffer = [-1, 3, 1, 9, 1, -1, 1, 21, 1, 27, -1, 33];
+
+    unsafe {
+        hints(BUFFER_SIZE as c_uint, buffer.as_mut_ptr());
+        rust_hints(BUFFER_SIZE as c_uint, rust_buffer.as_mut_ptr());
+    }
+
+    assert_eq!(buffer, rust_buffer);
+    assert_eq!(buffer, expected_buffer);
+}
@@ -0,0 +1,27 @@
+extern crate libc;
+
+use inline::rust_inline_attrs;
+use self::libc::c_int;
+use self::libc::c_uint;
+
+#[link(name = "test")]
+extern "C" {
+    #[no_mangle]
+    fn inline_attrs(_: c_uint, _: *mut c_int);
+}
+
+const BUFFER_SIZE: usize = 16;
+
+pub fn test_inline_attrs() {
+    let mut buffer = [0; BUFFER_SIZE];
+    let mut rust_buffer = [0; BUFFER_SIZE];
+    let expected_buffer = [-1, 2, 3, 28, 7, 126, 11, 344, 15, 730, 19, 1332, 23, 2198, 27, 3376];
+
+    unsafe {
+        inline_attrs(BUFFER_SIZE as c_uint, buffer.as_mut_ptr());
+        rust_inline_attrs(BUFFER_SIZE as c_uint, rust_buffer.as_mut_ptr());
+    }
+
+    assert_eq!(buffer, rust_buffer);
+    assert_eq!(buffer, expected_buffer);
+}
@@ -0,0 +1,66 @@
+extern crate libc;
+
+use simd::{rust_simd, rust_simd_sse41, rust_simd_not_intrinsics};
+use self::libc::c_int;
+use self::libc::c_uint;
+
+#[link(name = "test")]
+extern "C" {
+    #[no_mangle]
+    fn simd(_: c_uint, _: *mut c_int);
+
+    #[no_mangle]
+    fn simd_sse41(_: c_uint, _: *mut c_int);
+
+    #[no_mangle]
+    fn simd_not_intrinsics(_: c_uint, _: *mut c_int) -> c_int;
+}
+
+const BUFFER_SIZE: usize = 8;
+
+pub fn test_simd() {
+    let mut buffer = [1, 2, 3, 4, 10, 20, 30, 40];
+    let mut rust_buffer = buffer;
+    let expected_buffer = [2, 1, 1, 0, 22, 15, 12, 5];
+
+    unsafe {
+        simd(BUFFER_SIZE as c_uint, buffer.as_mut_ptr());
+        rust_simd(BUFFER_SIZE as c_uint, rust_buffer.as_mut_ptr());
+    }
+
+    assert_eq!(buffer, rust_buffer);
+    assert_eq!(buffer, expected_buffer);
+}
+
+pub fn test_simd_sse41() {
+    if !is_x86_feature_detected!("sse4.1") {
+        return
+    }
+
+    let mut buffer = [1, -2, 3, -4, 10, -20, 30, -40];
+    let mut rust_buffer = buffer;
+    let expected_buffer = [1, 12, 3, 24, 10, 120, 30, 240];
+
+    unsafe {
+        simd_sse41(BUFFER_SIZE as c_uint, buffer.as_mut_ptr());
+        rust_simd_sse41(BUFFER_SIZE as c_uint, rust_buffer.as_mut_ptr());
+    }
+
+    assert_eq!(buffer, rust_buffer);
+    assert_eq!(buffer, expected_buffer);
+}
+
+pub fn test_simd_not_intrinsics() {
+    let mut buffer = [1, 2, 3, 4, 10, 20, 30, 40];
+    let mut rust_buffer = buffer;
+
+    let ret = unsafe {
+        simd_not_intrinsics(BUFFER_SIZE as c_uint, buffer.as_mut_ptr())
+    };
+    let rust_ret = unsafe {
+        rust_simd_not_intrinsics(BUFFER_SIZE as c_uint, rust_buffer.as_mut_ptr())
+    };
+
+    assert_eq!(ret, 110);
+    assert_eq!(rust_ret, 110);
+}
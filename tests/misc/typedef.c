@@ -1,4 +1,4 @@
-
+//! compare_canonical_types
 // Typedefs should "forget" about their qualifiers for the type synonym
 typedef int my_int;                          // 'type my_int = libc::c_int'
 typedef my_int * int_ptr;                    // 'type int_ptr = *mut my_int'